@@ -152,6 +152,9 @@ class OBConversion; //used only as pointer
       //! Electronic transition data (e.g., UV/Vis, excitation energies, etc.)
       ElectronicTransitionData = 29,
 
+      //! Unparsed structure of a molecule whose parsing was deferred (see OBDeferredStructure)
+      DeferredStructureData = 30,
+
       // space for up to 2^14 more entries...
 
       //! Custom (user-defined data)
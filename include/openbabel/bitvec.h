@@ -24,10 +24,12 @@ GNU General Public License for more details.
 
 #include <vector>
 #include <string>
+#include <utility>
 
 #if defined(_MSC_VER) && _MSC_VER <= 1600
   // Assuming 32bit integer
   typedef unsigned uint32_t;
+  typedef unsigned __int64 uint64_t;
 #else
   #include <inttypes.h>
 #endif
@@ -45,11 +47,21 @@ GNU General Public License for more details.
 #define STARTWORDS 10
 #endif // STARTWORDS
 
+// Number of 64-bit words held inside the object itself; large enough
+// for a default-constructed vector, so that it never allocates
+#ifndef INLINEWORDS
+#define INLINEWORDS ((STARTWORDS + 1) / 2)
+#endif // INLINEWORDS
+
 namespace OpenBabel
   {
   /// A speed-optimized vector of bits
-  /** This class implements a fast vector of bits
-      using internally a vector of fixed size unsigned ints (uint32_t).
+  /** This class implements a fast vector of bits.
+      The size of the vector is counted in 32-bit words (as returned by
+      GetSize() and GetWords()), but the bits are stored and processed
+      64 at a time. Vectors of up to INLINEWORDS 64-bit words are stored
+      inside the object, so creating, copying or moving them does not
+      allocate memory.
       Any bits which are out of reach of the current size
       are considered to be zero.
       Streamlined, corrected and documented by kshepherd1@users.sourceforge.net
@@ -60,10 +72,31 @@ namespace OpenBabel
       typedef std::vector<uint32_t> word_vector;
 
 	private:
-	  /// The number of <b>words</b> currently stored ( NOT bit count )
+	  /// The number of 32-bit <b>words</b> currently stored ( NOT bit count )
       size_t _size; //was unsigned
-	  /// A vector of words used to store the bit values
-      word_vector	_set;
+	  /// The number of 64-bit words available at _words
+      size_t _capacity;
+	  /// The 64-bit words holding the bits, either _inline or a heap block.
+	  /** Unused bits (beyond _size 32-bit words) are always zero. */
+      uint64_t *_words;
+	  /// Storage for small vectors
+      uint64_t _inline[INLINEWORDS];
+
+	  /// The number of 64-bit words in use
+      size_t WordCount() const { return (_size + 1) >> 1; }
+	  /// Make room for at least \p words 64-bit words, keeping the current bits
+      void Reserve(size_t words);
+	  /// Return to the inline storage, freeing any heap block
+      void ReleaseWords()
+        {
+          if (_words != _inline)
+            delete [] _words;
+          _words = _inline;
+          _capacity = INLINEWORDS;
+        }
+	  /// The \p i 'th 32-bit word
+      uint32_t Word32(size_t i) const
+        { return static_cast<uint32_t>(_words[i >> 1] >> ((i & 1) << 5)); }
 
     public:
 	  /// Construct a bit vector of the default size
@@ -71,8 +104,8 @@ namespace OpenBabel
 	      cleared to all zero bits.
 	  */
       OBBitVec()
-	  :_set(STARTWORDS, 0)
-        { _size = _set.size(); }
+	  :_size(0), _capacity(INLINEWORDS), _words(_inline)
+        { ResizeWords(STARTWORDS); }
 	  /// Construct a bit vector of maxbits bits
 	  /** Construct a bit vector with a size in bits
 	      of \p size_in_bits rounded up to the nearest word
@@ -80,16 +113,28 @@ namespace OpenBabel
 		  \param[in]	size_in_bits The number of bits for which to reserve space
 	  */
       OBBitVec(unsigned size_in_bits)
-	  :_set(WORDSIZE_OF_BITSIZE(size_in_bits), 0)
-        { _size = _set.size(); }
+	  :_size(0), _capacity(INLINEWORDS), _words(_inline)
+        { Resize(size_in_bits); }
       /// Copy constructor (result has same number of bits)
 	  /** Construct a bit vector which is an exact
 	      duplicate of \p bv.
 		  \param[in]	bv The other bit vector to copy to this
 	  */
       OBBitVec(const OBBitVec & bv)
-	  :_size(0)
+	  :_size(0), _capacity(INLINEWORDS), _words(_inline)
 	  	{ (*this) = bv; }
+#ifndef SWIG
+      /// Move constructor
+	  /** Take over the bits of \p bv, which is left with no words.
+		  \param[in]	bv The other bit vector to move from
+	  */
+      OBBitVec(OBBitVec && bv)
+	  :_size(0), _capacity(INLINEWORDS), _words(_inline)
+	  	{ (*this) = std::move(bv); }
+#endif
+      /// Destructor
+      ~OBBitVec()
+        { ReleaseWords(); }
 	  /// Set the \p bit_offset 'th bit to 1
       void SetBitOn(unsigned bit_offset);
 	  /// Set the \p bit_offset 'th bit to 0
@@ -129,7 +174,7 @@ namespace OpenBabel
 	  	{
 		return ResizeWords( WORDSIZE_OF_BITSIZE(size_in_bits) );
 		}
-      /// Reserve space for \p size_in_words words
+      /// Reserve space for \p size_in_words 32-bit words
 	  /** Reserve space for \p size_in_words words
 	      \param[in] size_in_words the number of words
 	      \return true if enlargement was necessary, false otherwise
@@ -138,8 +183,12 @@ namespace OpenBabel
 	  	{
 		if (size_in_words <= _size)
 		  return false;
-		_set.resize(size_in_words, 0); // increase the vector with zeroed bits
-		_size = _set.size();
+		size_t words = (static_cast<size_t>(size_in_words) + 1) >> 1;
+		if (words > _capacity)
+		  Reserve(words);
+		for (size_t i = WordCount(); i < words; ++i) // increase the vector with zeroed bits
+		  _words[i] = 0;
+		_size = size_in_words;
 		return true;
 		}
       /// Asks if the \p bit_offset 'th bit is set
@@ -149,14 +198,8 @@ namespace OpenBabel
 	  */
       bool BitIsSet(unsigned bit_offset) const
         {
-		  bool rtn = false;
-		  unsigned word_offset = bit_offset >> WORDROLL;
-		  if (word_offset < GetSize())
-		  	{
-			  bit_offset &= WORDMASK;
-			  rtn = (( _set[word_offset] >> bit_offset ) & 1);
-			}
-          return rtn;
+		  size_t word_offset = bit_offset >> 6;
+		  return word_offset < WordCount() && (( _words[word_offset] >> (bit_offset & 63) ) & 1);
         }
       /// Sets the bits listed as bit offsets
 	  void FromVecInt(const std::vector<int> & bit_offsets);
@@ -173,21 +216,31 @@ namespace OpenBabel
 	  */
       void Negate()
         {
-		  for (word_vector::iterator wx = _set.begin(), wy = _set.end(); wx != wy; ++wx)
-		    * wx = ~(* wx);
+		  for (size_t i = 0, n = WordCount(); i < n; ++i)
+		    _words[i] = ~_words[i];
+		  if (_size & 1) // keep the unused half of the last word clear
+		    _words[_size >> 1] &= 0xFFFFFFFFu;
         }
       /// Return a copy of the internal vector of words, at the end of \p vec
 	  /** Copy the internal word vector.
 	      The copy is appended to \p vec.
 		  \param[out] vec a vector of words to which to append the data
 	  */
-      void GetWords(word_vector & vec)
+      void GetWords(word_vector & vec) const
         {
-		vec.insert(vec.end(), _set.begin(),_set.end());
+		vec.reserve(vec.size() + _size);
+		for (size_t i = 0; i < _size; ++i)
+		  vec.push_back(Word32(i));
         }
 
       /// Assignment operator
       OBBitVec & operator= (const OBBitVec & bv);
+#ifndef SWIG
+      /// Move assignment operator
+	  /** Take over the bits of \p bv, which is left with no words.
+	  */
+      OBBitVec & operator= (OBBitVec && bv);
+#endif
       /// And-equals operator
       OBBitVec & operator&= (const OBBitVec & bv);
       /// Or-equals operator
@@ -226,6 +279,8 @@ namespace OpenBabel
       friend OBERROR bool operator== (const OBBitVec & bv1,const OBBitVec & bv2);
       /// Smaller-than operator
       friend OBERROR bool operator< (const OBBitVec & bv1, const OBBitVec & bv2);
+      /// The Tanimoto coefficient
+      friend OBERROR double Tanimoto(const OBBitVec & bv1, const OBBitVec & bv2);
 
       /// Input from a stream
       friend OBERROR std::istream& operator>> ( std::istream & is, OBBitVec & bv );
@@ -22,6 +22,7 @@ GNU General Public License for more details.
 #include <string>
 #include <sstream>
 #include <limits>
+#include <vector>
 
 #include <openbabel/babelconfig.h>
 #include <openbabel/plugin.h>
@@ -38,6 +39,12 @@ class OBAPI OBDescriptor : public OBPlugin
 public:
   const char* TypeID() override { return "descriptors"; }
 
+  /// Optional flags.
+  /// DESCR_THREADSAFE: after the first call, the descriptor can be calculated
+  /// for different objects on several threads at once
+  enum DescrFlag{DESCR_THREADSAFE=1};
+  virtual unsigned int Flags() { return 0; }
+
   /// \return the value of a numeric descriptor
   virtual double Predict(OBBase* /* pOb */, std::string* /* param */ =nullptr)
   {return std::numeric_limits<double>::quiet_NaN();}
@@ -67,6 +74,13 @@ public:
   ///Reads list of descriptor IDs and calls PredictAndSave() for each.
   static void AddProperties(OBBase* pOb, const std::string& DescrList);
 
+  ///Reads list of descriptor IDs once and calls PredictAndSave() for each on every object.
+  ///The objects are shared between up to nthreads threads (0 is one per processor)
+  ///if all the descriptors are flagged DESCR_THREADSAFE.
+  /// \since version 3.2
+  static void AddProperties(std::vector<OBBase*>& objects, const std::string& DescrList,
+                            unsigned nthreads=0);
+
   ///Deletes all the OBPairDatas whose attribute names are in the list (if they exist).
   static void DeleteProperties(OBBase* pOb, const std::string& DescrList);
 
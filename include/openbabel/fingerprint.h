@@ -64,8 +64,21 @@ public:
   /// \return fingerprint in vector, which may be resized, folded to nbits (if nbits!=0)
   virtual bool GetFingerprint(OBBase* pOb, std::vector<unsigned int>& fp, int nbits=0)=0;
 
-  /// Optional flags
-  enum FptFlag{FPT_UNIQUEBITS=1, FPT_NOINFO=2};
+  /// Sparse fingerprint: (feature ID, count) pairs in increasing order of ID
+  typedef std::vector<std::pair<unsigned int, unsigned int> > CountVector;
+
+  /// \return the unfolded features of the object and the number of times each
+  /// occurs, or false if this fingerprint type has no sparse form
+  /// \since version 3.2
+  virtual bool GetCounts(OBBase* /* pOb */, CountVector& /* counts */)
+  {
+    return false;
+  }
+
+  /// Optional flags.
+  /// FPT_THREADSAFE: after the first call, GetFingerprint() and GetCounts()
+  /// can be called for different objects on several threads at once
+  enum FptFlag{FPT_UNIQUEBITS=1, FPT_NOINFO=2, FPT_THREADSAFE=4};
   virtual unsigned int Flags() { return 0;};
   //// \since version 2.3
   virtual void SetFlags(unsigned int){}
@@ -110,6 +123,23 @@ public:
       return((double)andbits/(double)orbits);
   };
 
+  /// \return the Tanimoto coefficient between two sparse fingerprints:
+  /// sum of the smaller counts / (sum of all counts - sum of the smaller counts)
+  /// \since version 3.2
+  static double Tanimoto(const CountVector& fp1, const CountVector& fp2);
+
+  /// \return the Dice coefficient between two sparse fingerprints:
+  /// 2 * sum of the smaller counts / sum of all counts
+  /// \since version 3.2
+  static double Dice(const CountVector& fp1, const CountVector& fp2);
+
+  /// \return the Tversky index of \p fp1 with respect to \p fp2. The counts of
+  /// \p fp1 and \p fp2 not in common are weighted by \p alpha and \p beta;
+  /// alpha=beta=1 gives Tanimoto and alpha=beta=0.5 gives Dice.
+  /// \since version 3.2
+  static double Tversky(const CountVector& fp1, const CountVector& fp2,
+                        double alpha, double beta);
+
   static unsigned int Getbitsperint(){ return bitsperint; }
 
 private:
@@ -137,12 +167,14 @@ private:
 /// \brief Header for fastsearch index file
 struct OBFPRT FptIndexHeader
 {
+  enum IndexFlag { SPARSE=1 };
   unsigned int headerlength;///<offset to data: sizeof(FptIndexHeader)
   unsigned int nEntries;    ///<number of fingerprints
-  unsigned int words;				///<number 32bit words per fingerprint
+  unsigned int words;				///<number 32bit words per fingerprint, or 0 for sparse fingerprints
   char fpid[15];            ///<ID of the fingerprint type
   char seek64; //if true, seek data consists of 64bit long values (only zero in legacy indices)
   char datafilename[256];   ///<the data that this is an index to
+  unsigned int flags;       ///<IndexFlag values; only in the longer header of sparse indices
 };
 
 /// \struct FptIndex fingerprint.h <openbabel/fingerprint.h>
@@ -152,6 +184,15 @@ struct OBFPRT FptIndex
   FptIndexHeader header;
   std::vector<unsigned int> fptdata;
   std::vector<unsigned long> seekdata;
+
+  /// Sparse fingerprints (the SPARSE header flag) are stored instead of fptdata
+  /// as the feature IDs of all the entries in a single sorted run per entry;
+  /// entry i is at sparseoffsets[i] to sparseoffsets[i+1]-1
+  std::vector<unsigned long long> sparseoffsets;
+  std::vector<unsigned int> sparseids;
+  std::vector<unsigned char> sparsecounts; ///<counts, limited to 255
+  bool IsSparse() const { return (header.flags & FptIndexHeader::SPARSE) != 0; }
+
   bool Read(std::istream* pIndexstream);
   bool ReadIndex(std::istream* pIndexstream);
   bool ReadHeader(std::istream* pIndexstream);
@@ -197,6 +238,9 @@ public:
   const FptIndexHeader& GetIndexHeader() const{ return _index.header;};
 
 private:
+  /// Fetches the sparse fingerprint of a target, with the counts limited as in the index
+  bool GetCounts(OBBase* pOb, OBFingerprint::CountVector& counts);
+
   FptIndex   _index;
   OBFingerprint* _pFP;
 };
@@ -208,8 +252,10 @@ class OBFPRT FastSearchIndexer
 //see end of cpp file for detailed documentation
 public:
   ///\brief Constructor with a new index
+  /// If \p sparse is true the unfolded counts from OBFingerprint::GetCounts()
+  /// are indexed and FptBits is ignored.
   FastSearchIndexer(std::string& datafilename, std::ostream* os, std::string& fpid,
-      int FptBits=0, int nmols=0);
+      int FptBits=0, int nmols=0, bool sparse=false);
 
   ///\brief Constructor using existing index
   FastSearchIndexer(FptIndex* pindex, std::ostream* os, int nmols=0);
@@ -219,11 +265,35 @@ public:
   ///\brief Called for each object
   bool Add(OBBase* pOb, std::streampos seekpos);
 
+  ///\brief Called for each object, which the indexer then owns and deletes.
+  /// The fingerprints may be made on other threads (see SetThreads()), but
+  /// the entries are in the order in which the objects were submitted.
+  /// Objects without a fingerprint are left out of the index.
+  /// \since version 3.2
+  void Submit(OBBase* pOb, std::streampos seekpos);
+
+  ///\brief Sets the number of threads used to make the fingerprints of
+  /// submitted objects. The default, 0, is one per processor. Threads are
+  /// used only with fingerprint types flagged FPT_THREADSAFE.
+  /// \since version 3.2
+  void SetThreads(unsigned nthreads) { _nthreads = nthreads; }
+
 private:
+  struct Entry;
+  struct Workers;
+  bool Make(Entry& entry);
+  bool Store(Entry& entry);
+  void Dispatch();
+  void WriteBatches(bool wait_all);
+  void Work();
+
   std::ostream* _indexstream;
   FptIndex*		_pindex;
   OBFingerprint* _pFP;
   int _nbits;
+  bool _sparse;
+  unsigned _nthreads;
+  Workers* _workers; //!< batches of submitted objects and the threads fingerprinting them
 };
 
 } //namespace OpenBabel
@@ -126,6 +126,14 @@ std::cerr << "Not a valid input format"; return false;}
         return 0; //shows not implemented in the format class
       };
 
+    /// @brief Start of the line which ends each object in a multi-object text file
+
+    /// Formats which return a value can be indexed with OBRecordIndex, which
+    /// lets -f go straight to an object. An empty string means that every
+    /// line, other than those starting with #, is an object.
+    /// \return NULL if objects cannot be found in this way (the default)
+    virtual const char* RecordTerminator() { return nullptr; }
+
     /// \return a pointer to a new instance of the format, or NULL if fails.
 
     /// Normally a single global instance is used but this may cause problems
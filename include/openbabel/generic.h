@@ -39,6 +39,7 @@ namespace OpenBabel
   class OBBond;
   class OBMol;
   class OBRing;
+  class OBFormat;
 
   //! \class OBCommentData generic.h <openbabel/generic.h>
   //! \brief Used to store a comment string (can be multiple lines long)
@@ -147,6 +148,29 @@ namespace OpenBabel
   //! Store arbitrary key/value boolean data like OBPairData
   typedef OBPairTemplate<bool>    OBPairBool;
 
+  //! \class OBDeferredStructure generic.h <openbabel/generic.h>
+  //! \brief The record text of a molecule whose structure has not been parsed yet
+  // More detailed description in generic.cpp
+ class OBAPI OBDeferredStructure : public OBGenericData
+  {
+  protected:
+    std::string _record;   //!< The record as read, including its title line
+    OBFormat*   _pFormat;  //!< The format which can parse the record
+    std::map<std::string, std::string> _options; //!< Input options used when parsing
+  public:
+    OBDeferredStructure(const std::string &record, OBFormat* pFormat,
+                        const std::map<std::string, std::string> &options);
+    OBGenericData* Clone(OBBase* /*parent*/) const override
+      {return new OBDeferredStructure(*this);}
+    const std::string &GetRecord() const { return _record; }
+    OBFormat* GetFormat() const          { return _pFormat; }
+
+    //! Parse the deferred structure of \p pmol into it, keeping the molecule's
+    //! present title and properties. The OBDeferredStructure is deleted.
+    //! \return true if \p pmol had no deferred structure or it was parsed.
+    static bool Expand(OBMol* pmol);
+  };
+
   //! \class OBSetData generic.h <openbabel/generic.h>
   //! \brief Used to store arbitrary attribute/set relationships.
   //! Should be used to store a set of OBGenericData based on an attribute.
@@ -558,7 +582,7 @@ namespace OpenBabel
     void SetData(std::vector<std::string> vdat) { _vData = vdat; }
 
     std::vector<unsigned short> GetDimension() { return _vDimension; }
-    std::vector<double>         GetEnergies()  { return _vEnergies; }
+    const std::vector<double> &GetEnergies() const { return _vEnergies; }
     std::vector< std::vector< vector3 > > GetForces() {return _vForces; }
     std::vector< std::vector< vector3 > > GetVelocities()
       {return _vVelocity;}
@@ -65,6 +65,12 @@ public:
 
   double Predict(OBBase* pOb, std::string* param=nullptr) override;
 
+  //! Thread-safe once the datafile has been read
+  unsigned int Flags() override
+  {
+    return (_contribsHeavy.empty() && _contribsHydrogen.empty()) ? 0 : DESCR_THREADSAFE;
+  }
+
  private:
   bool ParseFile();
 
@@ -72,6 +78,8 @@ public:
   const char* _descr;
   std::vector<std::pair<OBSmartsPattern*, double> > _contribsHeavy; //! heavy atom contributions
   std::vector<std::pair<OBSmartsPattern*, double> > _contribsHydrogen; //!  hydrogen contributions
+  std::vector<unsigned> _slotsHeavy; //! shared result slots of the heavy atom patterns
+  std::vector<unsigned> _slotsHydrogen; //! shared result slots of the hydrogen patterns
   bool _debug;
 };
 
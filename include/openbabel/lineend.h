@@ -73,6 +73,16 @@ namespace OpenBabel
     virtual std::streampos   seekoff(std::streamoff off, std::ios_base::seekdir way,
       std::ios_base::openmode which = std::ios_base::in | std::ios_base::out )
     {
+      // A character taken from the source but not yet delivered (after a
+      // peek()) has not been read, so a tellg() must not discard it
+      std::streamoff pending = gptr() < egptr() ? 1 : 0;
+      if (off == 0 && way == std::ios_base::cur)
+      {
+        std::streampos ret = mySource->tellg();
+        return ret == std::streampos(-1) ? ret : ret - pending;
+      }
+      if (way == std::ios_base::cur)
+        off -= pending;
       setg(  &myBuffer , &myBuffer , &myBuffer  ) ; //ensure next character is from new position
       mySource->seekg(off, way);
       std::streampos ret = mySource->tellg();
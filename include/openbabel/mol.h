@@ -41,6 +41,8 @@ GNU General Public License for more details.
 #include <math.h>
 #include <float.h>
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 #include <string>
 #include <map>
@@ -125,6 +127,63 @@ enum HydrogenType { AllHydrogen, PolarHydrogen, NonPolarHydrogen };
   static_assert(std::ranges::range<OBMolBondRange>);
 #endif
 
+  //! \class OBConformerView mol.h <openbabel/mol.h>
+  //! \brief Non-owning view of the conformer coordinate arrays of an OBMol
+  //!
+  //! Each conformer is a flat array of 3*NumAtoms() doubles (x, y, z per atom,
+  //! in atom index order). The view does not copy any coordinates: it is
+  //! invalidated by any call which adds, deletes or reallocates conformers
+  //! (e.g., AddHydrogens, DeleteAtom, SetConformers, Clear).
+  //! If the conformers happen to lie at a constant distance from each other in
+  //! memory (e.g., they were borrowed from one 2D array), Stride() returns that
+  //! distance in doubles and Data() the first array, so that the whole ensemble
+  //! can be handed to a kernel as a single strided block.
+  //! \since version 3.2
+  class OBConformerView
+  {
+    double * const *_confs;
+    unsigned int _nconfs;
+    unsigned int _natoms;
+    std::ptrdiff_t _stride;
+  public:
+    OBConformerView(double * const *confs, unsigned int nconfs, unsigned int natoms)
+      : _confs(confs), _nconfs(nconfs), _natoms(natoms), _stride(0)
+    {
+      if (nconfs == 0)
+        return;
+      if (nconfs == 1) {
+        _stride = 3 * static_cast<std::ptrdiff_t>(natoms);
+        return;
+      }
+      // compare addresses as integers: the arrays need not belong to one object
+      std::ptrdiff_t stride = static_cast<std::ptrdiff_t>(
+        reinterpret_cast<uintptr_t>(confs[1]) - reinterpret_cast<uintptr_t>(confs[0]));
+      if (stride <= 0 || stride % static_cast<std::ptrdiff_t>(sizeof(double)) != 0)
+        return;
+      for (unsigned int i = 2; i < nconfs; ++i)
+        if (static_cast<std::ptrdiff_t>(reinterpret_cast<uintptr_t>(confs[i])
+                                        - reinterpret_cast<uintptr_t>(confs[i-1])) != stride)
+          return;
+      stride /= sizeof(double);
+      if (stride >= 3 * static_cast<std::ptrdiff_t>(natoms))
+        _stride = stride;
+    }
+    //! \return the number of conformers in the view
+    unsigned int NumConformers() const { return _nconfs; }
+    //! \return the number of atoms in each conformer
+    unsigned int NumAtoms() const { return _natoms; }
+    //! \return the coordinate array of conformer @p i
+    double *operator[](unsigned int i) const { return _confs[i]; }
+    //! \return coordinate @p k (0=x, 1=y, 2=z) of atom @p a (0-based) in conformer @p i
+    double &operator()(unsigned int i, unsigned int a, unsigned int k) const
+    { return _confs[i][3 * a + k]; }
+    //! \return the distance in doubles between consecutive conformers,
+    //! or 0 if the conformers are not laid out at a constant stride
+    std::ptrdiff_t Stride() const { return _stride; }
+    //! \return the first conformer if Stride() is non-zero, otherwise nullptr
+    double *Data() const { return _stride ? _confs[0] : nullptr; }
+  };
+
   // class introduction in mol.cpp
  class OBAPI OBMol: public OBBase
   {
@@ -142,6 +201,15 @@ enum HydrogenType { AllHydrogen, PolarHydrogen, NonPolarHydrogen };
     unsigned int                  _totalSpin;   //!< Total spin on the molecule (if not specified, assumes lowest possible spin)
     double                        *_c;	        //!< coordinate array
     std::vector<double*>          _vconf;       //!< vector of conformers
+    std::vector<double*>          _vborrowed;   //!< conformers in _vconf owned by the caller (see BorrowConformer)
+    //! A block of conformers made by AddConformers() or PackConformers()
+    struct ConformerBlock
+    {
+      double *start;
+      size_t size;          //!< number of doubles
+      unsigned int nused;   //!< number of its conformers still in _vconf
+    };
+    std::vector<ConformerBlock>   _vconfblocks; //!< conformer blocks, usually none
     double                        _energy;      //!< heat of formation
     unsigned int                  _natoms;      //!< Number of atoms
     unsigned int                  _nbonds;      //!< Number of bonds
@@ -149,6 +217,10 @@ enum HydrogenType { AllHydrogen, PolarHydrogen, NonPolarHydrogen };
     std::vector<OBInternalCoord*> _internals;   //!< Internal Coordinates (if applicable)
     unsigned short int            _mod;	        //!< Number of nested calls to BeginModify()
 
+    //! Free the conformer array @p c, unless it is borrowed (see BorrowConformer).
+    //! A conformer in a block (see AddConformers) is freed with the last of its block.
+    void FreeConformer(double *c);
+
   public:
 
     //! \name Initialization and data (re)size methods
@@ -173,6 +245,15 @@ enum HydrogenType { AllHydrogen, PolarHydrogen, NonPolarHydrogen };
         _atomIds.reserve(natoms);
       }
     }
+    //! Reserve a minimum number of bonds for internal storage
+    //! This improves performance since the internal bond vector does not grow.
+    void ReserveBonds(int nbonds)
+    {
+      if (nbonds > 0 && _mod) {
+        _vbond.reserve(nbonds);
+        _bondIds.reserve(nbonds);
+      }
+    }
 
     //! Free an OBAtom pointer if defined. Does no bookkeeping
     //! \see DeleteAtom which ensures internal connections
@@ -335,6 +416,8 @@ enum HydrogenType { AllHydrogen, PolarHydrogen, NonPolarHydrogen };
     unsigned short int GetDimension() const { return _dimension; }
     //! \return the set of all atomic coordinates. See OBAtom::GetCoordPtr for more
     double      *GetCoordinates() { return(_c); }
+    //! \return the set of all atomic coordinates (read-only)
+    const double *GetCoordinates() const { return(_c); }
     //! \return the Smallest Set of Smallest Rings has been run (see OBRing class)
     std::vector<OBRing*> &GetSSSR();
     //! \return the Largest Set of Smallest Rings has been run (see OBRing class)
@@ -618,17 +701,51 @@ enum HydrogenType { AllHydrogen, PolarHydrogen, NonPolarHydrogen };
     //! Set the entire set of conformers for this molecule to @p v
     void    SetConformers(std::vector<double*> &v);
     //! Add a new set of coordinates @p f as a new conformer
+    //! The molecule takes ownership of @p f, which must be allocated with new[]
     void    AddConformer(double *f)    {  _vconf.push_back(f);    }
+    //! Add the caller-owned array @p f (3*NumAtoms() doubles) as a new conformer
+    //! without copying it. The molecule reads and writes @p f in place but never
+    //! frees it; @p f must outlive its use as a conformer. Operations which resize
+    //! the coordinate arrays (e.g., AddHydrogens) replace it with an owned copy.
+    //! Operations which replace the whole ensemble (SetConformers,
+    //! OBRotamerList::ExpandConformerList on GetConformers(), the OBForceField
+    //! rotor searches and GetConformers(), PackConformers) drop the borrowed
+    //! array without writing their results into it.
+    //! \return the index of the new conformer
+    //! \since version 3.2
+    int     BorrowConformer(double *f);
+    //! Append @p n zero-initialized conformers, stored contiguously in a
+    //! single block owned by the molecule. Unlike the conformers added by
+    //! AddConformer(), these are not separate new[] arrays, so must not be
+    //! deleted or replaced through GetConformers(); use SetConformers() or
+    //! DeleteConformer() instead.
+    //! \return the coordinates of the first new conformer; conformer k of the
+    //! block starts 3*NumAtoms()*k doubles later
+    //! \since version 3.2
+    double *AddConformers(unsigned int n);
+    //! Move all conformers into a single contiguous block, preserving their
+    //! order and the current conformer, so that GetConformerView() can hand
+    //! out the whole ensemble with a constant stride. Borrowed conformers are
+    //! copied and are no longer written through. As for AddConformers(), the
+    //! conformers must then not be deleted through GetConformers().
+    //! \warning Invalidates any conformer pointers held by the caller
+    //! \since version 3.2
+    void    PackConformers();
+    //! \return whether conformer @p i is a caller-owned array (see BorrowConformer)
+    //! \since version 3.2
+    bool    IsConformerBorrowed(int i) const;
     //! Set the molecule's current conformer to @p i
     //! Does nothing if @p i is larger than NumConformers()
     void    SetConformer(unsigned int i);
     //! Copy the conformer @p nconf into the array @p c
     //! \warning Does no checking to see if @p c is large enough
-    void    CopyConformer(double* c,int nconf);
+    void    CopyConformer(double* c,int nconf) const;
     //! Delete the conformer @p nconf
     void    DeleteConformer(int nconf);
     //! \return the coordinates to conformer @p i
     double  *GetConformer(int i)       {  return(_vconf[i]);      }
+    //! \return the coordinates to conformer @p i (read-only)
+    const double *GetConformer(int i) const {  return(_vconf[i]);  }
     //! Set the entire set of conformer energies
     void    SetEnergies(std::vector<double> &energies);
     //! Set the entire set of conformer energies
@@ -648,6 +765,12 @@ enum HydrogenType { AllHydrogen, PolarHydrogen, NonPolarHydrogen };
       return((i == _vconf.end()) ? nullptr:*i); }
     //! \return the entire set of conformers for this molecule as a vector of floating point arrays
     std::vector<double*> &GetConformers() {   return(_vconf);     }
+    //! \return a zero-copy view of all conformers, valid until the conformers
+    //! are next added, deleted or reallocated. See OBConformerView.
+    //! \since version 3.2
+    OBConformerView GetConformerView() const
+    { return OBConformerView(_vconf.empty() ? nullptr : &_vconf[0],
+                             static_cast<unsigned int>(_vconf.size()), NumAtoms()); }
     //@}
 
     //! \name Iterator methods
@@ -53,6 +53,19 @@ namespace OpenBabel {
 
   OBERROR extern  OBMessageHandler obErrorLog;
 
+  //*************************************************
+  /// @brief Data which a format keeps for one input or output stream of an
+  /// OBConversion between calls, e.g. a partly read block of the input.
+  /// \since version 3.2
+  class OBCONV OBFormatState
+  {
+  public:
+    virtual ~OBFormatState() {}
+    /// Called before the output stream @p os is closed or replaced, or after
+    /// the last object of Convert(), so that anything pending can be written
+    virtual void End(std::ostream& /*os*/) {}
+  };
+
   //*************************************************
   /// @brief Class to convert from one format to another.
   // Class introduction in obconversion.cpp
@@ -142,6 +155,16 @@ namespace OpenBabel {
       ///@brief Extension method: deleted in ~OBConversion()
       OBConversion* GetAuxConv() const {return pAuxConv;};
       void          SetAuxConv(OBConversion* pConv) {pAuxConv=pConv;};
+
+      ///@brief Data kept by the input format for the current input stream.
+      ///Takes ownership; deleted when the input stream is changed.
+      OBFormatState* GetInState() const {return pInState;};
+      void           SetInState(OBFormatState* pState);
+      ///@brief Data kept by the output format for the current output stream.
+      ///Takes ownership; its End() is called and it is deleted when the output
+      ///stream is changed or closed, or after the last object of Convert().
+      OBFormatState* GetOutState() const {return pOutState;};
+      void           SetOutState(OBFormatState* pState);
       //@}
       /** @name Option handling
        Three types of Option provide information and control instructions to the
@@ -351,8 +374,9 @@ protected:
       {
           std::ios *pStream; //active stream
           std::vector<std::ios *> ownedStreams; //streams we own the memory to
+          OBFormatState *pState; //format data for the active stream
 
-          StreamState(): pStream(nullptr) {}
+          StreamState(): pStream(nullptr), pState(nullptr) {}
           ~StreamState()
           {
             assert(ownedStreams.size() == 0); //should be popped
@@ -413,6 +437,8 @@ protected:
       size_t rInlen; ///<length in the input stream of the object being read
 
       OBConversion* pAuxConv;///<Way to extend OBConversion
+      OBFormatState* pInState;  ///<data kept by the input format, see GetInState()
+      OBFormatState* pOutState; ///<data kept by the output format, see GetOutState()
 
       std::vector<std::string> SupportedInputFormat; ///< list of supported input format
       std::vector<std::string> SupportedOutputFormat; ///< list of supported output format
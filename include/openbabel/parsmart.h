@@ -20,6 +20,7 @@ GNU General Public License for more details.
 #ifndef OB_PARSMART_H
 #define OB_PARSMART_H
 
+#include <map>
 #include <string>
 #include <vector>
 
@@ -125,6 +126,7 @@ namespace OpenBabel
     BondSpec *bond;
     int parts;
     bool hasExplicitH;
+    std::string smarts; //!< The SMARTS string of a recursive pattern
   }
   Pattern;
 
@@ -145,6 +147,7 @@ namespace OpenBabel
 
   //! Internal class for extending OBSmartsPattern
   class OBSmartsPrivate;
+  class OBSmartsMatcher;
 
   ///@addtogroup substructure Substructure Searching
   ///@{
@@ -278,6 +281,30 @@ namespace OpenBabel
     //! \return Whether matches occurred
     bool Match(OBMol &mol, std::vector<std::vector<int> > & mlist, MatchType mtype = All) const;
 
+    //! Perform SMARTS matching with a matcher supplied by the caller.
+    //! The matcher keeps the matches of recursive SMARTS, so a set of
+    //! patterns matched in turn against the same molecule, using the same
+    //! matcher, finds those of a recursive SMARTS they share only once.
+    //! A matcher must not be used with more than one molecule.
+    //! \param mol The molecule to use for matching
+    //! \param matcher The matcher holding the recursive SMARTS results
+    //! \param mlist The resulting match list
+    //! \param mtype The match type to use. Default is All.
+    //! \return Whether matches occurred
+    bool Match(OBMol &mol, OBSmartsMatcher &matcher,
+               std::vector<std::vector<int> > & mlist, MatchType mtype = All) const;
+
+    //! Check for a match with the first atom of the pattern at \p atom.
+    //! Only one match is looked for, so this is quicker than finding all the
+    //! matches when just the atoms at which a pattern starts are wanted.
+    //! As with Match(), the matcher must not be used with another molecule.
+    //! \param mol The molecule to use for matching
+    //! \param matcher The matcher holding the recursive SMARTS results
+    //! \param atom The atom of \p mol to match the first atom of the pattern
+    //! \return Whether there is such a match
+    //! \since version 3.2
+    bool HasMatchAt(OBMol &mol, OBSmartsMatcher &matcher, OBAtom *atom) const;
+
     //! \name Matching methods (SMARTS on a specific OBMol)
     //@{
     //! Thread safe check for any SMARTS match
@@ -338,8 +365,10 @@ namespace OpenBabel
   class OBAPI OBSmartsMatcher
   {
   protected:
-	  //recursive smarts cache
-	  std::vector<std::pair<const Pattern*,std::vector<bool> > > RSCACHE;
+	  //recursive smarts cache, keyed by the SMARTS string so that the
+	  //same recursive SMARTS in several patterns is matched only once
+	  std::map<std::string,std::vector<bool> > RSCACHE;
+	  std::map<const Pattern*,const std::vector<bool>*> RSINDEX;
 	  // list of fragment patterns (e.g., (*).(*)
 	  std::vector<const Pattern*> Fragments;
     /*
@@ -352,8 +381,17 @@ namespace OpenBabel
     bool EvalBondExpr(BondExpr *expr,OBBond *bond);
     void SetupAtomMatchTable(std::vector<std::vector<bool> > &ttab,
 	                           const Pattern *pat, OBMol &mol);
+    //! Find a single match, or with \p eachatom one match starting at
+    //! each atom which can be the first atom of a match
     void FastSingleMatch(OBMol &mol,const Pattern *pat,
-                         std::vector<std::vector<int> > &mlist);
+                         std::vector<std::vector<int> > &mlist,
+                         bool eachatom=false);
+    //! Find one match with the first atom of the pattern at \p atom, using
+    //! \p map, \p bv, \p vi and \p vif (sized for the pattern) as working space
+    bool FastMatchFrom(OBMol &mol, const Pattern *pat, OBAtom *atom,
+                       std::vector<int> &map, OBBitVec &bv,
+                       std::vector<std::vector<OBBond*>::iterator> &vi,
+                       std::vector<bool> &vif);
 
     friend class OBSSMatch;
   public:
@@ -361,6 +399,8 @@ namespace OpenBabel
     virtual ~OBSmartsMatcher() {}
 
     bool match(OBMol &mol, const Pattern *pat,std::vector<std::vector<int> > &mlist,bool single=false);
+    //! \return whether there is a match with the first atom of the pattern at \p atom
+    bool matchAt(OBMol &mol, const Pattern *pat, OBAtom *atom);
 
   };
 
@@ -490,6 +490,7 @@ public:
   OB_STATIC_PLUGIN(ViewMolFormat, theViewMolFormat)
   OB_STATIC_PLUGIN(XEDFormat, theXEDFormat)
   OB_STATIC_PLUGIN(XSFFormat, theXSFFormat)
+  OB_STATIC_PLUGIN(XTCFormat, theXTCFormat)
   OB_STATIC_PLUGIN(XYZFormat, theXYZFormat)
   OB_STATIC_PLUGIN(YOBFormat, theYOBFormat)
   OB_STATIC_PLUGIN(ZINDOFormat, theZINDOFormat)
@@ -507,9 +508,6 @@ public:
   OB_STATIC_PLUGIN(GAMESSUKInputFormat, theGAMESSUKInputFormat)
   OB_STATIC_PLUGIN(GAMESSUKOutputFormat, theGAMESSUKOutputFormat)
 #endif
-#ifdef HAVE_RPC_XDR_H
-  OB_STATIC_PLUGIN(XTCFormat, theXTCFormat)
-#endif
 
   // descriptors
   OB_STATIC_PLUGIN(CanSmiles, theCanSmiles)
@@ -0,0 +1,82 @@
+/**********************************************************************
+recordindex.h - Byte offsets of the records in a multi-record text file
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.org/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OB_RECORDINDEX_H
+#define OB_RECORDINDEX_H
+
+#include <openbabel/babelconfig.h>
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#ifndef OBCONV
+#define OBCONV
+#endif
+
+namespace OpenBabel
+{
+  class OBFormat;
+
+  // more detailed descriptions and documentation in recordindex.cpp
+  //! \brief Byte offsets of the records in a multi-record text file
+  class OBCONV OBRecordIndex
+  {
+  public:
+    OBRecordIndex() {}
+
+    /// Scan \p filename for the records of \p pFormat in \p nthreads
+    /// parallel chunks (0 for one per processor, if the file is large enough).
+    /// \return false if the file cannot be read or the format cannot be indexed
+    bool Build(const std::string &filename, OBFormat *pFormat, unsigned nthreads = 0);
+
+    /// Read the index of \p filename, in format \p pFormat, from \p indexfile.
+    /// \return false if there is no index, it is older than the data file
+    /// or it was made for another format or record terminator
+    bool Read(const std::string &indexfile, const std::string &filename, OBFormat *pFormat);
+    /// Write the index to \p indexfile
+    bool Write(const std::string &indexfile) const;
+
+    /// \return the number of records in the file
+    unsigned long NumRecords() const
+    { return _offsets.empty() ? 0 : _offsets.size() - 1; }
+    /// \return the byte offset of record \p n (from 0). Record NumRecords()
+    /// starts at the end of the last record.
+    unsigned long long Offset(unsigned long n) const { return _offsets[n]; }
+
+    /// Split the file into at most \p nparts runs of whole records of similar size
+    /// \return the [first, last) record numbers of each part
+    std::vector<std::pair<unsigned long, unsigned long> > Split(unsigned nparts) const;
+
+    /// \return the name of the sidecar index of \p filename
+    static std::string IndexFilename(const std::string &filename)
+    { return filename + ".obidx"; }
+    /// \return true if records of \p pFormat can be found line by line
+    static bool CanIndex(OBFormat *pFormat);
+
+  private:
+    std::vector<unsigned long long> _offsets; //!< start of each record, then the end of the last one
+    unsigned long long _filesize = 0;         //!< size of the indexed file
+    long long _mtime = 0;                     //!< modification time of the indexed file
+    std::string _format;                      //!< ID of the format the file was indexed as
+    std::string _terminator;                  //!< RecordTerminator() of that format
+  };
+
+} // namespace OpenBabel
+#endif // OB_RECORDINDEX_H
+
+//! \file recordindex.h
+//! \brief Byte offsets of the records in a multi-record text file
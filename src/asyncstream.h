@@ -0,0 +1,468 @@
+/**********************************************************************
+asyncstream.h - Stream buffers which do their I/O on another thread
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.org/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#ifndef OB_ASYNCSTREAM_H
+#define OB_ASYNCSTREAM_H
+
+#include <istream>
+#include <ostream>
+#include <fstream>
+#include <streambuf>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <algorithm>
+
+namespace OpenBabel
+{
+  /** \class ReadAheadStreambuf asyncstream.h
+      \brief A stream buffer which reads its source on another thread
+
+      The source istream is read in chunks by a background thread, which
+      keeps up to a few chunks ahead of the reader. This moves the cost of
+      producing the data (e.g. decompressing it) off the reading thread.
+
+      tellg() is answered without touching the source, as are seeks within
+      the chunk being read (e.g. going back a line). Other seeks stop the
+      background thread, are passed on to the source, and then reading
+      ahead starts again from the new position. While the ReadAheadStreambuf
+      exists, the source must not be used directly. When it is destroyed,
+      a seekable source is left just after the characters which were used.
+  */
+  class ReadAheadStreambuf : public std::streambuf
+  {
+  public:
+    explicit ReadAheadStreambuf(std::istream &source,
+                                size_t chunk_size = 1 << 16, size_t max_chunks = 4)
+      : _source(source), _chunk_size(chunk_size), _max_chunks(max_chunks),
+        _buffer(PUTBACK + chunk_size), _bufpos(source.tellg()),
+        _stop(false), _eof(false)
+    {
+      setg(&_buffer[PUTBACK], &_buffer[PUTBACK], &_buffer[PUTBACK]);
+      Start();
+    }
+
+    virtual ~ReadAheadStreambuf()
+    {
+      Stop();
+      if (!_eof && _bufpos != pos_type(-1)) {
+        _source.clear();
+        _source.seekg(Current());
+      }
+    }
+
+  protected:
+    virtual int_type underflow()
+    {
+      if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+      if (_eof)
+        return traits_type::eof();
+
+      Chunk chunk;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (_chunks.empty())
+          _ready_cv.wait(lock);
+        chunk.swap(_chunks.front());
+        _chunks.pop_front();
+      }
+      _space_cv.notify_one();
+
+      if (chunk.data.empty()) {
+        _eof = true; // the reading thread has finished
+        return traits_type::eof();
+      }
+
+      // keep a few characters before the new ones for putback
+      size_t nputback = std::min<size_t>(gptr() - eback(), PUTBACK);
+      memmove(&_buffer[PUTBACK - nputback], gptr() - nputback, nputback);
+      memcpy(&_buffer[PUTBACK], &chunk.data[0], chunk.data.size());
+      setg(&_buffer[PUTBACK - nputback], &_buffer[PUTBACK], &_buffer[PUTBACK] + chunk.data.size());
+      _bufpos = chunk.pos;
+      return traits_type::to_int_type(*gptr());
+    }
+
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir way,
+                             std::ios_base::openmode which = std::ios_base::in | std::ios_base::out)
+    {
+      pos_type current = Current();
+      if (way == std::ios_base::cur && off == 0) // for tellg()
+        return current;
+      if (current == pos_type(off_type(-1)))
+        return current; // the source cannot seek, so keep reading it
+      if (way == std::ios_base::cur)
+        return seekpos(current + off, which);
+
+      Stop();
+      _source.clear();
+      _source.seekg(off, way);
+      return Restart();
+    }
+
+    virtual pos_type seekpos(pos_type sp,
+                             std::ios_base::openmode which = std::ios_base::in | std::ios_base::out)
+    {
+      if (_bufpos == pos_type(off_type(-1)))
+        return _bufpos; // the source cannot seek, so keep reading it
+      // within the current chunk there is no need to read the source again
+      if (sp >= _bufpos
+          && sp <= _bufpos + off_type(egptr() - &_buffer[PUTBACK])) {
+        setg(eback(), &_buffer[PUTBACK] + off_type(sp - _bufpos), egptr());
+        return sp;
+      }
+      Stop();
+      _source.clear();
+      _source.seekg(sp);
+      return Restart();
+    }
+
+  private:
+    enum { PUTBACK = 4 };
+
+    struct Chunk
+    {
+      std::streampos pos;     // position of the data in the source
+      std::vector<char> data; // empty at the end of the source
+      void swap(Chunk &other) { std::swap(pos, other.pos); data.swap(other.data); }
+    };
+
+    // Background thread: read chunks until the source ends or Stop() is called
+    void Produce()
+    {
+      for (;;) {
+        {
+          std::unique_lock<std::mutex> lock(_mutex);
+          while (_chunks.size() >= _max_chunks && !_stop)
+            _space_cv.wait(lock);
+          if (_stop)
+            return;
+        }
+        Chunk chunk;
+        chunk.pos = _source.tellg();
+        chunk.data.resize(_chunk_size);
+        _source.read(&chunk.data[0], _chunk_size);
+        chunk.data.resize(_source.gcount());
+        bool end = chunk.data.empty();
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+          _chunks.push_back(Chunk());
+          _chunks.back().swap(chunk);
+        }
+        _ready_cv.notify_one();
+        if (end)
+          return;
+      }
+    }
+
+    void Start()
+    {
+      _stop = false;
+      _thread = std::thread(&ReadAheadStreambuf::Produce, this);
+    }
+
+    void Stop()
+    {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+      }
+      _space_cv.notify_one();
+      if (_thread.joinable())
+        _thread.join();
+      _chunks.clear();
+    }
+
+    // Position in the source of the next character to be read, or -1 if
+    // the source has no positions (e.g. a pipe)
+    pos_type Current()
+    {
+      if (_bufpos == pos_type(off_type(-1)))
+        return _bufpos;
+      return _bufpos + off_type(gptr() - &_buffer[PUTBACK]);
+    }
+
+    // Start reading ahead from the current position of the source. If the
+    // seek failed there is nothing to read, so the stream is at its end.
+    pos_type Restart()
+    {
+      _bufpos = _source.tellg();
+      setg(&_buffer[PUTBACK], &_buffer[PUTBACK], &_buffer[PUTBACK]);
+      _eof = _bufpos == pos_type(off_type(-1));
+      if (_eof)
+        return _bufpos;
+      Start();
+      return _bufpos;
+    }
+
+    std::istream &_source;
+    size_t _chunk_size;
+    size_t _max_chunks;
+    std::vector<char> _buffer;  // putback area followed by the current chunk
+    std::streampos _bufpos;     // position of _buffer[PUTBACK] in the source
+
+    // shared with the reading thread
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _ready_cv;
+    std::condition_variable _space_cv;
+    std::deque<Chunk> _chunks;
+    bool _stop;
+    bool _eof;
+  };
+
+  /// An istream reading its source on another thread, see ReadAheadStreambuf
+  class ReadAheadInStream : public std::istream
+  {
+  public:
+    explicit ReadAheadInStream(std::istream &source,
+                               size_t chunk_size = 1 << 16, size_t max_chunks = 4)
+      : std::istream(nullptr), _buf(source, chunk_size, max_chunks)
+    {
+      rdbuf(&_buf);
+    }
+  private:
+    ReadAheadStreambuf _buf;
+  };
+
+  /** \class WriteBehindStreambuf asyncstream.h
+      \brief A stream buffer which writes to its sink on another thread
+
+      Output is collected in chunks, which are written to the sink ostream
+      by a background thread. Up to a few chunks may be waiting, after which
+      the writer waits for the sink. This lets the writing thread go on
+      while the data is written out (e.g. to a network file system).
+
+      flush() waits until everything has been written and then flushes the
+      sink. The destructor does the same, so the sink is complete when the
+      WriteBehindStreambuf has gone. While it exists, the sink must not be
+      used directly. A failure to write to the sink fails the next write or
+      flush.
+  */
+  class WriteBehindStreambuf : public std::streambuf
+  {
+  public:
+    explicit WriteBehindStreambuf(std::ostream &sink,
+                                  size_t chunk_size = 1 << 16, size_t max_chunks = 4)
+      : _sink(sink), _chunk_size(chunk_size), _max_chunks(max_chunks),
+        _buffer(chunk_size), _bufpos(sink.tellp()),
+        _busy(false), _stop(false), _failed(false)
+    {
+      setp(&_buffer[0], &_buffer[0] + _buffer.size());
+      _thread = std::thread(&WriteBehindStreambuf::Consume, this);
+    }
+
+    virtual ~WriteBehindStreambuf()
+    {
+      sync();
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+      }
+      _ready_cv.notify_one();
+      _thread.join();
+    }
+
+    /// The stream being written to
+    std::ostream &Sink() { return _sink; }
+
+  protected:
+    virtual int_type overflow(int_type c)
+    {
+      if (!Submit())
+        return traits_type::eof();
+      if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+      }
+      return traits_type::not_eof(c);
+    }
+
+    virtual int sync()
+    {
+      if (!Submit())
+        return -1;
+      bool failed;
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_chunks.empty() || _busy)
+          _space_cv.wait(lock);
+        failed = _failed;
+      }
+      // the background thread is idle, so the sink can be used here
+      _sink.flush();
+      return (failed || !_sink) ? -1 : 0;
+    }
+
+    virtual pos_type seekoff(off_type off, std::ios_base::seekdir way,
+                             std::ios_base::openmode which = std::ios_base::in | std::ios_base::out)
+    {
+      if (_bufpos == pos_type(-1))
+        return pos_type(off_type(-1));
+      pos_type current = _bufpos + off_type(pptr() - pbase());
+      if (way == std::ios_base::cur && off == 0) // for tellp()
+        return current;
+      if (way == std::ios_base::cur)
+        return seekpos(current + off, which);
+      if (sync() != 0)
+        return pos_type(off_type(-1));
+      _sink.seekp(off, way);
+      _bufpos = _sink.tellp();
+      return _bufpos;
+    }
+
+    virtual pos_type seekpos(pos_type sp,
+                             std::ios_base::openmode which = std::ios_base::in | std::ios_base::out)
+    {
+      if (sync() != 0)
+        return pos_type(off_type(-1));
+      _sink.seekp(sp);
+      _bufpos = _sink.tellp();
+      return _bufpos;
+    }
+
+  private:
+    // Queue the buffered characters for writing and start a new buffer
+    bool Submit()
+    {
+      size_t n = pptr() - pbase();
+      std::vector<char> data;
+      if (n > 0) {
+        data.resize(_chunk_size);
+        data.swap(_buffer);
+        data.resize(n);
+        setp(&_buffer[0], &_buffer[0] + _buffer.size());
+        if (_bufpos != pos_type(-1))
+          _bufpos += off_type(n);
+      }
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (_chunks.size() >= _max_chunks && !_failed)
+          _space_cv.wait(lock);
+        if (_failed)
+          return false;
+        if (data.empty())
+          return true;
+        _chunks.push_back(std::vector<char>());
+        _chunks.back().swap(data);
+      }
+      _ready_cv.notify_one();
+      return true;
+    }
+
+    // Background thread: write chunks until the destructor stops it
+    void Consume()
+    {
+      for (;;) {
+        std::vector<char> data;
+        {
+          std::unique_lock<std::mutex> lock(_mutex);
+          while (_chunks.empty() && !_stop)
+            _ready_cv.wait(lock);
+          if (_chunks.empty())
+            return;
+          data.swap(_chunks.front());
+          _chunks.pop_front();
+          _busy = true;
+        }
+        bool ok = static_cast<bool>(_sink.write(&data[0], data.size()));
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+          _busy = false;
+          if (!ok)
+            _failed = true;
+        }
+        _space_cv.notify_all();
+      }
+    }
+
+    std::ostream &_sink;
+    size_t _chunk_size;
+    size_t _max_chunks;
+    std::vector<char> _buffer;  // the chunk being filled
+    std::streampos _bufpos;     // position of _buffer[0] in the sink
+
+    // shared with the writing thread
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _ready_cv;
+    std::condition_variable _space_cv;
+    std::deque<std::vector<char> > _chunks;
+    bool _busy;   // a chunk is being written
+    bool _stop;
+    bool _failed; // the sink could not be written
+  };
+
+  /// An ostream writing to its sink on another thread, see WriteBehindStreambuf
+  class WriteBehindOutStream : public std::ostream
+  {
+  public:
+    explicit WriteBehindOutStream(std::ostream &sink,
+                                  size_t chunk_size = 1 << 16, size_t max_chunks = 4)
+      : std::ostream(nullptr), _buf(sink, chunk_size, max_chunks)
+    {
+      rdbuf(&_buf);
+    }
+    /// The stream being written to
+    std::ostream &Sink() { return _buf.Sink(); }
+  private:
+    WriteBehindStreambuf _buf;
+  };
+
+  /// \return the stream that \p os writes to: its sink if it is a
+  /// WriteBehindOutStream, otherwise \p os itself. Lets a format or op find
+  /// the file of the output stream of a conversion.
+  inline std::ostream *SinkStream(std::ostream *os)
+  {
+    WriteBehindOutStream *pwb = dynamic_cast<WriteBehindOutStream*>(os);
+    return pwb ? &pwb->Sink() : os;
+  }
+
+  /// Replaces a file output stream by a WriteBehindOutStream while in scope
+  class WriteBehindScope
+  {
+  public:
+    explicit WriteBehindScope(std::ostream *&pOut)
+      : _pOut(pOut), _pSink(pOut), _pStream(nullptr)
+    {
+      if (dynamic_cast<std::ofstream*>(pOut)) {
+        _pStream = new WriteBehindOutStream(*pOut, 1 << 18);
+        _pOut = _pStream;
+      }
+    }
+    ~WriteBehindScope()
+    {
+      if (_pStream) {
+        _pOut = _pSink;
+        if (!_pStream->flush())
+          _pSink->setstate(std::ios::badbit);
+        delete _pStream;
+      }
+    }
+  private:
+    std::ostream *&_pOut;
+    std::ostream *_pSink;
+    WriteBehindOutStream *_pStream;
+  };
+
+} // namespace OpenBabel
+#endif // OB_ASYNCSTREAM_H
+
+//! \file asyncstream.h
+//! \brief Stream buffers which do their I/O on another thread
@@ -21,6 +21,7 @@ GNU General Public License for more details.
 #include <openbabel/bitvec.h>
 #include <openbabel/oberror.h>
 #include <cstdlib>
+#include <algorithm>
 
 namespace OpenBabel
 {
@@ -55,29 +56,34 @@ namespace OpenBabel
     \endcode
   */
 
-  static unsigned int bitsoff[SETWORD] =
-    {
-      0xFFFFFFFF,0xFFFFFFFE,0xFFFFFFFC,0xFFFFFFF8,0xFFFFFFF0,0xFFFFFFE0,0xFFFFFFC0,
-      0xFFFFFF80,0xFFFFFF00,0xFFFFFE00,0xFFFFFC00,0xFFFFF800,0xFFFFF000,0xFFFFE000,
-      0xFFFFC000,0xFFFF8000,0xFFFF0000,0xFFFE0000,0xFFFC0000,0xFFF80000,0xFFF00000,
-      0xFFE00000,0xFFC00000,0xFF800000,0xFF000000,0xFE000000,0xFC000000,0xF8000000,
-      0xF0000000,0xE0000000,0xC0000000,0x80000000
-    };
-
-#ifndef LowBit
-#define LowBit(set, bit)                                        \
-  {int m;                                                       \
-    if (set != 0)                                               \
-      {                                                         \
-        bit = 31;                                               \
-        if (set != 0x80000000) {                                \
-          if ((m = (set & 0x0000ffff))!=0) {set = m; bit -= 16;}   \
-          if ((m = (set & 0x00ff00ff))!=0) {set = m; bit -= 8;}    \
-          if ((m = (set & 0x0f0f0f0f))!=0) {set = m; bit -= 4;}    \
-          if ((m = (set & 0x33333333))!=0) {set = m; bit -= 2;}    \
-          if ((m = (set & 0x55555555))!=0) {set = m; bit -= 1;}}}  \
-    else bit = -1;}
+  //! \return the number of bits set in \p word
+  static inline unsigned PopCount(uint64_t word)
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_popcountll(word));
+#else
+    word = word - ((word >> 1) & 0x5555555555555555ULL);
+    word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<unsigned>((word * 0x0101010101010101ULL) >> 56);
+#endif
+  }
+
+  //! \return the offset of the lowest bit set in the non-zero \p word
+  static inline int LowBit(uint64_t word)
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(word);
+#else
+    return static_cast<int>(PopCount((word & (~word + 1)) - 1));
 #endif
+  }
+
+  //! \return a word with bits \p lo to \p hi (inclusive, 0 <= lo <= hi < 64) set
+  static inline uint64_t RangeMask(unsigned lo, unsigned hi)
+  {
+    return (~static_cast<uint64_t>(0) >> (63 - hi)) & (~static_cast<uint64_t>(0) << lo);
+  }
 
   /** Set the \p bit_offset 'th bit to 1
     Increases the size of this bit vector if necessary
@@ -86,11 +92,10 @@ namespace OpenBabel
   void OBBitVec::SetBitOn(unsigned bit_offset)
   {
     unsigned word_offset = bit_offset >> WORDROLL;
-    bit_offset &= WORDMASK;
 
     if (word_offset >= GetSize())
       ResizeWords(word_offset + 1);
-    _set[word_offset] |= (1<<bit_offset);
+    _words[bit_offset >> 6] |= static_cast<uint64_t>(1) << (bit_offset & 63);
   }
 
   /** Set the \p bit_offset 'th bit to 0
@@ -98,11 +103,10 @@ namespace OpenBabel
   */
   void OBBitVec::SetBitOff(unsigned bit_offset)
   {
-    unsigned word_offset = bit_offset >> WORDROLL;
-    bit_offset &= WORDMASK;
+    unsigned word_offset = bit_offset >> 6;
 
-    if (word_offset < GetSize())
-      _set[word_offset] &= (~(1 << bit_offset));
+    if (word_offset < WordCount())
+      _words[word_offset] &= ~(static_cast<uint64_t>(1) << (bit_offset & 63));
   }
 
   /** Set the range of bits from \p lo_bit_offset to \p hi_bit_offset to 1
@@ -114,32 +118,23 @@ namespace OpenBabel
   {
     if (lo_bit_offset > hi_bit_offset)
       return;
-    else if (lo_bit_offset == hi_bit_offset)
-      SetBitOn(hi_bit_offset);
-    else
-      {
-        unsigned lo_word_offset = lo_bit_offset >> WORDROLL;
-        unsigned hi_word_offset = hi_bit_offset >> WORDROLL;
-        lo_bit_offset &= WORDMASK;
-        hi_bit_offset &= WORDMASK;
 
-        if (hi_word_offset >= GetSize())
-          ResizeWords(hi_word_offset + 1);
+    if ((hi_bit_offset >> WORDROLL) >= GetSize())
+      ResizeWords((hi_bit_offset >> WORDROLL) + 1);
 
-        if (lo_word_offset == hi_word_offset)
-          {
-            for ( unsigned i = lo_bit_offset ; i <= hi_bit_offset ; i++ )
-              _set[lo_word_offset] |= (1<<i);
-          }
-        else
-          {
-            for ( unsigned i = lo_bit_offset ; i < SETWORD ; ++ i )
-              _set[lo_word_offset] |= (1<<i);
-            for ( unsigned i = lo_word_offset + 1 ; i < hi_word_offset ; ++ i )
-              _set[i] = ~0;
-            for ( unsigned i = 0 ; i <= hi_bit_offset ; ++ i )
-              _set[hi_word_offset] |= (1<<i);
-          }
+    unsigned lo_word_offset = lo_bit_offset >> 6;
+    unsigned hi_word_offset = hi_bit_offset >> 6;
+    lo_bit_offset &= 63;
+    hi_bit_offset &= 63;
+
+    if (lo_word_offset == hi_word_offset)
+      _words[lo_word_offset] |= RangeMask(lo_bit_offset, hi_bit_offset);
+    else
+      {
+        _words[lo_word_offset] |= RangeMask(lo_bit_offset, 63);
+        for ( unsigned i = lo_word_offset + 1 ; i < hi_word_offset ; ++ i )
+          _words[i] = ~static_cast<uint64_t>(0);
+        _words[hi_word_offset] |= RangeMask(0, hi_bit_offset);
       }
   }
 
@@ -151,37 +146,28 @@ namespace OpenBabel
   {
     if (lo_bit_offset > hi_bit_offset)
       return;
-    else if (lo_bit_offset == hi_bit_offset)
-      SetBitOff(hi_bit_offset);
-    else
+
+    unsigned lo_word_offset = lo_bit_offset >> 6;
+    unsigned hi_word_offset = hi_bit_offset >> 6;
+    lo_bit_offset &= 63;
+    hi_bit_offset &= 63;
+
+    if (lo_word_offset >= WordCount())
+      return;
+    if (hi_word_offset >= WordCount())
       {
-        unsigned lo_word_offset = lo_bit_offset >> WORDROLL;
-        unsigned hi_word_offset = hi_bit_offset >> WORDROLL;
-        lo_bit_offset &= WORDMASK;
-        hi_bit_offset &= WORDMASK;
-
-        if (lo_word_offset >= GetSize())
-          return;
-        if (hi_word_offset >= GetSize())
-          {
-            hi_word_offset = GetSize() - 1;
-            hi_bit_offset = SETWORD - 1;
-          }
+        hi_word_offset = WordCount() - 1;
+        hi_bit_offset = 63;
+      }
 
-        if (lo_word_offset == hi_word_offset)
-          {
-            for ( unsigned i = lo_bit_offset ; i <= hi_bit_offset ; ++ i )
-              _set[lo_word_offset] &= (~(1<<i));
-          }
-        else
-          {
-            for ( unsigned i = lo_bit_offset ; i < SETWORD ; ++ i )
-              _set[lo_word_offset] &= (~(1<<i));
-            for ( unsigned i = lo_word_offset + 1 ; i < hi_word_offset ; ++ i )
-              _set[i] = 0x00000000;
-            for ( unsigned i = 0 ; i <= hi_bit_offset ; ++ i )
-              _set[hi_word_offset] &= (~(1<<i));
-          }
+    if (lo_word_offset == hi_word_offset)
+      _words[lo_word_offset] &= ~RangeMask(lo_bit_offset, hi_bit_offset);
+    else
+      {
+        _words[lo_word_offset] &= ~RangeMask(lo_bit_offset, 63);
+        for ( unsigned i = lo_word_offset + 1 ; i < hi_word_offset ; ++ i )
+          _words[i] = 0;
+        _words[hi_word_offset] &= ~RangeMask(0, hi_bit_offset);
       }
   }
 
@@ -199,9 +185,10 @@ namespace OpenBabel
         return;
       }
 
-    for (unsigned i = 0, idx = new_word_size; idx < _size; ++idx )
+    // works on 32-bit words, as the size of the vector is counted in those
+    for (size_t i = 0, idx = new_word_size; idx < _size; ++idx )
       {
-        _set[i] |= _set[idx];
+        _words[i >> 1] |= static_cast<uint64_t>(Word32(idx)) << ((i & 1) << 5);
         if (i+1 < new_word_size)
           ++i;
         else
@@ -216,78 +203,33 @@ namespace OpenBabel
   */
   int OBBitVec::NextBit(int last_bit_offset) const
   {
-    unsigned s;
-    int bit;
-    unsigned wrdcnt;
     ++ last_bit_offset;
 
-    wrdcnt = (unsigned)last_bit_offset >> WORDROLL;
+    size_t wrdcnt = (unsigned)last_bit_offset >> 6;
+    size_t nwords = WordCount();
 
-    if (wrdcnt >= GetSize())
+    if (wrdcnt >= nwords)
       return(-1);
 
-    if (_set[wrdcnt] != 0)
+    // mask off the bits before last_bit_offset in the first word
+    uint64_t s = _words[wrdcnt] & (~static_cast<uint64_t>(0) << (last_bit_offset & 63));
+    while (!s)
       {
-        s = _set[wrdcnt] & bitsoff[last_bit_offset & WORDMASK];
-        if (s)
-          {
-            LowBit(s,bit);
-            if (bit != -1)
-              return(bit + (wrdcnt << WORDROLL));
-          }
+        if (++ wrdcnt >= nwords)
+          return(-1);
+        s = _words[wrdcnt];
       }
-    ++ wrdcnt;
 
-    while(wrdcnt < GetSize())
-      {
-        if (_set[wrdcnt] != 0)
-          {
-            s = _set[wrdcnt];
-            LowBit(s, bit);
-
-            if (bit != -1)
-              return(bit + (wrdcnt << WORDROLL));
-          }
-        ++ wrdcnt;
-      }
-
-    return(-1);
+    return(static_cast<int>(wrdcnt << 6) + LowBit(s));
   }
-  // Used by CountBits
-  const unsigned nibble_bit_count[0x10] =
-    {
-      0, // 0000
-      1, // 0001
-      1, // 0010
-      2, // 0011
-      1, // 0100
-      2, // 0101
-      2, // 0110
-      3, // 0111
-      1, // 1000
-      2, // 1001
-      2, // 1010
-      3, // 1011
-      2, // 1100
-      3, // 1101
-      3, // 1110
-      4  // 1111
-    };
   /** Count the number of bits which are set in this vector
       \return the bit count
   */
   unsigned OBBitVec::CountBits() const
   {
     unsigned count = 0;
-    for (word_vector::const_iterator sx = _set.begin(), sy = _set.end(); sx != sy; ++ sx)
-      {
-      uint32_t word = *sx;
-      while (word)
-        {
-        count += nibble_bit_count[word & 0xF];
-        word >>= 4;
-        }
-      }
+    for (size_t i = 0, n = WordCount(); i < n; ++i)
+      count += PopCount(_words[i]);
     return count;
   }
 
@@ -296,8 +238,8 @@ namespace OpenBabel
   */
   bool OBBitVec::IsEmpty() const
   {
-    for (word_vector::const_iterator sx = _set.begin(), sy = _set.end(); sx != sy; ++ sx)
-      if (* sx)
+    for (size_t i = 0, n = WordCount(); i < n; ++i)
+      if (_words[i])
         return(false);
 
     return(true);
@@ -380,8 +322,25 @@ namespace OpenBabel
   */
   void OBBitVec::Clear()
   {
-    for (word_vector::iterator wx = _set.begin(), wy = _set.end(); wx != wy; ++wx)
-      * wx = 0;
+    for (size_t i = 0, n = WordCount(); i < n; ++i)
+      _words[i] = 0;
+  }
+
+  /** Make room for at least \p words 64-bit words, moving the current
+      bits to a larger heap block if necessary
+      \param[in] words The number of 64-bit words needed
+  */
+  void OBBitVec::Reserve(size_t words)
+  {
+    if (words <= _capacity)
+      return;
+
+    size_t capacity = (words < 2 * _capacity) ? 2 * _capacity : words;
+    uint64_t *block = new uint64_t [capacity];
+    std::copy(_words, _words + WordCount(), block);
+    ReleaseWords();
+    _words = block;
+    _capacity = capacity;
   }
 
   /** Assign this vector to be a copy of \p bv
@@ -390,8 +349,41 @@ namespace OpenBabel
   */
   OBBitVec & OBBitVec::operator= (const OBBitVec & bv)
   {
-    _set = bv._set;
-    _size = _set.size();
+    if (this == &bv)
+      return(*this);
+
+    size_t n = bv.WordCount();
+    if (n > _capacity)
+      {
+        _size = 0; // no need to keep the current bits
+        Reserve(n);
+      }
+    std::copy(bv._words, bv._words + n, _words);
+    _size = bv._size;
+    return(*this);
+  }
+
+  /** Move the bits of \p bv into this vector, leaving \p bv with no words
+      \param[in] bv A bit vector
+      \return A reference to this
+  */
+  OBBitVec & OBBitVec::operator= (OBBitVec && bv)
+  {
+    if (this == &bv)
+      return(*this);
+
+    if (bv._words != bv._inline)
+      { // take over the heap block
+        ReleaseWords();
+        _words = bv._words;
+        _capacity = bv._capacity;
+        bv._words = bv._inline;
+        bv._capacity = INLINEWORDS;
+        _size = bv._size;
+      }
+    else
+      *this = static_cast<const OBBitVec &>(bv);
+    bv._size = 0;
     return(*this);
   }
 
@@ -401,13 +393,14 @@ namespace OpenBabel
   */
   OBBitVec & OBBitVec::operator&= (const OBBitVec & bv)
   {
-    unsigned min = (bv.GetSize() < _size) ? bv.GetSize() : _size;
-    unsigned i;
+    size_t n = WordCount();
+    size_t min = (bv.WordCount() < n) ? bv.WordCount() : n;
+    size_t i;
 
     for (i = 0;i < min;++i)
-      _set[i] &= bv._set[i];
-    for (;i < _size;++i)
-      _set[i] = 0;
+      _words[i] &= bv._words[i];
+    for (;i < n;++i)
+      _words[i] = 0;
 
     return(*this);
   }
@@ -421,8 +414,8 @@ namespace OpenBabel
     if (_size < bv.GetSize())
       ResizeWords(bv.GetSize());
 
-    for (unsigned i = 0;i < bv.GetSize(); ++i)
-      _set[i] |= bv._set[i];
+    for (size_t i = 0, n = bv.WordCount(); i < n; ++i)
+      _words[i] |= bv._words[i];
 
     return(*this);
   }
@@ -436,8 +429,8 @@ namespace OpenBabel
     if (_size < bv.GetSize())
       ResizeWords(bv.GetSize());
 
-    for (unsigned i = 0;i < bv.GetSize(); ++i)
-      _set[i] ^= bv._set[i];
+    for (size_t i = 0, n = bv.WordCount(); i < n; ++i)
+      _words[i] ^= bv._words[i];
 
     return(*this);
   }
@@ -451,9 +444,9 @@ namespace OpenBabel
     if (_size < bv.GetSize())
       ResizeWords(bv.GetSize());
 
-    OBBitVec tmp(*this);
-    tmp ^= bv;
-    *this &= tmp;
+    for (size_t i = 0, n = bv.WordCount(); i < n; ++i)
+      _words[i] &= ~bv._words[i];
+
     return(*this);
   }
 
@@ -463,7 +456,11 @@ namespace OpenBabel
   */
   OBBitVec & OBBitVec::operator+= (const OBBitVec & bv)
   {
-    _set.insert(_set.end(), bv._set.begin(), bv._set.end());
+    size_t offset = _size;
+    size_t n = bv._size; // bv may be this vector
+    ResizeWords(static_cast<unsigned>(_size + n));
+    for (size_t i = 0; i < n; ++i)
+      _words[(offset + i) >> 1] |= static_cast<uint64_t>(bv.Word32(i)) << (((offset + i) & 1) << 5);
     return(*this);
   }
 
@@ -510,9 +507,8 @@ namespace OpenBabel
   */
   OBBitVec operator- (const OBBitVec & bv1, const OBBitVec & bv2)
   {
-    OBBitVec bv;
-    bv = bv1 ^ bv2;
-    bv &= bv1;
+    OBBitVec bv(bv1);
+    bv -= bv2;
     return(bv);
   }
 
@@ -524,26 +520,15 @@ namespace OpenBabel
   */
   bool operator== (const OBBitVec & bv1, const OBBitVec & bv2)
   {
-    if (bv1.GetSize() < bv2.GetSize())
-      { // bv1 smaller than bv2
-      unsigned i;
-      for (i = 0; i < bv1.GetSize(); ++ i)
-        if (bv1._set[i] != bv2._set[i])
-          return false;
-      for (; i < bv2.GetSize(); ++ i)
-        if (bv2._set[i] != 0)
-          return false;
-      }
-    else
-      { // bv2 smaller or equal than bv1
-      unsigned i;
-      for (i = 0; i < bv2.GetSize(); ++ i)
-        if (bv1._set[i] != bv2._set[i])
-          return false;
-      for (; i < bv1.GetSize(); ++ i)
-        if (bv1._set[i] != 0)
-          return false;
-      }
+    const OBBitVec &small = (bv1.WordCount() < bv2.WordCount()) ? bv1 : bv2;
+    const OBBitVec &large = (bv1.WordCount() < bv2.WordCount()) ? bv2 : bv1;
+    size_t i;
+    for (i = 0; i < small.WordCount(); ++ i)
+      if (small._words[i] != large._words[i])
+        return false;
+    for (; i < large.WordCount(); ++ i)
+      if (large._words[i] != 0)
+        return false;
     return true;
   }
 
@@ -555,29 +540,15 @@ namespace OpenBabel
   */
   bool operator< (const OBBitVec & bv1, const OBBitVec & bv2)
   {
-    bool rtn = false;
-    int next_bit_1 = bv1.NextBit(-1);
-    int next_bit_2 = bv2.NextBit(-1);
-    bool should_continue = true;
-    while (should_continue)
+    size_t n1 = bv1.WordCount(), n2 = bv2.WordCount();
+    for (size_t i = 0, n = (n1 > n2) ? n1 : n2; i < n; ++i)
       {
-      should_continue = false;
-      if (next_bit_1 == -1)
-        rtn = (next_bit_2 == -1 ? false : true);
-      else if (next_bit_2 == -1)
-        rtn = false;
-      else if (next_bit_2 < next_bit_1)
-        rtn = true;
-      else if (next_bit_1 < next_bit_2)
-        rtn = false;
-      else
-        {
-        next_bit_1 = bv1.NextBit(next_bit_1);
-        next_bit_2 = bv2.NextBit(next_bit_2);
-        should_continue = true;
-        }
+        uint64_t w1 = (i < n1) ? bv1._words[i] : 0;
+        uint64_t w2 = (i < n2) ? bv2._words[i] : 0;
+        if (w1 != w2) // the lowest differing bit decides
+          return ((w2 >> LowBit(w1 ^ w2)) & 1) != 0;
       }
-    return rtn;
+    return false;
   }
 
   /** Sets bits on, listed as a string of character-represented integers in a stream
@@ -641,12 +612,10 @@ namespace OpenBabel
   */
   std::ostream & operator<< ( std::ostream & os, const OBBitVec & bv)
   {
-    os << "[ " << std::flush;
+    os << "[ ";
 
-    for (unsigned i = 0;i < bv._size;++i)
-      for (unsigned j = 0;j < SETWORD;++j)
-        if (bv._set[i]>>(j%SETWORD)&1)
-          os << (j+(i*SETWORD)) << ' ' << std::flush;
+    for (int bit = bv.NextBit(-1); bit != -1; bit = bv.NextBit(bit))
+      os << bit << ' ';
 
     os << "]" << std::flush;
     return(os);
@@ -659,15 +628,20 @@ namespace OpenBabel
   */
   double Tanimoto(const OBBitVec & bv1, const OBBitVec & bv2)
   {
-    OBBitVec bvtmp;
-    double andbits,orbits;
-
-    bvtmp = bv1 & bv2;
-    andbits = (double)bvtmp.CountBits();
-    bvtmp = bv1 | bv2;
-    orbits  = (double)bvtmp.CountBits();
+    unsigned andbits = 0, orbits = 0;
+    size_t n1 = bv1.WordCount(), n2 = bv2.WordCount();
+    size_t i;
+    for (i = 0; i < n1 && i < n2; ++i)
+      {
+        andbits += PopCount(bv1._words[i] & bv2._words[i]);
+        orbits += PopCount(bv1._words[i] | bv2._words[i]);
+      }
+    for (; i < n1; ++i)
+      orbits += PopCount(bv1._words[i]);
+    for (; i < n2; ++i)
+      orbits += PopCount(bv2._words[i]);
 
-    return(andbits/orbits);
+    return((double)andbits/(double)orbits);
   }
 
 } // end namespace OpenBabel
@@ -42,6 +42,8 @@ GNU General Public License for more details.
 #define DEBUG 0
 
 #define MAX_IDENTITY_NODES 50
+#define MAX_AUTOMORPHISMS 100
+#define MAX_ORBIT_SIZE 1000
 
 using namespace std;
 
@@ -402,10 +404,23 @@ namespace OpenBabel {
    * number of states to consider in various ways.
    *
    * @subsubsection canonical_opt5 Optimization 4
+   * Each automorphism discovered this way is stored as a permutation of the
+   * atoms (only permutations preserving the symmetry classes are kept). The
+   * stored automorphisms are shared by all start atoms of a fragment and are
+   * used to prune the search tree in the style of nauty's orbit pruning:
    *
+   * - A start atom is skipped if it is in the same orbit as a start atom
+   *   that has already been labeled. The subtree starting from this atom
+   *   is an image of the subtree that was already searched.
+   * - When permuting the neighbors of the current atom, a permutation is
+   *   skipped if an automorphism fixing all labeled atoms maps a previously
+   *   searched permutation onto it. Only the automorphisms fixing the labeled
+   *   atoms (i.e. elements of the pointwise stabilizer) are used.
    *
-   *
-   *
+   * The skipped subtrees only contain canonical candidate codes that have
+   * already been considered. This optimization does <b>not</b> affect the
+   * final result but makes highly symmetric structures (e.g. fullerenes and
+   * cages) tractable.
    *
      @verbatim
      [1] Brendan D. McKay, Backtrack programming and isomorphism rejection on
@@ -421,6 +436,12 @@ namespace OpenBabel {
   {
     typedef std::vector<OBAtom*> Orbit;
     typedef std::vector<Orbit> Orbits;
+    /**
+     * An automorphism stored as a permutation of the atom indexes (i.e.
+     * OBAtom::GetIndex()). Atoms not in the fragment are mapped on themselves.
+     */
+    typedef std::vector<unsigned int> Automorphism;
+    typedef std::vector<Automorphism> Automorphisms;
 
     static void print_orbits(const Orbits &orbits)
     {
@@ -695,10 +716,11 @@ namespace OpenBabel {
       State(const std::vector<unsigned int> &_symmetry_classes,
             const OBBitVec &_fragment, std::vector<StereoCenter> &_stereoCenters,
             std::vector<FullCode> &_identityCodes, Orbits &_orbits, OBBitVec &_mcr,
-            bool _onlyOne) : symmetry_classes(_symmetry_classes), fragment(_fragment),
-          onlyOne(_onlyOne), stereoCenters(_stereoCenters),
+            Automorphisms &_automorphisms, bool _onlyOne) : symmetry_classes(_symmetry_classes),
+          fragment(_fragment), onlyOne(_onlyOne), stereoCenters(_stereoCenters),
           code(_symmetry_classes.size()), identityCodes(_identityCodes),
-          backtrackDepth(0), orbits(_orbits), mcr(_mcr)
+          backtrackDepth(0), skipStartAtom(false), orbits(_orbits), mcr(_mcr),
+          automorphisms(_automorphisms)
       {
         mcr.Clear();
         if (mcr.IsEmpty())
@@ -728,8 +750,18 @@ namespace OpenBabel {
        */
       std::vector<FullCode> identityCodes;
       unsigned int backtrackDepth;
+      /**
+       * Set when the subtree for the start atom is equivalent to the subtree
+       * of a previous start atom (see Optimization 4).
+       */
+      bool skipStartAtom;
       Orbits orbits;
       OBBitVec &mcr;
+      /**
+       * The automorphisms found so far. These are shared between all start
+       * atoms of the fragment (see Optimization 4).
+       */
+      Automorphisms &automorphisms;
     };
 
     /**
@@ -925,7 +957,8 @@ namespace OpenBabel {
             std::vector<CanonicalLabelsImpl::FullCode> identityCodes;
             Orbits orbits;
             OBBitVec mcr;
-            State lstate(state.symmetry_classes, ligand, state.stereoCenters, identityCodes, orbits, mcr, state.onlyOne);
+            Automorphisms automorphisms;
+            State lstate(state.symmetry_classes, ligand, state.stereoCenters, identityCodes, orbits, mcr, automorphisms, state.onlyOne);
             lstate.code.add(nbrs[i]);
             lstate.code.labels[nbrs[i]->GetIndex()] = 1;
             CanonicalLabelsRecursive(nbrs[i], 1, timeout, lbestCode, lstate);
@@ -1154,6 +1187,161 @@ namespace OpenBabel {
     }
 
 
+    /**
+     * Store the automorphism mapping the atoms labeled by @p labels1 on the
+     * atoms with the same label in @p labels2. Both labelings must result in
+     * the same canonical candidate code. Automorphisms not preserving the
+     * symmetry classes are ignored since the search tree is not invariant
+     * under these permutations.
+     */
+    static void StoreAutomorphism(State &state, const std::vector<unsigned int> &labels1,
+        const std::vector<unsigned int> &labels2)
+    {
+      if (state.automorphisms.size() >= MAX_AUTOMORPHISMS)
+        return;
+
+      std::size_t numAtoms = labels1.size();
+      if (labels2.size() != numAtoms)
+        return;
+
+      // The atom index for each label in labels2.
+      std::vector<unsigned int> labelToIndex(numAtoms + 1, numAtoms);
+      for (std::size_t i = 0; i < numAtoms; ++i)
+        if (labels2[i])
+          labelToIndex[labels2[i]] = i;
+
+      Automorphism p(numAtoms);
+      bool identity = true;
+      for (std::size_t i = 0; i < numAtoms; ++i) {
+        if (!labels1[i]) {
+          if (labels2[i])
+            return;
+          p[i] = i;
+          continue;
+        }
+        unsigned int j = labelToIndex[labels1[i]];
+        if (j == numAtoms)
+          return;
+        if (state.symmetry_classes[i] != state.symmetry_classes[j])
+          return;
+        p[i] = j;
+        if (i != j)
+          identity = false;
+      }
+
+      if (identity)
+        return;
+      if (std::find(state.automorphisms.begin(), state.automorphisms.end(), p) != state.automorphisms.end())
+        return;
+
+      state.automorphisms.push_back(p);
+    }
+
+    /**
+     * Return the number of atoms that are labeled identically by @p labels1
+     * and @p labels2 before the labelings diverge. This is the depth of the
+     * common ancestor of both leafs in the search tree.
+     */
+    static unsigned int CommonAncestorDepth(const std::vector<unsigned int> &labels1,
+        const std::vector<unsigned int> &labels2)
+    {
+      std::vector<unsigned int> v1(labels1.size(), 0);
+      for (std::size_t j = 0; j < labels1.size(); ++j)
+        if (labels1[j])
+          v1[labels1[j]-1] = j + 1;
+
+      std::vector<unsigned int> v2(labels2.size(), 0);
+      for (std::size_t j = 0; j < labels2.size(); ++j)
+        if (labels2[j])
+          v2[labels2[j]-1] = j + 1;
+
+      unsigned int depth = 0;
+      for (std::size_t j = 0; j < v1.size(); ++j) {
+        if (v1[j] != v2[j] || !v1[j])
+          break;
+        depth++;
+      }
+
+      return depth;
+    }
+
+    /**
+     * Check if an atom with index in @p processed is in the same orbit as the
+     * atom with @p index. The orbit is computed from all found automorphisms.
+     */
+    static bool IsInProcessedOrbit(const Automorphisms &automorphisms, unsigned int index,
+        const std::vector<unsigned int> &processed)
+    {
+      if (automorphisms.empty() || processed.empty())
+        return false;
+
+      std::vector<bool> visited(automorphisms[0].size(), false);
+      std::vector<unsigned int> orbit(1, index);
+      visited[index] = true;
+      for (std::size_t i = 0; i < orbit.size(); ++i) {
+        if (std::find(processed.begin(), processed.end(), orbit[i]) != processed.end())
+          return true;
+        for (std::size_t j = 0; j < automorphisms.size(); ++j) {
+          unsigned int image = automorphisms[j][orbit[i]];
+          if (!visited[image]) {
+            visited[image] = true;
+            orbit.push_back(image);
+          }
+        }
+      }
+
+      return false;
+    }
+
+    /**
+     * Check if an automorphism fixing all labeled atoms maps one of the
+     * @p explored neighbor orderings on @p ordering. The subtree for
+     * @p ordering is then an image of an already searched subtree. Only the
+     * group generated by the stored automorphisms that fix the labeled atoms
+     * is considered (see Optimization 4).
+     */
+    static bool IsEquivalentOrdering(const State &state, const std::vector<unsigned int> &ordering,
+        const std::vector<std::vector<unsigned int> > &explored)
+    {
+      if (explored.empty() || state.automorphisms.empty())
+        return false;
+
+      // Select the automorphisms in the pointwise stabilizer of the labeled atoms.
+      std::vector<const Automorphism*> stabilizer;
+      for (std::size_t i = 0; i < state.automorphisms.size(); ++i) {
+        const Automorphism &p = state.automorphisms[i];
+        bool fixed = true;
+        for (std::size_t j = 0; j < state.code.atoms.size(); ++j) {
+          unsigned int index = state.code.atoms[j]->GetIndex();
+          if (p[index] != index) {
+            fixed = false;
+            break;
+          }
+        }
+        if (fixed)
+          stabilizer.push_back(&p);
+      }
+
+      if (stabilizer.empty())
+        return false;
+
+      // Enumerate the orbit of the ordering.
+      std::vector<std::vector<unsigned int> > orbit(1, ordering);
+      for (std::size_t i = 0; i < orbit.size() && orbit.size() < MAX_ORBIT_SIZE; ++i) {
+        for (std::size_t j = 0; j < stabilizer.size(); ++j) {
+          std::vector<unsigned int> image(orbit[i].size());
+          for (std::size_t k = 0; k < image.size(); ++k)
+            image[k] = (*stabilizer[j])[orbit[i][k]];
+          if (std::find(explored.begin(), explored.end(), image) != explored.end())
+            return true;
+          if (std::find(orbit.begin(), orbit.end(), image) == orbit.end())
+            orbit.push_back(image);
+        }
+      }
+
+      return false;
+    }
+
     /**
      * This is the recursive function implementing the labeling algorithm
      * outlined above (steps 1-3). This function works for single connected
@@ -1167,6 +1355,9 @@ namespace OpenBabel {
       OBMol *mol = current->GetParent();
       PartialCode &code = state.code;
 
+      if (state.skipStartAtom)
+        return;
+
       if (state.backtrackDepth) {
         //std::cout << "backtrackDepth = " << state.backtrackDepth << std::endl;
 
@@ -1210,6 +1401,8 @@ namespace OpenBabel {
               if (state.identityCodes[i-1].labels[j])
                 v2[state.identityCodes[i-1].labels[j]-1] = j + 1;
 
+            StoreAutomorphism(state, fullcode.labels, state.identityCodes[i-1].labels);
+
             state.backtrackDepth = 0;
             for (std::size_t j = 0; j < v1.size(); ++j) {
               if (v1[j] != v2[j]) {
@@ -1223,8 +1416,18 @@ namespace OpenBabel {
           }
 
         if (fullcode.code == bestCode.code) {
+          StoreAutomorphism(state, fullcode.labels, bestCode.labels);
           UpdateMcr(state.mcr, state.orbits, bestCode.labels);
           FindOrbits(state.orbits, mol, fullcode.labels, bestCode.labels);
+
+          // The subtree where the paths to both leafs diverge is equivalent
+          // to the already searched subtree containing bestCode. Backtrack to
+          // the common ancestor or skip the start atom if there is none.
+          unsigned int depth = CommonAncestorDepth(fullcode.labels, bestCode.labels);
+          if (depth)
+            state.backtrackDepth = depth;
+          else
+            state.skipStartAtom = true;
         } else if (fullcode > bestCode) {
           // if fullcode is greater than bestCode, we have found a new greatest code
           bestCode = fullcode;
@@ -1387,7 +1590,16 @@ namespace OpenBabel {
           }
         }
 
+        std::vector<std::vector<unsigned int> > exploredOrderings;
         for (std::size_t i = 0; i < allOrderedNbrs.size(); ++i) {
+          // Skip orderings equivalent to an already searched ordering.
+          std::vector<unsigned int> ordering;
+          for (std::size_t j = 0; j < allOrderedNbrs[i].size(); ++j)
+            ordering.push_back(allOrderedNbrs[i][j]->GetIndex());
+          if (IsEquivalentOrdering(state, ordering, exploredOrderings))
+            continue;
+          exploredOrderings.push_back(ordering);
+
           // Convert the order stored in allOrderedNbrs to labels.
           unsigned int lbl = label;
           for (std::size_t j = 0; j < allOrderedNbrs[i].size(); ++j) {
@@ -1575,12 +1787,19 @@ namespace OpenBabel {
         std::vector<CanonicalLabelsImpl::FullCode> identityCodes;
         Orbits orbits;
         OBBitVec mcr;
+        Automorphisms automorphisms;
+        std::vector<unsigned int> processedStartAtoms;
 
         for (std::size_t i = 0; i < startAtoms.size(); ++i) {
           OBAtom *atom = startAtoms[i];
 
+          // Skip start atoms equivalent to an already labeled start atom.
+          if (IsInProcessedOrbit(automorphisms, atom->GetIndex(), processedStartAtoms))
+            continue;
+          processedStartAtoms.push_back(atom->GetIndex());
+
           // Start labeling of the fragment.
-          State state(symmetry_classes, fragment, stereoCenters, identityCodes, orbits, mcr, onlyOne);
+          State state(symmetry_classes, fragment, stereoCenters, identityCodes, orbits, mcr, automorphisms, onlyOne);
           //if (!state.mcr.BitIsSet(atom->GetIdx()) && atom->IsInRing())
           //  continue;
 
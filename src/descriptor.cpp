@@ -22,6 +22,9 @@ GNU General Public License for more details.
 #include <openbabel/base.h>
 #include <openbabel/descriptor.h>
 
+#include <atomic>
+#include <thread>
+
 using namespace std;
 namespace OpenBabel
 {
@@ -413,20 +416,76 @@ bool OBDescriptor::CompareStringWithFilter(istream& optionText, string& sval, bo
   }
 }
 
-void OBDescriptor::AddProperties(OBBase* pOb, const string& DescrList)
+typedef vector<pair<OBDescriptor*, string> > DescriptorList;
+
+//Looks up each descriptor ID in the list, with its parameter
+static void FindDescriptors(const string& DescrList, DescriptorList& descrs)
 {
   stringstream ss(DescrList);
   OBDescriptor* pDescr;
   while(ss)
   {
-    pair<string,string> spair = GetIdentifier(ss);
+    pair<string,string> spair = OBDescriptor::GetIdentifier(ss);
     if( (pDescr = OBDescriptor::FindType(spair.first.c_str())) ) // extra parentheses to indicate assignment as truth value
-      pDescr->PredictAndSave(pOb, &spair.second);
+      descrs.push_back(make_pair(pDescr, spair.second));
     else
-      obErrorLog.ThrowError(__FUNCTION__, spair.first + " not recognized as a descriptor", obError, onceOnly);
+      obErrorLog.ThrowError("AddProperties", spair.first + " not recognized as a descriptor", obError, onceOnly);
   }
 }
 
+static void PredictAndSaveAll(OBBase* pOb, const DescriptorList& descrs)
+{
+  for(DescriptorList::const_iterator itr=descrs.begin();itr!=descrs.end();++itr)
+  {
+    string param(itr->second); // may be altered by the descriptor
+    itr->first->PredictAndSave(pOb, &param);
+  }
+}
+
+//Takes the next object until there are none left
+static void PredictAndSaveNext(vector<OBBase*>& objects, const DescriptorList& descrs, atomic<size_t>& next)
+{
+  for(size_t i = next++; i < objects.size(); i = next++)
+    PredictAndSaveAll(objects[i], descrs);
+}
+
+void OBDescriptor::AddProperties(OBBase* pOb, const string& DescrList)
+{
+  DescriptorList descrs;
+  FindDescriptors(DescrList, descrs);
+  PredictAndSaveAll(pOb, descrs);
+}
+
+void OBDescriptor::AddProperties(vector<OBBase*>& objects, const string& DescrList, unsigned nthreads)
+{
+  DescriptorList descrs;
+  FindDescriptors(DescrList, descrs);
+  if(objects.empty() || descrs.empty())
+    return;
+
+  // The first object is done on this thread, so that descriptors can read
+  // their data files before any others start
+  PredictAndSaveAll(objects[0], descrs);
+
+  bool threadsafe = true;
+  for(DescriptorList::iterator itr=descrs.begin();itr!=descrs.end();++itr)
+    if(!(itr->first->Flags() & DESCR_THREADSAFE))
+      threadsafe = false;
+  if(nthreads == 0)
+    nthreads = thread::hardware_concurrency();
+  if(!threadsafe)
+    nthreads = 1;
+  nthreads = static_cast<unsigned>(max<size_t>(1, min<size_t>(nthreads, objects.size() - 1)));
+
+  atomic<size_t> next(1);
+  vector<thread> threads;
+  for(unsigned i = 1; i < nthreads; ++i)
+    threads.push_back(thread(PredictAndSaveNext, ref(objects), cref(descrs), ref(next)));
+  PredictAndSaveNext(objects, descrs, next); // on this thread
+  for(size_t i = 0; i < threads.size(); ++i)
+    threads[i].join();
+}
+
 void OBDescriptor::DeleteProperties(OBBase* pOb, const string& DescrList)
 {
   vector<string> vs;
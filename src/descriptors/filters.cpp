@@ -38,6 +38,7 @@ public:
       return 0;
     return pmol->GetMolWt();
   }
+  unsigned int Flags() override { return DESCR_THREADSAFE; }
 };
 // Make a global instance
 MWFilter theMWFilter("MW");
@@ -52,6 +53,7 @@ public:
       return 0;
     return pmol->NumRotors();
   }
+  unsigned int Flags() override { return DESCR_THREADSAFE; }
 };
 // Make a global instance
 RotatableBondsFilter theRBFilter("rotors");
@@ -113,6 +115,7 @@ public:
   double GetStringValue(OBBase *pOb, std::string &svalue,
                         std::string *param = nullptr) override;
   virtual bool LessThan(OBBase *pOb1, OBBase *pOb2);
+  unsigned int Flags() override { return DESCR_THREADSAFE; }
 };
 
 bool TitleFilter::Compare(OBBase *pOb, istream &optionText, bool noEval,
@@ -165,6 +168,7 @@ public:
     GetStringValue(pOb, svalue);
     return CompareStringWithFilter(optionText, svalue, noEval);
   }
+  unsigned int Flags() override { return DESCR_THREADSAFE; }
 };
 
 FormulaDescriptor TheFormulaDescriptor("formula");
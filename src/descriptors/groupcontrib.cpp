@@ -23,10 +23,13 @@ GNU General Public License for more details.
 
 #include <openbabel/babelconfig.h>
 #include <vector>
+#include <map>
 #include <utility>
 #include <cstdlib>
 #include <openbabel/mol.h>
 #include <openbabel/atom.h>
+#include <openbabel/bond.h>
+#include <openbabel/obiter.h>
 #include <openbabel/oberror.h>
 #include <openbabel/parsmart.h>
 #include <openbabel/bitvec.h>
@@ -39,6 +42,107 @@ using namespace std;
 namespace OpenBabel
 {
 
+  // Each SMARTS string used by any group contribution descriptor has a slot
+  // for its results, so a pattern in several data files (e.g. logp.txt and
+  // mr.txt) is matched only once for each molecule
+  static map<string, unsigned> smartsSlots;
+  // The element of the first atom of the pattern in each slot, or 0 if not fixed
+  static vector<int> slotElements;
+
+  static unsigned SmartsSlot(OBSmartsPattern *sp)
+  {
+    pair<map<string, unsigned>::iterator, bool> ins =
+      smartsSlots.insert(make_pair(sp->GetSMARTS(), static_cast<unsigned>(slotElements.size())));
+    if (ins.second)
+      slotElements.push_back(sp->GetAtomicNum(0));
+    return ins.first->second;
+  }
+
+  // The working copy of the last molecule, with hydrogens added and dative
+  // bonds converted, shared by all the group contribution descriptors.
+  struct GroupContribState
+  {
+    vector<int> signature;   // of the molecule the copy was made from
+    OBMol mol;
+    OBSmartsMatcher matcher; // shares recursive SMARTS between patterns
+    // For each SMARTS slot and atom: 0 not yet tried, 1 no match, 2 a match
+    // starting at the atom
+    vector<vector<char> > tried;
+  };
+  static THREAD_LOCAL GroupContribState prepared;
+
+  //! Lists what the contributions depend on, to notice when a molecule
+  //! differs from the one the working copy was made from
+  static void GetSignature(OBMol &mol, vector<int> &signature)
+  {
+    bool aromatic = mol.HasAromaticPerceived();
+    signature.clear();
+    signature.push_back(mol.NumAtoms());
+    signature.push_back(mol.NumBonds());
+    signature.push_back(aromatic);
+    signature.push_back(mol.HasHydrogensAdded());
+    FOR_ATOMS_OF_MOL(atom, mol) {
+      signature.push_back(atom->GetAtomicNum());
+      signature.push_back(atom->GetFormalCharge());
+      signature.push_back(atom->GetIsotope());
+      signature.push_back(atom->GetImplicitHCount());
+      if (aromatic)
+        signature.push_back(atom->IsAromatic());
+    }
+    FOR_BONDS_OF_MOL(bond, mol) {
+      signature.push_back(bond->GetBeginAtomIdx());
+      signature.push_back(bond->GetEndAtomIdx());
+      signature.push_back(bond->GetBondOrder());
+      if (aromatic)
+        signature.push_back(bond->IsAromatic());
+    }
+  }
+
+  //! Gives each heavy atom the contribution of the last pattern in the list
+  //! which matches starting at that atom, by trying the patterns from the end.
+  //! Hydrogen contributions are multiplied by the number of hydrogens.
+  static void AssignContributions(vector<pair<OBSmartsPattern*, double> > &contribs,
+                                  vector<unsigned> &slots, bool hydrogen,
+                                  vector<double> &values, OBBitVec &seen,
+                                  bool debug, stringstream &debugMessage)
+  {
+    OBMol &mol = prepared.mol;
+    if (prepared.tried.size() < slotElements.size())
+      prepared.tried.resize(slotElements.size());
+
+    FOR_ATOMS_OF_MOL(atom, mol) {
+      if (atom->GetAtomicNum() == OBElements::Hydrogen)
+        continue;
+      unsigned int idx = atom->GetIdx();
+      for (unsigned int i = contribs.size(); i-- > 0;) {
+        int element = slotElements[slots[i]];
+        if (element != 0 && element != atom->GetAtomicNum())
+          continue;
+        vector<char> &tried = prepared.tried[slots[i]];
+        if (tried.empty())
+          tried.resize(mol.NumAtoms() + 1, 0);
+        if (tried[idx] == 0)
+          tried[idx] = contribs[i].first->HasMatchAt(mol, prepared.matcher, &*atom) ? 2 : 1;
+        if (tried[idx] == 1)
+          continue;
+
+        if (hydrogen) {
+          int Hcount = atom->GetExplicitDegree() - atom->GetHvyDegree();
+          values[idx - 1] = contribs[i].second * Hcount;
+          if (debug)
+            debugMessage << idx << " = " << contribs[i].first->GetSMARTS() << " : " << contribs[i].second << " Hcount " << Hcount << endl;
+        }
+        else {
+          values[idx - 1] = contribs[i].second;
+          if (debug)
+            debugMessage << idx << " = " << contribs[i].first->GetSMARTS() << " : " << contribs[i].second << endl;
+        }
+        seen.SetBitOn(idx);
+        break;
+      }
+    }
+  }
+
   OBGroupContrib::~OBGroupContrib()
   {
     vector<pair<OBSmartsPattern*, double> >::iterator i;
@@ -101,10 +205,14 @@ namespace OpenBabel
       sp = new OBSmartsPattern;
       if (sp->Init(vs[0]))
       {
-        if (heavy)
+        if (heavy) {
           _contribsHeavy.push_back(pair<OBSmartsPattern*, double> (sp, atof(vs[1].c_str())));
-        else
+          _slotsHeavy.push_back(SmartsSlot(sp));
+        }
+        else {
           _contribsHydrogen.push_back(pair<OBSmartsPattern*, double> (sp, atof(vs[1].c_str())));
+          _slotsHydrogen.push_back(SmartsSlot(sp));
+        }
       }
       else
       {
@@ -131,59 +239,39 @@ namespace OpenBabel
     if(!pmol)
       return 0.0;
 
-    //Need to add hydrogens, so do this to a copy to leave original unchanged
-    OBMol mol(*pmol);
-    mol.AddHydrogens(false, false);
-
     //Read in data, unless it has already been done.
     if(_contribsHeavy.empty() && _contribsHydrogen.empty())
       ParseFile();
 
-    vector<vector<int> > _mlist; // match list for atom typing
-    vector<vector<int> >::iterator j;
-    vector<pair<OBSmartsPattern*, double> >::iterator i;
+    //Need to add hydrogens, so do this to a copy to leave original unchanged.
+    //The copy is kept for the other descriptors, until another molecule,
+    //or this one after it has been changed, is used.
+    vector<int> signature;
+    GetSignature(*pmol, signature);
+    if (signature != prepared.signature) {
+      prepared.signature.swap(signature);
+      prepared.mol = *pmol;
+      prepared.mol.AddHydrogens(false, false);
+      prepared.mol.ConvertDativeBonds();
+      prepared.matcher = OBSmartsMatcher();
+      for (unsigned int i = 0; i < prepared.tried.size(); ++i)
+        prepared.tried[i].clear();
+    }
+    OBMol &tmpmol = prepared.mol;
 
     stringstream debugMessage;
-    OBBitVec seenHeavy(mol.NumAtoms() + 1);
-    OBBitVec seenHydrogen(mol.NumAtoms() + 1);
-    vector<double> atomValues(mol.NumAtoms(), 0.0);
-
-    OBMol tmpmol;
-    tmpmol = mol;
-    tmpmol.ConvertDativeBonds();
+    OBBitVec seenHeavy(tmpmol.NumAtoms() + 1);
+    OBBitVec seenHydrogen(tmpmol.NumAtoms() + 1);
+    vector<double> atomValues(tmpmol.NumAtoms(), 0.0);
+    vector<double> hydrogenValues(tmpmol.NumAtoms(), 0.0);
 
     // atom contributions
     if (_debug) debugMessage << "Heavy atom contributions:" << endl;
-    for (i = _contribsHeavy.begin();i != _contribsHeavy.end();++i) {
-      if (i->first->Match(tmpmol)) {
-        _mlist = i->first->GetMapList();
-        for (j = _mlist.begin();j != _mlist.end();++j) {
-          atomValues[(*j)[0] - 1] = i->second;
-          seenHeavy.SetBitOn((*j)[0]);
-	        if (_debug)
-            debugMessage << (*j)[0] << " = " << i->first->GetSMARTS() << " : " << i->second << endl;
-        }
-      }
-    }
-
-    vector<double> hydrogenValues(tmpmol.NumAtoms(), 0.0);
+    AssignContributions(_contribsHeavy, _slotsHeavy, false, atomValues, seenHeavy, _debug, debugMessage);
 
     // Hydrogen contributions - note that matches to hydrogens themselves are ignored
     if (_debug) debugMessage << "  Hydrogen contributions:" << endl;
-    for (i = _contribsHydrogen.begin();i != _contribsHydrogen.end();++i) {
-      if (i->first->Match(tmpmol)) {
-        _mlist = i->first->GetMapList();
-        for (j = _mlist.begin();j != _mlist.end();++j) {
-          if (tmpmol.GetAtom((*j)[0])->GetAtomicNum() == OBElements::Hydrogen)
-            continue;
-          int Hcount = tmpmol.GetAtom((*j)[0])->GetExplicitDegree() - tmpmol.GetAtom((*j)[0])->GetHvyDegree();
-          hydrogenValues[(*j)[0] - 1] = i->second * Hcount;
-          seenHydrogen.SetBitOn((*j)[0]);
-          if (_debug)
-            debugMessage << (*j)[0] << " = " << i->first->GetSMARTS() << " : " << i->second << " Hcount " << Hcount << endl;
-        }
-      }
-    }
+    AssignContributions(_contribsHydrogen, _slotsHydrogen, true, hydrogenValues, seenHydrogen, _debug, debugMessage);
 
     // total atomic and hydrogen contribution
     double total = 0.0;
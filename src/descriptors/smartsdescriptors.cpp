@@ -58,6 +58,8 @@ namespace OpenBabel
         return 0.0;
     }
 
+    unsigned int Flags() override { return DESCR_THREADSAFE; }
+
     SmartsDescriptor* MakeInstance(const std::vector<std::string>& textlines) override
     {
       return new SmartsDescriptor(textlines[1].c_str(),textlines[2].c_str(),textlines[3].c_str());
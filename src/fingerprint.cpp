@@ -19,11 +19,16 @@ GNU General Public License for more details.
 #include <openbabel/babelconfig.h>
 
 #include <vector>
+#include <deque>
 #include <algorithm>
 #include <iosfwd>
 #include <cstring>
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
+#include <openbabel/base.h>
 #include <openbabel/fingerprint.h>
 #include <openbabel/oberror.h>
 
@@ -37,6 +42,10 @@ namespace OpenBabel
 
   const unsigned int OBFingerprint::bitsperint = 8 * sizeof(unsigned int);
 
+  //headerlength of dense indices, which is also that of legacy ones
+  static const unsigned int LegacyHeaderLength = 3*sizeof(unsigned)
+    + sizeof(FptIndexHeader::fpid) + sizeof(FptIndexHeader::datafilename);
+
   void OBFingerprint::SetBit(vector<unsigned int>& vec, const unsigned int n)
   {
     vec[n/Getbitsperint()] |= (1 << (n % Getbitsperint()));
@@ -130,6 +139,127 @@ namespace OpenBabel
     return((double)andbits/(double)orbits);
   }
 
+  ////////////////////////////////////////
+  // Sum of the counts of each sparse fingerprint and of the smaller count
+  // of each feature they have in common, found by merging the sorted IDs
+  static double CommonCounts(const OBFingerprint::CountVector& fp1,
+                             const OBFingerprint::CountVector& fp2,
+                             double& sum1, double& sum2)
+  {
+    unsigned long common=0, n1=0, n2=0;
+    OBFingerprint::CountVector::const_iterator p1=fp1.begin(), p2=fp2.begin();
+    while(p1!=fp1.end() && p2!=fp2.end())
+      {
+        if(p1->first < p2->first)
+          n1 += (p1++)->second;
+        else if(p2->first < p1->first)
+          n2 += (p2++)->second;
+        else
+          {
+            n1 += p1->second;
+            n2 += p2->second;
+            common += min(p1->second, p2->second);
+            ++p1;
+            ++p2;
+          }
+      }
+    for(;p1!=fp1.end();++p1)
+      n1 += p1->second;
+    for(;p2!=fp2.end();++p2)
+      n2 += p2->second;
+    sum1 = n1;
+    sum2 = n2;
+    return common;
+  }
+
+  double OBFingerprint::Tanimoto(const CountVector& fp1, const CountVector& fp2)
+  {
+    double sum1, sum2;
+    double common = CommonCounts(fp1, fp2, sum1, sum2);
+    if(sum1 + sum2 == 0)
+      return 0.0;
+    return common / (sum1 + sum2 - common);
+  }
+
+  double OBFingerprint::Dice(const CountVector& fp1, const CountVector& fp2)
+  {
+    double sum1, sum2;
+    double common = CommonCounts(fp1, fp2, sum1, sum2);
+    if(sum1 + sum2 == 0)
+      return 0.0;
+    return 2 * common / (sum1 + sum2);
+  }
+
+  double OBFingerprint::Tversky(const CountVector& fp1, const CountVector& fp2,
+                                double alpha, double beta)
+  {
+    double sum1, sum2;
+    double common = CommonCounts(fp1, fp2, sum1, sum2);
+    double denom = common + alpha * (sum1 - common) + beta * (sum2 - common);
+    if(denom == 0)
+      return 0.0;
+    return common / denom;
+  }
+
+  //*****************************************************************
+  // Sum of the counts of entry i of a sparse index
+  static unsigned int SparseSum(const FptIndex& index, unsigned int i)
+  {
+    unsigned int sum=0;
+    for(unsigned long long k=index.sparseoffsets[i];k<index.sparseoffsets[i+1];++k)
+      sum += index.sparsecounts[k];
+    return sum;
+  }
+
+  // Sum of the smaller counts of the features common to a target and to
+  // entry i of a sparse index
+  static unsigned int SparseCommon(const OBFingerprint::CountVector& target,
+                                   const FptIndex& index, unsigned int i)
+  {
+    const unsigned int* id = index.sparseids.data() + index.sparseoffsets[i];
+    const unsigned int* idend = index.sparseids.data() + index.sparseoffsets[i+1];
+    const unsigned char* n = index.sparsecounts.data() + index.sparseoffsets[i];
+    OBFingerprint::CountVector::const_iterator t=target.begin();
+    unsigned int common=0;
+    for(;id<idend && t!=target.end();++id,++n)
+      {
+        while(t!=target.end() && t->first < *id)
+          ++t;
+        if(t!=target.end() && t->first == *id)
+          common += min<unsigned int>(t->second, *n);
+      }
+    return common;
+  }
+
+  // Tanimoto coefficient of a target with entry i of a sparse index, or -1
+  // without merging the IDs if it cannot be greater than \p threshold
+  static double SparseTanimoto(const OBFingerprint::CountVector& target, unsigned int tsum,
+                               const FptIndex& index, unsigned int i, double threshold)
+  {
+    unsigned int esum = SparseSum(index, i);
+    if(tsum + esum == 0)
+      return 0.0;
+    //The common counts are at most the smaller of the two sums
+    if((double)min(tsum, esum) / max(tsum, esum) <= threshold)
+      return -1.0;
+    double common = SparseCommon(target, index, i);
+    return common / (tsum + esum - common);
+  }
+
+  bool FastSearch::GetCounts(OBBase* pOb, OBFingerprint::CountVector& counts)
+  {
+    if(!_pFP->GetCounts(pOb, counts))
+      {
+        obErrorLog.ThrowError(__FUNCTION__,
+          "The fingerprint type of the index has no sparse form", obError);
+        return false;
+      }
+    OBFingerprint::CountVector::iterator itr;
+    for(itr=counts.begin();itr!=counts.end();++itr)
+      itr->second = min(itr->second, 255u);
+    return true;
+  }
+
   //*****************************************************************
   bool FastSearch::Find(OBBase* pOb, vector<unsigned long>& SeekPositions,
                         unsigned int MaxCandidates)
@@ -141,6 +271,32 @@ namespace OpenBabel
     ///here because the values in the index file are used.
     ///The positions of the candidate matching molecules in the original datafile are returned.
 
+    if(_index.IsSparse())
+      {
+        //Every feature of the pattern has to be present at least as many times
+        OBFingerprint::CountVector target;
+        if(!GetCounts(pOb, target))
+          return false;
+        unsigned int tsum=0, found=0, i;
+        for(i=0;i<target.size();++i)
+          tsum += target[i].second;
+        for(i=0;i<_index.header.nEntries && found<MaxCandidates;++i)
+          {
+            if(SparseCommon(target, _index, i)==tsum)
+              {
+                SeekPositions.push_back(_index.seekdata[i]);
+                ++found;
+              }
+          }
+        if(i<_index.header.nEntries)
+          {
+            stringstream errorMsg;
+            errorMsg << "Stopped looking after " << i << " molecules." << endl;
+            obErrorLog.ThrowError(__FUNCTION__, errorMsg.str(), obWarning);
+          }
+        return true;
+      }
+
     vector<unsigned int> vecwords;
     _pFP->GetFingerprint(pOb,vecwords, _index.header.words * OBFingerprint::Getbitsperint());
 
@@ -199,6 +355,32 @@ namespace OpenBabel
                             unsigned int MaxCandidates)
 {
 //Similar to FastSearch::Find() except that successful candidates have all bits the same as the target
+  if(_index.IsSparse())
+  {
+    //The same features, each the same number of times
+    OBFingerprint::CountVector target;
+    if(!GetCounts(pOb, target))
+      return false;
+    unsigned int found=0;
+    for(unsigned int i=0;i<_index.header.nEntries && found<MaxCandidates;++i)
+    {
+      unsigned long long start = _index.sparseoffsets[i];
+      if(_index.sparseoffsets[i+1] - start != target.size())
+        continue;
+      unsigned int j;
+      for(j=0;j<target.size();++j)
+        if(_index.sparseids[start+j]!=target[j].first
+           || _index.sparsecounts[start+j]!=target[j].second)
+          break;
+      if(j==target.size())
+      {
+        SeekPositions.push_back(_index.seekdata[i]);
+        ++found;
+      }
+    }
+    return true;
+  }
+
   vector<unsigned int> vecwords;
   _pFP->GetFingerprint(pOb,vecwords, _index.header.words * OBFingerprint::Getbitsperint());
 
@@ -239,6 +421,23 @@ namespace OpenBabel
   bool FastSearch::FindSimilar(OBBase* pOb, multimap<double, unsigned long>& SeekposMap,
                                double MinTani, double MaxTani)
   {
+    if(_index.IsSparse())
+      {
+        OBFingerprint::CountVector target;
+        if(!GetCounts(pOb, target))
+          return false;
+        unsigned int tsum=0, i;
+        for(i=0;i<target.size();++i)
+          tsum += target[i].second;
+        for(i=0;i<_index.header.nEntries;++i)
+          {
+            double tani = SparseTanimoto(target, tsum, _index, i, MinTani);
+            if(tani>MinTani && tani < MaxTani)
+              SeekposMap.insert(pair<const double, unsigned long>(tani,_index.seekdata[i]));
+          }
+        return true;
+      }
+
     vector<unsigned int> targetfp;
     _pFP->GetFingerprint(pOb,targetfp, _index.header.words * OBFingerprint::Getbitsperint());
 
@@ -274,6 +473,26 @@ namespace OpenBabel
     else if(SeekposMap.size()==0)
       return false;
 
+    if(_index.IsSparse())
+      {
+        OBFingerprint::CountVector target;
+        if(!GetCounts(pOb, target))
+          return false;
+        unsigned int tsum=0, i;
+        for(i=0;i<target.size();++i)
+          tsum += target[i].second;
+        for(i=0;i<_index.header.nEntries;++i)
+          {
+            double tani = SparseTanimoto(target, tsum, _index, i, SeekposMap.begin()->first);
+            if(tani>SeekposMap.begin()->first)
+              {
+                SeekposMap.insert(pair<const double, unsigned long>(tani,_index.seekdata[i]));
+                SeekposMap.erase(SeekposMap.begin());
+              }
+          }
+        return true;
+      }
+
     vector<unsigned int> targetfp;
     _pFP->GetFingerprint(pOb,targetfp, _index.header.words * OBFingerprint::Getbitsperint());
 
@@ -334,11 +553,27 @@ namespace OpenBabel
         return false;
       }
 
-    unsigned long nwords = header.nEntries * header.words;
-    fptdata.resize(nwords);
     seekdata.resize(header.nEntries);
-
-    pIndexstream->read((char*)&(fptdata[0]), sizeof(unsigned int) * nwords);
+    if(IsSparse())
+      {
+        sparseoffsets.resize(header.nEntries + 1);
+        pIndexstream->read((char*)sparseoffsets.data(), sizeof(unsigned long long) * sparseoffsets.size());
+        if(pIndexstream->fail())
+          {
+            *(header.datafilename) = '\0';
+            return false;
+          }
+        sparseids.resize(sparseoffsets.back());
+        sparsecounts.resize(sparseoffsets.back());
+        pIndexstream->read((char*)sparseids.data(), sizeof(unsigned int) * sparseids.size());
+        pIndexstream->read((char*)sparsecounts.data(), sparsecounts.size());
+      }
+    else
+      {
+        unsigned long nwords = header.nEntries * header.words;
+        fptdata.resize(nwords);
+        pIndexstream->read((char*)&(fptdata[0]), sizeof(unsigned int) * nwords);
+      }
     if(header.seek64) 
       {
     	pIndexstream->read((char*)&(seekdata[0]), sizeof(unsigned long) * header.nEntries);
@@ -367,6 +602,10 @@ namespace OpenBabel
     pIndexstream->read( (char*)&header.fpid,         sizeof(header.fpid) );
     pIndexstream->read( (char*)&header.seek64,       sizeof(header.seek64) );
     pIndexstream->read( (char*)&header.datafilename, sizeof(header.datafilename) );
+    //Only sparse indices have the flags; the legacy headerlength leaves out seek64
+    header.flags = 0;
+    if(header.headerlength >= LegacyHeaderLength + sizeof(header.seek64) + sizeof(header.flags))
+      pIndexstream->read( (char*)&header.flags,      sizeof(header.flags) );
     return !pIndexstream->fail();
  }
 
@@ -385,16 +624,53 @@ namespace OpenBabel
     return pFP; //NULL if not available
   }
 
+  //*******************************************************
+  /// An object to be indexed and its fingerprint
+  struct FastSearchIndexer::Entry
+  {
+    OBBase* pOb;
+    streampos seekpos;
+    bool ok;
+    vector<unsigned int> words;
+    OBFingerprint::CountVector counts;
+  };
+
+  /// Submitted objects are fingerprinted in batches. The first batch is done
+  /// on the submitting thread and the rest by worker threads. The batches are
+  /// stored in the index in the order they were submitted.
+  struct FastSearchIndexer::Workers
+  {
+    struct Batch
+    {
+      vector<Entry> entries;
+      bool done;
+    };
+    static const size_t batchsize = 64;
+
+    Batch* current;       //being filled by Submit()
+    deque<Batch*> pending; //not yet stored, in submission order
+    deque<Batch*> queue;   //not yet taken by a worker
+    vector<thread> threads;
+    mutex mtx;
+    condition_variable work_cv, done_cv;
+    bool started, stop;
+
+    Workers() : current(nullptr), started(false), stop(false) {}
+  };
+
   //*******************************************************
   FastSearchIndexer::FastSearchIndexer(string& datafilename, ostream* os,
-                                       std::string& fpid, int FptBits, int nmols)
+                                       std::string& fpid, int FptBits, int nmols, bool sparse)
   {
     ///Starts indexing process
     _indexstream = os;
     _nbits=FptBits;
+    _sparse=sparse;
+    _nthreads=0;
+    _workers=nullptr;
     _pindex= new FptIndex;
-    _pindex->header.headerlength = 3*sizeof(unsigned)+sizeof(_pindex->header.fpid)
-                                    +sizeof(_pindex->header.datafilename);
+    _pindex->header.headerlength = LegacyHeaderLength;
+    _pindex->header.flags = 0;
     strncpy(_pindex->header.fpid,fpid.c_str(),15);
     _pindex->header.fpid[14]='\0'; //ensure fpid is terminated at 14 characters.
     _pindex->header.seek64 = 1;
@@ -403,6 +679,15 @@ namespace OpenBabel
     //just a hint to reserve size of vectors; definitive value set in destructor
     _pindex->header.nEntries = nmols;
 
+    if(_sparse)
+      {
+        //Readers without the flags see no fingerprint words
+        _pindex->header.words = 0;
+        _pindex->header.headerlength += sizeof(_pindex->header.seek64) + sizeof(_pindex->header.flags);
+        _pindex->header.flags = FptIndexHeader::SPARSE;
+        _pindex->sparseoffsets.push_back(0);
+      }
+
     //check that fingerprint type is available
     _pFP = _pindex->CheckFP();
     if(fpid.empty()) // add id of default FP
@@ -419,6 +704,9 @@ namespace OpenBabel
     _indexstream = os;
     _pindex = pindex;
     _nbits  = _pindex->header.words * OBFingerprint::Getbitsperint();
+    _sparse = _pindex->IsSparse();
+    _nthreads = 0;
+    _workers = nullptr;
 
     //just a hint to reserve size of vectors; definitive value set in destructor
     _pindex->header.nEntries = nmols;
@@ -430,6 +718,21 @@ namespace OpenBabel
   /////////////////////////////////////////////////////////////
   FastSearchIndexer::~FastSearchIndexer()
   {
+    if(_workers)
+      {
+        //Store the remaining submitted objects, then stop the workers
+        Dispatch();
+        WriteBatches(true);
+        {
+          lock_guard<mutex> lock(_workers->mtx);
+          _workers->stop = true;
+        }
+        _workers->work_cv.notify_all();
+        for(size_t i=0;i<_workers->threads.size();++i)
+          _workers->threads[i].join();
+        delete _workers;
+      }
+
     ///Saves index file
     FptIndexHeader& hdr = _pindex->header;
     hdr.nEntries = _pindex->seekdata.size();
@@ -441,8 +744,15 @@ namespace OpenBabel
     _indexstream->write( (const char*)&hdr.fpid,         sizeof(hdr.fpid) );
     _indexstream->write( (const char*)&hdr.seek64,         sizeof(hdr.seek64) );
     _indexstream->write( (const char*)&hdr.datafilename, sizeof(hdr.datafilename) );
-
-    _indexstream->write((const char*)&_pindex->fptdata[0], _pindex->fptdata.size()*sizeof(unsigned int));
+    if(_sparse)
+      {
+        _indexstream->write((const char*)&hdr.flags, sizeof(hdr.flags));
+        _indexstream->write((const char*)_pindex->sparseoffsets.data(), _pindex->sparseoffsets.size()*sizeof(unsigned long long));
+        _indexstream->write((const char*)_pindex->sparseids.data(), _pindex->sparseids.size()*sizeof(unsigned int));
+        _indexstream->write((const char*)_pindex->sparsecounts.data(), _pindex->sparsecounts.size());
+      }
+    else
+      _indexstream->write((const char*)&_pindex->fptdata[0], _pindex->fptdata.size()*sizeof(unsigned int));
     _indexstream->write((const char*)&_pindex->seekdata[0], _pindex->seekdata.size()*sizeof(unsigned long));
     if(!_indexstream)
       obErrorLog.ThrowError(__FUNCTION__,
@@ -457,11 +767,190 @@ namespace OpenBabel
   {
     ///Adds a fingerprint
 
-    vector<unsigned int> vecwords;
     if(!_pFP)
       return false;
-    if(_pFP->GetFingerprint(pOb, vecwords, _nbits))
+    if(_workers)
+      {
+        //Objects submitted earlier come first
+        Dispatch();
+        WriteBatches(true);
+      }
+    Entry entry;
+    entry.pOb = pOb;
+    entry.seekpos = seekpos;
+    Make(entry);
+    return Store(entry);
+  }
+
+  ///////////////////////////////////////////////////////////////
+  void FastSearchIndexer::Submit(OBBase* pOb, std::streampos seekpos)
+  {
+    unsigned nthreads = _nthreads ? _nthreads : thread::hardware_concurrency();
+    if(!_pFP || nthreads<=1 || !(_pFP->Flags() & OBFingerprint::FPT_THREADSAFE))
+      {
+        Add(pOb, seekpos);
+        delete pOb;
+        return;
+      }
+
+    if(!_workers)
+      _workers = new Workers;
+    Workers::Batch*& b = _workers->current;
+    if(!b)
+      {
+        b = new Workers::Batch;
+        b->done = false;
+        b->entries.reserve(Workers::batchsize);
+      }
+    Entry entry;
+    entry.pOb = pOb;
+    entry.seekpos = seekpos;
+    entry.ok = false;
+    b->entries.push_back(entry);
+    if(b->entries.size() == Workers::batchsize)
+      Dispatch();
+  }
+
+  ///////////////////////////////////////////////////////////////
+  /// Hands the batch being filled to the workers, starting them if this is
+  /// not the first batch, or fingerprints and stores it here if it is
+  void FastSearchIndexer::Dispatch()
+  {
+    Workers& w = *_workers;
+    Workers::Batch* b = w.current;
+    w.current = nullptr;
+    if(!b)
+      return;
+
+    if(w.started && w.threads.empty())
+      {
+        unsigned nthreads = _nthreads ? _nthreads : thread::hardware_concurrency();
+        try
+          {
+            for(unsigned i=0;i<nthreads;++i)
+              w.threads.push_back(thread(&FastSearchIndexer::Work, this));
+          }
+        catch(...)
+          {
+            //carry on with the threads there are, if any
+          }
+      }
+
+    if(w.threads.empty())
       {
+        //The first batch also loads any data the fingerprint needs,
+        //before other threads use it
+        w.started = true;
+        vector<Entry>::iterator itr;
+        for(itr=b->entries.begin();itr!=b->entries.end();++itr)
+          {
+            Make(*itr);
+            Store(*itr);
+            delete itr->pOb;
+          }
+        delete b;
+        return;
+      }
+
+    {
+      lock_guard<mutex> lock(w.mtx);
+      w.pending.push_back(b);
+      w.queue.push_back(b);
+    }
+    w.work_cv.notify_one();
+    WriteBatches(false);
+  }
+
+  ///////////////////////////////////////////////////////////////
+  /// Stores the finished batches at the front of the queue. If wait_all is
+  /// set, waits for all of them; otherwise only if too many are in flight.
+  void FastSearchIndexer::WriteBatches(bool wait_all)
+  {
+    Workers& w = *_workers;
+    unique_lock<mutex> lock(w.mtx);
+    while(!w.pending.empty())
+      {
+        Workers::Batch* b = w.pending.front();
+        if(!b->done)
+          {
+            if(!wait_all && w.pending.size() < 2 * w.threads.size())
+              break;
+            w.done_cv.wait(lock);
+            continue;
+          }
+        w.pending.pop_front();
+        lock.unlock();
+        vector<Entry>::iterator itr;
+        for(itr=b->entries.begin();itr!=b->entries.end();++itr)
+          Store(*itr);
+        delete b;
+        lock.lock();
+      }
+  }
+
+  ///////////////////////////////////////////////////////////////
+  /// Worker thread: fingerprints batches until told to stop
+  void FastSearchIndexer::Work()
+  {
+    Workers& w = *_workers;
+    unique_lock<mutex> lock(w.mtx);
+    for(;;)
+      {
+        while(w.queue.empty() && !w.stop)
+          w.work_cv.wait(lock);
+        if(w.queue.empty())
+          return;
+        Workers::Batch* b = w.queue.front();
+        w.queue.pop_front();
+        lock.unlock();
+        vector<Entry>::iterator itr;
+        for(itr=b->entries.begin();itr!=b->entries.end();++itr)
+          {
+            Make(*itr);
+            delete itr->pOb;
+            itr->pOb = nullptr;
+          }
+        lock.lock();
+        b->done = true;
+        w.done_cv.notify_all();
+      }
+  }
+
+  ///////////////////////////////////////////////////////////////
+  bool FastSearchIndexer::Make(Entry& entry)
+  {
+    if(_sparse)
+      entry.ok = _pFP->GetCounts(entry.pOb, entry.counts);
+    else
+      entry.ok = _pFP->GetFingerprint(entry.pOb, entry.words, _nbits);
+    return entry.ok;
+  }
+
+  ///////////////////////////////////////////////////////////////
+  bool FastSearchIndexer::Store(Entry& entry)
+  {
+    if(_sparse)
+      {
+        //The IDs are appended to a single array; counts are kept in a byte
+        if(entry.ok)
+          {
+            OBFingerprint::CountVector::iterator itr;
+            for(itr=entry.counts.begin();itr!=entry.counts.end();++itr)
+              {
+                _pindex->sparseids.push_back(itr->first);
+                _pindex->sparsecounts.push_back(min(itr->second, 255u));
+              }
+            _pindex->sparseoffsets.push_back(_pindex->sparseids.size());
+            _pindex->seekdata.push_back(entry.seekpos);
+            return true;
+          }
+        obErrorLog.ThrowError(__FUNCTION__, "Failed to make a sparse fingerprint", obWarning);
+        return false;
+      }
+
+    if(entry.ok)
+      {
+        vector<unsigned int>& vecwords = entry.words;
         _pindex->header.words = vecwords.size(); //Use size as returned from fingerprint
         if(_pindex->fptdata.empty() && _pindex->header.nEntries!=0)
         {
@@ -472,7 +961,7 @@ namespace OpenBabel
         }
         for(unsigned int i=0;i<_pindex->header.words;++i)
           _pindex->fptdata.push_back(vecwords[i]);
-        _pindex->seekdata.push_back(seekpos);
+        _pindex->seekdata.push_back(entry.seekpos);
         return true;
       }
     obErrorLog.ThrowError(__FUNCTION__, "Failed to make a fingerprint", obWarning);
@@ -621,6 +1110,16 @@ namespace OpenBabel
     - an array of fingerprints of the molecules
     - an array of the seek positions in the datasource file of all the molecules
 
+    When FastSearchIndexer is made with sparse=true, the first table instead holds
+    the unfolded features from OBFingerprint::GetCounts() (e.g. of ECFP4), as a
+    sorted run of 32bit IDs and a run of byte counts for each molecule. Nothing
+    is lost by folding, and a molecule takes only as much space as it has
+    features. Similarity searches then use the count-based Tanimoto coefficient,
+    and the sums of the counts are compared first so that most molecules are
+    rejected without merging their IDs with those of the target. A sparse index
+    is marked by the SPARSE flag at the end of a longer header, which older
+    versions of Open Babel do not read, so they cannot search it.
+
     <h4>To prepare an fastsearch index file:</h4>
     - Open an ostream to the index file.
     - Make a FastSearchIndexer object on the heap or the stack, passing in as parameters:
@@ -632,6 +1131,10 @@ namespace OpenBabel
     - For each molecule, call Add() with its pointer and its position in the datafile.<br>
     Currently the std::streampos value is implicitly cast to unsigned int so that
     for 32bit machines the datafile has to be no longer than about 2Gbyte.
+    - Alternatively, call Submit() with a molecule made on the heap, which the
+    indexer then deletes. If the fingerprint type is flagged FPT_THREADSAFE,
+    the fingerprints are made in batches on worker threads (see SetThreads())
+    while further molecules are read. They are still stored in submission order.
     - The index file is written when the FastSearchIndexer object is deleted or goes out
     of scope.
 
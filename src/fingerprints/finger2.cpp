@@ -22,7 +22,6 @@ GNU General Public License for more details.
 #include <openbabel/atom.h>
 #include <openbabel/bond.h>
 #include <openbabel/fingerprint.h>
-#include <set>
 #include <vector>
 #include <algorithm>
 #include <openbabel/elements.h>
@@ -45,7 +44,7 @@ public:
     "from one to Max_Fragment_Size = 7 atoms but single atom fragments of C,N,and O\n"
     "are ignored. A fragment is terminated when the atoms form a ring.\n"
     "For each of these fragments the atoms, bonding and whether they constitute\n"
-    "a complete ring is recorded and saved in a std::set, so that there is\n"
+    "a complete ring is recorded, so that there is\n"
     "only one of each fragment type. Chemically identical versions, i.e. ones with\n"
     "the atoms listed in reverse order and rings listed starting at different\n"
     "atoms, are identified and only a single canonical fragment is retained\n"
@@ -58,6 +57,10 @@ public:
 	//Calculates the fingerprint
 	bool GetFingerprint(OBBase* pOb, vector<unsigned int>&fp, int nbits=0) override;
 
+  /// A 32bit hash of each distinct fragment, rather than one of 1021 bits.
+  /// Each count is 1.
+  bool GetCounts(OBBase* pOb, CountVector& counts) override;
+
   /// \returns fragment info unless SetFlags(OBFingerprint::FPT_NOINFO) has been called before GetFingerprint() called. 
   /** Structure of a fragment (vector<int>)
    For a complete ring: last atom bonded to first atom
@@ -68,23 +71,15 @@ public:
   std::string DescribeBits(const std::vector<unsigned int> fp, bool bSet=true) override
   { return _ss.str(); }
 
-  unsigned int Flags() override { return _flags; }
-  void SetFlags(unsigned int f) override { _flags=f; }
+  /// Re-entrant unless the fragments are being kept for DescribeBits()
+  unsigned int Flags() override
+  { return (_flags & FPT_NOINFO) ? _flags | FPT_THREADSAFE : _flags; }
+  void SetFlags(unsigned int f) override { _flags = f & ~FPT_THREADSAFE; }
 
 private:
-	typedef std::set<std::vector<int> > Fset;
-	typedef std::set<std::vector<int> >::iterator SetItr;
-
-	void getFragments(std::vector<int> levels, std::vector<int> curfrag,
-			int level, OBAtom* patom, OBBond* pbond);
-	void DoReverses();
-	void DoRings();
-
-	unsigned int CalcHash(const std::vector<int>& frag);
+	bool FindFragments(OBBase* pOb, bool describe);
 	void PrintFpt(const std::vector<int>& f, int hash=0);
 
-	Fset fragset;
-	Fset ringset;
   stringstream _ss;
   unsigned int _flags;
 
@@ -98,172 +93,279 @@ fingerprint2 thefingerprint2("FP2",true);
 /*! class fingerprint2
 Similar to Fabien Fontain's fingerprint class, with a slightly improved
 algorithm, but re-written using STL which makes it shorter.
+
+Every linear path of up to Max_Fragment_Size heavy atoms is followed once
+from each end by a depth-first search. The fragment is the sequence of
+atomic numbers and bond orders along the path, and is identified with the
+lexicographically larger of its two directions. A ring closed by the last
+atom is identified with the largest of its rotations and reflections. Rather
+than building each fragment as a vector and putting it in a std::set, the
+hashes of a path in both directions are extended as each atom is added, and
+a fragment is used only from the end where it is canonical, so nothing is
+allocated for each fragment.
 */
 
-bool fingerprint2::GetFingerprint(OBBase* pOb, vector<unsigned int>&fp, int nbits)
+static const int Max_Fragment_Size = 7;
+static const unsigned int MODINT = 108; //2^32 % 1021
+static const unsigned int IDMULT = 16777619u; //multiplier for the 32bit IDs
+
+/// Working storage for one fingerprint, kept between calls on each thread
+struct FP2Scratch {
+  std::vector<unsigned int> pos;      // position of each atom among the heavy atoms, by Idx
+  std::vector<unsigned int> nbrStart; // neighbours of heavy atom i are nbrStart[i]..nbrStart[i+1]-1
+  std::vector<unsigned int> nbr;      // position of each neighbour
+  std::vector<int> order;             // bond order of each neighbour, 5 for aromatic
+  std::vector<int> atno;              // atomic number of each heavy atom
+  std::vector<char> onpath;
+
+  // The current path of n atoms
+  unsigned int path[Max_Fragment_Size];
+  int seq[2*Max_Fragment_Size];  // atno(1), bo(1)(2), atno(2),...atno(n)
+  // Hashes mod 1021 of seq and of seq reversed when there were i+1 atoms,
+  // and 108^(2i+1). The same mod 2^32 for the 32bit IDs.
+  unsigned int fwd[Max_Fragment_Size], rev[Max_Fragment_Size], pw[Max_Fragment_Size];
+  unsigned int fwd32[Max_Fragment_Size], rev32[Max_Fragment_Size], pw32[Max_Fragment_Size];
+
+  // Results: the hash and the ID of each fragment found (with repeats) and,
+  // if they are described, the canonical fragments
+  std::vector<unsigned int> hashes;
+  std::vector<unsigned int> ids;
+  bool describe;
+  std::vector<std::vector<int> > frags;
+};
+
+static THREAD_LOCAL FP2Scratch fp2Scratch;
+
+static unsigned int CalcHash(const int* frag, unsigned int len)
 {
-	OBMol* pmol = dynamic_cast<OBMol*>(pOb);
-	if(!pmol) return false;
-	fp.resize(1024/Getbitsperint());
-	fragset.clear();//needed because now only one instance of fp class
-	ringset.clear();
- 
-	//identify fragments starting at every atom
-	OBAtom *patom;
-	vector<OBNodeBase*>::iterator i;
-	for (patom = pmol->BeginAtom(i);patom;patom = pmol->NextAtom(i))
-	{
-		if(patom->GetAtomicNum() == OBElements::Hydrogen) continue;
-		vector<int> curfrag;
-		vector<int> levels(pmol->NumAtoms());
-		getFragments(levels, curfrag, 1, patom, nullptr);
-	}
+  //Something like... whole of fragment treated as a binary number modulus 1021
+  unsigned int hash=0;
+  for(unsigned i=0;i<len;++i)
+    hash= (hash*MODINT + (frag[i] % 1021)) % 1021;
+  return hash;
+}
 
-//	TRACE("%s %d frags before; ",pmol->GetTitle(),fragset.size());
+static unsigned int CalcID(const int* frag, unsigned int len)
+{
+  unsigned int hash=0;
+  for(unsigned i=0;i<len;++i)
+    hash = hash*IDMULT + (unsigned int)frag[i];
+  return hash;
+}
 
-	//Ensure that each chemically identical fragment is present only in a single
-	DoRings();
-	DoReverses();
+static void Record(FP2Scratch& s, unsigned int hash, unsigned int id, const int* frag, unsigned int len)
+{
+  s.hashes.push_back(hash);
+  s.ids.push_back(id);
+  if(s.describe)
+    s.frags.push_back(std::vector<int>(frag, frag+len));
+}
 
-	SetItr itr;
-  _ss.str("");
-	for(itr=fragset.begin();itr!=fragset.end();++itr)
-	{
-		//Use hash of fragment to set a bit in the fingerprint
-		int hash = CalcHash(*itr);
-		SetBit(fp,hash);
-		if(!(Flags() & FPT_NOINFO))
-      PrintFpt(*itr,hash);
-	}
-	if(nbits)
-		Fold(fp, nbits);
+// The linear fragment of the current n atoms, if this is its canonical end
+static void DoLinear(FP2Scratch& s, unsigned int n)
+{
+  //do not save C,N,O single atom fragments
+  if(n==1)
+  {
+    int a = s.seq[0];
+    if(a<=8 && a>=6)
+      return;
+  }
+  //each path is found from both ends; use it from one
+  else if(s.path[0] > s.path[n-1])
+    return;
+
+  //The fragment is the larger of the two directions
+  unsigned int len = 2*n - 1;
+  bool reversed = false;
+  for(unsigned int i=0;i<len/2;++i)
+    if(s.seq[i]!=s.seq[len-1-i])
+    {
+      reversed = s.seq[len-1-i] > s.seq[i];
+      break;
+    }
+
+  if(!s.describe)
+  {
+    if(reversed)
+      Record(s, s.rev[n-1], s.rev32[n-1], nullptr, 0);
+    else
+      Record(s, s.fwd[n-1], s.fwd32[n-1], nullptr, 0);
+    return;
+  }
+  int frag[2*Max_Fragment_Size];
+  frag[0] = 0;
+  for(unsigned int i=0;i<len;++i)
+    frag[i+1] = reversed ? s.seq[len-1-i] : s.seq[i];
+  Record(s, reversed ? s.rev[n-1] : s.fwd[n-1],
+         reversed ? s.rev32[n-1] : s.fwd32[n-1], frag, len+1);
+}
 
-//	TRACE("%d after\n",fragset.size());
-	return true;
+// The ring closed from the last of the current n atoms to the first by a
+// bond of order bo, if this is the start and direction in which it is used
+static void DoRing(FP2Scratch& s, unsigned int n, int bo)
+{
+  //each ring is found from each atom in both directions
+  for(unsigned int i=1;i<n;++i)
+    if(s.path[i] < s.path[0])
+      return;
+  if(s.path[1] > s.path[n-1])
+    return;
+
+  //Find its largest chemically identical representation by rotating and reversing
+  unsigned int len = 2*n;
+  int t1[2*Max_Fragment_Size], t2[2*Max_Fragment_Size], maxring[2*Max_Fragment_Size];
+  t1[0] = bo;
+  std::copy(s.seq, s.seq+len-1, t1+1);
+  std::copy(t1, t1+len, maxring);
+  for(unsigned int i=0;i<n;++i)
+  {
+    //rotate atoms in ring
+    std::rotate(t1, t1+2, t1+len);
+    if(std::lexicographical_compare(maxring, maxring+len, t1, t1+len))
+      std::copy(t1, t1+len, maxring);
+
+    //reverse the direction around ring
+    std::copy(t1, t1+len, t2);
+    std::reverse(t2+1, t2+len);
+    if(std::lexicographical_compare(maxring, maxring+len, t2, t2+len))
+      std::copy(t2, t2+len, maxring);
+  }
+  Record(s, CalcHash(maxring, len), CalcID(maxring, len), maxring, len);
 }
 
-//////////////////////////////////////////////////////////
-void fingerprint2::getFragments(vector<int> levels, vector<int> curfrag,
-					int level, OBAtom* patom, OBBond* pbond)
+// Extends the path of n atoms, ending at atom cur, to each neighbour
+static void Extend(FP2Scratch& s, unsigned int n)
 {
-	//Recursive routine to analyse schemical structure and populate fragset and ringset
-	//Hydrogens,charges(except dative bonds), spinMultiplicity ignored
-	const int Max_Fragment_Size = 7;
-	int bo=0;
-	if(pbond)
-	{
-		bo = pbond->IsAromatic() ? 5 : pbond->GetBondOrder();
+  unsigned int cur = s.path[n-1];
+  unsigned int prev = n>1 ? s.path[n-2] : cur;
+  for(unsigned int k=s.nbrStart[cur];k<s.nbrStart[cur+1];++k)
+  {
+    unsigned int nxt = s.nbr[k];
+    if(nxt==prev) continue; //don't retrace steps
+    int bo = s.order[k];
+    if(s.onpath[nxt]) //ring
+    {
+      if(nxt==s.path[0])
+        DoRing(s, n, bo);
+    }
+    else if(n<(unsigned int)Max_Fragment_Size)
+    {
+      //Add the bond and atom, and extend the hashes of both directions
+      int a = s.atno[nxt];
+      s.path[n] = nxt;
+      s.seq[2*n-1] = bo;
+      s.seq[2*n] = a;
+      unsigned int p = s.pw[n-1];
+      s.fwd[n] = ((s.fwd[n-1]*MODINT + bo%1021)%1021*MODINT + a%1021)%1021;
+      s.rev[n] = ((a%1021)*p%1021*MODINT + (bo%1021)*p + s.rev[n-1])%1021;
+      s.pw[n] = p*MODINT%1021*MODINT%1021;
+      unsigned int p32 = s.pw32[n-1];
+      s.fwd32[n] = (s.fwd32[n-1]*IDMULT + (unsigned int)bo)*IDMULT + (unsigned int)a;
+      s.rev32[n] = (unsigned int)a*p32*IDMULT + (unsigned int)bo*p32 + s.rev32[n-1];
+      s.pw32[n] = p32*IDMULT*IDMULT;
+      s.onpath[nxt] = 1;
+      Extend(s, n+1);
+      s.onpath[nxt] = 0;
+    }
+  }
+  DoLinear(s, n);
+}
 
-//		OBAtom* pprevat = pbond->GetNbrAtom(patom);
-//		if(patom->GetFormalCharge() && (patom->GetFormalCharge() == -pprevat->GetFormalCharge()))
-//			++bo; //coordinate (dative) bond eg C[N+]([O-])=O is seen as CN(=O)=O
-	}
-	curfrag.push_back(bo);
-	curfrag.push_back(patom->GetAtomicNum());
-	levels[patom->GetIdx()-1] = level;
-
-	vector<OBBond*>::iterator itr;
-	OBBond *pnewbond;
-//	PrintFpt(curfrag,(int)patom);
-	for (pnewbond = patom->BeginBond(itr);pnewbond;pnewbond = patom->NextBond(itr))
-	{
-		if(pnewbond==pbond) continue; //don't retrace steps
-		OBAtom* pnxtat = pnewbond->GetNbrAtom(patom);
-		if(pnxtat->GetAtomicNum() == OBElements::Hydrogen) continue;
+bool fingerprint2::FindFragments(OBBase* pOb, bool describe)
+{
+	OBMol* pmol = dynamic_cast<OBMol*>(pOb);
+	if(!pmol) return false;
 
-		int atlevel = levels[pnxtat->GetIdx()-1];
-		if(atlevel) //ring
-		{
-			if(atlevel==1)
-			{
-				//If complete ring (last bond is back to starting atom) add bond at front
-				//and save in ringset
-				curfrag[0] = pnewbond->IsAromatic() ? 5 : pnewbond->GetBondOrder();
-				ringset.insert(curfrag);
- 				curfrag[0] = 0;
-			}
-		}
-		else //no ring
+	//Hydrogens,charges(except dative bonds), spinMultiplicity ignored
+	FP2Scratch &s = fp2Scratch;
+	s.pos.assign(pmol->NumAtoms() + 1, 0);
+	s.nbrStart.clear();
+	s.nbr.clear();
+	s.order.clear();
+	s.atno.clear();
+	s.hashes.clear();
+	s.ids.clear();
+	s.frags.clear();
+	s.describe = describe;
+
+	unsigned int nheavy = 0;
+	OBAtom *patom;
+	vector<OBNodeBase*>::iterator i;
+	for (patom = pmol->BeginAtom(i);patom;patom = pmol->NextAtom(i))
+		if(patom->GetAtomicNum() != OBElements::Hydrogen)
+			s.pos[patom->GetIdx()] = nheavy++;
+	for (patom = pmol->BeginAtom(i);patom;patom = pmol->NextAtom(i))
+	{
+		if(patom->GetAtomicNum() == OBElements::Hydrogen) continue;
+		s.atno.push_back(patom->GetAtomicNum());
+		s.nbrStart.push_back((unsigned int)s.nbr.size());
+		vector<OBBond*>::iterator itr;
+		for (OBBond* pbond = patom->BeginBond(itr);pbond;pbond = patom->NextBond(itr))
 		{
-			if(level<Max_Fragment_Size)
-			{
-//				TRACE("level=%d size=%d %p frag[0]=%p\n",level, curfrag.size(),&curfrag, &(curfrag[0]));
-				//Do the next atom; levels, curfrag are passed by value and hence copied
-				getFragments(levels, curfrag, level+1, pnxtat, pnewbond);
-			}
+			OBAtom* pnxtat = pbond->GetNbrAtom(patom);
+			if(pnxtat->GetAtomicNum() == OBElements::Hydrogen) continue;
+			s.nbr.push_back(s.pos[pnxtat->GetIdx()]);
+			s.order.push_back(pbond->IsAromatic() ? 5 : pbond->GetBondOrder());
 		}
 	}
+	s.nbrStart.push_back((unsigned int)s.nbr.size());
+	s.onpath.assign(nheavy, 0);
 
-	//do not save C,N,O single atom fragments
-	if(curfrag[0]==0 &&
-		(level>1 || patom->GetAtomicNum()>8  || patom->GetAtomicNum()<6))
+	//identify fragments starting at every atom
+	for(unsigned int start=0;start<nheavy;++start)
 	{
-		fragset.insert(curfrag); //curfrag ignored if an identical fragment already present
-//		PrintFpt(curfrag,level);
+		int a = s.atno[start];
+		s.path[0] = start;
+		s.seq[0] = a;
+		s.fwd[0] = s.rev[0] = a % 1021;
+		s.pw[0] = MODINT;
+		s.fwd32[0] = s.rev32[0] = (unsigned int)a;
+		s.pw32[0] = IDMULT;
+		s.onpath[start] = 1;
+		Extend(s, 1);
+		s.onpath[start] = 0;
 	}
+	return true;
 }
 
-///////////////////////////////////////////////////
-void fingerprint2::DoReverses()
-{
-	SetItr itr;
-	for(itr=fragset.begin();itr!=fragset.end();)
-	{
-		//Reverse the order of the atoms, add the smallest fragment and remove the larger
-		SetItr titr = itr++; //Ensure have valid next iterator in case current one is erased
-		vector<int> t1(*titr); //temporary copy
-		reverse(t1.begin()+1, t1.end()); //(leave 0 at front alone)
-		if(t1!=*titr)
-		{
-			//Add the larger fragment and delete the smaller
-			if(t1>*titr)
-			{
-				fragset.erase(titr);
-				fragset.insert(t1);
-			}
-			else
-				fragset.erase(t1);
-		}
-	}
-}
-///////////////////////////////////////////////////
-void fingerprint2::DoRings()
+bool fingerprint2::GetFingerprint(OBBase* pOb, vector<unsigned int>&fp, int nbits)
 {
-	//For each complete ring fragment, find its largest chemically identical representation
-	//by rotating and reversing, and insert into the main set of fragments
-	SetItr itr;
-	for(itr=ringset.begin();itr!=ringset.end();++itr)
+	bool describe = !(Flags() & FPT_NOINFO);
+	if(!FindFragments(pOb, describe))
+		return false;
+	FP2Scratch &s = fp2Scratch;
+	fp.assign(1024/Getbitsperint(), 0);
+
+	//Use hash of fragment to set a bit in the fingerprint
+	for(unsigned int i=0;i<s.hashes.size();++i)
+		SetBit(fp, s.hashes[i]);
+
+	if(describe)
 	{
-		vector<int> t1(*itr); //temporary copy
-		vector<int> maxring(*itr); //the current largest vector
-		unsigned int i;
-		for(i=0;i<t1.size()/2;++i)
-		{
-			//rotate atoms in ring
-			rotate(t1.begin(),t1.begin()+2,t1.end());
-			if(t1>maxring)
-				maxring=t1;
-
-			//reverse the direction around ring
-			vector<int> t2(t1);
-			reverse(t2.begin()+1, t2.end());
-			if(t2>maxring)
-				maxring=t2;
-		}
-		fragset.insert(maxring);
-		//PrintFpt(maxring,0);
+		_ss.str("");
+		//Each chemically identical fragment only once, in order
+		sort(s.frags.begin(), s.frags.end());
+		s.frags.erase(unique(s.frags.begin(), s.frags.end()), s.frags.end());
+		for(unsigned int i=0;i<s.frags.size();++i)
+			PrintFpt(s.frags[i], CalcHash(&s.frags[i][0], s.frags[i].size()));
 	}
+	if(nbits)
+		Fold(fp, nbits);
+	return true;
 }
 
-//////////////////////////////////////////////////////////
-unsigned int fingerprint2::CalcHash(const vector<int>& frag)
+bool fingerprint2::GetCounts(OBBase* pOb, CountVector& counts)
 {
-	//Something like... whole of fragment treated as a binary number modulus 1021
-	const int MODINT = 108; //2^32 % 1021
-	unsigned int hash=0;
-	for(unsigned i=0;i<frag.size();++i)
-		hash= (hash*MODINT + (frag[i] % 1021)) % 1021;
-	return hash;
+	if(!FindFragments(pOb, false))
+		return false;
+	FP2Scratch &s = fp2Scratch;
+	sort(s.ids.begin(), s.ids.end());
+	s.ids.erase(unique(s.ids.begin(), s.ids.end()), s.ids.end());
+	counts.clear();
+	for(unsigned int i=0;i<s.ids.size();++i)
+		counts.push_back(make_pair(s.ids[i], 1u));
+	return true;
 }
 
 void fingerprint2::PrintFpt(const vector<int>& f, int hash)
@@ -17,6 +17,8 @@ GNU General Public License for more details.
 
 #include <openbabel/babelconfig.h>
 #include <openbabel/mol.h>
+#include <openbabel/atom.h>
+#include <openbabel/obiter.h>
 #include <openbabel/parsmart.h>
 #include <openbabel/oberror.h>
 #include <sstream>
@@ -41,6 +43,7 @@ private:
     int numbits;
     int numoccurrences;
     int bitindex;
+    vector<pair<int,int> > elements; //atomic number and count of atoms the pattern needs
   };
   vector<pattern> _pats;
   int _bitcount;
@@ -80,8 +83,9 @@ public:
   }
 
 //////////////////////////////////////////////////////////////////////////////
-  //Each bit represents a single substructure
-  unsigned int Flags() override { return FPT_UNIQUEBITS; }
+  //Each bit represents a single substructure.
+  //Once the patterns have been read, the matches are made in local variables.
+  unsigned int Flags() override { return FPT_UNIQUEBITS | FPT_THREADSAFE; }
 
 ///////////////////////////////////////////////////////////////////////////////
   PatternFP* MakeInstance(const std::vector<std::string>& textlines) override
@@ -110,12 +114,26 @@ public:
       n*=2;
     fp.resize(n/Getbitsperint());
 
+    //Count the atoms of each element. A pattern which needs more atoms
+    //of some element than the molecule has cannot match and is skipped.
+    vector<int> elemcounts(256);
+    FOR_ATOMS_OF_MOL(patom, pmol)
+      elemcounts[patom->GetAtomicNum()]++;
+
+    //The same matcher is used for all the patterns, so that recursive SMARTS
+    //which appear in several of them are matched only once in the molecule
+    OBSmartsMatcher matcher;
+    vector<vector<int> > mlist;
+
     n=0; //bit position
     vector<pattern>::iterator ppat;
     for(ppat=_pats.begin();ppat!=_pats.end();++ppat)
     {
       if(ppat->numbits //ignore pattern if numbits==0
-        && ppat->obsmarts.Match(*pmol, ppat->numoccurrences==0))//do single match if all that's needed
+        && HasElements(*ppat, elemcounts)
+        && ppat->obsmarts.Match(*pmol, matcher, mlist, ppat->numoccurrences==0
+          ? OBSmartsPattern::Single //do single match if all that's needed
+          : OBSmartsPattern::AllUnique))
       {
         /* Set bits in the fingerprint depending on the number of matches in the molecule
            and the parameters, numbits and numoccurrences, in the pattern.
@@ -132,7 +150,7 @@ public:
               2 matches to the pattern would give 0111
               3 or more matches to the pattern would give 1111
         */
-        int numMatches = ppat->obsmarts.GetUMapList().size();
+        int numMatches = mlist.size();
         int num =  ppat->numbits, div = ppat->numoccurrences+1, ngrp;
 
         int i = n;
@@ -155,6 +173,32 @@ public:
     return true;
   }
 
+  /////////////////////////////////////////////////////////////////////
+  static bool HasElements(const pattern& p, const vector<int>& elemcounts)
+  {
+    vector<pair<int,int> >::const_iterator itr;
+    for(itr=p.elements.begin();itr!=p.elements.end();++itr)
+      if(elemcounts[itr->first] < itr->second)
+        return false;
+    return true;
+  }
+
+  //Find the elements and the number of atoms of each that a pattern needs
+  //from those atoms in the SMARTS which are restricted to one element.
+  //Hydrogen is left out: the molecule has none, but a pattern with [H]
+  //is matched against a copy of it with explicit hydrogens.
+  static void FindElements(pattern& p)
+  {
+    map<int,int> counts;
+    for(unsigned int i=0; i<p.obsmarts.NumAtoms(); ++i)
+    {
+      int atomicnum = p.obsmarts.GetAtomicNum(i);
+      if(atomicnum > 1 && atomicnum < 256)
+        counts[atomicnum]++;
+    }
+    p.elements.assign(counts.begin(), counts.end());
+  }
+
   /////////////////////////////////////////////////////////////////////
   bool ReadPatternFile(string& ver)
   {
@@ -212,6 +256,7 @@ public:
             "Faulty SMARTS: " + p.description + ' ' + p.smartsstring, obError);
           continue;
         }
+        FindElements(p);
         _pats.push_back(p);
         _bitcount += p.numbits;
       }
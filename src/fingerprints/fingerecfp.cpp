@@ -49,17 +49,18 @@ public:
 	//Calculates the fingerprint
 	bool GetFingerprint(OBBase* pOb, vector<unsigned int>&fp, int nbits=0) override;
 
-  /// \returns fragment info unless SetFlags(OBFingerprint::FPT_NOINFO) has been called before GetFingerprint() called.
+  /// \returns an empty string: the bits are hashes of circular environments
+  /// which are not kept
   std::string DescribeBits(const std::vector<unsigned int> fp, bool bSet=true) override
-  { return _ss.str(); }
+  { return std::string(); }
 
-  unsigned int Flags() override { return _flags; }
+  /// The unfolded identifiers, with how many times each occurs
+  bool GetCounts(OBBase* pOb, CountVector& counts) override;
+
+  unsigned int Flags() override { return _flags | FPT_THREADSAFE; }
   void SetFlags(unsigned int f) override { _flags=f; }
 
 private:
-  std::vector<unsigned int> v;
-
-  stringstream _ss;
   unsigned int _radius;
   bool _keepdups;
   unsigned int _flags;
@@ -129,9 +130,8 @@ static unsigned int ECFPHash(unsigned char *ptr, unsigned int length)
 }
 
 
-static unsigned int ECFPHash(std::vector<unsigned int> &v)
+static unsigned int ECFPHash(const unsigned int *v, unsigned int len)
 {
-  unsigned int len = (unsigned int)v.size();
   unsigned int a = 0;
   unsigned int b = 0;
   unsigned int c = 0;
@@ -153,36 +153,60 @@ static unsigned int ECFPHash(std::vector<unsigned int> &v)
   return c;
 }
 
-
-struct AtomInfo {
-  unsigned int e[5]; // hashcodes for ecfp0, 2, 4... This will segfault at ECFP12
-  std::vector<unsigned int> b[4]; // for duplicate removal as described in paper?
+/// Working storage for one fingerprint, kept between calls on each thread
+/// so that its vectors are not reallocated for every molecule
+struct ECFPScratch {
+  std::vector<unsigned int> pos;      // position of each atom among the heavy atoms, by Idx
+  std::vector<unsigned int> nbrStart; // neighbours of heavy atom i are nbrStart[i]..nbrStart[i+1]-1
+  std::vector<unsigned int> nbr;      // position of each neighbour
+  std::vector<unsigned int> order;    // 1, 2 or 3, or 4 for aromatic, for each neighbour
+  std::vector<unsigned int> ids;      // identifiers, nheavy for each pass
+  std::vector<unsigned long long> sorted; // order and identifier of the neighbours of an atom
+  std::vector<unsigned int> vint;     // the values hashed for an atom
 };
 
-struct NborInfo {
-  unsigned int order;
-  unsigned int idx;
+static THREAD_LOCAL ECFPScratch ecfpScratch;
 
-  NborInfo(unsigned int o, unsigned int i) : order(o), idx(i) {}
-  bool operator < (const NborInfo &x) const
-  {
-    if (order != x.order)
-      return order < x.order;
-    return idx < x.idx;
-  }
-};
+static unsigned int ECFPAtomHash(OBAtom *aptr)
+{
+  unsigned char buffer[8];
+  buffer[0] = aptr->GetHvyDegree(); // degree of heavy atom connections
+  buffer[1] = aptr->GetExplicitValence() - aptr->ExplicitHydrogenCount(); // valence of heavy atom connections
+  buffer[2] = aptr->GetAtomicNum();
+  buffer[3] = (unsigned char)aptr->GetIsotope();
+  buffer[4] = (unsigned char)aptr->GetFormalCharge();
+  buffer[5] = (unsigned char)(aptr->ExplicitHydrogenCount() + aptr->GetImplicitHCount());
+  buffer[6] = aptr->IsInRing() ? 1 : 0;
+  buffer[7] = 0;  // aptr->IsAromatic() ? 1 : 0;
+  return ECFPHash(buffer,8);
+}
 
-static void ECFPPass(OpenBabel::OBMol &mol,
-                     AtomInfo *ainfo, unsigned int pass)
+/// Calculates the identifiers of the heavy atoms for passes 0 to \p radius.
+/// The neighbours of the heavy atoms are gathered into flat arrays first.
+/// \returns the number of heavy atoms; identifier of atom i in pass p is
+/// s.ids[p*nheavy + i]
+static unsigned int ECFPIdentifiers(OBMol &mol, unsigned int radius, ECFPScratch &s)
 {
+  s.pos.assign(mol.NumAtoms() + 1, 0);
+  s.nbrStart.clear();
+  s.nbr.clear();
+  s.order.clear();
+  s.ids.clear();
+
+  unsigned int nheavy = 0;
   FOR_ATOMS_OF_MOL(atom, mol) {
-    if (atom->GetAtomicNum() == OBElements::Hydrogen)
-      continue;
-    OpenBabel::OBAtom* aptr = &(*atom);
-    unsigned int idx = aptr->GetIdx();
-    AtomInfo *ptr = &ainfo[idx];
+    if (atom->GetAtomicNum() != OBElements::Hydrogen)
+      s.pos[atom->GetIdx()] = nheavy++;
+  }
 
-    std::vector<NborInfo> nbrs;
+  /* First Pass: ECFP_0 */
+  s.ids.resize((radius + 1) * nheavy);
+  FOR_ATOMS_OF_MOL(atom, mol) {
+    OpenBabel::OBAtom* aptr = &(*atom);
+    if (aptr->GetAtomicNum() == OBElements::Hydrogen)
+      continue;
+    s.ids[s.pos[aptr->GetIdx()]] = ECFPAtomHash(aptr);
+    s.nbrStart.push_back((unsigned int)s.nbr.size());
     FOR_BONDS_OF_ATOM(bptr, aptr) {
       OpenBabel::OBAtom* nptr = bptr->GetNbrAtom(aptr);
       if (nptr->GetAtomicNum() == OBElements::Hydrogen)
@@ -195,49 +219,33 @@ static void ECFPPass(OpenBabel::OBMol &mol,
         default: order = 1;
         }
       } else order = 4;
-
-      unsigned int nidx = nptr->GetIdx();
-
-      nbrs.push_back(NborInfo(order,ainfo[nidx].e[pass-1]));
-      // for duplicate removal as described in paper (?)
-      if (pass == 1)
-        ptr->b[pass-1].push_back(bptr->GetIdx());
-    }
-    std::sort(nbrs.begin(),nbrs.end());
-
-    std::vector<unsigned int> vint;
-    vint.push_back(pass);
-    vint.push_back(ptr->e[pass-1]);
-    std::vector<NborInfo>::const_iterator ni;
-    for (ni=nbrs.begin(); ni!=nbrs.end(); ++ni) {
-      vint.push_back(ni->order);
-      vint.push_back(ni->idx);
+      s.nbr.push_back(s.pos[nptr->GetIdx()]);
+      s.order.push_back(order);
     }
-    ptr->e[pass] = ECFPHash(vint);
   }
-}
-
-static void ECFPFirstPass(OpenBabel::OBMol &mol,
-                          AtomInfo *ainfo)
-{
-  unsigned char buffer[8];
-
-  /* First Pass: ECFP_0 */
-  FOR_ATOMS_OF_MOL(atom, mol) {
-    if (atom->GetAtomicNum() == OBElements::Hydrogen)
-      continue;
-    OpenBabel::OBAtom* aptr = &(*atom);
-    unsigned int idx = aptr->GetIdx();
-    buffer[0] = aptr->GetHvyDegree(); // degree of heavy atom connections
-    buffer[1] = aptr->GetExplicitValence() - aptr->ExplicitHydrogenCount(); // valence of heavy atom connections
-    buffer[2] = aptr->GetAtomicNum();
-    buffer[3] = (unsigned char)aptr->GetIsotope();
-    buffer[4] = (unsigned char)aptr->GetFormalCharge();
-    buffer[5] = (unsigned char)(aptr->ExplicitHydrogenCount() + aptr->GetImplicitHCount());
-    buffer[6] = aptr->IsInRing() ? 1 : 0;
-    buffer[7] = 0;  // aptr->IsAromatic() ? 1 : 0;
-    ainfo[idx].e[0] = ECFPHash(buffer,8);
+  s.nbrStart.push_back((unsigned int)s.nbr.size());
+
+  for (unsigned int pass = 1; pass <= radius; pass++) {
+    const unsigned int *prev = s.ids.data() + (pass - 1) * nheavy;
+    unsigned int *cur = s.ids.data() + pass * nheavy;
+    for (unsigned int i = 0; i < nheavy; ++i) {
+      // The neighbours sorted by bond order and then identifier
+      s.sorted.clear();
+      for (unsigned int k = s.nbrStart[i]; k < s.nbrStart[i + 1]; ++k)
+        s.sorted.push_back(((unsigned long long)s.order[k] << 32) | prev[s.nbr[k]]);
+      std::sort(s.sorted.begin(), s.sorted.end());
+
+      s.vint.clear();
+      s.vint.push_back(pass);
+      s.vint.push_back(prev[i]);
+      for (size_t k = 0; k < s.sorted.size(); ++k) {
+        s.vint.push_back((unsigned int)(s.sorted[k] >> 32));
+        s.vint.push_back((unsigned int)s.sorted[k]);
+      }
+      cur[i] = ECFPHash(&s.vint[0], (unsigned int)s.vint.size());
+    }
   }
+  return nheavy;
 }
 
 bool fingerprintECFP::GetFingerprint(OBBase* pOb, vector<unsigned int>&fp, int nbits)
@@ -251,34 +259,42 @@ bool fingerprintECFP::GetFingerprint(OBBase* pOb, vector<unsigned int>&fp, int n
 
   fp.resize(0); // clear without deallocating memory
   fp.resize(nbits/Getbitsperint());
-	
-  _ss.str("");
-
-  unsigned int pass;
 
-  unsigned int count = pmol->NumAtoms();
-  if (count == 0) return true;
+  if (pmol->NumAtoms() == 0) return true;
 
-  // Access this using the Atom::Idx()
-  AtomInfo *ainfo = new AtomInfo[count+1];
+  // All the state is local (or per thread), so fingerprints can be
+  // calculated on several threads at once
+  ECFPScratch &s = ecfpScratch;
+  ECFPIdentifiers(*pmol, _radius, s);
 
-  ECFPFirstPass(*pmol,ainfo);
-  for (pass=1; pass<= _radius; pass++)
-    ECFPPass(*pmol,ainfo,pass);
-
-  // Duplicate removal - this is a simplified version of what's in the paper
-  FOR_ATOMS_OF_MOL(atom, pmol) {
-    if (atom->GetAtomicNum() == OBElements::Hydrogen)
-      continue;    
-    unsigned int idx = atom->GetIdx();
-    for (pass=0; pass <= _radius; pass++) {
-      unsigned int bit = (ainfo[idx].e[pass] % nbits) & 0x7fffffff; 
-      SetBit(fp, bit);
-    }
+  // Duplicate identifiers set the same bit
+  for (unsigned int i = 0; i < s.ids.size(); ++i) {
+    unsigned int bit = (s.ids[i] % nbits) & 0x7fffffff;
+    SetBit(fp, bit);
   }
 
-  delete[] ainfo;
+  return true;
+}
 
+bool fingerprintECFP::GetCounts(OBBase* pOb, CountVector& counts)
+{
+  OBMol* pmol = dynamic_cast<OBMol*>(pOb);
+  if(!pmol) return false;
+
+  counts.clear();
+  if (pmol->NumAtoms() == 0) return true;
+
+  ECFPScratch &s = ecfpScratch;
+  ECFPIdentifiers(*pmol, _radius, s);
+
+  // Run-length count the sorted identifiers
+  std::sort(s.ids.begin(), s.ids.end());
+  for (unsigned int i = 0; i < s.ids.size(); ++i) {
+    if (counts.empty() || counts.back().first != s.ids[i])
+      counts.push_back(std::make_pair(s.ids[i], 1u));
+    else
+      ++counts.back().second;
+  }
   return true;
 }
 
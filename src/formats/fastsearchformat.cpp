@@ -24,6 +24,7 @@ GNU General Public License for more details.
 #include <openbabel/elements.h>
 #include <openbabel/bond.h>
 #include <openbabel/obutil.h>
+#include "../asyncstream.h"
 #include <cstdlib>
 #include <algorithm>
 
@@ -45,6 +46,8 @@ FastSearchFormat() : fsi(nullptr)
   OBConversion::RegisterOptionParam("f", this, 1);
   OBConversion::RegisterOptionParam("N", this, 1);
   OBConversion::RegisterOptionParam("u", this, 0);
+  OBConversion::RegisterOptionParam("C", this, 0);
+  OBConversion::RegisterOptionParam("T", this, 1);
   OBConversion::RegisterOptionParam("t", this, 1, OBConversion::INOPTIONS);
   OBConversion::RegisterOptionParam("l", this, 1, OBConversion::INOPTIONS);
   OBConversion::RegisterOptionParam("a", this, 0, OBConversion::INOPTIONS);
@@ -92,6 +95,11 @@ const char* Description() override  // required
   " f# Fingerprint type\n"
   "     If not specified, the default fingerprint (currently FP2) is used\n"
   " N# Fold fingerprint to # bits\n"
+  " C  Store unfolded feature counts, e.g. -xfECFP4 -xC\n"
+  "     Needs a fingerprint with a sparse form (ECFPn, FP2).\n"
+  "     Similarity is then the Tanimoto coefficient of the counts\n"
+  " T# Number of threads making fingerprints\n"
+  "     Default is one per processor\n"
   " u  Update an existing index\n\n"
 
   "Read Options (when searching) e.g. -at0.7\n"
@@ -383,7 +391,7 @@ const char* Description() override  // required
         FptIndex* pidx = nullptr; //used with update
 
         //if(pOs==&cout) did not work with GUI
-        if(!dynamic_cast<ofstream*>(pOs))
+        if(!dynamic_cast<ofstream*>(SinkStream(pOs)))
           {
             //No index filename specified
             //Derive index name from datafile name
@@ -445,6 +453,21 @@ const char* Description() override  // required
         if(p)
           fpid=p;
 
+        bool sparse = pConv->IsOption("C") != nullptr;
+        if(sparse && !update)
+          {
+            OBFingerprint* pFP = OBFingerprint::FindFingerprint(fpid.c_str());
+            OBMol empty;
+            OBFingerprint::CountVector counts;
+            if(pFP && !pFP->GetCounts(&empty, counts))
+              {
+                obErrorLog.ThrowError(__FUNCTION__,
+                  "The fingerprint type has no sparse form for the -xC option", obError);
+                delete pidx;
+                return false;
+              }
+          }
+
         //Prepare name without path
         string datafilename = pConv->GetInFilename();
         if(datafilename.empty())
@@ -484,7 +507,11 @@ const char* Description() override  // required
             pConv->GetInStream()->seekg(LastSeekpos);
           }
         else
-          fsi = new FastSearchIndexer(datafilename, pOs, fpid, nbits, nmols);
+          fsi = new FastSearchIndexer(datafilename, pOs, fpid, nbits, nmols, sparse);
+
+        p = pConv->IsOption("T");
+        if(p)
+          fsi->SetThreads(atoi(p));
 
         obErrorLog.StopLogging();
       }
@@ -498,7 +525,9 @@ const char* Description() override  // required
     streampos seekpos = pConv->GetInPos();
     if(!update || seekpos>LastSeekpos)
     {
-      fsi->Add(pOb, seekpos );
+      //The indexer now owns the object and may fingerprint it on another thread
+      fsi->Submit(pOb, seekpos);
+      pOb = nullptr;
       if(pConv->GetOutputIndex()==400 && nmols>1000)
       {
         clog << " Estimated completion time ";
@@ -668,9 +697,12 @@ const char* Description() override  // required
         id = "default";
       clog << indexname << " is an index of\n " << header.datafilename
            << ".\n It contains " << header.nEntries
-           << " molecules. The fingerprint type is " << id << " with "
-           << OBFingerprint::Getbitsperint() * header.words << " bits.\n"
-           << "Typical usage for a substructure search:\n"
+           << " molecules. The fingerprint type is " << id << " with ";
+      if(!(header.flags & FptIndexHeader::SPARSE))
+        clog << OBFingerprint::Getbitsperint() * header.words << " bits.\n";
+      else
+        clog << "unfolded feature counts.\n";
+      clog << "Typical usage for a substructure search:\n"
            << "obabel indexfile.fs -osmi -sSMILES\n"
            << "(-s option in GUI is 'Convert only if match SMARTS or mols in file')" << endl;
       return false;
@@ -128,6 +128,7 @@ set(formats_misc
       mpqcformat
       msiformat
       msmsformat
+      obcformat
       opendxformat
       outformat
       pcmodelformat
@@ -147,6 +148,7 @@ set(formats_misc
       viewmolformat
       wlnformat
       xedformat
+      xtcformat
       xyzformat
       yasaraformat
       )
@@ -236,13 +238,6 @@ if(LIBXML2_FOUND AND (BUILD_SHARED OR WITH_STATIC_LIBXML))
   )
 endif(LIBXML2_FOUND AND (BUILD_SHARED OR WITH_STATIC_LIBXML))
 
-if(HAVE_RPC_XDR_H)
-  set(formats_misc
-    ${formats_misc}
-    xtcformat
-  )
-endif(HAVE_RPC_XDR_H)
-
 if(MINIMAL_BUILD)
   set(formats
     ${formats_common}
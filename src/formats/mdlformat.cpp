@@ -23,6 +23,8 @@ GNU General Public License for more details.
 #endif
 
 #include <ctime>
+#include <cmath>
+#include <cstring>
 #include <vector>
 #include <iomanip>
 #include <map>
@@ -32,6 +34,7 @@ GNU General Public License for more details.
 #include <openbabel/bond.h>
 #include <openbabel/obiter.h>
 #include <openbabel/elements.h>
+#include <openbabel/generic.h>
 #include <openbabel/obmolecformat.h>
 #include <openbabel/stereo/stereo.h>
 #include <openbabel/stereo/cistrans.h>
@@ -84,7 +87,11 @@ namespace OpenBabel
                "       When filtering an sdf file on title or properties\n"
                "       only, avoid lengthy chemical interpretation by\n"
                "       using the ``T`` or ``P`` option together with the\n"
-               "       :ref:`copy format <Copy_raw_text>`.\n\n"
+               "       :ref:`copy format <Copy_raw_text>`.\n"
+               " L  read title and properties, parse the structure only if needed\n"
+               "       The connection table is kept as text. It is parsed\n"
+               "       when an option or the output format needs the atoms,\n"
+               "       and otherwise written to MDL/SD output unchanged.\n\n"
 
                "Write Options, e.g. -x3\n"
                " 3  output V3000 not V2000 (used for >999 atoms/bonds) \n"
@@ -129,6 +136,8 @@ namespace OpenBabel
         return ifs.good() ? 1 : -1;
       }
 
+      const char* RecordTerminator() override { return "$$$$"; }
+
       ////////////////////////////////////////////////////
       /// The "API" interface functions
       bool ReadMolecule(OBBase* pOb, OBConversion* pConv) override;
@@ -144,6 +153,7 @@ namespace OpenBabel
       bool ReadRGroupBlock(istream& ifs,OBMol& mol, OBConversion* pConv);
       bool ReadUnimplementedBlock(istream& ifs,OBMol& mol, OBConversion* pConv, string& blockname);
       bool WriteV3000(ostream& ofs,OBMol& mol, OBConversion* pConv);
+      void AppendDataItems(string& buf, OBMol& mol, OBConversion* pConv);
       bool ReadPropertyLines(istream& ifs, OBMol& mol);
       bool TestForAlias(const string& symbol, OBAtom* at, vector<pair<AliasData*,OBAtom*> >& aliases);
 
@@ -300,6 +310,24 @@ namespace OpenBabel
       return true;
     }
 
+    if(pConv->IsOption("L",OBConversion::INOPTIONS))
+    {
+      //Keep the connection table as text, to be parsed only if it is needed
+      string record(line);
+      record += '\n';
+      while (std::getline(ifs, line)) {
+        record += line;
+        record += '\n';
+        if (line.substr(0, 6) == "M  END")
+          break;
+      }
+      map<string, string> options(*pConv->GetOptions(OBConversion::INOPTIONS));
+      options.erase("L");
+      mol.SetData(new OBDeferredStructure(record, this, options));
+      ReadPropertyLines(ifs, mol);//also reads $$$$
+      return true;
+    }
+
     // line 2: IIPPPPPPPPMMDDYYHHmmddSSssssssssssEEEEEEEEEEEERRRRRR
     //
     //          0...1    I = user's initials
@@ -1038,6 +1066,82 @@ namespace OpenBabel
     return false;
   }
 
+  // Append \p value right-aligned in a field of \p width characters,
+  // as printf's "%*d" would
+  static void AppendInt(string &buf, int value, int width)
+  {
+    char tmp[12];
+    char *p = tmp + sizeof(tmp);
+    unsigned int u = value < 0 ? 0u - static_cast<unsigned int>(value) : static_cast<unsigned int>(value);
+    do {
+      *--p = static_cast<char>('0' + u % 10);
+      u /= 10;
+    } while (u);
+    if (value < 0)
+      *--p = '-';
+    int len = static_cast<int>(tmp + sizeof(tmp) - p);
+    if (len < width)
+      buf.append(width - len, ' ');
+    buf.append(p, len);
+  }
+
+  // Append a coordinate exactly as printf's "%10.4f" would. The product
+  // x*10000 is split into its rounded value and the rounding error so that
+  // the decimal rounding (half to even) is decided on the exact value.
+  static void AppendCoord(string &buf, double x)
+  {
+    double ax = fabs(x);
+    if (!(ax < 1.0e10)) { // very large, inf or nan
+      char tmp[BUFF_SIZE];
+      snprintf(tmp, BUFF_SIZE, "%10.4f", x);
+      buf += tmp;
+      return;
+    }
+    double p = ax * 10000.0;
+    double err = fma(ax, 10000.0, -p);
+    double n = floor(p);
+    double s = ((p - n) - 0.5) + err;
+    if (s > 0.0 || (s == 0.0 && fmod(n, 2.0) != 0.0))
+      n += 1.0;
+
+    unsigned long long v = static_cast<unsigned long long>(n);
+    char tmp[32];
+    char *q = tmp + sizeof(tmp);
+    for (int k = 0; k < 4; ++k) {
+      *--q = static_cast<char>('0' + v % 10);
+      v /= 10;
+    }
+    *--q = '.';
+    do {
+      *--q = static_cast<char>('0' + v % 10);
+      v /= 10;
+    } while (v);
+    if (signbit(x))
+      *--q = '-';
+    int len = static_cast<int>(tmp + sizeof(tmp) - q);
+    if (len < 10)
+      buf.append(10 - len, ' ');
+    buf.append(q, len);
+  }
+
+  // Append "M  XXX" property lines, eight (index, value) entries per line
+  static void AppendPropertyLines(string &buf, const char *tag, const vector<pair<int, int> > &entries)
+  {
+    for (unsigned int counter = 0; counter < entries.size(); ++counter) {
+      if (counter % 8 == 0) {
+        if (counter > 0)
+          buf += '\n';
+        buf += "M  ";
+        buf += tag;
+        AppendInt(buf, static_cast<int>(min<size_t>(entries.size() - counter, 8)), 3);
+      }
+      AppendInt(buf, entries[counter].first, 4);
+      AppendInt(buf, entries[counter].second, 4);
+    }
+    if (!entries.empty())
+      buf += '\n';
+  }
+
   /////////////////////////////////////////////////////////////////
   bool MDLFormat::WriteMolecule(OBBase* pOb, OBConversion* pConv)
   {
@@ -1047,6 +1151,34 @@ namespace OpenBabel
     ostream &ofs = *pConv->GetOutStream();
     OBMol &mol = *pmol;
 
+    if (pConv->GetOutputIndex()==1)
+      HasProperties = false;
+
+    //A connection table read with the L option is copied unchanged unless
+    //an option needs the structure
+    OBDeferredStructure* pDef = static_cast<OBDeferredStructure*>
+      (mol.GetData(OBGenericDataType::DeferredStructureData));
+    if (pDef)
+    {
+      if (dynamic_cast<MDLFormat*>(pDef->GetFormat())
+          && !pConv->IsOption("3") && !pConv->IsOption("a") && !pConv->IsOption("w")
+          && !pConv->IsOption("v") && !pConv->IsOption("S") && !pConv->IsOption("A")
+          && !pConv->IsOption("E") && !pConv->IsOption("H"))
+      {
+        const string &record = pDef->GetRecord();
+        string buf(mol.GetTitle());
+        buf += '\n';
+        string::size_type eol = record.find('\n');
+        if (eol != string::npos)
+          buf.append(record, eol + 1, string::npos);
+        AppendDataItems(buf, mol, pConv);
+        ofs.write(buf.data(), buf.size());
+        return true;
+      }
+      if (!OBDeferredStructure::Expand(pmol))
+        return false;
+    }
+
     // Recommend using --gen2D or --gen3D
     if (mol.GetDimension()==0)
     {
@@ -1062,17 +1194,30 @@ namespace OpenBabel
     bool writeAtomClass = pConv->IsOption("a");
 
 
-    // Make a copy of mol (origmol) then ConvertZeroBonds() in mol
+    // If there are zero-order bonds, make a copy of mol (origmol) then
+    // ConvertZeroBonds() in mol. Otherwise mol is left unchanged and
+    // serves as its own original.
     // TODO: Do we need to worry about modifying mol? (It happens anyway in Kekulize etc?)
     // If so, instead make mol the copy: OBMol &origmol = *pmol; OBMol mol = origmol;
     // However there is information loss in the copy, so may cause issues
-    OBMol origmol = mol;
-    bool foundZBO = mol.ConvertZeroBonds();
+    bool hasZBO = false;
+    FOR_BONDS_OF_MOL(b, mol)
+      if (b->GetBondOrder() == 0) {
+        hasZBO = true;
+        break;
+      }
+    OBMol origmol;
+    bool foundZBO = false;
+    if (hasZBO) {
+      origmol = mol;
+      foundZBO = mol.ConvertZeroBonds();
+    }
 
     PerceiveStereo(&mol);
 
-    if (pConv->GetOutputIndex()==1)
-      HasProperties = false;
+    // The whole record is formatted into buf and written with a single call
+    string buf;
+    buf.reserve(128 + 70 * mol.NumAtoms() + 22 * mol.NumBonds());
 
     //
     // Header Block
@@ -1086,31 +1231,34 @@ namespace OpenBabel
       AliasData::RevertToAliasForm(mol);
 
     // line 1: molecule name
-    ofs << mol.GetTitle() <<  endl;
+    buf += mol.GetTitle();
+    buf += '\n';
 
     // line 2: Program name, date/time, dimensions code
-    ofs << " OpenBabel" << GetTimeDate() <<  dimension << endl; //line2
+    buf += " OpenBabel";
+    buf += GetTimeDate();
+    buf += dimension;
+    buf += '\n';
 
     // line 3: comment
     if (mol.HasData(OBGenericDataType::CommentData)) {
       OBCommentData *cd = (OBCommentData*)mol.GetData(OBGenericDataType::CommentData);
-      string comment = cd->GetData();
-      if(comment.size()>80)
-        comment.erase(80); //truncate to 80 chars
-      ofs << comment;
+      const string &comment = cd->GetData();
+      buf.append(comment, 0, 80); //truncate to 80 chars
     }
-    ofs << endl;
+    buf += '\n';
 
     //
     // Atom Block
     //
 
     if(pConv->IsOption("3") || mol.NumAtoms() > 999 || mol.NumBonds() > 999) {
+      ofs.write(buf.data(), buf.size());
+      buf.clear();
       if (!WriteV3000(ofs, mol, pConv))
         return false;
     } else {
       //The rest of the function is the same as the original
-      char buff[BUFF_SIZE];
 
       if (mol.NumAtoms() > 999 || mol.NumBonds() > 999) { // Three digits!
         stringstream errorMsg;
@@ -1129,7 +1277,9 @@ namespace OpenBabel
       // For 2D, if pConv->IsOption("w", pConv->OUTOPTIONS)), then the IsWedge/IsHash bond
       // designations are used instead of calculating them. For 3D it is always calculated. For 0D never.
       map<OBBond*, OBStereo::BondDirection> updown;
+      map<OBBond*, OBStereo::BondDirection>::const_iterator updown_cit;
       map<OBAtom*, Parity> parity;
+      map<OBAtom*, Parity>::const_iterator parity_cit;
       map<OBBond*, OBStereo::Ref> from;
       map<OBBond*, OBStereo::Ref>::const_iterator from_cit;
       GetParity(mol, parity);
@@ -1153,10 +1303,12 @@ namespace OpenBabel
       // mmm = no longer supported (default=999)
       //                         aaabbblllfffcccsssxxxrrrpppiiimmmvvvvvv
       bool chiralFlag = GetChiralFlagFromGenericData(mol);
- 
-      snprintf(buff, BUFF_SIZE, "%3d%3d  0  0%3d  0  0  0  0  0999 V2000\n",
-               mol.NumAtoms(), mol.NumBonds(), chiralFlag);
-      ofs << buff;
+
+      AppendInt(buf, mol.NumAtoms(), 3);
+      AppendInt(buf, mol.NumBonds(), 3);
+      buf += "  0  0";
+      AppendInt(buf, chiralFlag, 3);
+      buf += "  0  0  0  0  0999 V2000\n";
 
       OBAtom *atom;
       vector<OBAtom*>::iterator i;
@@ -1174,10 +1326,11 @@ namespace OpenBabel
           default: charge = 0; break;
         }
         Parity stereo = NotStereo;
-        if (parity.find(atom) != parity.end())
-          stereo = parity[atom];
+        parity_cit = parity.find(atom);
+        if (parity_cit != parity.end())
+          stereo = parity_cit->second;
+
 
-        
         int expval = atom->GetExplicitValence();
         int impval = MDLValence(atom->GetAtomicNum(), atom->GetFormalCharge(), expval);
         int actual_impval = expval + atom->GetImplicitHCount();
@@ -1202,18 +1355,31 @@ namespace OpenBabel
           }
         }
 
-        snprintf(buff, BUFF_SIZE, "%10.4f%10.4f%10.4f %-3s%2d%3d%3d%3d%3d%3d%3d%3d%3d%3d%3d%3d",
-          atom->GetX(), atom->GetY(), atom->GetZ(),
-          AtomSymbol(pmol, atom),
-          0,charge,stereo,0,0,valence,0,0,0,aclass,0,0);
-        ofs << buff << endl;
+        // "%10.4f%10.4f%10.4f %-3s%2d%3d%3d%3d%3d%3d%3d%3d%3d%3d%3d%3d"
+        AppendCoord(buf, atom->GetX());
+        AppendCoord(buf, atom->GetY());
+        AppendCoord(buf, atom->GetZ());
+        buf += ' ';
+        const char *symbol = AtomSymbol(pmol, atom);
+        size_t symlen = strlen(symbol);
+        buf.append(symbol, symlen);
+        if (symlen < 3)
+          buf.append(3 - symlen, ' ');
+        buf += " 0";
+        AppendInt(buf, charge, 3);
+        AppendInt(buf, stereo, 3);
+        buf += "  0  0";
+        AppendInt(buf, valence, 3);
+        buf += "  0  0  0";
+        AppendInt(buf, aclass, 3);
+        buf += "  0  0\n";
       }
 
       OBAtom *nbr;
       OBBond *bond;
       vector<OBBond*>::iterator j;
       int bondline = 0;
-      vector<int> zbos;
+      vector<pair<int, int> > zbos;
       for (atom = mol.BeginAtom(i);atom;atom = mol.NextAtom(i)) {
         for (nbr = atom->BeginNbrAtom(j);nbr;nbr = atom->NextNbrAtom(j)) {
           bond = (OBBond*) *j;
@@ -1238,41 +1404,40 @@ namespace OpenBabel
             if (unspec_ctstereo.find(bond) != unspec_ctstereo.end())
               stereo = 3;
             // For 3D (and 2D if "w" output option), set the stereo of the chiral centers.
-            if (updown.find(bond) != updown.end())
-              stereo = updown[bond];
+            updown_cit = updown.find(bond);
+            if (updown_cit != updown.end())
+              stereo = updown_cit->second;
 
-            ofs << setw(3) << atom->GetIdx(); // begin atom number
-            ofs << setw(3) << nbr->GetIdx(); // end atom number
-            ofs << setw(3) << bond->GetBondOrder(); // bond type
-            ofs << setw(3) << stereo; // bond stereo
-            ofs << "  0  0  0" << endl;
+            AppendInt(buf, atom->GetIdx(), 3); // begin atom number
+            AppendInt(buf, nbr->GetIdx(), 3); // end atom number
+            AppendInt(buf, bond->GetBondOrder(), 3); // bond type
+            AppendInt(buf, stereo, 3); // bond stereo
+            buf += "  0  0  0\n";
 
             // Add position in bond list to zbos for zero-order bonds
             bondline++;
             if (foundZBO) {
                 OBBond *origbond = origmol.GetBond(bond->GetIdx());
                 if (origbond->GetBondOrder() == 0) {
-                  zbos.push_back(bondline);
+                  zbos.push_back(make_pair(bondline, 0));
                 }
               }
           }
         }
       }
 
-      vector<OBAtom*> rads, isos, chgs;
-      vector<OBAtom*>::iterator itr;
+      vector<pair<int,int> > rads, isos, chgs;
       vector<pair<int,int> > zchs, hyds;
-      vector<pair<int,int> >::iterator zitr;
       vector<pair<int, int> > numberedRGroups;
       for (atom = mol.BeginAtom(i);atom;atom = mol.NextAtom(i)) {
         if(atom->GetSpinMultiplicity()>0 && atom->GetSpinMultiplicity()<4)
-          rads.push_back(atom);
+          rads.push_back(make_pair(atom->GetIdx(), atom->GetSpinMultiplicity()));
         if(atom->GetIsotope())
-          isos.push_back(atom);
+          isos.push_back(make_pair(atom->GetIdx(), atom->GetIsotope()));
         if(atom->GetFormalCharge())
-          chgs.push_back(atom);
+          chgs.push_back(make_pair(atom->GetIdx(), atom->GetFormalCharge()));
 
-        OBAtom *origatom = origmol.GetAtom(atom->GetIdx());
+        OBAtom *origatom = hasZBO ? origmol.GetAtom(atom->GetIdx()) : atom;
         // Get charge differences for ZCH, and hydrogen counts for HYD
         if (foundZBO || pConv->IsOption("H", pConv->OUTOPTIONS)) {
           if (foundZBO && origatom->GetFormalCharge() != atom->GetFormalCharge()) {
@@ -1291,8 +1456,13 @@ namespace OpenBabel
         if (rgroupIdx == -1) {
           if (atom->HasData(AliasDataType)) {
             AliasData* ad = static_cast<AliasData*>(atom->GetData(AliasDataType));
-            if(!ad->IsExpanded()) //do nothing with an expanded alias
-              ofs << "A  " << setw(3) << right << atom->GetIdx() << '\n' << ad->GetAlias() << endl;
+            if(!ad->IsExpanded()) { //do nothing with an expanded alias
+              buf += "A  ";
+              AppendInt(buf, atom->GetIdx(), 3);
+              buf += '\n';
+              buf += ad->GetAlias();
+              buf += '\n';
+            }
           }
         }
         else {
@@ -1300,94 +1470,33 @@ namespace OpenBabel
         }
       }
 
-      if (rads.size()) {
-        int counter = 0;
-        for(itr=rads.begin();itr!=rads.end();++itr, counter++) {
-          if (counter % 8 == 0) {
-            if (counter > 0) ofs << endl;
-            ofs << "M  RAD" << setw(3) << min(static_cast<unsigned long int>(rads.size() - counter), static_cast<unsigned long int>(8));
-          }
-          ofs << setw(4) << (*itr)->GetIdx() << setw(4) << (*itr)->GetSpinMultiplicity();
-        }
-        ofs << endl;
-      }
-      if(isos.size()) {
-        int counter = 0;
-        for(itr=isos.begin();itr!=isos.end();++itr, counter++) {
-          if (counter % 8 == 0) {
-            if (counter > 0) ofs << endl;
-            ofs << "M  ISO" << setw(3) << min(static_cast<unsigned long int>(isos.size() - counter), static_cast<unsigned long int>(8));
-          }
-          ofs << setw(4) << (*itr)->GetIdx() << setw(4) << (*itr)->GetIsotope();
-        }
-        ofs << endl;
-      }
-      if(chgs.size()) {
-        int counter = 0;
-        for (itr=chgs.begin(); itr != chgs.end(); ++itr, counter++) {
-          if (counter % 8 == 0) {
-            if (counter > 0) ofs << endl;
-            ofs << "M  CHG" << setw(3) << min(static_cast<unsigned long int>(chgs.size() - counter), static_cast<unsigned long int>(8));
-          }
-          ofs << setw(4) << (*itr)->GetIdx() << setw(4) << (*itr)->GetFormalCharge();
-        }
-        ofs << endl;
-      }
-      if(zchs.size()) {
-        int counter = 0;
-        for (zitr=zchs.begin(); zitr != zchs.end(); ++zitr, counter++) {
-          if (counter % 8 == 0) {
-            if (counter > 0) ofs << endl;
-            ofs << "M  ZCH" << setw(3) << min(static_cast<unsigned long int>(zchs.size() - counter), static_cast<unsigned long int>(8));
-          }
-          ofs << setw(4) << zitr->first << setw(4) << zitr->second;
-        }
-        ofs << endl;
-      }
-      if(hyds.size()) {
-        int counter = 0;
-        for (zitr=hyds.begin(); zitr != hyds.end(); ++zitr, counter++) {
-          if (counter % 8 == 0) {
-            if (counter > 0) ofs << endl;
-            ofs << "M  HYD" << setw(3) << min(static_cast<unsigned long int>(hyds.size() - counter), static_cast<unsigned long int>(8));
-          }
-          ofs << setw(4) << zitr->first << setw(4) << zitr->second;
-        }
-        ofs << endl;
-      }
-      if(zbos.size()) {
-        int counter = 0;
-        for(vector<int>::iterator it = zbos.begin(); it != zbos.end(); ++it, counter++) {
-          if (counter % 8 == 0) {
-            if (counter > 0) ofs << endl;
-            ofs << "M  ZBO" << setw(3) << min(static_cast<unsigned long int>(zbos.size() - counter), static_cast<unsigned long int>(8));
-          }
-          ofs << setw(4) << *it << setw(4) << 0;
-        }
-        ofs << endl;
-      }
-      if(numberedRGroups.size()) {
-        int counter = 0;
-        for (zitr=numberedRGroups.begin(); zitr != numberedRGroups.end(); ++zitr, counter++) {
-          if (counter % 8 == 0) {
-            if (counter > 0) ofs << endl;
-            ofs << "M  RGP" << setw(3) << min(static_cast<unsigned long int>(numberedRGroups.size() - counter), static_cast<unsigned long int>(8));
-          }
-          ofs << setw(4) << zitr->first << setw(4) << zitr->second;
-        }
-        ofs << endl;
-      }
+      AppendPropertyLines(buf, "RAD", rads);
+      AppendPropertyLines(buf, "ISO", isos);
+      AppendPropertyLines(buf, "CHG", chgs);
+      AppendPropertyLines(buf, "ZCH", zchs);
+      AppendPropertyLines(buf, "HYD", hyds);
+      AppendPropertyLines(buf, "ZBO", zbos);
+      AppendPropertyLines(buf, "RGP", numberedRGroups);
     }
-    ofs << "M  END" << endl;
+    buf += "M  END\n";
 
+    if (pConv->IsOption("sd") && !pConv->IsOption("m") && pConv->IsOption("E"))
+      GenerateAsciiDepiction(pmol);
+    AppendDataItems(buf, mol, pConv);
+
+    ofs.write(buf.data(), buf.size());
+
+    return(true);
+  }
+
+  void MDLFormat::AppendDataItems(string& buf, OBMol& mol, OBConversion* pConv)
+  {
     //For SD files only, write properties unless option m
     if(pConv->IsOption("sd") && !pConv->IsOption("m"))
     {
-      if (pConv->IsOption("E"))
-        GenerateAsciiDepiction(pmol);
 
       vector<OBGenericData*>::iterator k;
-      vector<OBGenericData*> vdata = mol.GetData();
+      vector<OBGenericData*> &vdata = mol.GetData();
       for (k = vdata.begin();k != vdata.end();k++)
       {
         if ((*k)->GetDataType() == OBGenericDataType::PairData
@@ -1398,8 +1507,11 @@ namespace OpenBabel
           //in this format, don't need the annotation
           if((*k)->GetAttribute()!="PartialCharges")
           {
-            ofs << ">  <" << (*k)->GetAttribute() << ">" << endl;
-            ofs << ((OBPairData*)(*k))->GetValue() << endl << endl;
+            buf += ">  <";
+            buf += (*k)->GetAttribute();
+            buf += ">\n";
+            buf += ((OBPairData*)(*k))->GetValue();
+            buf += "\n\n";
           }
         }
       }
@@ -1410,9 +1522,7 @@ namespace OpenBabel
     //or if the sd option is set.
     if(!pConv->IsOption("no$$$$"))
       if(!pConv->IsLast()  || HasProperties  || pConv->IsOption("sd"))
-        ofs << "$$$$" << endl;
-
-    return(true);
+        buf += "$$$$\n";
   }
 
 
@@ -1700,15 +1810,20 @@ namespace OpenBabel
 
   string MDLFormat::GetTimeDate()
   {
-    char td[11];
+    // The result is kept for calls made within the same second
+    static THREAD_LOCAL time_t last_time = 0;
+    static THREAD_LOCAL char td[11];
     //returns MMDDYYHHmm
     struct tm* ts;
     time_t long_time;
     time( &long_time );
-    ts = localtime( &long_time );
-    snprintf(td, 11, "%02d%02d%02d%02d%02d", ts->tm_mon+1, ts->tm_mday,
-             ((ts->tm_year>=100)? ts->tm_year-100 : ts->tm_year),
-             ts->tm_hour, ts->tm_min);
+    if (long_time != last_time || td[0] == '\0') {
+      ts = localtime( &long_time );
+      snprintf(td, 11, "%02d%02d%02d%02d%02d", ts->tm_mon+1, ts->tm_mday,
+               ((ts->tm_year>=100)? ts->tm_year-100 : ts->tm_year),
+               ts->tm_hour, ts->tm_min);
+      last_time = long_time;
+    }
     return string(td);
   }
 
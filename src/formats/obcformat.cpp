@@ -0,0 +1,884 @@
+/**********************************************************************
+obcformat.cpp - Columnar binary cache format for OBMol
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+#include <openbabel/babelconfig.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <openbabel/obmolecformat.h>
+#include <openbabel/mol.h>
+#include <openbabel/atom.h>
+#include <openbabel/bond.h>
+#include <openbabel/obiter.h>
+#include <openbabel/generic.h>
+#include <openbabel/residue.h>
+#include <openbabel/stereo/stereo.h>
+#include <openbabel/stereo/tetrahedral.h>
+#include <openbabel/stereo/cistrans.h>
+#include <openbabel/stereo/squareplanar.h>
+
+using namespace std;
+namespace OpenBabel
+{
+  /* File layout (all integers little-endian, every block a multiple of 8 bytes)
+
+     file header   "OBCF" u16 version u16 0 u32 0 u32 0
+     chunk         "OBCK" u32 ncolumns u32 nmols u32 0 u64 first record u64 payload length
+                   payload: ncolumns x { u32 column id, u32 0, u64 length, data padded to 8 }
+     ...
+     record index  "OBCX" u32 nchunks, nchunks x { u64 chunk offset, u64 first record, u64 nmols }
+     footer        u64 offset of the record index, "OBCEND\0\0"
+
+     Each column holds one field for all the molecules, atoms, bonds, etc. of
+     the chunk. Numeric columns are arrays of fixed-size values; a string column
+     is u32 count, u32 end offsets[count], then the characters. Columns whose
+     values are all zero (or all empty strings) are not written, and readers
+     treat missing or unknown columns as such, so that fields can be added
+     without changing the version.
+  */
+
+  enum OBCColumn {
+    // one entry per molecule
+    MOL_NATOMS = 1, MOL_NBONDS, MOL_NCONFS, MOL_CURCONF, MOL_FLAGS, MOL_DIM,
+    MOL_CHARGE, MOL_SPIN, MOL_ENERGY, MOL_TITLE, MOL_COMMENT, MOL_EXTRA,
+    MOL_NSTEREO, MOL_NPAIRS, MOL_NRESIDUES, MOL_NENERGIES,
+    // one entry per atom
+    ATOM_ELEMENT = 20, ATOM_CHARGE, ATOM_ISOTOPE, ATOM_SPIN, ATOM_IMPLICITH,
+    ATOM_HYB, ATOM_FLAGS, ATOM_PCHARGE, ATOM_TYPE,
+    // 3 * natoms * nconfs doubles per molecule
+    COORDS = 30,
+    // one entry per bond
+    BOND_BEGIN = 40, BOND_END, BOND_ORDER, BOND_FLAGS,
+    // one 32-byte record per stereo object
+    STEREO = 50,
+    // one entry per OBPairData
+    PAIR_ATTR = 60, PAIR_VALUE, PAIR_ORIGIN,
+    // one entry per residue
+    RES_NAME = 70, RES_NUM, RES_CHAIN, RES_CHAINNUM, RES_ICODE, RES_SEGNAME, RES_NATOMS,
+    // one entry per atom of each residue, in residue order
+    RATOM_ATOM = 80, RATOM_ID, RATOM_HET, RATOM_SERIAL,
+    // conformer energies
+    CONF_ENERGY = 90,
+    // one entry per unit cell (3 cell vectors and the offset)
+    CELL = 95, CELL_SPACEGROUP,
+    OBC_MAXCOLUMN = 100
+  };
+
+  // Bits of MOL_EXTRA and ATOM_FLAGS
+  enum { EXTRA_COMMENT = 1, EXTRA_CELL = 2 };
+  enum { AFLAG_AROMATIC = 1, AFLAG_RING = 2 };
+
+  static const unsigned short OBC_VERSION = 1;
+  static const unsigned int OBC_CHUNKMOLS = 1024;
+  static const size_t OBC_CHUNKBYTES = 4 << 20;
+
+  //Byte order of the file is little-endian
+  template<class T> static T ToLittleEndian(T value)
+  {
+#ifdef WORDS_BIGENDIAN
+    char *p = reinterpret_cast<char*>(&value);
+    for (size_t i = 0; i < sizeof(T) / 2; ++i)
+      swap(p[i], p[sizeof(T) - 1 - i]);
+#endif
+    return value;
+  }
+
+  template<class T> static void Put(string &col, T value)
+  {
+    value = ToLittleEndian(value);
+    col.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  template<class T> static T Get(const char *p)
+  {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return ToLittleEndian(value);
+  }
+
+  static void PadTo8(string &s)
+  {
+    if (s.size() % 8)
+      s.append(8 - s.size() % 8, '\0');
+  }
+
+  /// A column of a chunk which has been read, pointing into the chunk buffer
+  struct OBCReadColumn
+  {
+    const char *data;
+    size_t size;
+    OBCReadColumn() : data(nullptr), size(0) {}
+
+    /// \return value @p i, or zero if the column is missing or too short
+    template<class T> T At(size_t i) const
+    {
+      if (!data || (i + 1) * sizeof(T) > size)
+        return T(0);
+      return Get<T>(data + i * sizeof(T));
+    }
+    /// \return string @p i of a string column, or "" if it is not present
+    string String(size_t i) const
+    {
+      if (!data || size < 4)
+        return string();
+      size_t count = Get<unsigned int>(data);
+      if (i >= count || (count + 1) * 4 > size)
+        return string();
+      size_t begin = i ? Get<unsigned int>(data + 4 * i) : 0;
+      size_t end = Get<unsigned int>(data + 4 * (i + 1));
+      const char *chars = data + 4 * (count + 1);
+      if (begin > end || chars + end > data + size)
+        return string();
+      return string(chars + begin, end - begin);
+    }
+  };
+
+  /// A chunk which has been read from a stream, with the next molecule to be read
+  struct OBCReadChunk
+  {
+    streampos end;              //!< position of the stream after the chunk
+    vector<unsigned long long> buf; //!< chunk payload (8-byte aligned)
+    OBCReadColumn cols[OBC_MAXCOLUMN];
+    unsigned int nmols;         //!< molecules in the chunk
+    unsigned int cursor;        //!< next molecule to read
+    // Start of each molecule's atoms, bonds, etc. in the columns (nmols+1 entries)
+    vector<size_t> atom, bond, coord, stereo, pair, res, energy, cell;
+    vector<size_t> resatom;     //!< start of each residue's atoms (nresidues+1 entries)
+    OBCReadChunk() : end(-1), nmols(0), cursor(0) {}
+  };
+
+  /// Column being written: numeric data, or the offsets and characters of strings
+  struct OBCWriteColumn
+  {
+    string data;
+    string chars;
+    unsigned int count;
+    OBCWriteColumn() : count(0) {}
+
+    void AddString(const string &s)
+    {
+      chars += s;
+      Put<unsigned int>(data, static_cast<unsigned int>(chars.size()));
+      ++count;
+    }
+    void Clear() { data.clear(); chars.clear(); count = 0; }
+  };
+
+  /// The molecules waiting to be written to an output stream, and the chunks
+  /// written so far. The record index is written when the stream ends.
+  class OBCWriter : public OBFormatState
+  {
+  public:
+    OBCWriter() : _wmols(0), _wrecords(0), _wpos(0) {}
+    void AddMolecule(OBMol &mol);
+    void WriteHeader(ostream &ofs);
+    void WriteChunk(ostream &ofs);
+    bool ChunkFull() const
+    { return _wmols >= OBC_CHUNKMOLS || ColumnBytes() >= OBC_CHUNKBYTES; }
+    void End(ostream &ofs) override
+    {
+      if (_wmols)
+        WriteChunk(ofs);
+      WriteIndex(ofs);
+    }
+
+  private:
+    void WriteIndex(ostream &ofs);
+    size_t ColumnBytes() const;
+
+    OBCWriteColumn _wcols[OBC_MAXCOLUMN];
+    unsigned int _wmols;                 //!< molecules in the current chunk
+    unsigned long long _wrecords;        //!< molecules in earlier chunks
+    unsigned long long _wpos;            //!< bytes written to the file so far
+    vector<unsigned long long> _windex;  //!< offset, first record, nmols for each chunk
+  };
+
+  /// The chunk being read from an input stream
+  struct OBCReader : public OBFormatState
+  {
+    OBCReadChunk chunk;
+  };
+
+  class OBCFormat : public OBMoleculeFormat
+  {
+  public:
+    //Register this format type ID
+    OBCFormat()
+    {
+      OBConversion::RegisterFormat("obc", this);
+    }
+
+    const char* Description() override //required
+    {
+      return
+        "Open Babel columnar cache format\n"
+        "Binary format which stores the full state of each molecule\n\n"
+        "Molecules are stored with their atoms, bonds, all conformers,\n"
+        "stereochemistry, properties (OBPairData), comments, residues and\n"
+        "unit cell, together with the aromaticity, ring and stereo perception\n"
+        "that has been done on them. Reading a molecule back is therefore much\n"
+        "quicker than re-parsing a text format, and needs no re-perception,\n"
+        "which makes it suitable as an intermediate file between obabel runs::\n\n"
+        "      obabel dataset.sdf -O stage1.obc\n"
+        "      obabel stage1.obc -O stage2.obc --filter \"MW<300\"\n\n"
+        "Molecules are written in chunks of up to 1024, each of which holds one\n"
+        "column per atom, bond or molecule property, and the file ends with an\n"
+        "index of the chunks. Skipping molecules (e.g. with -f) does not decode\n"
+        "the chunks which are skipped over. The file is not portable between\n"
+        "Open Babel versions with different atom or bond flag definitions.\n\n"
+        "When writing through the API (e.g. WriteFile() and then Write()), the\n"
+        "last chunk and the index are written when the output is closed, by\n"
+        "CloseOutFile() or by changing the output stream.\n\n";
+    }
+
+    unsigned int Flags() override
+    {
+      return READBINARY | WRITEBINARY | ZEROATOMSOK;
+    }
+
+    int SkipObjects(int n, OBConversion* pConv) override;
+    bool ReadMolecule(OBBase* pOb, OBConversion* pConv) override;
+    bool WriteMolecule(OBBase* pOb, OBConversion* pConv) override;
+
+  private:
+    // The chunk being read is kept with the input stream of each OBConversion
+    OBCReadChunk* NextChunk(OBConversion *pConv, int skip);
+    OBCReadChunk* HaveChunk(OBConversion *pConv);
+    void MoleculeFromChunk(OBMol &mol, const OBCReadChunk &ch, unsigned int m);
+  };
+
+  //Make an instance of the format class
+  OBCFormat theOBCFormat;
+
+  /////////////////////////////////////////////////////////////////
+  // Writing
+
+  // Stereo refs are stored as atom indexes (from 0), keeping the special values
+  static unsigned int RefToIndex(OBMol &mol, OBStereo::Ref ref)
+  {
+    if (ref == OBStereo::NoRef || ref == OBStereo::ImplicitRef)
+      return static_cast<unsigned int>(ref);
+    OBAtom *atom = mol.GetAtomById(ref);
+    return atom ? atom->GetIdx() - 1 : static_cast<unsigned int>(OBStereo::NoRef);
+  }
+
+  static OBStereo::Ref IndexToRef(OBMol &mol, unsigned int idx)
+  {
+    if (idx == static_cast<unsigned int>(OBStereo::ImplicitRef))
+      return OBStereo::ImplicitRef;
+    OBAtom *atom = idx < mol.NumAtoms() ? mol.GetAtom(idx + 1) : nullptr;
+    return atom ? atom->GetId() : static_cast<OBStereo::Ref>(OBStereo::NoRef);
+  }
+
+  static void PutStereo(string &col, OBMol &mol, OBStereo::Type type, bool specified,
+                        int arg, int view, OBStereo::Ref a, OBStereo::Ref b,
+                        const OBStereo::Refs &refs)
+  {
+    unsigned int nrefs = min<size_t>(refs.size(), 4);
+    Put<unsigned char>(col, static_cast<unsigned char>(type));
+    Put<unsigned char>(col, specified);
+    Put<unsigned char>(col, static_cast<unsigned char>(arg));
+    Put<unsigned char>(col, static_cast<unsigned char>(view));
+    Put<unsigned int>(col, nrefs);
+    Put<unsigned int>(col, RefToIndex(mol, a));
+    Put<unsigned int>(col, RefToIndex(mol, b));
+    for (unsigned int i = 0; i < 4; ++i)
+      Put<unsigned int>(col, i < nrefs ? RefToIndex(mol, refs[i]) : static_cast<unsigned int>(OBStereo::NoRef));
+  }
+
+  void OBCWriter::AddMolecule(OBMol &mol)
+  {
+    // Do the perception that a reader of the molecule would otherwise need
+    PerceiveStereo(&mol);
+    if (mol.NumAtoms()) {
+      mol.GetAtom(1)->IsAromatic();
+      mol.GetAtom(1)->IsInRing();
+    }
+    int flags = mol.GetFlags();
+
+    unsigned int natoms = mol.NumAtoms();
+    unsigned int nconfs = natoms ? max(1, mol.NumConformers()) : 0;
+    unsigned int curconf = 0;
+    for (int k = 0; k < mol.NumConformers(); ++k)
+      if (mol.GetConformer(k) == mol.GetCoordinates())
+        curconf = k;
+
+    Put<unsigned int>(_wcols[MOL_NATOMS].data, natoms);
+    Put<unsigned int>(_wcols[MOL_NBONDS].data, mol.NumBonds());
+    Put<unsigned int>(_wcols[MOL_NCONFS].data, nconfs);
+    Put<unsigned int>(_wcols[MOL_CURCONF].data, curconf);
+    Put<int>(_wcols[MOL_FLAGS].data, flags);
+    Put<unsigned char>(_wcols[MOL_DIM].data, static_cast<unsigned char>(mol.GetDimension()));
+    Put<int>(_wcols[MOL_CHARGE].data, (flags & OB_TCHARGE_MOL) ? mol.GetTotalCharge() : 0);
+    Put<unsigned int>(_wcols[MOL_SPIN].data, (flags & OB_TSPIN_MOL) ? mol.GetTotalSpinMultiplicity() : 0);
+    Put<double>(_wcols[MOL_ENERGY].data, mol.GetEnergy());
+    _wcols[MOL_TITLE].AddString(mol.GetTitle());
+
+    unsigned char extra = 0;
+    OBCommentData *cd = static_cast<OBCommentData*>(mol.GetData(OBGenericDataType::CommentData));
+    if (cd)
+      extra |= EXTRA_COMMENT;
+    _wcols[MOL_COMMENT].AddString(cd ? cd->GetData() : string());
+    OBUnitCell *cell = static_cast<OBUnitCell*>(mol.GetData(OBGenericDataType::UnitCell));
+    if (cell) {
+      extra |= EXTRA_CELL;
+      vector<vector3> v = cell->GetCellVectors();
+      v.push_back(cell->GetOffset());
+      for (unsigned int i = 0; i < v.size(); ++i)
+        for (unsigned int j = 0; j < 3; ++j)
+          Put<double>(_wcols[CELL].data, v[i][j]);
+      _wcols[CELL_SPACEGROUP].AddString(cell->GetSpaceGroupName());
+    }
+    Put<unsigned char>(_wcols[MOL_EXTRA].data, extra);
+
+    // Atoms
+    FOR_ATOMS_OF_MOL(a, mol) {
+      unsigned char aflags = (a->IsAromatic() ? AFLAG_AROMATIC : 0) | (a->IsInRing() ? AFLAG_RING : 0);
+      Put<unsigned char>(_wcols[ATOM_ELEMENT].data, static_cast<unsigned char>(a->GetAtomicNum()));
+      Put<signed char>(_wcols[ATOM_CHARGE].data, static_cast<signed char>(a->GetFormalCharge()));
+      Put<unsigned short>(_wcols[ATOM_ISOTOPE].data, a->GetIsotope());
+      Put<unsigned char>(_wcols[ATOM_SPIN].data, static_cast<unsigned char>(a->GetSpinMultiplicity()));
+      Put<unsigned char>(_wcols[ATOM_IMPLICITH].data, static_cast<unsigned char>(a->GetImplicitHCount()));
+      Put<unsigned char>(_wcols[ATOM_HYB].data, (flags & OB_HYBRID_MOL) ? static_cast<unsigned char>(a->GetHyb()) : 0);
+      Put<unsigned char>(_wcols[ATOM_FLAGS].data, aflags);
+      Put<double>(_wcols[ATOM_PCHARGE].data, (flags & OB_PCHARGE_MOL) ? a->GetPartialCharge() : 0.0);
+      _wcols[ATOM_TYPE].AddString((flags & OB_ATOMTYPES_MOL) ? a->GetType() : "");
+    }
+
+    // Coordinates of all the conformers
+    string &coords = _wcols[COORDS].data;
+    if (mol.NumConformers() == 0) {
+      FOR_ATOMS_OF_MOL(a, mol) {
+        Put<double>(coords, a->GetX());
+        Put<double>(coords, a->GetY());
+        Put<double>(coords, a->GetZ());
+      }
+    }
+    else {
+      for (unsigned int k = 0; k < nconfs; ++k) {
+        const double *c = mol.GetConformer(k);
+#ifdef WORDS_BIGENDIAN
+        for (unsigned int i = 0; i < 3 * natoms; ++i)
+          Put<double>(coords, c[i]);
+#else
+        coords.append(reinterpret_cast<const char*>(c), 3 * natoms * sizeof(double));
+#endif
+      }
+    }
+
+    // Bonds
+    FOR_BONDS_OF_MOL(b, mol) {
+      Put<unsigned int>(_wcols[BOND_BEGIN].data, b->GetBeginAtomIdx() - 1);
+      Put<unsigned int>(_wcols[BOND_END].data, b->GetEndAtomIdx() - 1);
+      Put<unsigned char>(_wcols[BOND_ORDER].data, static_cast<unsigned char>(b->GetBondOrder()));
+      Put<unsigned int>(_wcols[BOND_FLAGS].data, b->GetFlags());
+    }
+
+    // Stereochemistry
+    unsigned int nstereo = 0;
+    vector<OBGenericData*> stereodata = mol.GetAllData(OBGenericDataType::StereoData);
+    for (vector<OBGenericData*>::iterator data = stereodata.begin(); data != stereodata.end(); ++data) {
+      OBStereo::Type type = static_cast<OBStereoBase*>(*data)->GetType();
+      if (type == OBStereo::Tetrahedral) {
+        OBTetrahedralStereo::Config cfg = static_cast<OBTetrahedralStereo*>(*data)->GetConfig();
+        PutStereo(_wcols[STEREO].data, mol, type, cfg.specified, cfg.winding, cfg.view,
+                  cfg.center, cfg.from, cfg.refs);
+      }
+      else if (type == OBStereo::CisTrans) {
+        OBCisTransStereo::Config cfg = static_cast<OBCisTransStereo*>(*data)->GetConfig();
+        PutStereo(_wcols[STEREO].data, mol, type, cfg.specified, cfg.shape, 0,
+                  cfg.begin, cfg.end, cfg.refs);
+      }
+      else if (type == OBStereo::SquarePlanar) {
+        OBSquarePlanarStereo::Config cfg = static_cast<OBSquarePlanarStereo*>(*data)->GetConfig();
+        PutStereo(_wcols[STEREO].data, mol, type, cfg.specified, cfg.shape, 0,
+                  cfg.center, OBStereo::NoRef, cfg.refs);
+      }
+      else
+        continue;
+      ++nstereo;
+    }
+    Put<unsigned int>(_wcols[MOL_NSTEREO].data, nstereo);
+
+    // Properties
+    unsigned int npairs = 0;
+    vector<OBGenericData*> &vdata = mol.GetData();
+    for (vector<OBGenericData*>::iterator data = vdata.begin(); data != vdata.end(); ++data) {
+      if ((*data)->GetDataType() != OBGenericDataType::PairData)
+        continue;
+      OBPairData *pd = dynamic_cast<OBPairData*>(*data);
+      if (!pd)
+        continue;
+      _wcols[PAIR_ATTR].AddString(pd->GetAttribute());
+      _wcols[PAIR_VALUE].AddString(pd->GetValue());
+      Put<unsigned char>(_wcols[PAIR_ORIGIN].data, static_cast<unsigned char>(pd->GetOrigin()));
+      ++npairs;
+    }
+    Put<unsigned int>(_wcols[MOL_NPAIRS].data, npairs);
+
+    // Residues
+    Put<unsigned int>(_wcols[MOL_NRESIDUES].data, mol.NumResidues());
+    FOR_RESIDUES_OF_MOL(r, mol) {
+      vector<OBAtom*> ratoms = r->GetAtoms();
+      _wcols[RES_NAME].AddString(r->GetName());
+      _wcols[RES_NUM].AddString(r->GetNumString());
+      Put<char>(_wcols[RES_CHAIN].data, r->GetChain());
+      Put<unsigned int>(_wcols[RES_CHAINNUM].data, r->GetChainNum());
+      Put<char>(_wcols[RES_ICODE].data, r->GetInsertionCode());
+      _wcols[RES_SEGNAME].AddString(r->GetSegName());
+      Put<unsigned int>(_wcols[RES_NATOMS].data, static_cast<unsigned int>(ratoms.size()));
+      for (vector<OBAtom*>::iterator a = ratoms.begin(); a != ratoms.end(); ++a) {
+        Put<unsigned int>(_wcols[RATOM_ATOM].data, (*a)->GetIdx() - 1);
+        _wcols[RATOM_ID].AddString(r->GetAtomID(*a));
+        Put<unsigned char>(_wcols[RATOM_HET].data, r->IsHetAtom(*a));
+        Put<unsigned int>(_wcols[RATOM_SERIAL].data, r->GetSerialNum(*a));
+      }
+    }
+
+    // Conformer energies
+    OBConformerData *confdata = static_cast<OBConformerData*>(mol.GetData(OBGenericDataType::ConformerData));
+    vector<double> energies;
+    if (confdata)
+      energies = confdata->GetEnergies();
+    Put<unsigned int>(_wcols[MOL_NENERGIES].data, static_cast<unsigned int>(energies.size()));
+    for (unsigned int k = 0; k < energies.size(); ++k)
+      Put<double>(_wcols[CONF_ENERGY].data, energies[k]);
+
+    ++_wmols;
+  }
+
+  size_t OBCWriter::ColumnBytes() const
+  {
+    size_t bytes = 0;
+    for (unsigned int id = 0; id < OBC_MAXCOLUMN; ++id)
+      bytes += _wcols[id].data.size() + _wcols[id].chars.size();
+    return bytes;
+  }
+
+  void OBCWriter::WriteHeader(ostream &ofs)
+  {
+    string header("OBCF");
+    Put<unsigned short>(header, OBC_VERSION);
+    Put<unsigned short>(header, 0);
+    Put<unsigned int>(header, 0);
+    Put<unsigned int>(header, 0);
+    ofs.write(header.data(), header.size());
+    _wpos = header.size();
+  }
+
+  void OBCWriter::WriteChunk(ostream &ofs)
+  {
+    // Assemble the payload, leaving out columns of zeros or empty strings
+    string payload;
+    payload.reserve(ColumnBytes() + 16 * OBC_MAXCOLUMN);
+    unsigned int ncols = 0;
+    for (unsigned int id = 0; id < OBC_MAXCOLUMN; ++id) {
+      OBCWriteColumn &col = _wcols[id];
+      string coldata;
+      if (col.count) {
+        if (col.chars.empty())
+          continue;
+        Put<unsigned int>(coldata, col.count);
+        coldata += col.data;
+        coldata += col.chars;
+      }
+      else {
+        if (col.data.find_first_not_of('\0') == string::npos)
+          continue;
+        coldata.swap(col.data);
+      }
+      Put<unsigned int>(payload, id);
+      Put<unsigned int>(payload, 0);
+      Put<unsigned long long>(payload, coldata.size());
+      payload += coldata;
+      PadTo8(payload);
+      ++ncols;
+    }
+
+    string header("OBCK");
+    Put<unsigned int>(header, ncols);
+    Put<unsigned int>(header, _wmols);
+    Put<unsigned int>(header, 0);
+    Put<unsigned long long>(header, _wrecords);
+    Put<unsigned long long>(header, payload.size());
+    ofs.write(header.data(), header.size());
+    ofs.write(payload.data(), payload.size());
+
+    _windex.push_back(_wpos);
+    _windex.push_back(_wrecords);
+    _windex.push_back(_wmols);
+    _wpos += header.size() + payload.size();
+    _wrecords += _wmols;
+    for (unsigned int id = 0; id < OBC_MAXCOLUMN; ++id)
+      _wcols[id].Clear();
+    _wmols = 0;
+  }
+
+  void OBCWriter::WriteIndex(ostream &ofs)
+  {
+    string index("OBCX");
+    Put<unsigned int>(index, static_cast<unsigned int>(_windex.size() / 3));
+    for (unsigned int i = 0; i < _windex.size(); ++i)
+      Put<unsigned long long>(index, _windex[i]);
+    Put<unsigned long long>(index, _wpos);
+    index.append("OBCEND\0\0", 8);
+    ofs.write(index.data(), index.size());
+    _wpos += index.size();
+  }
+
+  bool OBCFormat::WriteMolecule(OBBase* pOb, OBConversion* pConv)
+  {
+    OBMol* pmol = dynamic_cast<OBMol*>(pOb);
+    if (pmol == nullptr)
+      return false;
+    ostream &ofs = *pConv->GetOutStream();
+
+    // Each output stream (or restart of the output) is a complete file. The
+    // last chunk and the index are written by End(), when the stream is
+    // closed or changed or at the end of Convert().
+    OBCWriter *w = dynamic_cast<OBCWriter*>(pConv->GetOutState());
+    if (!w || pConv->GetOutputIndex() == 1) {
+      w = new OBCWriter;
+      pConv->SetOutState(w);
+      w->WriteHeader(ofs);
+    }
+
+    w->AddMolecule(*pmol);
+    if (w->ChunkFull())
+      w->WriteChunk(ofs);
+    return ofs.good();
+  }
+
+  /////////////////////////////////////////////////////////////////
+  // Reading
+
+  /// \return the chunk of the stream if its molecules follow on at the
+  /// stream position, or NULL
+  OBCReadChunk* OBCFormat::HaveChunk(OBConversion *pConv)
+  {
+    OBCReader *r = dynamic_cast<OBCReader*>(pConv->GetInState());
+    if (!r)
+      return nullptr;
+    OBCReadChunk &ch = r->chunk;
+    if (ch.cursor < ch.nmols && pConv->GetInStream()->tellg() == ch.end)
+      return &ch;
+    pConv->SetInState(nullptr);
+    return nullptr;
+  }
+
+  /// Read on to the next chunk, passing over file headers and record indexes
+  /// (so that concatenated files can be read). Chunks which contain only
+  /// molecules to be skipped are passed over without being read.
+  /// \return the chunk, or NULL at the end of the input or on error
+  OBCReadChunk* OBCFormat::NextChunk(OBConversion *pConv, int skip)
+  {
+    istream &ifs = *pConv->GetInStream();
+    pConv->SetInState(nullptr);
+    char tag[4];
+    while (ifs.read(tag, 4)) {
+      if (!memcmp(tag, "OBCF", 4)) {
+        char rest[12];
+        if (!ifs.read(rest, 12))
+          break;
+        if (Get<unsigned short>(rest) > OBC_VERSION) {
+          obErrorLog.ThrowError(__FUNCTION__, "The obc file was written by a newer version of Open Babel", obError);
+          ifs.setstate(ios::failbit);
+          return nullptr;
+        }
+      }
+      else if (!memcmp(tag, "OBCX", 4)) {
+        char count[4];
+        if (!ifs.read(count, 4))
+          break;
+        ifs.ignore(static_cast<streamsize>(Get<unsigned int>(count)) * 24 + 16);
+      }
+      else if (!memcmp(tag, "OBCK", 4)) {
+        char header[28];
+        if (!ifs.read(header, 28))
+          break;
+        unsigned int ncols = Get<unsigned int>(header);
+        unsigned int nmols = Get<unsigned int>(header + 4);
+        unsigned long long length = Get<unsigned long long>(header + 20);
+        if (skip >= static_cast<int>(nmols)) {
+          ifs.ignore(static_cast<streamsize>(length));
+          skip -= nmols;
+          continue;
+        }
+
+        OBCReader *r = new OBCReader;
+        pConv->SetInState(r);
+        OBCReadChunk &ch = r->chunk;
+        ch.buf.resize(length / 8 + 1);
+        char *payload = reinterpret_cast<char*>(&ch.buf[0]);
+        if (!ifs.read(payload, length)) {
+          pConv->SetInState(nullptr);
+          break;
+        }
+        size_t pos = 0;
+        for (unsigned int c = 0; c < ncols && pos + 16 <= length; ++c) {
+          unsigned int id = Get<unsigned int>(payload + pos);
+          unsigned long long size = Get<unsigned long long>(payload + pos + 8);
+          pos += 16;
+          if (size > length - pos)
+            break;
+          if (id < OBC_MAXCOLUMN) {
+            ch.cols[id].data = payload + pos;
+            ch.cols[id].size = size;
+          }
+          pos += (size + 7) & ~7ULL;
+        }
+
+        // Where each molecule's entries start in the other columns
+        ch.atom.assign(1, 0); ch.bond.assign(1, 0); ch.coord.assign(1, 0);
+        ch.stereo.assign(1, 0); ch.pair.assign(1, 0); ch.res.assign(1, 0);
+        ch.energy.assign(1, 0); ch.cell.assign(1, 0);
+        for (unsigned int m = 0; m < nmols; ++m) {
+          size_t natoms = ch.cols[MOL_NATOMS].At<unsigned int>(m);
+          ch.atom.push_back(ch.atom.back() + natoms);
+          ch.bond.push_back(ch.bond.back() + ch.cols[MOL_NBONDS].At<unsigned int>(m));
+          ch.coord.push_back(ch.coord.back() + 3 * natoms * ch.cols[MOL_NCONFS].At<unsigned int>(m));
+          ch.stereo.push_back(ch.stereo.back() + ch.cols[MOL_NSTEREO].At<unsigned int>(m));
+          ch.pair.push_back(ch.pair.back() + ch.cols[MOL_NPAIRS].At<unsigned int>(m));
+          ch.res.push_back(ch.res.back() + ch.cols[MOL_NRESIDUES].At<unsigned int>(m));
+          ch.energy.push_back(ch.energy.back() + ch.cols[MOL_NENERGIES].At<unsigned int>(m));
+          ch.cell.push_back(ch.cell.back() + ((ch.cols[MOL_EXTRA].At<unsigned char>(m) & EXTRA_CELL) ? 1 : 0));
+        }
+        ch.resatom.assign(1, 0);
+        for (size_t r = 0; r < ch.res.back(); ++r)
+          ch.resatom.push_back(ch.resatom.back() + ch.cols[RES_NATOMS].At<unsigned int>(r));
+        if (ch.cols[COORDS].data && ch.cols[COORDS].size < ch.coord.back() * sizeof(double)) {
+          obErrorLog.ThrowError(__FUNCTION__, "The obc file is corrupt", obError);
+          pConv->SetInState(nullptr);
+          ifs.setstate(ios::failbit);
+          return nullptr;
+        }
+
+        ch.end = ifs.tellg();
+        ch.nmols = nmols;
+        ch.cursor = skip;
+        return &ch;
+      }
+      else {
+        obErrorLog.ThrowError(__FUNCTION__, "The input is not an obc file, or is corrupt", obError);
+        ifs.setstate(ios::failbit);
+        return nullptr;
+      }
+    }
+    return nullptr;
+  }
+
+  int OBCFormat::SkipObjects(int n, OBConversion* pConv)
+  {
+    istream &ifs = *pConv->GetInStream();
+    if (n == 0)
+      return ifs ? 1 : -1;
+    if (OBCReadChunk *ch = HaveChunk(pConv)) {
+      unsigned int k = min<unsigned int>(n, ch->nmols - ch->cursor);
+      ch->cursor += k;
+      n -= k;
+      if (n == 0)
+        return 1;
+    }
+    if (!NextChunk(pConv, n))
+      return -1;
+    return 1;
+  }
+
+  void OBCFormat::MoleculeFromChunk(OBMol &mol, const OBCReadChunk &ch, unsigned int m)
+  {
+    const OBCReadColumn *c = ch.cols;
+    size_t a0 = ch.atom[m], natoms = ch.atom[m + 1] - a0;
+    size_t b0 = ch.bond[m], nbonds = ch.bond[m + 1] - b0;
+    int flags = c[MOL_FLAGS].At<int>(m);
+
+    mol.BeginModify();
+    mol.ReserveAtoms(static_cast<int>(natoms));
+    mol.ReserveBonds(static_cast<int>(nbonds));
+    for (size_t i = a0; i < a0 + natoms; ++i) {
+      OBAtom *atom = mol.NewAtom();
+      atom->SetAtomicNum(c[ATOM_ELEMENT].At<unsigned char>(i));
+      atom->SetFormalCharge(c[ATOM_CHARGE].At<signed char>(i));
+      atom->SetIsotope(c[ATOM_ISOTOPE].At<unsigned short>(i));
+      atom->SetSpinMultiplicity(c[ATOM_SPIN].At<unsigned char>(i));
+      atom->SetImplicitHCount(c[ATOM_IMPLICITH].At<unsigned char>(i));
+      if (unsigned int hyb = c[ATOM_HYB].At<unsigned char>(i))
+        atom->SetHyb(hyb);
+      unsigned char aflags = c[ATOM_FLAGS].At<unsigned char>(i);
+      if (aflags & AFLAG_AROMATIC)
+        atom->SetAromatic();
+      if (aflags & AFLAG_RING)
+        atom->SetInRing();
+      if (c[ATOM_PCHARGE].data)
+        atom->SetPartialCharge(c[ATOM_PCHARGE].At<double>(i));
+      if (c[ATOM_TYPE].data)
+        atom->SetType(c[ATOM_TYPE].String(i));
+    }
+    for (size_t i = b0; i < b0 + nbonds; ++i) {
+      unsigned int begin = c[BOND_BEGIN].At<unsigned int>(i);
+      unsigned int end = c[BOND_END].At<unsigned int>(i);
+      if (begin < natoms && end < natoms && begin != end)
+        mol.AddBond(begin + 1, end + 1, c[BOND_ORDER].At<unsigned char>(i),
+                    c[BOND_FLAGS].At<unsigned int>(i));
+    }
+    mol.EndModify();
+
+    // Coordinates: the first conformer was made by EndModify(). A missing
+    // column means that all of the coordinates are zero.
+    unsigned int nconfs = c[MOL_NCONFS].At<unsigned int>(m);
+    if (natoms && nconfs) {
+      size_t size = 3 * natoms;
+      for (unsigned int k = 1; k < nconfs; ++k)
+        mol.AddConformer(new double [size]());
+      if (c[COORDS].data) {
+        const char *src = c[COORDS].data + ch.coord[m] * sizeof(double);
+        for (unsigned int k = 0; k < nconfs; ++k, src += size * sizeof(double)) {
+          double *conf = mol.GetConformer(k);
+#ifdef WORDS_BIGENDIAN
+          for (size_t i = 0; i < size; ++i)
+            conf[i] = Get<double>(src + i * sizeof(double));
+#else
+          memcpy(conf, src, size * sizeof(double));
+#endif
+        }
+      }
+      mol.SetConformer(c[MOL_CURCONF].At<unsigned int>(m));
+    }
+
+    // What had been perceived, except for ring data which is not stored
+    mol.SetFlags(flags & ~(OB_SSSR_MOL | OB_LSSR_MOL | OB_RINGTYPES_MOL));
+    string title = c[MOL_TITLE].String(m);
+    mol.SetTitle(title);
+    mol.SetDimension(c[MOL_DIM].At<unsigned char>(m));
+    mol.SetEnergy(c[MOL_ENERGY].At<double>(m));
+    if (flags & OB_TCHARGE_MOL)
+      mol.SetTotalCharge(c[MOL_CHARGE].At<int>(m));
+    if (flags & OB_TSPIN_MOL)
+      mol.SetTotalSpinMultiplicity(c[MOL_SPIN].At<unsigned int>(m));
+
+    unsigned char extra = c[MOL_EXTRA].At<unsigned char>(m);
+    if (extra & EXTRA_COMMENT) {
+      OBCommentData *cd = new OBCommentData;
+      cd->SetData(c[MOL_COMMENT].String(m));
+      mol.SetData(cd);
+    }
+    if (extra & EXTRA_CELL) {
+      size_t k = ch.cell[m];
+      vector3 v[4];
+      for (unsigned int i = 0; i < 4; ++i)
+        v[i].Set(c[CELL].At<double>(12 * k + 3 * i), c[CELL].At<double>(12 * k + 3 * i + 1),
+                 c[CELL].At<double>(12 * k + 3 * i + 2));
+      OBUnitCell *cell = new OBUnitCell;
+      cell->SetData(v[0], v[1], v[2]);
+      cell->SetOffset(v[3]);
+      string spacegroup = c[CELL_SPACEGROUP].String(k);
+      if (!spacegroup.empty())
+        cell->SetSpaceGroup(spacegroup);
+      mol.SetData(cell);
+    }
+
+    // Stereochemistry
+    for (size_t s = ch.stereo[m]; s < ch.stereo[m + 1]; ++s) {
+      if (!c[STEREO].data || (s + 1) * 32 > c[STEREO].size)
+        break;
+      const char *rec = c[STEREO].data + s * 32;
+      OBStereo::Type type = static_cast<OBStereo::Type>(Get<unsigned char>(rec));
+      bool specified = Get<unsigned char>(rec + 1) != 0;
+      int arg = Get<unsigned char>(rec + 2);
+      int view = Get<unsigned char>(rec + 3);
+      unsigned int nrefs = min(Get<unsigned int>(rec + 4), 4u);
+      OBStereo::Ref a = IndexToRef(mol, Get<unsigned int>(rec + 8));
+      OBStereo::Ref b = IndexToRef(mol, Get<unsigned int>(rec + 12));
+      OBStereo::Refs refs;
+      for (unsigned int i = 0; i < nrefs; ++i)
+        refs.push_back(IndexToRef(mol, Get<unsigned int>(rec + 16 + 4 * i)));
+      if (type == OBStereo::Tetrahedral) {
+        OBTetrahedralStereo::Config cfg(a, b, refs, static_cast<OBStereo::Winding>(arg),
+                                        static_cast<OBStereo::View>(view));
+        cfg.specified = specified;
+        OBTetrahedralStereo *ts = new OBTetrahedralStereo(&mol);
+        ts->SetConfig(cfg);
+        mol.SetData(ts);
+      }
+      else if (type == OBStereo::CisTrans) {
+        OBCisTransStereo::Config cfg(a, b, refs, static_cast<OBStereo::Shape>(arg));
+        cfg.specified = specified;
+        OBCisTransStereo *ct = new OBCisTransStereo(&mol);
+        ct->SetConfig(cfg);
+        mol.SetData(ct);
+      }
+      else if (type == OBStereo::SquarePlanar) {
+        OBSquarePlanarStereo::Config cfg(a, refs, static_cast<OBStereo::Shape>(arg));
+        cfg.specified = specified;
+        OBSquarePlanarStereo *sp = new OBSquarePlanarStereo(&mol);
+        sp->SetConfig(cfg);
+        mol.SetData(sp);
+      }
+    }
+
+    // Properties
+    for (size_t p = ch.pair[m]; p < ch.pair[m + 1]; ++p) {
+      OBPairData *pd = new OBPairData;
+      pd->SetAttribute(c[PAIR_ATTR].String(p));
+      pd->SetValue(c[PAIR_VALUE].String(p));
+      pd->SetOrigin(static_cast<DataOrigin>(c[PAIR_ORIGIN].At<unsigned char>(p)));
+      mol.SetData(pd);
+    }
+
+    // Residues
+    for (size_t r = ch.res[m]; r < ch.res[m + 1]; ++r) {
+      OBResidue *res = mol.NewResidue();
+      res->SetName(c[RES_NAME].String(r));
+      res->SetNum(c[RES_NUM].String(r));
+      res->SetChain(c[RES_CHAIN].At<char>(r));
+      res->SetChainNum(c[RES_CHAINNUM].At<unsigned int>(r));
+      res->SetInsertionCode(c[RES_ICODE].At<char>(r));
+      res->SetSegName(c[RES_SEGNAME].String(r));
+      for (size_t k = ch.resatom[r]; k < ch.resatom[r + 1]; ++k) {
+        unsigned int idx = c[RATOM_ATOM].At<unsigned int>(k);
+        if (idx >= natoms)
+          continue;
+        OBAtom *atom = mol.GetAtom(idx + 1);
+        res->AddAtom(atom);
+        res->SetAtomID(atom, c[RATOM_ID].String(k));
+        res->SetHetAtom(atom, c[RATOM_HET].At<unsigned char>(k) != 0);
+        res->SetSerialNum(atom, c[RATOM_SERIAL].At<unsigned int>(k));
+      }
+    }
+
+    // Conformer energies
+    if (ch.energy[m + 1] > ch.energy[m]) {
+      vector<double> energies;
+      for (size_t k = ch.energy[m]; k < ch.energy[m + 1]; ++k)
+        energies.push_back(c[CONF_ENERGY].At<double>(k));
+      mol.SetEnergies(energies);
+    }
+  }
+
+  bool OBCFormat::ReadMolecule(OBBase* pOb, OBConversion* pConv)
+  {
+    OBMol* pmol = dynamic_cast<OBMol*>(pOb);
+    if (pmol == nullptr)
+      return false;
+    OBCReadChunk *ch = HaveChunk(pConv);
+    if (!ch && !(ch = NextChunk(pConv, 0)))
+      return false;
+
+    pmol->Clear();
+    MoleculeFromChunk(*pmol, *ch, ch->cursor++);
+    if (ch->cursor == ch->nmols)
+      pConv->SetInState(nullptr); // free it now rather than when the stream is next read
+    return true;
+  }
+
+} //namespace OpenBabel
@@ -27,6 +27,7 @@ GNU General Public License for more details.
 #include <vector>
 #include <map>
 #include <cstdlib>
+#include <cstring>
 #include <algorithm>
 
 #include <sstream>
@@ -46,6 +47,7 @@ namespace OpenBabel
       OBConversion::RegisterOptionParam("s", this, 0, OBConversion::INOPTIONS);
       OBConversion::RegisterOptionParam("b", this, 0, OBConversion::INOPTIONS);
       OBConversion::RegisterOptionParam("c", this, 0, OBConversion::INOPTIONS);
+      OBConversion::RegisterOptionParam("T", this, 0, OBConversion::INOPTIONS);
 
       OBConversion::RegisterOptionParam("o", this, 0, OBConversion::OUTOPTIONS);
       OBConversion::RegisterOptionParam("n", this, 0, OBConversion::OUTOPTIONS);
@@ -58,7 +60,13 @@ namespace OpenBabel
         "Read Options e.g. -as\n"
         "  s  Output single bonds only\n"
         "  b  Disable bonding entirely\n"
-        "  c  Ignore CONECT records\n\n"
+        "  c  Ignore CONECT records\n"
+        "  T  Read each chain (ending at a TER record) as a separate molecule\n"
+        "     Only one chain is held in memory at a time, so this suits\n"
+        "     very large assemblies. Bonds between chains are not made.\n"
+        "     CONECT records come after the chains, so they are only used\n"
+        "     for atoms after the last TER record (e.g. ligands). Bonds in\n"
+        "     the chains are perceived from the coordinates.\n\n"
 
         "Write Options, e.g. -xo\n"
         "  n  Do not write duplicate CONECT records to indicate bond order\n"
@@ -75,6 +83,7 @@ namespace OpenBabel
     ////////////////////////////////////////////////////
     /// The "API" interface functions
     int SkipObjects(int n, OBConversion* pConv) override;
+    const char* RecordTerminator() override { return "END"; } // END or ENDMDL
     bool ReadMolecule(OBBase* pOb, OBConversion* pConv) override;
     bool WriteMolecule(OBBase* pOb, OBConversion* pConv) override;
 
@@ -88,12 +97,23 @@ namespace OpenBabel
   /// Utility functions
   static void fixRhombohedralSpaceGroupWriter(string &strHM);
   static void fixRhombohedralSpaceGroupReader(string &strHM);
-  static bool parseAtomRecord(char *buffer, OBMol & mol, int chainNum);
-  static bool parseConectRecord(char *buffer, OBMol & mol);
+  struct PDBLookup;
+  static bool parseAtomRecord(char *buffer, OBMol & mol, int chainNum, PDBLookup &lookup);
+  static bool parseConectRecord(char *buffer, OBMol & mol, PDBLookup &lookup, bool partial);
   static bool readIntegerFromRecord(char *buffer, unsigned int columnAsSpecifiedInPDB, long int *target);
 
   //extern OBResidueData    resdat; now in mol.h
 
+  //! Residues and atoms of the molecule being read, indexed so that
+  //! each record is parsed in constant or logarithmic time
+  struct PDBLookup
+  {
+    //! Residues, by name, number, segment, chain and insertion code
+    std::map<std::string, OBResidue*> residues;
+    //! The first atom with each serial number, for CONECT records
+    std::map<long int, OBAtom*> serials;
+  };
+
   /////////////////////////////////////////////////////////////////
  	int PDBFormat::SkipObjects(int n, OBConversion* pConv)
   {
@@ -101,10 +121,36 @@ namespace OpenBabel
       ++ n;
     istream &ifs = *pConv->GetInStream();
     char buffer[BUFF_SIZE];
+    if (pConv->IsOption("T",OBConversion::INOPTIONS)) {
+      // A chain ends at a TER, ENDMDL or END record after some atoms
+      bool atoms = false;
+      while (n && ifs.getline(buffer,BUFF_SIZE))
+        {
+          if (EQn(buffer,"ATOM",4) || EQn(buffer,"HETATM",6))
+            atoms = true;
+          else if (atoms && EQn(buffer,"END",3)) {
+            atoms = false;
+            -- n;
+          }
+          else if (atoms && EQn(buffer,"TER",3)) {
+            atoms = false;
+            -- n;
+          }
+        }
+      return ifs.good() ? 1 : -1;
+    }
+    // Like ReadMolecule(), an END or ENDMDL record ends a molecule unless
+    // there is nothing in front of it
+    bool started = false;
     while (n && ifs.getline(buffer,BUFF_SIZE))
       {
-        if (EQn(buffer,"ENDMDL",6))
-          -- n;
+        if (EQn(buffer,"END",3)) {
+          if (started)
+            -- n;
+          started = false;
+        }
+        else if (buffer[strspn(buffer," \t\r")] != '\0')
+          started = true;
       }
 
     return ifs.good() ? 1 : -1;
@@ -140,27 +186,37 @@ namespace OpenBabel
     // we are adding residues from the PDB file
     mol.SetChainsPerceived();
 
+    // With the T option each chain is a molecule, and models which have
+    // no atoms left after their last TER record are passed over
+    bool perChain = pConv->IsOption("T",OBConversion::INOPTIONS) != nullptr;
+    PDBLookup lookup;
+
     mol.BeginModify();
     bool ateend = false;
+    bool started = false; // read anything but whitespace
     while (ifs.good() && ifs.getline(buffer,BUFF_SIZE))
       {
-        if (EQn(buffer,"ENDMDL",6)) {
-          ateend = true;
-          break;
-        }
         if (EQn(buffer,"END",3)) {
-          // eat anything until the next ENDMDL
-          while (ifs.getline(buffer,BUFF_SIZE) && !EQn(buffer,"ENDMDL",6));
+          // An END or ENDMDL record ends the molecule. One with nothing in
+          // front of it, like the ENDMDL after an END, is passed over.
+          if (!started || (perChain && !mol.NumAtoms()))
+            continue;
           ateend = true;
           break;
         }
+        if (!started && buffer[strspn(buffer," \t\r")] != '\0')
+          started = true;
         if (EQn(buffer,"TER",3)) {
           chainNum++;
+          if (perChain && mol.NumAtoms()) {
+            ateend = true;
+            break;
+          }
           continue;
         }
         if (EQn(buffer,"ATOM",4) || EQn(buffer,"HETATM",6))
           {
-            if( ! parseAtomRecord(buffer,mol,chainNum))
+            if( ! parseAtomRecord(buffer,mol,chainNum,lookup))
               {
                 stringstream errorMsg;
                 errorMsg << "WARNING: Problems reading a PDB file\n"
@@ -173,7 +229,7 @@ namespace OpenBabel
         if (EQn(buffer,"CONECT",6)) {
           // Don't parse a CONECT record if the user tells us to ignore them
           if (!pConv->IsOption("c",OBConversion::INOPTIONS)) {
-            parseConectRecord(buffer,mol);
+            parseConectRecord(buffer,mol,lookup,perChain);
             continue;
           }
         }
@@ -232,7 +288,9 @@ namespace OpenBabel
 
     if (!mol.NumAtoms()) { // skip the rest of this processing
       mol.EndModify();
-      return ateend; //explicitly empty molecules are not invalid
+      //explicitly empty molecules are not invalid, except that when
+      //reading chains there is nothing after the last one
+      return ateend && !perChain;
     }
 
     resdat.AssignBonds(mol);
@@ -328,7 +386,7 @@ namespace OpenBabel
     Hydrogen bonds and salt bridges are ignored. --Stefan Kebekus.
   */
 
-  bool parseConectRecord(char *buffer,OBMol &mol)
+  bool parseConectRecord(char *buffer,OBMol &mol,PDBLookup &lookup,bool partial)
   {
     stringstream errorMsg;
     string clearError;
@@ -394,21 +452,15 @@ namespace OpenBabel
           }
       }
 
-    vector<OBAtom*>::iterator i;
-    for (OBAtom *a1 = mol.BeginAtom(i);a1;a1 = mol.NextAtom(i)) {
-      // atoms may not have residue information, but if they do,
-      // check serial numbers
-      if (a1->GetResidue() != nullptr &&
-          static_cast<long int>(a1->GetResidue()->
-                                GetSerialNum(a1)) == startAtomSerialNumber)
-        {
-          firstAtom = a1;
-          break;
-        }
-    }
+    map<long int, OBAtom*>::iterator found = lookup.serials.find(startAtomSerialNumber);
+    if (found != lookup.serials.end())
+      firstAtom = found->second;
 
     if (firstAtom == nullptr)
       {
+        // When reading a chain at a time, the atom may be in another chain
+        if (partial)
+          return(false);
         errorMsg << "WARNING: Problems reading a PDB file:\n"
                  << "  Problems reading a CONECT record.\n"
                  << "  According to the PDB specification,\n"
@@ -453,18 +505,13 @@ namespace OpenBabel
       {
         // Find atom that is connected to, write an error message
         OBAtom *connectedAtom = nullptr;
-        for (OBAtom *a1 = mol.BeginAtom(i);a1;a1 = mol.NextAtom(i)) {
-          // again, atoms may not have residues, but if they do, check serials
-          if (a1->GetResidue() != nullptr &&
-              static_cast<long int>(a1->GetResidue()->
-                                    GetSerialNum(a1)) == boundedAtomsSerialNumbers[k])
-            {
-              connectedAtom = a1;
-              break;
-            }
-        }
+        found = lookup.serials.find(boundedAtomsSerialNumbers[k]);
+        if (found != lookup.serials.end())
+          connectedAtom = found->second;
         if (connectedAtom == nullptr)
           {
+            if (partial)
+              return(false);
             errorMsg << "WARNING: Problems reading a PDB file:\n"
                      << "  Problems reading a CONECT record.\n"
                      << "  According to the PDB specification,\n"
@@ -894,7 +941,7 @@ namespace OpenBabel
 	77 - 78        LString(2)      Element symbol, right-justified.
 	79 - 80        LString(2)      Charge on the atom.
   */
-  static bool parseAtomRecord(char *buffer, OBMol &mol,int /*chainNum*/)
+  static bool parseAtomRecord(char *buffer, OBMol &mol,int /*chainNum*/, PDBLookup &lookup)
   /* ATOMFORMAT "(i5,1x,a4,a1,a3,1x,a1,i4,a1,3x,3f8.3,2f6.2,a2,a2)" */
   {
     string sbuf = &buffer[6];
@@ -1082,44 +1129,37 @@ namespace OpenBabel
       } // HETATM records
     } // no element column to use
 
-    OBAtom atom;
     /* X, Y, Z */
     string xstr = sbuf.substr(24,8);
     string ystr = sbuf.substr(32,8);
     string zstr = sbuf.substr(40,8);
     vector3 v(atof(xstr.c_str()),atof(ystr.c_str()),atof(zstr.c_str()));
-    atom.SetVector(v);
 
     double occupancy = atof(sbuf.substr(48, 6).c_str());
-    OBPairFloatingPoint* occup = new OBPairFloatingPoint;
-    occup->SetAttribute("_atom_site_occupancy");
     if (occupancy <= 0.0 || occupancy > 1.0){
       occupancy = 1.0;
     }
-    occup->SetValue(occupancy);
-    occup->SetOrigin(fileformatInput);
-    atom.SetData(occup);
 
     // useful for debugging unknown atom types (e.g., PR#1577238)
     //    cout << mol.NumAtoms() + 1  << " : '" << element << "'" << " " << OBElements::GetAtomicNum(element.c_str()) << endl;
+    unsigned int atomic_num;
     if (elementFound)
-      atom.SetAtomicNum(OBElements::GetAtomicNum(element.c_str()));
+      atomic_num = OBElements::GetAtomicNum(element.c_str());
     else { // use our old-style guess from athe atom type
-      unsigned int atomic_num = OBElements::GetAtomicNum(type.c_str());
+      atomic_num = OBElements::GetAtomicNum(type.c_str());
       if (atomic_num ==  0) { //try one character if two character element not found
         type = type.substr(0,1);
         atomic_num = OBElements::GetAtomicNum(type.c_str());
       }
-      atom.SetAtomicNum(atomic_num);
     }
 
+    int formal_charge = 0;
     if ( (! scharge.empty()) && "  " != scharge )
       {
         if ( isdigit(scharge[0]) && ('+' == scharge[1] || '-' == scharge[1]) )
           {
             const char reorderCharge[3] = { scharge[1], scharge[0], '\0' };
-            const int charge = atoi(reorderCharge);
-            atom.SetFormalCharge(charge);
+            formal_charge = atoi(reorderCharge);
           }
         else
           {
@@ -1132,9 +1172,6 @@ namespace OpenBabel
             obErrorLog.ThrowError(__FUNCTION__, errorMsg.str(), obWarning);
           }
       }
-    else {
-      atom.SetFormalCharge(0);
-    }
 
     /* residue sequence number */
     string resnum = sbuf.substr(16,4);
@@ -1146,39 +1183,42 @@ namespace OpenBabel
         || res->GetInsertionCode() != insertioncode
         || res->GetSegName() != segname)
       {
-        vector<OBResidue*>::iterator ri;
-        for (res = mol.BeginResidue(ri) ; res ; res = mol.NextResidue(ri))
-          if (res->GetName() == resname
-              && res->GetNumString() == resnum
-              && static_cast<int>(res->GetChain()) == chain
-              && static_cast<int>(res->GetInsertionCode()) == insertioncode
-              && res->GetSegName() == segname) {
-            if (insertioncode) fprintf(stderr,"I: identified residue wrt insertion code: '%c'\n",insertioncode);
-            break;
-          }
-
-        if (res == nullptr) {
+        string key = resname + '\n' + resnum + '\n' + segname + '\n' + chain + insertioncode;
+        map<string, OBResidue*>::iterator found = lookup.residues.find(key);
+        if (found != lookup.residues.end()) {
+          res = found->second;
+          if (insertioncode) fprintf(stderr,"I: identified residue wrt insertion code: '%c'\n",insertioncode);
+        }
+        else {
           res = mol.NewResidue();
           res->SetChain(chain);
           res->SetName(resname);
           res->SetNum(resnum);
           res->SetInsertionCode(insertioncode);
           res->SetSegName(segname);
+          lookup.residues.insert(make_pair(key, res));
         }
       }
 
-    if (!mol.AddAtom(atom))
-      return(false);
-    else {
-      OBAtom *atom = mol.GetAtom(mol.NumAtoms());
+    OBAtom *atom = mol.NewAtom();
+    atom->SetVector(v);
+    atom->SetAtomicNum(atomic_num);
+    atom->SetFormalCharge(formal_charge);
+
+    OBPairFloatingPoint* occup = new OBPairFloatingPoint;
+    occup->SetAttribute("_atom_site_occupancy");
+    occup->SetValue(occupancy);
+    occup->SetOrigin(fileformatInput);
+    atom->SetData(occup);
 
-      res->AddAtom(atom);
-      res->SetSerialNum(atom, atoi(serno.c_str()));
-      res->SetAtomID(atom, sbuf.substr(6,4));
-      res->SetHetAtom(atom, hetatm);
+    unsigned int serial = atoi(serno.c_str());
+    res->AddAtom(atom);
+    res->SetSerialNum(atom, serial);
+    res->SetAtomID(atom, sbuf.substr(6,4));
+    res->SetHetAtom(atom, hetatm);
+    lookup.serials.insert(make_pair(static_cast<long int>(serial), atom));
 
-      return(true);
-    }
+    return(true);
   } // end reading atom records
 
 } //namespace OpenBabel
@@ -106,6 +106,8 @@ namespace OpenBabel {
         }
       return ifs ? 1 : -1;
     }
+
+    const char* RecordTerminator() override { return ""; }
   private:
     bool GetInchifiedSMILESMolecule(OBMol *mol, bool useFixedHRecMet);
   };
@@ -319,7 +321,10 @@ namespace OpenBabel {
     ~OBSmilesParser() { }
 
     bool SmiToMol(OBMol&,const string&);
+    bool SmiToMol(OBMol&,const char*);
     bool ParseSmiles(OBMol&, const string&);
+    bool ParseSmiles(OBMol&, const char*);
+    void ReserveStorage(OBMol&, const char*);
     bool ParseSimple(OBMol&);
     bool ParseComplex(OBMol&);
     bool ParseRingBond(OBMol&);
@@ -349,8 +354,10 @@ namespace OpenBabel {
     OBMol* pmol = pOb->CastAndClear<OBMol>();
 
     istream &ifs = *pConv->GetInStream();
-    string ln, smiles, title;
-    string::size_type pos;
+    // The line buffer is kept between calls so that reading a large file
+    // does not allocate for every record
+    static THREAD_LOCAL string ln;
+    ln.clear();
 
     //Ignore lines that start with #
     while(ifs && ifs.peek()=='#')
@@ -358,18 +365,27 @@ namespace OpenBabel {
         return false;
 
     //Get title
+    //The SMILES and the title are split in place rather than copied out
+    const char *smiles = "";
     if(getline(ifs, ln))
     {
-      pos = ln.find_first_of(" \t");
-      if(pos!=string::npos)
+      char *buf = &ln[0];
+      char *end = buf + ln.size();
+      char *p = buf;
+      while(p != end && *p != ' ' && *p != '\t')
+        ++p;
+      if(p != end)
       {
-        smiles = ln.substr(0,pos);
-        title = ln.substr(pos+1);
-        Trim(title);
-        pmol->SetTitle(title.c_str());
+        *p++ = '\0';
+        // Trim the title
+        while(p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+          ++p;
+        while(end != p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r'))
+          --end;
+        *end = '\0';
+        pmol->SetTitle(p);
       }
-      else
-        smiles = ln;
+      smiles = buf;
     }
 
     pmol->SetDimension(0);
@@ -383,6 +399,12 @@ namespace OpenBabel {
   //////////////////////////////////////////////
 
   bool OBSmilesParser::SmiToMol(OBMol &mol,const string &s)
+  {
+    return SmiToMol(mol, s.c_str());
+  }
+
+  //! Parse the NUL-terminated SMILES string \p s into \p mol without copying it
+  bool OBSmilesParser::SmiToMol(OBMol &mol,const char *s)
   {
     _vprev.clear();
     _rclose.clear();
@@ -414,11 +436,42 @@ namespace OpenBabel {
   }
 
   bool OBSmilesParser::ParseSmiles(OBMol &mol, const std::string &smiles)
+  {
+    return ParseSmiles(mol, smiles.c_str());
+  }
+
+  //! Make room for the atoms and bonds of \p smiles up front.
+  //! The counts come from a quick scan of the string and only need to be
+  //! upper bounds: every letter outside brackets, plus every bracket atom,
+  //! is taken as an atom, and every ring-closure digit as an extra bond.
+  void OBSmilesParser::ReserveStorage(OBMol &mol, const char *smiles)
+  {
+    int natoms = 0, nclosures = 0;
+    for (const char *p = smiles; *p; ++p) {
+      if (*p == '[') {
+        ++natoms;
+        while (*p && *p != ']')
+          ++p;
+        if (!*p)
+          break;
+      }
+      else if (isalpha((unsigned char)*p) || *p == '*')
+        ++natoms;
+      else if (isdigit((unsigned char)*p))
+        ++nclosures;
+    }
+    mol.ReserveAtoms(natoms);
+    mol.ReserveBonds(natoms + nclosures / 2);
+    _hcount.reserve(natoms);
+  }
+
+  bool OBSmilesParser::ParseSmiles(OBMol &mol, const char *smiles)
   {
     mol.SetAromaticPerceived(); // Turn off perception until the end of this function
     mol.BeginModify();
+    ReserveStorage(mol, smiles);
 
-    for (_ptr=smiles.c_str();*_ptr;_ptr++)
+    for (_ptr=smiles;*_ptr;_ptr++)
     {
       switch(*_ptr)
       {
@@ -563,7 +616,10 @@ namespace OpenBabel {
     }
 
     // Apply the SMILES valence model
+    bool has_aromatic_atoms = false;
     FOR_ATOMS_OF_MOL(atom, mol) {
+      if (atom->IsAromatic())
+        has_aromatic_atoms = true;
       unsigned int idx = atom->GetIdx();
       int hcount = _hcount[idx - 1];
       if (hcount == -1) { // Apply SMILES implicit valence model
@@ -592,8 +648,8 @@ namespace OpenBabel {
       }
     }
 
-    // TODO: Only Kekulize if the molecule has a lower case atom
-    bool ok = OBKekulize(&mol);
+    // Only Kekulize if the molecule has a lower case atom
+    bool ok = !has_aromatic_atoms || OBKekulize(&mol);
     if (!ok) {
       stringstream errorMsg;
       errorMsg << "Failed to kekulize aromatic SMILES";
@@ -760,6 +816,12 @@ namespace OpenBabel {
 
   void OBSmilesParser::CreateCisTrans(OBMol &mol)
   {
+    // Without any '/' or '\' there is nothing to do. Returning here also
+    // avoids the aromaticity perception triggered by IsAromatic() below,
+    // which is left for whoever needs it later.
+    if (_upDownMap.empty())
+      return;
+
     // Create a vector of CisTransStereo objects for the molecule
     FOR_BONDS_OF_MOL(dbi, mol) {
 
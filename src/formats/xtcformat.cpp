@@ -20,26 +20,16 @@
 #include <openbabel/babelconfig.h>
 #include <openbabel/obmolecformat.h>
 #include <openbabel/mol.h>
+#include <openbabel/atom.h>
 
- // This include is not necessary for VS2017
-#if defined(_MSC_VER) && _MSC_VER <= 1910
-#include <rpc/types.h>
-#endif
-#include <rpc/xdr.h>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
 #include <vector>
 
-#define MAXID 20
-#define MAXABS INT_MAX-2
-
-#ifndef MIN
-#define MIN(x,y) ((x) < (y) ? (x):(y))
-#endif
 #ifndef MAX
 #define MAX(x,y) ((x) > (y) ? (x):(y))
 #endif
-#ifndef SQR
-#define SQR(x) ((x)*(x))
-#endif
 
 #define FIRSTIDX 9
 /* note that magicints[FIRSTIDX-1] == 0 */
@@ -48,28 +38,46 @@
 namespace OpenBabel
 {
 
-  class XTCFormat : public OBMoleculeFormat
+  //! The header of an XTC frame
+  struct XTCFrame
+  {
+    int natoms;
+    int step;
+    float time;
+    float box[3][3];
+  };
+
+  //! \brief Reads the frames of an XTC file from a stream
+  //!
+  //! The XDR encoding is decoded directly (big-endian 4-byte words, opaque
+  //! data padded to 4 bytes), so no RPC library is needed. All the decoding
+  //! state is held here rather than in the format, so separate conversions
+  //! can read XTC files at the same time.
+  class XTCReader
   {
+  public:
+    XTCReader(std::istream &ifs) : _ifs(ifs) {}
+
+    //! Read the header of the next frame.
+    //! \return false at the end of the input or if it is not an XTC frame
+    bool ReadHeader(XTCFrame &frame);
+    //! Decompress the coordinates (in nm) of a frame of \p natoms atoms
+    bool ReadCoords(int natoms, std::vector<float> &coords);
+    //! Move past the coordinates of a frame without decompressing them
+    bool SkipCoords(int natoms);
+
   private:
-    XDR 	xd;
-    FILE*	xdrfiles[MAXID];
-    XDR*	xdridptr[MAXID];
-    char 	xdrmodes[MAXID];
-    unsigned int cnt;
-
-    static int magicints[]; // defined below
-    int	xdropen(XDR *xdrs, const char *filename, const char *type);
-    int	xdrclose(XDR *xdrs);
-    void	sendbits(int buf[], int num_of_bits, int num);
-    int	sizeofint(const int size);
-    int	sizeofints( const int num_of_ints, unsigned int sizes[]);
-    void	sendints(int buf[], const int num_of_ints, const int num_of_bits,
-                   unsigned int sizes[], unsigned int nums[]);
-    int	receivebits(int buf[], int num_of_bits);
-    void	receiveints(int buf[], const int num_of_ints, int num_of_bits,
-                      unsigned int sizes[], int nums[]);
-    int	xdr3dfcoord(XDR *xdrs, float *fp, int *size, float *precision);
+    bool ReadInt(int &value);
+    bool ReadFloat(float &value);
+    bool Skip(std::streamoff n);
+
+    std::istream &_ifs;
+    std::vector<int> _ip;  //!< integer coordinates of the frame
+    std::vector<int> _buf; //!< 3 words of bit reader state, then the compressed bytes
+  };
 
+  class XTCFormat : public OBMoleculeFormat
+  {
   public:
     //Register this format type ID
     XTCFormat()
@@ -81,7 +89,15 @@ namespace OpenBabel
     {
       return
         "XTC format\n"
-        "A portable format for trajectories (gromacs)\n";
+        "A portable format for trajectories (gromacs)\n\n"
+        "XTC files hold only coordinates. When read into a molecule which\n"
+        "already has its atoms (e.g. from a .gro or .pdb file of the same\n"
+        "system), all the remaining frames are added as conformers.\n"
+        "Otherwise each frame is read as a separate molecule with dummy\n"
+        "atoms, so -f and -l select frames and only one frame is held in\n"
+        "memory at a time.\n\n"
+        "Read Options e.g. -aF\n"
+        "  F  Read one frame at a time into a molecule which has its atoms\n\n";
     }
 
     const char* SpecificationURL() override
@@ -93,9 +109,11 @@ namespace OpenBabel
     // NOTREADABLE  READONEONLY  NOTWRITABLE  WRITEONEONLY
     unsigned int Flags() override
     {
-      return NOTWRITABLE;
+      return READBINARY | NOTWRITABLE;
     }
 
+    int SkipObjects(int n, OBConversion* pConv) override;
+
     //*** This section identical for most OBMol conversions ***
     ////////////////////////////////////////////////////
     /// The "API" interface functions
@@ -104,17 +122,6 @@ namespace OpenBabel
   };
   //***
 
-  // define the static magicints
-  int XTCFormat::magicints[] = {
-    0, 0, 0, 0, 0, 0, 0, 0, 0,
-    8, 10, 12, 16, 20, 25, 32, 40, 50, 64,
-    80, 101, 128, 161, 203, 256, 322, 406, 512, 645,
-    812, 1024, 1290, 1625, 2048, 2580, 3250, 4096, 5060, 6501,
-    8192, 10321, 13003, 16384, 20642, 26007, 32768, 41285, 52015, 65536,
-    82570, 104031, 131072, 165140, 208063, 262144, 330280, 416127, 524287, 660561,
-    832255, 1048576, 1321122, 1664510, 2097152, 2642245, 3329021, 4194304, 5284491, 6658042,
-    8388607, 10568983, 13316085, 16777216 };
-
   //Make an instance of the format class
   XTCFormat theXTCFormat;
 
@@ -127,78 +134,60 @@ namespace OpenBabel
       return false;
 
     OBMol &mol = *pmol;
-    std::string filename = pConv->GetInFilename();
+    XTCReader reader(*pConv->GetInStream());
 
-    if (xdropen(&xd, filename.c_str(),"r") == 0) {
-      std::stringstream errorMsg;
-      errorMsg << "Error while opening " << filename << " for reading.";
-      obErrorLog.ThrowError(__FUNCTION__, errorMsg.str(), obWarning);
-      return false;
-    }
+    // Without a topology, or when asked to, deliver one frame per object
+    bool oneFrame = mol.NumAtoms() == 0 || pConv->IsOption("F", OBConversion::INOPTIONS);
 
-    int magic, natoms, step;
-    float prec = 1000.0;
-    float time, box[3][3];
+    XTCFrame frame;
     std::vector<float> floatCoord;
     std::vector<double*> vconf;
 
-
-    while (true) {
-      // Check the magic int starting each frame
-      xdr_int(&xd, &magic);
-      if (magic != 1995) {
-        std::stringstream errorMsg;
-        errorMsg << "Error: magic int is " << magic << ", should be 1995.";
-        obErrorLog.ThrowError(__FUNCTION__, errorMsg.str(), obWarning);
-        return false;
+    while (reader.ReadHeader(frame)) {
+      if (mol.NumAtoms() == 0) {
+        // The atoms are not known, so make dummy ones
+        mol.BeginModify();
+        mol.ReserveAtoms(frame.natoms);
+        for (int i = 0; i < frame.natoms; ++i)
+          mol.NewAtom();
+        mol.EndModify();
+        char title[64];
+        snprintf(title, sizeof(title), "t= %.5f step= %d", frame.time, frame.step);
+        mol.SetTitle(title);
       }
 
-      // Get the number of atoms
-      xdr_int(&xd, &natoms);
-      if (natoms != mol.NumAtoms()) {
+      if (frame.natoms != static_cast<int>(mol.NumAtoms())) {
         std::stringstream errorMsg;
-        errorMsg << "Error: number of atoms in the trajectory (" << natoms
+        errorMsg << "Error: number of atoms in the trajectory (" << frame.natoms
                  << ") doesn't match the number of atoms in the supplied "
                  << "molecule (" << mol.NumAtoms() << ").";
         obErrorLog.ThrowError(__FUNCTION__, errorMsg.str(), obWarning);
+        for (size_t i = 0; i < vconf.size(); ++i)
+          delete [] vconf[i];
         return false;
       }
 
-      // Get the frame step number
-      xdr_int(&xd, &step);
-      // Get the frame time
-      xdr_float(&xd, &time);
-      // Get the frame box
-      xdr_float(&xd, &box[0][0]);
-      xdr_float(&xd, &box[0][1]);
-      xdr_float(&xd, &box[0][2]);
-      xdr_float(&xd, &box[1][0]);
-      xdr_float(&xd, &box[1][1]);
-      xdr_float(&xd, &box[1][2]);
-      xdr_float(&xd, &box[2][0]);
-      xdr_float(&xd, &box[2][1]);
-      xdr_float(&xd, &box[2][2]);
-
-      if (!floatCoord.size())
-        floatCoord.resize(natoms * 3);
-
       // Read the positions
-      if (xdr3dfcoord(&xd, &floatCoord[0], &natoms, &prec) == 0) {
-        // printf("end reached...\n");
-        break;
+      if (!reader.ReadCoords(frame.natoms, floatCoord)) {
+        obErrorLog.ThrowError(__FUNCTION__, "Error: the XTC frame is incomplete.", obWarning);
+        for (size_t i = 0; i < vconf.size(); ++i)
+          delete [] vconf[i];
+        return false;
       }
 
       // Convert positions from single to double precision and convert from
       // nm to A
-      double *confs = new double[natoms *3];
-      for (int i=0; i < natoms * 3; ++i) // unroll??
-        confs[i] = static_cast<double>(10.0 * floatCoord.at(i));
+      double *confs = new double[frame.natoms * 3];
+      for (int i = 0; i < frame.natoms * 3; ++i)
+        confs[i] = static_cast<double>(10.0 * floatCoord[i]);
 
       vconf.push_back(confs);
+      if (oneFrame)
+        break;
     }
 
-    // Close the XDR file
-    xdrclose(&xd);
+    if (vconf.empty())
+      return false;
 
     // Set the conformers in the mol object
     mol.SetConformers(vconf);
@@ -206,184 +195,116 @@ namespace OpenBabel
     return(true);
   }
 
-  /*____________________________________________________________________________
-    |
-    | libxdrf - portable fortran interface to xdr. some xdr routines
-    |	     are C routines for compressed coordinates
-    |
-    | version 1.1
-    |
-    | This collection of routines is intended to write and read
-    | data in a portable way to a file, so data written on one type
-    | of machine can be read back on a different type.
-    | ________________________________________________________________________
-    |
-    | Below are the routines to be used by C programmers. Use the 'normal'
-    | xdr routines to write integers, floats, etc (see man xdr)
-    |
-    | int xdropen(XDR *xdrs, const char *filename, const char *type)
-    |	This will open the file with the given filename and the
-    |	given mode. You should pass it an allocated XDR struct
-    |	in xdrs, to be used in all other calls to xdr routines.
-    |	Mode is 'w' to create, or update an file, and for all
-    |	other values of mode the file is opened for reading.
-    |	You need to call xdrclose to flush the output and close
-    |	the file.
-    |
-    |	Note that you should not use xdrstdio_create, which
-    |	comes with the standard xdr library.
-    |
-    | int xdrclose(XDR *xdrs)
-    |	Flush the data to the file, and close the file;
-    |	You should not use xdr_destroy (which comes standard
-    |	with the xdr libraries).
-    |
-    | int xdr3dfcoord(XDR *xdrs, float *fp, int *size, float *precision)
-    |	This is \fInot\fR a standard xdr routine. I named it this
-    |	way, because it invites people to use the other xdr
-    |	routines.
-    |
-    |	frans van hoesel hoesel@chem.rug.nl
-  */
-
-
-  /*___________________________________________________________________________
-    |
-    | what follows are the C routines for opening, closing xdr streams
-    | and the routine to read/write compressed coordinates together
-    | with some routines to assist in this task (those are marked
-    | static and cannot be called from user programs)
-  */
-
-  /*__________________________________________________________________________
-    |
-    | xdropen - open xdr file
-    |
-    | This versions differs from xdrstdio_create, because I need to know
-    | the state of the file (read or write) so I can use xdr3dfcoord
-    | in eigther read or write mode, and the file descriptor
-    | so I can close the file (something xdr_destroy doesn't do).
-    |
-  */
-
-  int XTCFormat::xdropen(XDR *xdrs, const char *filename, const char *type) {
-    int init_done = 0;
-    enum xdr_op lmode;
-    int xdrid;
-
-    if (init_done == 0) {
-      for (xdrid = 1; xdrid < MAXID; xdrid++) {
-        xdridptr[xdrid] = nullptr;
-      }
-      init_done = 1;
-    }
-    xdrid = 1;
-    while (xdrid < MAXID && xdridptr[xdrid] != nullptr) {
-      xdrid++;
-    }
-    if (xdrid == MAXID) {
-      return 0;
-    }
-    if (*type == 'w' || *type == 'W') {
-	    type = "w+";
-	    lmode = XDR_ENCODE;
-    } else {
-	    type = "r";
-	    lmode = XDR_DECODE;
-    }
-    xdrfiles[xdrid] = fopen(filename, type);
-    if (xdrfiles[xdrid] == nullptr) {
-      xdrs = nullptr;
-      return 0;
-    }
-    xdrmodes[xdrid] = *type;
-    /* next test isn't useful in the case of C language
-     * but is used for the Fortran interface
-     * (C users are expected to pass the address of an already allocated
-     * XDR staructure)
-     */
-    if (xdrs == nullptr) {
-      xdridptr[xdrid] = (XDR *) calloc(1,sizeof(XDR));
-      xdrstdio_create(xdridptr[xdrid], xdrfiles[xdrid], lmode);
-    } else {
-      xdridptr[xdrid] = xdrs;
-      xdrstdio_create(xdrs, xdrfiles[xdrid], lmode);
+  /////////////////////////////////////////////////////////////////
+  int XTCFormat::SkipObjects(int n, OBConversion* pConv)
+  {
+    // Each frame records the size of its compressed coordinates, so frames
+    // are skipped by reading only their headers
+    if (n == 0)
+      n++;
+    XTCReader reader(*pConv->GetInStream());
+    XTCFrame frame;
+    for (; n > 0; --n) {
+      if (!reader.ReadHeader(frame) || !reader.SkipCoords(frame.natoms))
+        return -1;
     }
-    return xdrid;
+    return 1;
   }
 
-  /*_________________________________________________________________________
-    |
-    | xdrclose - close a xdr file
-    |
-    | This will flush the xdr buffers, and destroy the xdr stream.
-    | It also closes the associated file descriptor (this is *not*
-    | done by xdr_destroy).
-    |
-  */
+  /////////////////////////////////////////////////////////////////
+  bool XTCReader::ReadInt(int &value)
+  {
+    unsigned char b[4];
+    if (!_ifs.read(reinterpret_cast<char*>(b), 4))
+      return false;
+    value = static_cast<int>((static_cast<unsigned int>(b[0]) << 24) | (b[1] << 16) | (b[2] << 8) | b[3]);
+    return true;
+  }
 
-  int XTCFormat::xdrclose(XDR *xdrs) {
-    int xdrid;
+  bool XTCReader::ReadFloat(float &value)
+  {
+    int i;
+    if (!ReadInt(i))
+      return false;
+    memcpy(&value, &i, sizeof(value));
+    return true;
+  }
 
-    if (xdrs == nullptr) {
-      fprintf(stderr, "xdrclose: passed a NULL pointer\n");
-      return 0;
-    }
-    for (xdrid = 1; xdrid < MAXID; xdrid++) {
-      if (xdridptr[xdrid] == xdrs) {
+  bool XTCReader::Skip(std::streamoff n)
+  {
+    // Seek if possible, but a pipe can only be read through
+    std::streampos pos = _ifs.tellg();
+    if (pos != std::streampos(-1) && _ifs.seekg(pos + n))
+      return true;
+    _ifs.clear();
+    _ifs.ignore(n);
+    return _ifs.gcount() == n;
+  }
 
-        xdr_destroy(xdrs);
-        fclose(xdrfiles[xdrid]);
-        xdridptr[xdrid] = nullptr;
-        return 1;
-      }
+  bool XTCReader::ReadHeader(XTCFrame &frame)
+  {
+    // Check the magic int starting each frame
+    int magic;
+    if (!ReadInt(magic))
+      return false; // end of the file
+    if (magic != 1995) {
+      std::stringstream errorMsg;
+      errorMsg << "Error: magic int is " << magic << ", should be 1995.";
+      obErrorLog.ThrowError("ReadMolecule", errorMsg.str(), obWarning);
+      return false;
     }
-    fprintf(stderr, "xdrclose: no such open xdr file\n");
-    return 0;
 
+    // The number of atoms, the step number, the time and the box
+    if (!ReadInt(frame.natoms) || !ReadInt(frame.step) || !ReadFloat(frame.time))
+      return false;
+    for (int i = 0; i < 3; ++i)
+      for (int j = 0; j < 3; ++j)
+        if (!ReadFloat(frame.box[i][j]))
+          return false;
+    return frame.natoms >= 0;
+  }
+
+  bool XTCReader::SkipCoords(int natoms)
+  {
+    int lsize, nbytes;
+    if (!ReadInt(lsize) || lsize != natoms)
+      return false;
+    if (lsize <= 9) // stored uncompressed
+      return Skip(static_cast<std::streamoff>(lsize) * 3 * 4);
+    // precision, minint[3], maxint[3] and smallidx precede the byte count
+    if (!Skip(8 * 4) || !ReadInt(nbytes) || nbytes < 0)
+      return false;
+    return Skip((static_cast<std::streamoff>(nbytes) + 3) & ~3);
   }
 
   /*____________________________________________________________________________
     |
-    | sendbits - encode num into buf using the specified number of bits
+    | libxdrf - portable fortran interface to xdr. some xdr routines
+    |	     are C routines for compressed coordinates
+    |
+    | version 1.1
+    |
+    | This collection of routines is intended to write and read
+    | data in a portable way to a file, so data written on one type
+    | of machine can be read back on a different type.
+    | ________________________________________________________________________
     |
-    | This routines appends the value of num to the bits already present in
-    | the array buf. You need to give it the number of bits to use and you
-    | better make sure that this number of bits is enough to hold the value
-    | Also num must be positive.
+    | Only the decompression of coordinates is used here, in
+    | XTCReader::ReadCoords (xdr3dfcoord in libxdrf). The XDR
+    | integers and floats around it are read by XTCReader itself.
     |
+    |	frans van hoesel hoesel@chem.rug.nl
   */
 
-  void XTCFormat::sendbits(int buf[], int num_of_bits, int num) {
-
-    unsigned int cnt, lastbyte;
-    int lastbits;
-    unsigned char * cbuf;
-
-    cbuf = ((unsigned char *)buf) + 3 * sizeof(*buf);
-    cnt = (unsigned int) buf[0];
-    lastbits = buf[1];
-    lastbyte =(unsigned int) buf[2];
-    while (num_of_bits >= 8) {
-      lastbyte = (lastbyte << 8) | ((num >> (num_of_bits -8)) /* & 0xff*/);
-      cbuf[cnt++] = lastbyte >> lastbits;
-      num_of_bits -= 8;
-    }
-    if (num_of_bits > 0) {
-      lastbyte = (lastbyte << num_of_bits) | num;
-      lastbits += num_of_bits;
-      if (lastbits >= 8) {
-        lastbits -= 8;
-        cbuf[cnt++] = lastbyte >> lastbits;
-      }
-    }
-    buf[0] = cnt;
-    buf[1] = lastbits;
-    buf[2] = lastbyte;
-    if (lastbits>0) {
-      cbuf[cnt] = lastbyte << (8 - lastbits);
-    }
-  }
+  static const int magicints[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0,
+    8, 10, 12, 16, 20, 25, 32, 40, 50, 64,
+    80, 101, 128, 161, 203, 256, 322, 406, 512, 645,
+    812, 1024, 1290, 1625, 2048, 2580, 3250, 4096, 5060, 6501,
+    8192, 10321, 13003, 16384, 20642, 26007, 32768, 41285, 52015, 65536,
+    82570, 104031, 131072, 165140, 208063, 262144, 330280, 416127, 524287, 660561,
+    832255, 1048576, 1321122, 1664510, 2097152, 2642245, 3329021, 4194304, 5284491, 6658042,
+    8388607, 10568983, 13316085, 16777216 };
 
   /*_________________________________________________________________________
     |
@@ -393,7 +314,7 @@ namespace OpenBabel
     |
   */
 
-  int XTCFormat::sizeofint(const int size) {
+  static int sizeofint(const int size) {
     unsigned int num = 1;
     int num_of_bits = 0;
 
@@ -416,7 +337,7 @@ namespace OpenBabel
     | So I don't need to call 'sizeofints for those calls.
   */
 
-  int XTCFormat::sizeofints( const int num_of_ints, unsigned int sizes[]) {
+  static int sizeofints( const int num_of_ints, unsigned int sizes[]) {
     int i, num;
     unsigned int num_of_bytes, num_of_bits, bytes[32], bytecnt, tmp;
     num_of_bytes = 1;
@@ -445,67 +366,6 @@ namespace OpenBabel
 
   }
 
-  /*____________________________________________________________________________
-    |
-    | sendints - send a small set of small integers in compressed format
-    |
-    | this routine is used internally by xdr3dfcoord, to send a set of
-    | small integers to the buffer.
-    | Multiplication with fixed (specified maximum ) sizes is used to get
-    | to one big, multibyte integer. Allthough the routine could be
-    | modified to handle sizes bigger than 16777216, or more than just
-    | a few integers, this is not done, because the gain in compression
-    | isn't worth the effort. Note that overflowing the multiplication
-    | or the byte buffer (32 bytes) is unchecked and causes bad results.
-    |
-  */
-
-  void XTCFormat::sendints(int buf[], const int num_of_ints, const int num_of_bits,
-                           unsigned int sizes[], unsigned int nums[]) {
-
-    int i;
-    unsigned int bytes[32], num_of_bytes, bytecnt, tmp;
-
-    tmp = nums[0];
-    num_of_bytes = 0;
-    do {
-      bytes[num_of_bytes++] = tmp & 0xff;
-      tmp >>= 8;
-    } while (tmp != 0);
-
-    for (i = 1; i < num_of_ints; i++) {
-      if (nums[i] >= sizes[i]) {
-        fprintf(stderr,"major breakdown in sendints num %d doesn't "
-                "match size %d\n", nums[i], sizes[i]);
-        return;
-      }
-      /* use one step multiply */
-      tmp = nums[i];
-      for (bytecnt = 0; bytecnt < num_of_bytes; bytecnt++) {
-        tmp = bytes[bytecnt] * sizes[i] + tmp;
-        bytes[bytecnt] = tmp & 0xff;
-        tmp >>= 8;
-      }
-      while (tmp != 0) {
-        bytes[bytecnt++] = tmp & 0xff;
-        tmp >>= 8;
-      }
-      num_of_bytes = bytecnt;
-    }
-    if (num_of_bits >= num_of_bytes * 8) {
-      for (i = 0; i < num_of_bytes; i++) {
-        sendbits(buf, 8, bytes[i]);
-      }
-      sendbits(buf, num_of_bits - num_of_bytes * 8, 0);
-    } else {
-      for (i = 0; i < num_of_bytes-1; i++) {
-        sendbits(buf, 8, bytes[i]);
-      }
-      sendbits(buf, num_of_bits- (num_of_bytes -1) * 8, bytes[i]);
-    }
-  }
-
-
   /*___________________________________________________________________________
     |
     | receivebits - decode number from buf using specified number of bits
@@ -515,7 +375,7 @@ namespace OpenBabel
     |
   */
 
-  int XTCFormat::receivebits(int buf[], int num_of_bits) {
+  static int receivebits(int buf[], int num_of_bits) {
     int cnt, num;
     unsigned int lastbits, lastbyte;
     unsigned char * cbuf;
@@ -558,7 +418,7 @@ namespace OpenBabel
     |
   */
 
-  void XTCFormat::receiveints(int buf[], const int num_of_ints, int num_of_bits,
+  static void receiveints(int buf[], const int num_of_ints, int num_of_bits,
                               unsigned int sizes[], int nums[]) {
     int bytes[32];
     int i, j, num_of_bytes, p, num;
@@ -587,14 +447,10 @@ namespace OpenBabel
 
   /*____________________________________________________________________________
     |
-    | xdr3dfcoord - read or write compressed 3d coordinates to xdr file.
+    | ReadCoords - read compressed 3d coordinates (xdr3dfcoord in libxdrf)
     |
-    | this routine reads or writes (depending on how you opened the file with
-    | xdropen() ) a large number of 3d coordinates (stored in *fp).
-    | The number of coordinates triplets to write is given by *size. On
-    | read this number may be zero, in which case it reads as many as were written
-    | or it may specify the number if triplets to read (which should match the
-    | number written).
+    | this routine reads a large number of 3d coordinates into coords.
+    | The number of coordinate triplets must match the number written.
     | Compression is achieved by first converting all floating numbers to integer
     | using multiplication by *precision and rounding to the nearest integer.
     | Then the minimum and maximum value are calculated to determine the range.
@@ -612,448 +468,168 @@ namespace OpenBabel
     |
   */
 
-  int XTCFormat::xdr3dfcoord(XDR *xdrs, float *fp, int *size, float *precision) {
-    int *ip = nullptr;
-    int oldsize = 0;
-    int *buf = nullptr;
-
-    int minint[3], maxint[3], mindiff, *lip, diff;
-    int lint1, lint2, lint3, oldlint1, oldlint2, oldlint3, smallidx;
-    int minidx, maxidx;
-    unsigned sizeint[3], sizesmall[3], bitsizeint[3], size3, *luip;
+  bool XTCReader::ReadCoords(int natoms, std::vector<float> &coords) {
+    int minint[3], maxint[3], *lip;
+    int smallidx;
+    unsigned sizeint[3], sizesmall[3], bitsizeint[3], size3;
     int flag, k;
-    int small_, smaller, larger, i;
-    int is_small, is_smaller, run, prevrun;
-    float *lfp, lf;
+    int small_, smaller, i;
+    int is_smaller, run;
+    float *lfp, *fp;
     int tmp, *thiscoord,  prevcoord[3];
-    unsigned int tmpcoord[30];
+    int *buf;
 
-    int bufsize, xdrid, lsize;
+    int lsize, nbytes;
     unsigned int bitsize;
-    float inv_precision;
-    int errval = 1;
-
-    /* find out if xdrs is opened for reading or for writing */
-    xdrid = 0;
-    while (xdridptr[xdrid] != xdrs) {
-      xdrid++;
-      if (xdrid >= MAXID) {
-        fprintf(stderr, "xdr error. no open xdr stream\n");
-        return 0;
-      }
-    }
-    if (xdrmodes[xdrid] == 'w') {
-
-      /* xdrs is open for writing */
-
-      if (xdr_int(xdrs, size) == 0)
-        return 0;
-      size3 = *size * 3;
-      /* when the number of coordinates is small, don't try to compress; just
-       * write them as floats using xdr_vector
-       */
-      if (*size <= 9 ) {
-        return (xdr_vector(xdrs, (char *) fp, size3, sizeof(*fp),
-                           (xdrproc_t)xdr_float));
-      }
-
-      xdr_float(xdrs, precision);
-      if (ip == nullptr) {
-        ip = (int *)calloc(size3, sizeof(*ip));
-        if (ip == NULL) {
-          fprintf(stderr,"malloc failed\n");
-          return 0;
-        }
-        bufsize = static_cast<int> (size3 * 1.2);
-        buf = (int *)calloc(bufsize, sizeof(*buf));
-        if (buf == nullptr) {
-          fprintf(stderr,"malloc failed\n");
-          return 0;
-        }
-        oldsize = *size;
-      } else if (*size > oldsize) {
-        ip = (int *)realloc(ip, size3 * sizeof(*ip));
-        if (ip == nullptr) {
-          fprintf(stderr,"malloc failed\n");
-          return 0;
-        }
-        bufsize = static_cast<int> (size3 * 1.2);
-        buf = (int *)realloc(buf, bufsize * sizeof(*buf));
-        if (buf == nullptr) {
-          fprintf(stderr,"malloc failed\n");
-          return 0;
-        }
-        oldsize = *size;
-      }
-      /* buf[0-2] are special and do not contain actual data */
-      buf[0] = buf[1] = buf[2] = 0;
-      minint[0] = minint[1] = minint[2] = INT_MAX;
-      maxint[0] = maxint[1] = maxint[2] = INT_MIN;
-      prevrun = -1;
-      lfp = fp;
-      lip = ip;
-      mindiff = INT_MAX;
-      oldlint1 = oldlint2 = oldlint3 = 0;
-      while(lfp < fp + size3 ) {
-        /* find nearest integer */
-        if (*lfp >= 0.0)
-          lf = *lfp * *precision + 0.5f;
-        else
-          lf = *lfp * *precision - 0.5f;
-        if (fabs(lf) > MAXABS) {
-          /* scaling would cause overflow */
-          errval = 0;
-        }
-        lint1 = static_cast<int> (lf);
-        if (lint1 < minint[0]) minint[0] = lint1;
-        if (lint1 > maxint[0]) maxint[0] = lint1;
-        *lip++ = lint1;
-        lfp++;
-        if (*lfp >= 0.0)
-          lf = *lfp * *precision + 0.5f;
-        else
-          lf = *lfp * *precision - 0.5f;
-        if (fabs(lf) > MAXABS) {
-          /* scaling would cause overflow */
-          errval = 0;
-        }
-        lint2 = static_cast<int> (lf);
-        if (lint2 < minint[1]) minint[1] = lint2;
-        if (lint2 > maxint[1]) maxint[1] = lint2;
-        *lip++ = lint2;
-        lfp++;
-        if (*lfp >= 0.0)
-          lf = *lfp * *precision + 0.5f;
-        else
-          lf = *lfp * *precision - 0.5f;
-        if (fabs(lf) > MAXABS) {
-          /* scaling would cause overflow */
-          errval = 0;
-        }
-        lint3 = static_cast<int> (lf);
-        if (lint3 < minint[2]) minint[2] = lint3;
-        if (lint3 > maxint[2]) maxint[2] = lint3;
-        *lip++ = lint3;
-        lfp++;
-        diff = abs(oldlint1-lint1)+abs(oldlint2-lint2)+abs(oldlint3-lint3);
-        if (diff < mindiff && lfp > fp + 3)
-          mindiff = diff;
-        oldlint1 = lint1;
-        oldlint2 = lint2;
-        oldlint3 = lint3;
-      }
-      xdr_int(xdrs, &(minint[0]));
-      xdr_int(xdrs, &(minint[1]));
-      xdr_int(xdrs, &(minint[2]));
-
-      xdr_int(xdrs, &(maxint[0]));
-      xdr_int(xdrs, &(maxint[1]));
-      xdr_int(xdrs, &(maxint[2]));
-
-      if ((float)maxint[0] - (float)minint[0] >= MAXABS ||
-          (float)maxint[1] - (float)minint[1] >= MAXABS ||
-          (float)maxint[2] - (float)minint[2] >= MAXABS) {
-        /* turning value in unsigned by subtracting minint
-         * would cause overflow
-         */
-        errval = 0;
-      }
-      sizeint[0] = maxint[0] - minint[0]+1;
-      sizeint[1] = maxint[1] - minint[1]+1;
-      sizeint[2] = maxint[2] - minint[2]+1;
-
-      /* check if one of the sizes is to big to be multiplied */
-      if ((sizeint[0] | sizeint[1] | sizeint[2] ) > 0xffffff) {
-        bitsizeint[0] = sizeofint(sizeint[0]);
-        bitsizeint[1] = sizeofint(sizeint[1]);
-        bitsizeint[2] = sizeofint(sizeint[2]);
-        bitsize = 0; /* flag the use of large sizes */
-      } else {
-        bitsize = sizeofints(3, sizeint);
-      }
-      lip = ip;
-      luip = (unsigned int *) ip;
-      smallidx = FIRSTIDX;
-      while (smallidx < LASTIDX && magicints[smallidx] < mindiff) {
-        smallidx++;
-      }
-      xdr_int(xdrs, &smallidx);
-      maxidx = MIN(LASTIDX, smallidx + 8) ;
-      minidx = maxidx - 8; /* often this equal smallidx */
-      smaller = magicints[MAX(FIRSTIDX, smallidx-1)] / 2;
-      small_ = magicints[smallidx] / 2;
-      sizesmall[0] = sizesmall[1] = sizesmall[2] = magicints[smallidx];
-      larger = magicints[maxidx] / 2;
-      i = 0;
-      while (i < *size) {
-        is_small = 0;
-        thiscoord = (int *)(luip) + i * 3;
-        if (smallidx < maxidx && i >= 1 &&
-            abs(thiscoord[0] - prevcoord[0]) < larger &&
-            abs(thiscoord[1] - prevcoord[1]) < larger &&
-            abs(thiscoord[2] - prevcoord[2]) < larger) {
-          is_smaller = 1;
-        } else if (smallidx > minidx) {
-          is_smaller = -1;
-        } else {
-          is_smaller = 0;
-        }
-        if (i + 1 < *size) {
-          if (abs(thiscoord[0] - thiscoord[3]) < small_ &&
-              abs(thiscoord[1] - thiscoord[4]) < small_ &&
-              abs(thiscoord[2] - thiscoord[5]) < small_) {
-            /* interchange first with second atom for better
-             * compression of water molecules
-             */
-            tmp = thiscoord[0]; thiscoord[0] = thiscoord[3];
-            thiscoord[3] = tmp;
-            tmp = thiscoord[1]; thiscoord[1] = thiscoord[4];
-            thiscoord[4] = tmp;
-            tmp = thiscoord[2]; thiscoord[2] = thiscoord[5];
-            thiscoord[5] = tmp;
-            is_small = 1;
-          }
+    float precision, inv_precision;
 
-        }
-        tmpcoord[0] = thiscoord[0] - minint[0];
-        tmpcoord[1] = thiscoord[1] - minint[1];
-        tmpcoord[2] = thiscoord[2] - minint[2];
-        if (bitsize == 0) {
-          sendbits(buf, bitsizeint[0], tmpcoord[0]);
-          sendbits(buf, bitsizeint[1], tmpcoord[1]);
-          sendbits(buf, bitsizeint[2], tmpcoord[2]);
-        } else {
-          sendints(buf, 3, bitsize, sizeint, tmpcoord);
-        }
-        prevcoord[0] = thiscoord[0];
-        prevcoord[1] = thiscoord[1];
-        prevcoord[2] = thiscoord[2];
-        thiscoord = thiscoord + 3;
-        i++;
-
-        run = 0;
-        if (is_small == 0 && is_smaller == -1)
-          is_smaller = 0;
-        while (is_small && run < 8*3) {
-          if (is_smaller == -1 && (
-                                   SQR(thiscoord[0] - prevcoord[0]) +
-                                   SQR(thiscoord[1] - prevcoord[1]) +
-                                   SQR(thiscoord[2] - prevcoord[2]) >= smaller * smaller)) {
-            is_smaller = 0;
-          }
+    if (!ReadInt(lsize))
+      return false;
+    if (lsize != natoms) {
+      std::stringstream errorMsg;
+      errorMsg << "wrong number of coordinates in xdr3dfcoor; "
+               << natoms << " arg vs " << lsize << " in file";
+      obErrorLog.ThrowError("ReadMolecule", errorMsg.str(), obWarning);
+      return false;
+    }
+    size3 = lsize * 3;
+    coords.resize(size3);
+    fp = &coords[0];
+    if (lsize <= 9) {
+      for (i = 0; i < static_cast<int>(size3); ++i)
+        if (!ReadFloat(fp[i]))
+          return false;
+      return true;
+    }
+    if (!ReadFloat(precision))
+      return false;
+    if (_ip.size() < size3)
+      _ip.resize(size3);
 
-          tmpcoord[run++] = thiscoord[0] - prevcoord[0] + small_;
-          tmpcoord[run++] = thiscoord[1] - prevcoord[1] + small_;
-          tmpcoord[run++] = thiscoord[2] - prevcoord[2] + small_;
+    for (k = 0; k < 3; ++k)
+      if (!ReadInt(minint[k]))
+        return false;
+    for (k = 0; k < 3; ++k)
+      if (!ReadInt(maxint[k]))
+        return false;
 
-          prevcoord[0] = thiscoord[0];
-          prevcoord[1] = thiscoord[1];
-          prevcoord[2] = thiscoord[2];
+    sizeint[0] = maxint[0] - minint[0]+1;
+    sizeint[1] = maxint[1] - minint[1]+1;
+    sizeint[2] = maxint[2] - minint[2]+1;
 
-          i++;
-          thiscoord = thiscoord + 3;
-          is_small = 0;
-          if (i < *size &&
-              abs(thiscoord[0] - prevcoord[0]) < small_ &&
-              abs(thiscoord[1] - prevcoord[1]) < small_ &&
-              abs(thiscoord[2] - prevcoord[2]) < small_) {
-            is_small = 1;
-          }
-        }
-        if (run != prevrun || is_smaller != 0) {
-          prevrun = run;
-          sendbits(buf, 1, 1); /* flag the change in run-length */
-          sendbits(buf, 5, run+is_smaller+1);
-        } else {
-          sendbits(buf, 1, 0); /* flag the fact that runlength did not change */
-        }
-        for (k=0; k < run; k+=3) {
-          sendints(buf, 3, smallidx, sizesmall, &tmpcoord[k]);
-        }
-        if (is_smaller != 0) {
-          smallidx += is_smaller;
-          if (is_smaller < 0) {
-            small_ = smaller;
-            smaller = magicints[smallidx-1] / 2;
-          } else {
-            smaller = small_;
-            small_ = magicints[smallidx] / 2;
-          }
-          sizesmall[0] = sizesmall[1] = sizesmall[2] = magicints[smallidx];
-        }
-      }
-      if (buf[1] != 0) buf[0]++;;
-      xdr_int(xdrs, &(buf[0])); /* buf[0] holds the length in bytes */
-      return errval * (xdr_opaque(xdrs, (caddr_t)&(buf[3]), (u_int)buf[0]));
+    /* check if one of the sizes is to big to be multiplied */
+    if ((sizeint[0] | sizeint[1] | sizeint[2] ) > 0xffffff) {
+      bitsizeint[0] = sizeofint(sizeint[0]);
+      bitsizeint[1] = sizeofint(sizeint[1]);
+      bitsizeint[2] = sizeofint(sizeint[2]);
+      bitsize = 0; /* flag the use of large sizes */
     } else {
+      bitsize = sizeofints(3, sizeint);
+    }
 
-      /* xdrs is open for reading */
+    if (!ReadInt(smallidx) || smallidx < FIRSTIDX || smallidx >= static_cast<int>(LASTIDX))
+      return false;
+    smaller = magicints[MAX(FIRSTIDX, smallidx-1)] / 2;
+    small_ = magicints[smallidx] / 2;
+    sizesmall[0] = sizesmall[1] = sizesmall[2] = magicints[smallidx] ;
 
-      if (xdr_int(xdrs, &lsize) == 0)
-        return 0;
-      if (*size != 0 && lsize != *size) {
-        fprintf(stderr, "wrong number of coordinates in xdr3dfcoor; "
-                "%d arg vs %d in file", *size, lsize);
-      }
-      *size = lsize;
-      size3 = *size * 3;
-      if (*size <= 9) {
-        return (xdr_vector(xdrs, (char *) fp, size3, sizeof(*fp),
-                           (xdrproc_t)xdr_float));
-      }
-      xdr_float(xdrs, precision);
-      if (ip == nullptr) {
-        ip = (int *)calloc(size3, sizeof(*ip));
-        if (ip == nullptr) {
-          fprintf(stderr,"malloc failed\n");
-          return 0;
-        }
-        bufsize = static_cast<int> (size3 * 1.2);
-        buf = (int *)calloc(bufsize, sizeof(*buf));
-        if (buf == nullptr) {
-          fprintf(stderr,"malloc failed\n");
-          return 0;
-        }
-        oldsize = *size;
-      } else if (*size > oldsize) {
-        ip = (int *)realloc(ip, size3 * sizeof(*ip));
-        if (ip == nullptr) {
-          fprintf(stderr,"malloc failed\n");
-          return 0;
-        }
-        bufsize = static_cast<int> (size3 * 1.2);
-        buf = (int *)realloc(buf, bufsize * sizeof(*buf));
-        if (buf == nullptr) {
-          fprintf(stderr,"malloc failed\n");
-          return 0;
-        }
-        oldsize = *size;
-      }
-      buf[0] = buf[1] = buf[2] = 0;
-
-      xdr_int(xdrs, &(minint[0]));
-      xdr_int(xdrs, &(minint[1]));
-      xdr_int(xdrs, &(minint[2]));
-
-      xdr_int(xdrs, &(maxint[0]));
-      xdr_int(xdrs, &(maxint[1]));
-      xdr_int(xdrs, &(maxint[2]));
-
-      sizeint[0] = maxint[0] - minint[0]+1;
-      sizeint[1] = maxint[1] - minint[1]+1;
-      sizeint[2] = maxint[2] - minint[2]+1;
-
-      /* check if one of the sizes is to big to be multiplied */
-      if ((sizeint[0] | sizeint[1] | sizeint[2] ) > 0xffffff) {
-        bitsizeint[0] = sizeofint(sizeint[0]);
-        bitsizeint[1] = sizeofint(sizeint[1]);
-        bitsizeint[2] = sizeofint(sizeint[2]);
-        bitsize = 0; /* flag the use of large sizes */
+    /* the compressed data follows its length in bytes, padded to 4 bytes */
+    if (!ReadInt(nbytes) || nbytes < 0)
+      return false;
+    _buf.resize(3 + (nbytes + 3) / 4 + 1);
+    buf = &_buf[0];
+    if (!_ifs.read(reinterpret_cast<char*>(&buf[3]), (nbytes + 3) & ~3))
+      return false;
+    buf[0] = buf[1] = buf[2] = 0;
+
+    lfp = fp;
+    inv_precision = 1.0f / precision;
+    run = 0;
+    i = 0;
+    lip = &_ip[0];
+    while ( i < lsize ) {
+      thiscoord = (int *)(lip) + i * 3;
+
+      if (bitsize == 0) {
+        thiscoord[0] = receivebits(buf, bitsizeint[0]);
+        thiscoord[1] = receivebits(buf, bitsizeint[1]);
+        thiscoord[2] = receivebits(buf, bitsizeint[2]);
       } else {
-        bitsize = sizeofints(3, sizeint);
+        receiveints(buf, 3, bitsize, sizeint, thiscoord);
       }
 
-      xdr_int(xdrs, &smallidx);
-      maxidx = MIN(LASTIDX, smallidx + 8) ;
-      minidx = maxidx - 8; /* often this equal smallidx */
-      smaller = magicints[MAX(FIRSTIDX, smallidx-1)] / 2;
-      small_ = magicints[smallidx] / 2;
-      sizesmall[0] = sizesmall[1] = sizesmall[2] = magicints[smallidx] ;
-      larger = magicints[maxidx];
-
-    	/* buf[0] holds the length in bytes */
-
-      if (xdr_int(xdrs, &(buf[0])) == 0)
-        return 0;
-      if (xdr_opaque(xdrs, (caddr_t)&(buf[3]), (u_int)buf[0]) == 0)
-        return 0;
-      buf[0] = buf[1] = buf[2] = 0;
-
-      lfp = fp;
-      inv_precision = 1.0f / * precision;
-      run = 0;
-      i = 0;
-      lip = ip;
-      while ( i < lsize ) {
-        thiscoord = (int *)(lip) + i * 3;
-
-        if (bitsize == 0) {
-          thiscoord[0] = receivebits(buf, bitsizeint[0]);
-          thiscoord[1] = receivebits(buf, bitsizeint[1]);
-          thiscoord[2] = receivebits(buf, bitsizeint[2]);
-        } else {
-          receiveints(buf, 3, bitsize, sizeint, thiscoord);
-        }
-
-        i++;
-        thiscoord[0] += minint[0];
-        thiscoord[1] += minint[1];
-        thiscoord[2] += minint[2];
+      i++;
+      thiscoord[0] += minint[0];
+      thiscoord[1] += minint[1];
+      thiscoord[2] += minint[2];
 
-        prevcoord[0] = thiscoord[0];
-        prevcoord[1] = thiscoord[1];
-        prevcoord[2] = thiscoord[2];
+      prevcoord[0] = thiscoord[0];
+      prevcoord[1] = thiscoord[1];
+      prevcoord[2] = thiscoord[2];
 
 
-        flag = receivebits(buf, 1);
-        is_smaller = 0;
-        if (flag == 1) {
-          run = receivebits(buf, 5);
-          is_smaller = run % 3;
-          run -= is_smaller;
-          is_smaller--;
-        }
-        if (run > 0) {
-          thiscoord += 3;
-          for (k = 0; k < run; k+=3) {
-            receiveints(buf, 3, smallidx, sizesmall, thiscoord);
-            i++;
-            thiscoord[0] += prevcoord[0] - small_;
-            thiscoord[1] += prevcoord[1] - small_;
-            thiscoord[2] += prevcoord[2] - small_;
-            if (k == 0) {
-              /* interchange first with second atom for better
-               * compression of water molecules
-               */
-              tmp = thiscoord[0]; thiscoord[0] = prevcoord[0];
-              prevcoord[0] = tmp;
-              tmp = thiscoord[1]; thiscoord[1] = prevcoord[1];
-              prevcoord[1] = tmp;
-              tmp = thiscoord[2]; thiscoord[2] = prevcoord[2];
-              prevcoord[2] = tmp;
-              *lfp++ = prevcoord[0] * inv_precision;
-              *lfp++ = prevcoord[1] * inv_precision;
-              *lfp++ = prevcoord[2] * inv_precision;
-            } else {
-              prevcoord[0] = thiscoord[0];
-              prevcoord[1] = thiscoord[1];
-              prevcoord[2] = thiscoord[2];
-            }
-            *lfp++ = thiscoord[0] * inv_precision;
-            *lfp++ = thiscoord[1] * inv_precision;
-            *lfp++ = thiscoord[2] * inv_precision;
+      flag = receivebits(buf, 1);
+      is_smaller = 0;
+      if (flag == 1) {
+        run = receivebits(buf, 5);
+        is_smaller = run % 3;
+        run -= is_smaller;
+        is_smaller--;
+      }
+      if (run > 0) {
+        if (i + run / 3 > lsize)
+          return false; // corrupt data would overrun the coordinates
+        thiscoord += 3;
+        for (k = 0; k < run; k+=3) {
+          receiveints(buf, 3, smallidx, sizesmall, thiscoord);
+          i++;
+          thiscoord[0] += prevcoord[0] - small_;
+          thiscoord[1] += prevcoord[1] - small_;
+          thiscoord[2] += prevcoord[2] - small_;
+          if (k == 0) {
+            /* interchange first with second atom for better
+             * compression of water molecules
+             */
+            tmp = thiscoord[0]; thiscoord[0] = prevcoord[0];
+            prevcoord[0] = tmp;
+            tmp = thiscoord[1]; thiscoord[1] = prevcoord[1];
+            prevcoord[1] = tmp;
+            tmp = thiscoord[2]; thiscoord[2] = prevcoord[2];
+            prevcoord[2] = tmp;
+            *lfp++ = prevcoord[0] * inv_precision;
+            *lfp++ = prevcoord[1] * inv_precision;
+            *lfp++ = prevcoord[2] * inv_precision;
+          } else {
+            prevcoord[0] = thiscoord[0];
+            prevcoord[1] = thiscoord[1];
+            prevcoord[2] = thiscoord[2];
           }
-        } else {
           *lfp++ = thiscoord[0] * inv_precision;
           *lfp++ = thiscoord[1] * inv_precision;
           *lfp++ = thiscoord[2] * inv_precision;
         }
-        smallidx += is_smaller;
-        if (is_smaller < 0) {
-          small_ = smaller;
-          if (smallidx > FIRSTIDX) {
-            smaller = magicints[smallidx - 1] /2;
-          } else {
-            smaller = 0;
-          }
-        } else if (is_smaller > 0) {
-          smaller = small_;
-          small_ = magicints[smallidx] / 2;
+      } else {
+        *lfp++ = thiscoord[0] * inv_precision;
+        *lfp++ = thiscoord[1] * inv_precision;
+        *lfp++ = thiscoord[2] * inv_precision;
+      }
+      smallidx += is_smaller;
+      if (smallidx < FIRSTIDX || smallidx >= static_cast<int>(LASTIDX))
+        return false;
+      if (is_smaller < 0) {
+        small_ = smaller;
+        if (smallidx > FIRSTIDX) {
+          smaller = magicints[smallidx - 1] /2;
+        } else {
+          smaller = 0;
         }
-        sizesmall[0] = sizesmall[1] = sizesmall[2] = magicints[smallidx] ;
+      } else if (is_smaller > 0) {
+        smaller = small_;
+        small_ = magicints[smallidx] / 2;
       }
+      sizesmall[0] = sizesmall[1] = sizesmall[2] = magicints[smallidx] ;
     }
-    return 1;
+    return true;
   }
 
 } //namespace OpenBabel
@@ -21,6 +21,7 @@ GNU General Public License for more details.
 
 #include <string>
 #include <set>
+#include <sstream>
 
 #include <openbabel/mol.h>
 #include <openbabel/atom.h>
@@ -30,6 +31,7 @@ GNU General Public License for more details.
 #include <openbabel/generic.h>
 #include <openbabel/math/matrix3x3.h>
 #include <openbabel/elements.h>
+#include <openbabel/obconversion.h>
 
 // needed for msvc to have at least one reference to AtomClass, AliasData in openbabel library
 #include <openbabel/alias.h>
@@ -234,6 +236,65 @@ namespace OpenBabel
     OBGenericData("PairData", OBGenericDataType::PairData)
   { }
 
+  //
+  //member functions for OBDeferredStructure class
+  //
+
+  /** \class OBDeferredStructure generic.h <openbabel/generic.h>
+
+      A format may read only the title and properties of a molecule and keep
+      the rest of the record as text (e.g. the MDL format with the L option).
+      This is much quicker when most molecules are only filtered on their
+      properties and copied to the output. The molecule then has no atoms
+      until Expand() is called, which is done automatically by the
+      conversion before an operation or an output format which needs the
+      structure.
+  **/
+  OBDeferredStructure::OBDeferredStructure(const string &record, OBFormat* pFormat,
+                                           const map<string, string> &options) :
+    OBGenericData("DeferredStructure", OBGenericDataType::DeferredStructureData, local),
+    _record(record), _pFormat(pFormat), _options(options)
+  { }
+
+  bool OBDeferredStructure::Expand(OBMol* pmol)
+  {
+    OBDeferredStructure* pDef = static_cast<OBDeferredStructure*>
+      (pmol->GetData(OBGenericDataType::DeferredStructureData));
+    if (!pDef)
+      return true;
+
+    //The molecule is cleared when it is read, so keep what is needed
+    OBFormat* pFormat = pDef->_pFormat;
+    istringstream is(pDef->_record);
+    OBConversion conv;
+    conv.SetInFormat(pFormat);
+    conv.SetInStream(&is);
+    map<string, string>::const_iterator itr;
+    for (itr = pDef->_options.begin(); itr != pDef->_options.end(); ++itr)
+      conv.AddOption(itr->first.c_str(), OBConversion::INOPTIONS, itr->second.c_str());
+
+    //The title and properties may have been changed since the record was read
+    string title(pmol->GetTitle());
+    vector<OBGenericData*> kept;
+    for (OBDataIterator d = pmol->BeginData(); d != pmol->EndData(); ++d)
+      if (*d != pDef)
+        kept.push_back((*d)->Clone(pmol));
+
+    bool ret = pFormat->ReadMolecule(pmol, &conv);
+
+    //Replace the properties read again by the kept ones
+    vector<OBGenericData*> props;
+    for (OBDataIterator d = pmol->BeginData(); d != pmol->EndData(); ++d)
+      if ((*d)->GetDataType() == OBGenericDataType::PairData
+          && (*d)->GetOrigin() == fileformatInput)
+        props.push_back(*d);
+    pmol->DeleteData(props);
+    for (vector<OBGenericData*>::iterator k = kept.begin(); k != kept.end(); ++k)
+      pmol->SetData(*k);
+    pmol->SetTitle(title);
+    return ret;
+  }
+
   //
   //member functions for OBVirtualBond class
   //
@@ -82,13 +82,16 @@ namespace OpenBabel {
       unsigned int GetHvyDegree(OBAtom *atom);
       unsigned int GetHvyBondSum(OBAtom *atom);
       void FindRingAtoms(OBBitVec &ring_atoms);
-      void CreateNewClassVector(std::vector<std::pair<OBAtom*,unsigned int> > &vp1,
-                                std::vector<std::pair<OBAtom*,unsigned int> > &vp2);
-      static void CreateNewClassVector(OBMol *mol, std::vector<std::pair<OBAtom*,unsigned int> > &vp1,
-                                       std::vector<std::pair<OBAtom*,unsigned int> > &vp2);
+      void GetFragmentNbrs(const std::vector<std::pair<OBAtom*,unsigned int> > &vp,
+                           std::vector<unsigned int> &nbrStart, std::vector<unsigned int> &nbrs);
+      static void CreateNewClassVector(const std::vector<unsigned int> &classes,
+                                       const std::vector<unsigned int> &nbrStart,
+                                       const std::vector<unsigned int> &nbrs,
+                                       std::vector<unsigned int> &newClasses);
       void GetGIVector(std::vector<unsigned int> &vid);
       bool GetGTDVector(std::vector<int> &gtd);
-      static void CountAndRenumberClasses(std::vector<std::pair<OBAtom*,unsigned int> > &vp, unsigned int &count);
+      static void CountAndRenumberClasses(std::vector<unsigned int> &classes, unsigned int &count,
+                                          std::vector<std::pair<unsigned int, unsigned int> > &order);
       int ExtendInvariants(std::vector<std::pair<OBAtom*, unsigned int> > &symmetry_classes);
       int CalculateSymmetry(std::vector<unsigned int> &symmetry_classes);
       int Iterate(std::vector<unsigned int> &symmetry_classes);
@@ -114,25 +117,6 @@ namespace OpenBabel {
 
   const unsigned int OBGraphSym::NoSymmetryClass = 0x7FFFFFFF;
 
-  /**
-   * Functions for use by the sort() method of a vector.
-   */
-  inline bool CompareUnsigned(const unsigned int &a,const unsigned int &b)
-  {
-    return(a<b);
-  }
-
-  inline bool ComparePairFirst(const std::pair<OBAtom*,unsigned int> &a,const std::pair<OBAtom*,unsigned int> &b)
-  {
-    return(a.first->GetIdx() < b.first->GetIdx());
-  }
-
-  inline bool ComparePairSecond(const std::pair<OBAtom*,unsigned int> &a,const std::pair<OBAtom*,unsigned int> &b)
-  {
-    return(a.second < b.second);
-  }
-
-
   /**
    * Like OBAtom::GetHvyDegree(): Counts the number non-hydrogen
    * neighbors, but doesn't count atoms not in the fragment.
@@ -202,51 +186,59 @@ namespace OpenBabel {
    */
   bool OBGraphSymPrivate::GetGTDVector(vector<int> &gtd)
   {
+    unsigned int numAtoms = _pmol->NumAtoms();
     gtd.clear();
-    gtd.resize(_pmol->NumAtoms());
+    gtd.resize(numAtoms);
 
-    int gtdcount, natom;
-    OBBitVec used, curr, next;
-    OBAtom *atom, *atom1;
-    OBBond *bond;
-    vector<OBNodeBase*>::iterator ai;
+    // Flatten the heavy atom neighbors in the fragment (indexed from zero)
+    // to avoid walking the bond lists once for every breadth-first search.
+    std::vector<unsigned int> nbrStart(numAtoms + 1, 0);
+    std::vector<unsigned int> nbrs;
     vector<OBBond*>::iterator j;
-
-    next.Clear();
-
-    for (atom = _pmol->BeginAtom(ai); atom; atom = _pmol->NextAtom(ai)) {
-
-      int idx = atom->GetIdx();
-      if (!_frag_atoms.BitIsSet(idx)) {     // Not in this fragment?
-        gtd[idx-1] = OBGraphSym::NoSymmetryClass;
+    for (unsigned int i = 0; i < numAtoms; ++i) {
+      nbrStart[i] = nbrs.size();
+      OBAtom *atom = _pmol->GetAtom(i + 1);
+      if (!_frag_atoms.BitIsSet(i + 1))
+        continue;
+      for (OBBond *bond = atom->BeginBond(j); bond; bond = atom->NextBond(j)) {
+        OBAtom *nbr = bond->GetNbrAtom(atom);
+        if (_frag_atoms.BitIsSet(nbr->GetIdx()) && nbr->GetAtomicNum() != OBElements::Hydrogen)
+          nbrs.push_back(nbr->GetIndex());
+      }
+    }
+    nbrStart[numAtoms] = nbrs.size();
+
+    // Breadth-first search from each atom. The visited array is stamped with
+    // the start atom to avoid clearing it for every search.
+    std::vector<unsigned int> visited(numAtoms, 0);
+    std::vector<unsigned int> curr, next;
+    for (unsigned int i = 0; i < numAtoms; ++i) {
+      if (!_frag_atoms.BitIsSet(i + 1)) {     // Not in this fragment?
+        gtd[i] = OBGraphSym::NoSymmetryClass;
         continue;
       }
 
-      gtdcount = 0;
-      used.Clear();curr.Clear();
-      used.SetBitOn(idx);
-      curr.SetBitOn(idx);
-
-      while (!curr.IsEmpty()) {
-        next.Clear();
-        for (natom = curr.NextBit(-1);natom != curr.EndBit();natom = curr.NextBit(natom)) {
-          atom1 = _pmol->GetAtom(natom);
-          if (!_frag_atoms.BitIsSet(atom1->GetIdx()))
-            continue;
-          for (bond = atom1->BeginBond(j);bond;bond = atom1->NextBond(j)) {
-            int nbr_idx = bond->GetNbrAtomIdx(atom1);
-            if (   _frag_atoms.BitIsSet(nbr_idx)
-                && !used.BitIsSet(nbr_idx)
-                && !curr.BitIsSet(nbr_idx)
-                && bond->GetNbrAtom(atom1)->GetAtomicNum() != OBElements::Hydrogen)
-              next.SetBitOn(nbr_idx);
+      unsigned int stamp = i + 1;
+      int gtdcount = 0;
+      visited[i] = stamp;
+      curr.assign(1, i);
+
+      while (!curr.empty()) {
+        next.clear();
+        for (std::size_t k = 0; k < curr.size(); ++k) {
+          unsigned int a = curr[k];
+          for (unsigned int n = nbrStart[a]; n < nbrStart[a + 1]; ++n) {
+            unsigned int nbr = nbrs[n];
+            if (visited[nbr] != stamp) {
+              visited[nbr] = stamp;
+              next.push_back(nbr);
+            }
           }
         }
-        used |= next;
-        curr = next;
+        curr.swap(next);
         gtdcount++;
       }
-      gtd[idx-1] = gtdcount;
+      gtd[i] = gtdcount;
     }
 
     return(true);
@@ -326,160 +318,115 @@ namespace OpenBabel {
   }
 
   /**
-   * Creates a new vector of symmetry classes based on an existing
-   * vector.  (Helper routine to GetGIDVector.)  On return, vp2 will
-   * have newly-extended connectivity sums, but the numbers (the class
-   * IDs) are very large.
-   *
-   * (Comments by CJ) This appears to compute the "extended connectivity
-   * sums" similar to those described by Weininger, Morgan, etc. It uses
-   * vp1 as its starting point (the current connectivity sums), and puts
-   * the new sums in vp2.  Note that vp1 is modified along the way.
-   *
-   * Note that, per Weininger's warning, this assumes the initial class
-   * ID's are less than 100, which is a BAD assumption, e.g. OCC...CCN
-   * would have more than 100 symmetry classes if the chain is more than
-   * 98 carbons long.  Should change this to use Weininger's product of
-   * corresponding primes.
+   * Create the neighbor lists for the atoms in @p vp. The neighbors of the
+   * atom vp[i] are nbrs[nbrStart[i]] ... nbrs[nbrStart[i+1]-1] and are stored
+   * as indexes into @p vp. Only neighbors in the fragment are included.
    */
-  void OBGraphSymPrivate::CreateNewClassVector(std::vector<std::pair<OBAtom*,unsigned int> > &vp1,
-                                        std::vector<std::pair<OBAtom*,unsigned int> > &vp2)
+  void OBGraphSymPrivate::GetFragmentNbrs(const std::vector<std::pair<OBAtom*,unsigned int> > &vp,
+                                          std::vector<unsigned int> &nbrStart, std::vector<unsigned int> &nbrs)
   {
-    unsigned int m,id;
-    OBAtom *atom, *nbr;
-    vector<OBBond*>::iterator nbr_iter;
-    vector<unsigned int>::iterator k;
-    vector<pair<OBAtom*,unsigned int> >::iterator vp_iter;
-
-#if DEBUG2
-    cout << "CreateNewClassVector: START\n";
-    //print_vector_pairs("    ", vp1);
-#endif
-
     // There may be fewer atoms than in the whole molecule, so we can't
-    // index the vp1 array by atom->GetIdx().  Instead, create a quick
-    // mapping vector of idx-to-index for vp1.
+    // index the vp array by atom->GetIdx().  Instead, create a quick
+    // mapping vector of idx-to-index for vp.
     vector<int> idx2index(_pmol->NumAtoms() + 1, -1);  // natoms + 1
-    int index = 0;
-    for (vp_iter = vp1.begin(); vp_iter != vp1.end(); ++vp_iter) {
-      int idx = vp_iter->first->GetIdx();
-      idx2index[idx] = index++;
-    }
-
-    // vp2 will hold the newly-extended symmetry classes
-    vp2.resize(vp1.size());
-    vp2.clear();
-
-    // Loop over original atoms.
-    // Create a new extended varient for each atom.  Get its neighbors' class ID's,
-    // sort them into ascending order, and create a sum of (c0 + c1*10^2 + c2*10^4 + ...)
-    // which becomes the new class ID (where c0 is the current classID).
+    for (std::size_t i = 0; i < vp.size(); ++i)
+      idx2index[vp[i].first->GetIdx()] = i;
 
-    for (vp_iter = vp1.begin(); vp_iter != vp1.end(); ++vp_iter) {
-      atom = vp_iter->first;
-      id   = vp_iter->second;
-      vector<unsigned int> vtmp;
+    nbrStart.resize(vp.size() + 1);
+    nbrs.clear();
+    OBAtom *nbr;
+    vector<OBBond*>::iterator nbr_iter;
+    for (std::size_t i = 0; i < vp.size(); ++i) {
+      nbrStart[i] = nbrs.size();
+      OBAtom *atom = vp[i].first;
       for (nbr = atom->BeginNbrAtom(nbr_iter); nbr; nbr = atom->NextNbrAtom(nbr_iter)) {
         int idx = nbr->GetIdx();
         if (_frag_atoms.BitIsSet(idx))
-          vtmp.push_back(vp1[idx2index[idx]].second);
+          nbrs.push_back(idx2index[idx]);
       }
-
-      sort(vtmp.begin(),vtmp.end(),CompareUnsigned);
-      for (m = 100, k = vtmp.begin(); k != vtmp.end(); ++k, m*=100)
-        id += *k * m;
-      vp2.push_back(pair<OBAtom*,unsigned int> (atom, id));
     }
-#if DEBUG2
-    cout << "CreateNewClassVector: FINISH\n";
-    //print_vector_pairs("    ", vp2);
-#endif
+    nbrStart[vp.size()] = nbrs.size();
   }
 
-  void OBGraphSymPrivate::CreateNewClassVector(OBMol *mol, std::vector<std::pair<OBAtom*,unsigned int> > &vp1,
-      std::vector<std::pair<OBAtom*,unsigned int> > &vp2)
+  /**
+   * Creates a new vector of symmetry classes based on an existing
+   * vector.  (Helper routine to GetGIDVector.)  On return, @p newClasses
+   * will have newly-extended connectivity sums, but the numbers (the class
+   * IDs) are very large.
+   *
+   * (Comments by CJ) This appears to compute the "extended connectivity
+   * sums" similar to those described by Weininger, Morgan, etc. It uses
+   * @p classes as its starting point (the current connectivity sums), and puts
+   * the new sums in @p newClasses.
+   *
+   * Note that, per Weininger's warning, this assumes the initial class
+   * ID's are less than 100, which is a BAD assumption, e.g. OCC...CCN
+   * would have more than 100 symmetry classes if the chain is more than
+   * 98 carbons long.  Should change this to use Weininger's product of
+   * corresponding primes.
+   *
+   * The neighbor lists are precomputed by GetFragmentNbrs() since they don't
+   * change between iterations.
+   */
+  void OBGraphSymPrivate::CreateNewClassVector(const std::vector<unsigned int> &classes,
+                                               const std::vector<unsigned int> &nbrStart,
+                                               const std::vector<unsigned int> &nbrs,
+                                               std::vector<unsigned int> &newClasses)
   {
-    int m,id;
-    OBAtom *atom, *nbr;
-    vector<OBBond*>::iterator nbr_iter;
-    vector<unsigned int>::iterator k;
-    vector<pair<OBAtom*,unsigned int> >::iterator vp_iter;
-
-#if DEBUG2
-    cout << "CreateNewClassVector: START\n";
-    //print_vector_pairs("    ", vp1);
-#endif
-
-    // There may be fewer atoms than in the whole molecule, so we can't
-    // index the vp1 array by atom->GetIdx().  Instead, create a quick
-    // mapping vector of idx-to-index for vp1.
-    vector<int> idx2index(mol->NumAtoms() + 1, -1);  // natoms + 1
-    int index = 0;
-    for (vp_iter = vp1.begin(); vp_iter != vp1.end(); ++vp_iter) {
-      int idx = vp_iter->first->GetIdx();
-      idx2index[idx] = index++;
-    }
-
-    // vp2 will hold the newly-extended symmetry classes
-    vp2.resize(vp1.size());
-    vp2.clear();
+    newClasses.resize(classes.size());
 
     // Loop over original atoms.
     // Create a new extended varient for each atom.  Get its neighbors' class ID's,
     // sort them into ascending order, and create a sum of (c0 + c1*10^2 + c2*10^4 + ...)
     // which becomes the new class ID (where c0 is the current classID).
-
-    for (vp_iter = vp1.begin(); vp_iter != vp1.end(); ++vp_iter) {
-      atom = vp_iter->first;
-      id   = vp_iter->second;
-      vector<unsigned int> vtmp;
-      for (nbr = atom->BeginNbrAtom(nbr_iter); nbr; nbr = atom->NextNbrAtom(nbr_iter)) {
-        int idx = nbr->GetIdx();
-        vtmp.push_back(vp1[idx2index[idx]].second);
-      }
-
-      sort(vtmp.begin(),vtmp.end(),CompareUnsigned);
-      for (m = 100, k = vtmp.begin(); k != vtmp.end(); ++k, m*=100)
-        id += *k * m;
-      vp2.push_back(pair<OBAtom*,unsigned int> (atom, id));
+    std::vector<unsigned int> vtmp;
+    for (std::size_t i = 0; i < classes.size(); ++i) {
+      unsigned int id = classes[i];
+      vtmp.clear();
+      for (unsigned int n = nbrStart[i]; n < nbrStart[i + 1]; ++n)
+        vtmp.push_back(classes[nbrs[n]]);
+
+      sort(vtmp.begin(), vtmp.end());
+      unsigned int m = 100;
+      for (std::size_t k = 0; k < vtmp.size(); ++k, m *= 100)
+        id += vtmp[k] * m;
+      newClasses[i] = id;
     }
-#if DEBUG2
-    cout << "CreateNewClassVector: FINISH\n";
-    //print_vector_pairs("    ", vp2);
-#endif
-
   }
 
   /**
    * Counts the number of unique symmetry classes in a list.
    *
-   * (NOTE: CJ -- It also appears to MODIFY the list.  It sorts it in order
-   * of class ID, then renumbers the ID's zero through N-1.  See the comments
-   * in CreateNewClassVector() about how it returns very large numbers for the
+   * (NOTE: CJ -- It also appears to MODIFY the list.  It renumbers the ID's
+   * in order of class ID, one through N.  See the comments in
+   * CreateNewClassVector() about how it returns very large numbers for the
    * class IDs it creates.  These are replaced by lower, sequential numbers here.)
+   *
+   * The @p order vector is scratch space reused between calls.
    */
-  void OBGraphSymPrivate::CountAndRenumberClasses(std::vector<std::pair<OBAtom*,unsigned int> > &vp,
-                                           unsigned int &count)
+  void OBGraphSymPrivate::CountAndRenumberClasses(std::vector<unsigned int> &classes, unsigned int &count,
+                                                  std::vector<std::pair<unsigned int, unsigned int> > &order)
   {
     count = 1;
-    vector<pair<OBAtom*,unsigned int> >::iterator k;
-
-    sort(vp.begin(), vp.end(), ComparePairSecond);
-    k = vp.begin();
-    if (k != vp.end()) {
-      unsigned int id = k->second;
-      if (id) {
-      k->second = 1;
-      ++k;
-      for (;k != vp.end(); ++k) {
-        if (k->second != id) {
-          id = k->second;
-          k->second = ++count;
-        } else {
-          k->second = count;
-        }
-      }
+    if (classes.empty())
+      return;
+
+    order.resize(classes.size());
+    for (std::size_t i = 0; i < classes.size(); ++i)
+      order[i] = std::make_pair(classes[i], static_cast<unsigned int>(i));
+    sort(order.begin(), order.end());
+
+    unsigned int id = order[0].first;
+    if (!id)
+      return;
+
+    classes[order[0].second] = 1;
+    for (std::size_t i = 1; i < order.size(); ++i) {
+      if (order[i].first != id) {
+        id = order[i].first;
+        ++count;
       }
+      classes[order[i].second] = count;
     }
   }
 
@@ -490,43 +437,53 @@ namespace OpenBabel {
    * until a stable solution is found (further spreading doesn't
    * change the answer).
    *
+   * The classes are refined on flat index arrays: the fragment neighbor
+   * lists are computed once and the class vectors and sort buffer are
+   * reused between iterations.
+   *
    * @return The number of distinct symmetry classes found.
    */
   int OBGraphSymPrivate::ExtendInvariants(std::vector<std::pair<OBAtom*, unsigned int> > &symmetry_classes)
   {
     unsigned int nclasses1, nclasses2;
-    vector<pair<OBAtom*,unsigned int> > tmp_classes;
 
-    // How many classes are we starting with?  (The "renumber" part isn't relevant.)
-    CountAndRenumberClasses(symmetry_classes, nclasses1);
+    std::vector<unsigned int> nbrStart, nbrs;
+    GetFragmentNbrs(symmetry_classes, nbrStart, nbrs);
+
+    std::vector<unsigned int> classes(symmetry_classes.size()), tmp_classes;
+    for (std::size_t i = 0; i < symmetry_classes.size(); ++i)
+      classes[i] = symmetry_classes[i].second;
+    std::vector<std::pair<unsigned int, unsigned int> > order;
 
     unsigned int nfragatoms = _frag_atoms.CountBits();
 
-    // LOOP: Do extended sum-of-invarients until no further changes are
-    // noted.  (Note: This is inefficient, as it re-computes extended sums
-    // and re-sorts the entire list each time.  You can save a lot of time by
-    // only recomputing and resorting within regions where there is a tie
-    // initially.  But it's a lot more code.)
-
-    if (nclasses1 < nfragatoms) {
-      for (int i = 0; i < 100;i++) {  //sanity check - shouldn't ever hit this number
-        CreateNewClassVector(symmetry_classes, tmp_classes);
-        CountAndRenumberClasses(tmp_classes, nclasses2);
-        symmetry_classes = tmp_classes;
-        if (nclasses1 == nclasses2) break;
-        nclasses1 = nclasses2;
+    while (true) {
+      // How many classes are we starting with?  (The "renumber" part isn't relevant.)
+      CountAndRenumberClasses(classes, nclasses1, order);
+
+      // LOOP: Do extended sum-of-invarients until no further changes are
+      // noted.
+      if (nclasses1 < nfragatoms) {
+        for (int i = 0; i < 100;i++) {  //sanity check - shouldn't ever hit this number
+          CreateNewClassVector(classes, nbrStart, nbrs, tmp_classes);
+          CountAndRenumberClasses(tmp_classes, nclasses2, order);
+          classes.swap(tmp_classes);
+          if (nclasses1 == nclasses2) break;
+          nclasses1 = nclasses2;
+        }
       }
-    }
 
-    CreateNewClassVector(symmetry_classes, tmp_classes);
-    CountAndRenumberClasses(tmp_classes, nclasses2);
+      CreateNewClassVector(classes, nbrStart, nbrs, tmp_classes);
+      CountAndRenumberClasses(tmp_classes, nclasses2, order);
 
+      if (nclasses1 == nclasses2)
+        break;
 
-    if (nclasses1 != nclasses2) {
-      symmetry_classes = tmp_classes;
-      return ExtendInvariants(symmetry_classes);
+      classes.swap(tmp_classes);
     }
 
+    for (std::size_t i = 0; i < symmetry_classes.size(); ++i)
+      symmetry_classes[i].second = classes[i];
 
     return nclasses1;
   }
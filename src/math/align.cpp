@@ -395,11 +395,16 @@ namespace OpenBabel
       }
     }
     else { // Need to deal with the case where hydrogens were excluded
-      vector<vector3> target_coords;
-      for (unsigned int i=1; i<=_ptargetmol->NumAtoms(); ++i)
-        target_coords.push_back(_ptargetmol->GetAtom(i)->GetVector());
       Eigen::MatrixXd mtarget;
-      VectorsToMatrix(&target_coords, mtarget);
+      const double *c = _ptargetmol->GetCoordinates();
+      if (c) // the coordinate array is already a column-major 3xN matrix
+        mtarget = Eigen::Map<const Eigen::MatrixXd>(c, 3, _ptargetmol->NumAtoms());
+      else {
+        vector<vector3> target_coords;
+        for (unsigned int i=1; i<=_ptargetmol->NumAtoms(); ++i)
+          target_coords.push_back(_ptargetmol->GetAtom(i)->GetVector());
+        VectorsToMatrix(&target_coords, mtarget);
+      }
 
       // Subtract the centroid of the non-H atoms
       for (unsigned int i=0; i<mtarget.cols(); ++i)
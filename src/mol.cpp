@@ -36,6 +36,7 @@ GNU General Public License for more details.
 #include <openbabel/stereo/tetrahedral.h>
 #include <openbabel/stereo/cistrans.h>
 
+#include <algorithm>
 #include <sstream>
 #include <set>
 
@@ -1469,8 +1470,9 @@ namespace OpenBabel
     //clear out the multiconformer data
     vector<double*>::iterator k;
     for (k = _vconf.begin();k != _vconf.end();++k)
-      delete [] *k;
+      FreeConformer(*k);
     _vconf.clear();
+    _vborrowed.clear();
 
     //Clear flags except OB_PATTERN_STRUCTURE which is left the same
     _flags &= OB_PATTERN_STRUCTURE;
@@ -1497,10 +1499,11 @@ namespace OpenBabel
 
         vector<double*>::iterator j;
         for (j = _vconf.begin();j != _vconf.end();++j)
-          delete [] *j;
+          FreeConformer(*j);
 
         _c = nullptr;
         _vconf.clear();
+        _vborrowed.clear();
 
         //Destroy rotamer list if necessary
         if ((OBRotamerList *)GetData(OBGenericDataType::RotamerList))
@@ -2197,7 +2200,7 @@ namespace OpenBabel
         memset(tmpf,'\0',sizeof(double)*(NumAtoms()+count)*3);
         if (hasCoords)
           memcpy(tmpf,(*j),sizeof(double)*NumAtoms()*3);
-        delete []*j;
+        FreeConformer(*j);
         *j = tmpf;
       }
 
@@ -2311,7 +2314,7 @@ namespace OpenBabel
       {
         tmpf = new double [(NumAtoms()+hcount)*3+10];
         memcpy(tmpf,(*j),sizeof(double)*NumAtoms()*3);
-        delete []*j;
+        FreeConformer(*j);
         *j = tmpf;
       }
 
@@ -2775,8 +2778,9 @@ namespace OpenBabel
     //clear out the multiconformer data
     vector<double*>::iterator k;
     for (k = _vconf.begin();k != _vconf.end();++k)
-      delete [] *k;
+      FreeConformer(*k);
     _vconf.clear();
+    _vborrowed.clear();
   }
 
   bool OBMol::HasNonZeroCoords()
@@ -2955,6 +2959,175 @@ namespace OpenBabel
     return true;
   }
 
+  //! Grid cell of each atom for FindBondCandidates()
+  struct BondGridCell
+  {
+    int x, y, z;
+    bool operator<(const BondGridCell &o) const
+    {
+      if (x != o.x) return x < o.x;
+      if (y != o.y) return y < o.y;
+      return z < o.z;
+    }
+    bool operator==(const BondGridCell &o) const
+    { return x == o.x && y == o.y && z == o.z; }
+  };
+
+  //! \return the squared distance between atoms \p idx1 and \p idx2 in
+  //! \p c, using the minimum image convention if \p unitCell is set
+  static double BondDistanceSq(const double *c, int idx1, int idx2, OBUnitCell *unitCell)
+  {
+    if (unitCell)
+      {
+        vector3 atom1(c[idx1*3], c[idx1*3+1], c[idx1*3+2]);
+        vector3 atom2(c[idx2*3], c[idx2*3+1], c[idx2*3+2]);
+        return unitCell->MinimumImageCartesian(atom1 - atom2).length_2();
+      }
+    double d2 = SQUARE(c[idx1*3] - c[idx2*3]);
+    d2 += SQUARE(c[idx1*3+1] - c[idx2*3+1]);
+    d2 += SQUARE(c[idx1*3+2] - c[idx2*3+2]);
+    return d2;
+  }
+
+  //! For each atom j in \p order (indexes into the coordinates \p c), set
+  //! \p candidates[j] to the later atoms k > j which are within bonding
+  //! distance: closer than rad[j] + rad[k] + 0.45 but not closer than 0.4.
+  //! \p cellSize is the largest bonding distance.
+  static void FindBondCandidates(const double *c, const vector<int> &order,
+                                 const vector<double> &rad, double cellSize,
+                                 OBUnitCell *unitCell,
+                                 vector<vector<int> > &candidates)
+  {
+    int n = order.size();
+    candidates.assign(n, vector<int>());
+    if (n < 2)
+      return;
+
+    // Allow for rounding when assigning atoms to cells
+    cellSize += 0.01;
+
+    vector<vector3> pos(n);
+    int ncells[3] = {0, 0, 0}; // only used for periodic grids
+    if (unitCell)
+      {
+        // The number of cells along each axis is limited by the distance
+        // between opposite faces of the unit cell
+        vector3 origin = unitCell->FractionalToCartesian(VZero);
+        vector3 a = unitCell->FractionalToCartesian(VX) - origin;
+        vector3 b = unitCell->FractionalToCartesian(VY) - origin;
+        vector3 cv = unitCell->FractionalToCartesian(VZ) - origin;
+        double volume = fabs(dot(a, cross(b, cv)));
+        double width[3] = { volume / cross(b, cv).length(),
+                            volume / cross(cv, a).length(),
+                            volume / cross(a, b).length() };
+        for (int axis = 0; axis < 3; ++axis)
+          ncells[axis] = width[axis] > cellSize ?
+            std::min(1024, static_cast<int>(width[axis] / cellSize)) : 1;
+        for (int j = 0; j < n; ++j)
+          {
+            int idx = order[j];
+            vector3 f = unitCell->CartesianToFractional(vector3(c[idx*3], c[idx*3+1], c[idx*3+2]));
+            pos[j] = vector3(f.x() - floor(f.x()), f.y() - floor(f.y()), f.z() - floor(f.z()));
+          }
+      }
+    else
+      {
+        vector3 lo(c[order[0]*3], c[order[0]*3+1], c[order[0]*3+2]), hi = lo;
+        for (int j = 0; j < n; ++j)
+          {
+            int idx = order[j];
+            pos[j] = vector3(c[idx*3], c[idx*3+1], c[idx*3+2]);
+            lo = vector3(std::min(lo.x(), pos[j].x()), std::min(lo.y(), pos[j].y()), std::min(lo.z(), pos[j].z()));
+            hi = vector3(std::max(hi.x(), pos[j].x()), std::max(hi.y(), pos[j].y()), std::max(hi.z(), pos[j].z()));
+          }
+        // Keep the cell indices in range for widely separated atoms
+        vector3 extent = hi - lo;
+        double widest = std::max(extent.x(), std::max(extent.y(), extent.z()));
+        cellSize = std::max(cellSize, widest / 1000000.0);
+        for (int j = 0; j < n; ++j)
+          pos[j] = (pos[j] - lo) / cellSize;
+      }
+
+    // Sort the atoms by cell, so each cell is a contiguous range
+    vector<pair<BondGridCell, int> > cellAtoms(n);
+    for (int j = 0; j < n; ++j)
+      {
+        BondGridCell &cell = cellAtoms[j].first;
+        if (unitCell)
+          {
+            cell.x = std::min(ncells[0] - 1, static_cast<int>(pos[j].x() * ncells[0]));
+            cell.y = std::min(ncells[1] - 1, static_cast<int>(pos[j].y() * ncells[1]));
+            cell.z = std::min(ncells[2] - 1, static_cast<int>(pos[j].z() * ncells[2]));
+          }
+        else
+          {
+            cell.x = static_cast<int>(pos[j].x());
+            cell.y = static_cast<int>(pos[j].y());
+            cell.z = static_cast<int>(pos[j].z());
+          }
+        cellAtoms[j].second = j;
+      }
+    sort(cellAtoms.begin(), cellAtoms.end());
+    vector<int> cellStart;
+    for (int i = 0; i < n; ++i)
+      if (i == 0 || !(cellAtoms[i].first == cellAtoms[i-1].first))
+        cellStart.push_back(i);
+    int nOccupied = cellStart.size();
+    cellStart.push_back(n);
+
+    // Each cell is compared with its (up to 26) neighbours. The cells are
+    // independent of one another, so they can be done in parallel.
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 64)
+#endif
+    for (int ci = 0; ci < nOccupied; ++ci)
+      {
+        const BondGridCell &home = cellAtoms[cellStart[ci]].first;
+        vector<BondGridCell> nbrCells;
+        for (int dx = -1; dx <= 1; ++dx)
+          for (int dy = -1; dy <= 1; ++dy)
+            for (int dz = -1; dz <= 1; ++dz)
+              {
+                BondGridCell cell = { home.x + dx, home.y + dy, home.z + dz };
+                if (unitCell)
+                  {
+                    cell.x = (cell.x + ncells[0]) % ncells[0];
+                    cell.y = (cell.y + ncells[1]) % ncells[1];
+                    cell.z = (cell.z + ncells[2]) % ncells[2];
+                  }
+                nbrCells.push_back(cell);
+              }
+        // Small periodic grids wrap onto the same cell more than once
+        sort(nbrCells.begin(), nbrCells.end());
+        nbrCells.erase(unique(nbrCells.begin(), nbrCells.end()), nbrCells.end());
+
+        for (vector<BondGridCell>::iterator nc = nbrCells.begin(); nc != nbrCells.end(); ++nc)
+          {
+            vector<pair<BondGridCell, int> >::const_iterator first =
+              lower_bound(cellAtoms.begin(), cellAtoms.end(), make_pair(*nc, -1));
+            for (int a = cellStart[ci]; a < cellStart[ci+1]; ++a)
+              {
+                int j = cellAtoms[a].second;
+                for (vector<pair<BondGridCell, int> >::const_iterator it = first;
+                     it != cellAtoms.end() && it->first == *nc; ++it)
+                  {
+                    int k = it->second;
+                    if (k <= j)
+                      continue;
+                    // bonded if closer than elemental Rcov + tolerance
+                    double cutoff = SQUARE(rad[j] + rad[k] + 0.45);
+                    double d2 = BondDistanceSq(c, order[j], order[k], unitCell);
+                    if (d2 > cutoff)
+                      continue;
+                    if (d2 < 0.16) // 0.4 * 0.4 = 0.16
+                      continue;
+                    candidates[j].push_back(k);
+                  }
+              }
+          }
+      }
+  }
+
   /*! This method adds single bonds between all atoms
     closer than their combined atomic covalent radii,
     then "cleans up" making sure bonded atoms are not
@@ -2977,7 +3150,7 @@ namespace OpenBabel
                             "Ran OpenBabel::ConnectTheDots", obAuditMsg);
 
 
-    int j,k,max;
+    int j,max;
     double maxrad = 0;
     bool unset = false;
     OBAtom *atom,*nbr;
@@ -3015,53 +3188,24 @@ namespace OpenBabel
         zsorted.push_back(atom->GetIdx()-1);
       }
 
+    // Find the candidate pairs using a uniform grid with cells at least as
+    // wide as the largest bonding distance, so only atoms in the same or
+    // adjacent cells need to be compared. For a periodic cell the grid is
+    // laid over the unit cell in fractional coordinates and wraps around.
+    OBUnitCell *unitCell = IsPeriodic() ?
+      static_cast<OBUnitCell*>(GetData(OBGenericDataType::UnitCell)) : nullptr;
+    vector<vector<int> > candidates;
+    FindBondCandidates(c, zsorted, rad, 2.0 * maxrad + 0.45, unitCell, candidates);
+
+    // Add the bonds in the same order as a pairwise scan of the z-sorted atoms
     int idx1, idx2;
-    double d2,cutoff,zd;
-    vector3 atom1, atom2, wrapped_coords;  // Only used for periodic coords
     for (j = 0 ; j < max ; ++j)
       {
-        double maxcutoff = SQUARE(rad[j]+maxrad+0.45);
         idx1 = zsorted[j];
-        for (k = j + 1 ; k < max ; k++ )
+        sort(candidates[j].begin(), candidates[j].end());
+        for (vector<int>::iterator kit = candidates[j].begin(); kit != candidates[j].end(); ++kit)
           {
-            idx2 = zsorted[k];
-
-            // bonded if closer than elemental Rcov + tolerance
-            cutoff = SQUARE(rad[j] + rad[k] + 0.45);
-
-            // Use minimum image convention if the unit cell is periodic
-            // Otherwise, use a simpler (faster) distance calculation based on raw coordinates
-            if (IsPeriodic())
-              {
-                atom1 = vector3(c[idx1*3], c[idx1*3+1], c[idx1*3+2]);
-                atom2 = vector3(c[idx2*3], c[idx2*3+1], c[idx2*3+2]);
-                OBUnitCell *unitCell = (OBUnitCell * ) GetData(OBGenericDataType::UnitCell);
-                wrapped_coords = unitCell->MinimumImageCartesian(atom1 - atom2);
-                d2 = wrapped_coords.length_2();
-              }
-            else
-              {
-                zd  = SQUARE(c[idx1*3+2] - c[idx2*3+2]);
-                // bigger than max cutoff, which is determined using largest radius,
-                // not the radius of k (which might be small, ie H, and cause an early  termination)
-                // since we sort by z, anything beyond k will also fail
-                if (zd > maxcutoff )
-                  break;
-
-                d2  = SQUARE(c[idx1*3]   - c[idx2*3]);
-                if (d2 > cutoff)
-                  continue; // x's bigger than cutoff
-                d2 += SQUARE(c[idx1*3+1] - c[idx2*3+1]);
-                if (d2 > cutoff)
-                  continue; // x^2 + y^2 bigger than cutoff
-                d2 += zd;
-              }
-
-            if (d2 > cutoff)
-              continue;
-            if (d2 < 0.16) // 0.4 * 0.4 = 0.16
-              continue;
-
+            idx2 = zsorted[*kit];
             atom = GetAtom(idx1+1);
             nbr  = GetAtom(idx2+1);
 
@@ -3692,7 +3836,7 @@ namespace OpenBabel
     if (!HasData(OBGenericDataType::ConformerData))
       SetData(new OBConformerData);
     OBConformerData *cd = (OBConformerData*) GetData(OBGenericDataType::ConformerData);
-    vector<double> energies = cd->GetEnergies();
+    const vector<double> &energies = cd->GetEnergies();
 
     if (((unsigned int)ci >= energies.size()) || (ci < 0))
       return 0.0;
@@ -3700,11 +3844,87 @@ namespace OpenBabel
     return energies[ci];
   }
 
+  void OBMol::FreeConformer(double *c)
+  {
+    if (!_vborrowed.empty()) {
+      vector<double*>::iterator i = std::find(_vborrowed.begin(), _vborrowed.end(), c);
+      if (i != _vborrowed.end()) {
+        _vborrowed.erase(i); // owned by the caller
+        return;
+      }
+    }
+    vector<ConformerBlock>::iterator b;
+    for (b = _vconfblocks.begin(); b != _vconfblocks.end(); ++b)
+      if (c >= b->start && c < b->start + b->size) {
+        if (--b->nused == 0) {
+          delete [] b->start;
+          _vconfblocks.erase(b);
+        }
+        return;
+      }
+    delete [] c;
+  }
+
+  double *OBMol::AddConformers(unsigned int n)
+  {
+    if (n == 0)
+      return nullptr;
+    size_t size = 3 * static_cast<size_t>(NumAtoms());
+    double *block = new double [size * n]();
+    ConformerBlock b = { block, size * n, n };
+    _vconfblocks.push_back(b);
+    _vconf.reserve(_vconf.size() + n);
+    for (unsigned int k = 0; k < n; ++k)
+      _vconf.push_back(block + k * size);
+    return block;
+  }
+
+  void OBMol::PackConformers()
+  {
+    if (_vconf.empty())
+      return;
+    size_t size = 3 * static_cast<size_t>(NumAtoms());
+    size_t nconfs = _vconf.size();
+    // Nothing to do if the conformers already fill one owned block in order
+    if (_vconfblocks.size() == 1 && _vborrowed.empty()
+        && _vconfblocks[0].start == _vconf[0] && _vconfblocks[0].size == size * nconfs
+        && GetConformerView().Stride() == static_cast<std::ptrdiff_t>(size))
+      return;
+
+    double *block = new double [size * nconfs];
+    for (size_t k = 0; k < nconfs; ++k) {
+      memcpy(block + k * size, _vconf[k], sizeof(double) * size);
+      if (_vconf[k] == _c)
+        _c = block + k * size;
+      FreeConformer(_vconf[k]);
+      _vconf[k] = block + k * size;
+    }
+    ConformerBlock b = { block, size * nconfs, static_cast<unsigned int>(nconfs) };
+    _vconfblocks.push_back(b);
+  }
+
+  int OBMol::BorrowConformer(double *f)
+  {
+    _vconf.push_back(f);
+    _vborrowed.push_back(f);
+    return static_cast<int>(_vconf.size()) - 1;
+  }
+
+  bool OBMol::IsConformerBorrowed(int i) const
+  {
+    if (i < 0 || i >= (signed)_vconf.size())
+      return false;
+    return std::find(_vborrowed.begin(), _vborrowed.end(), _vconf[i]) != _vborrowed.end();
+  }
+
   void OBMol::SetConformers(vector<double*> &v)
   {
+    vector<double*> kept(v); // conformers which are in v stay as they are
+    std::sort(kept.begin(), kept.end());
     vector<double*>::iterator i;
     for (i = _vconf.begin();i != _vconf.end();++i)
-      delete [] *i;
+      if (!std::binary_search(kept.begin(), kept.end(), *i))
+        FreeConformer(*i);
 
     _vconf = v;
     _c = _vconf.empty() ? nullptr : _vconf[0];
@@ -3717,7 +3937,7 @@ namespace OpenBabel
       _c = _vconf[i];
   }
 
-  void OBMol::CopyConformer(double *c,int idx)
+  void OBMol::CopyConformer(double *c,int idx) const
   {
     //    obAssert(!_vconf.empty() && (unsigned)idx < _vconf.size());
     memcpy((char*)c, (char*)_vconf[idx], sizeof(double)*3*NumAtoms());
@@ -3741,7 +3961,7 @@ namespace OpenBabel
     if (idx < 0 || idx >= (signed)_vconf.size())
       return;
 
-    delete [] _vconf[idx];
+    FreeConformer(_vconf[idx]);
     _vconf.erase((_vconf.begin()+idx));
   }
 
@@ -42,16 +42,19 @@ GNU General Public License for more details.
 #include <limits>
 #include <typeinfo>
 #include <iterator>
+#include <algorithm>
 
 #include <cstdlib>
 
 #include <openbabel/obconversion.h>
 //#include <openbabel/mol.h>
 #include <openbabel/locale.h>
+#include <openbabel/recordindex.h>
 
 #ifdef HAVE_LIBZ
 #include "zipstream.h"
 #endif
+#include "asyncstream.h"
 
 #if !HAVE_STRNCASECMP
 extern "C" int strncasecmp(const char *s1, const char *s2, size_t n);
@@ -233,7 +236,8 @@ namespace OpenBabel {
     EndNumber(0), Count(-1), m_IsFirstInput(true), m_IsLast(true),
     MoreFilesToCome(false), OneObjectOnly(false), ReadyToInput(false), SkippedMolecules(false),
     inFormatGzip(false), outFormatGzip(false),
-    pOb1(nullptr), wInpos(0), wInlen(0), pAuxConv(nullptr)
+    pOb1(nullptr), wInpos(0), wInlen(0), pAuxConv(nullptr),
+    pInState(nullptr), pOutState(nullptr)
   {
    	SetInStream(is);
    	SetOutStream(os);
@@ -251,7 +255,8 @@ namespace OpenBabel {
         EndNumber(0), Count(-1), m_IsFirstInput(true), m_IsLast(true),
         MoreFilesToCome(false), OneObjectOnly(false), ReadyToInput(false), SkippedMolecules(false),
         inFormatGzip(false), outFormatGzip(false),
-        pOb1(nullptr), wInpos(0), wInlen(0), pAuxConv(nullptr)
+        pOb1(nullptr), wInpos(0), wInlen(0), pAuxConv(nullptr),
+        pInState(nullptr), pOutState(nullptr)
   {
     //These options take a parameter
     RegisterOptionParam("f", nullptr, 1,GENOPTIONS);
@@ -261,7 +266,8 @@ namespace OpenBabel {
   }
 
   /////////////////////////////////////////////////
-  OBConversion::OBConversion(const OBConversion& o)
+  OBConversion::OBConversion(const OBConversion& o) :
+    pInState(nullptr), pOutState(nullptr)
   {
     *this = o;
   }
@@ -332,12 +338,17 @@ namespace OpenBabel {
 
   /// Set input stream, removing/deallocating previous stream if necessary.
   /// If takeOwnership is true, takes responsibility for freeing pIn
+  /// An owned file stream is read ahead on another thread.
   void OBConversion::SetInStream(std::istream* pIn, bool takeOwnership)
   {
-      //clear and deallocate any existing streams
-      for(unsigned i = 0, n = ownedInStreams.size(); i < n; i++)
+      //the format's data belongs to the old stream
+      SetInState(nullptr);
+
+      //clear and deallocate any existing streams, outermost first
+      //since a read-ahead stream may still be reading the one below it
+      for(unsigned i = ownedInStreams.size(); i > 0; i--)
       {
-        delete ownedInStreams[i];
+        delete ownedInStreams[i-1];
       }
       ownedInStreams.clear();
       pInput = nullptr;
@@ -348,14 +359,31 @@ namespace OpenBabel {
               ownedInStreams.push_back(pIn);
           pInput = pIn; //simplest case
 
+          bool readAhead = takeOwnership && dynamic_cast<std::ifstream*>(pIn);
   #ifdef HAVE_LIBZ
           if(IsOption("zin", GENOPTIONS) || inFormatGzip)
           {
+            readAhead = false;
             zlib_stream::zip_istream *zIn = new zlib_stream::zip_istream(*pInput);
             ownedInStreams.push_back(zIn);
             pInput = zIn;
+            //decompress on another thread if there is a spare processor
+            if(std::thread::hardware_concurrency() > 1)
+            {
+              ReadAheadInStream *raIn = new ReadAheadInStream(*pInput);
+              ownedInStreams.push_back(raIn);
+              pInput = raIn;
+            }
           }
   #endif
+          //read a file in large chunks on another thread, so that waiting
+          //for the file system overlaps with parsing
+          if(readAhead)
+          {
+            ReadAheadInStream *raIn = new ReadAheadInStream(*pInput, 1 << 18);
+            ownedInStreams.push_back(raIn);
+            pInput = raIn;
+          }
           //always transform newlines if input isn't binary/xml
           if(pInFormat && !(pInFormat->Flags() & (READBINARY | READXML)) &&
               pIn != &std::cin) //avoid filtering stdin as well
@@ -374,6 +402,9 @@ namespace OpenBabel {
   /// destroyed before the underlying outputstream is deallocated.
   void OBConversion::SetOutStream(std::ostream* pOut, bool takeOwnership)
   {
+    //let the format finish writing to the old stream
+    SetOutState(nullptr);
+
     //clear and deallocate any existing streams
     for (unsigned i = 0, n = ownedOutStreams.size(); i < n; i++)
     {
@@ -392,7 +423,8 @@ namespace OpenBabel {
 
       if (IsOption("z", GENOPTIONS) || outFormatGzip)
       {
-        zlib_stream::zip_ostream *zOut = new zlib_stream::zip_ostream(*pOutput, true);
+        //gzip in independent BGZF blocks, compressed in parallel
+        zlib_stream::bgzf_ostream *zOut = new zlib_stream::bgzf_ostream(*pOutput);
         //we need to delete the zstream _before_ the underlying stream so it can add the footer
         ownedOutStreams.insert(ownedOutStreams.begin(),zOut);
         pOutput = zOut;
@@ -403,6 +435,24 @@ namespace OpenBabel {
 
 
 
+  void OBConversion::SetInState(OBFormatState* pState)
+  {
+    if(pInState != pState)
+      delete pInState;
+    pInState = pState;
+  }
+
+  void OBConversion::SetOutState(OBFormatState* pState)
+  {
+    if(pOutState && pOutState != pState)
+    {
+      if(pOutput)
+        pOutState->End(*pOutput);
+      delete pOutState;
+    }
+    pOutState = pState;
+  }
+
 //////////////////////////////////////////////////////
   /// Sets the formats from their ids, e g CML.
   /// If inID is NULL, the input format is left unchanged. Similarly for outID
@@ -454,6 +504,8 @@ namespace OpenBabel {
   //////////////////////////////////////////////////////
   /// Convert molecules from is into os.  If either is null, uses existing streams.
   /// If streams are specified, they do _not_ replace any existing streams.
+  /// A file is read ahead and written behind on other threads; afterwards
+  /// \p is is left at the position reached by the conversion.
   int OBConversion::Convert(istream* is, ostream* os)
   {
     StreamState savedIn, savedOut;
@@ -466,7 +518,11 @@ namespace OpenBabel {
       }
 #endif
       savedIn.pushInput(*this);
-      SetInStream(is, false);
+      //the file is only used during this call, so it can be read ahead
+      if(dynamic_cast<std::ifstream*>(is))
+        SetInStream(new ReadAheadInStream(*is, 1 << 18), true);
+      else
+        SetInStream(is, false);
     }
 
     if (os)
@@ -524,6 +580,10 @@ namespace OpenBabel {
     if(pInFormat->Flags() & READONEONLY)
       OneObjectOnly=true;
 
+    //Write a file on another thread during the conversion. It is flushed
+    //and the file stream restored when wbOut goes out of scope.
+    WriteBehindScope wbOut(pOutput);
+
     //Input loop
     while(ReadyToInput && pInput->good()) //Possible to omit? && pInStream->peek() != EOF
       {
@@ -603,6 +663,8 @@ namespace OpenBabel {
     if(pOutFormat && (!oae || m_IsLast))
       if((oae || pOb1) && !pOutFormat->WriteChemObject(this))
         Index--;
+    if(m_IsLast)
+      SetOutState(nullptr); //finish the output
 
     //Put AddChemObject() into non-queue mode
     Count= -1;
@@ -613,8 +675,34 @@ namespace OpenBabel {
     return Index; //The number actually output
   }
   //////////////////////////////////////////////////////
+  /// Get the record index of an input file, reading the sidecar index
+  /// or, if \p build is set, making (and saving) a new one.
+  static bool GetRecordIndex(OBRecordIndex& recindex, const string& filename,
+                             OBFormat* pFormat, bool build)
+  {
+    if(filename.empty() || !OBRecordIndex::CanIndex(pFormat))
+      return false;
+    string indexfile = OBRecordIndex::IndexFilename(filename);
+    if(recindex.Read(indexfile, filename, pFormat))
+      return true;
+    if(!build || !recindex.Build(filename, pFormat))
+      return false;
+    if(!recindex.Write(indexfile))
+      obErrorLog.ThrowError(__FUNCTION__, "Cannot write index file " + indexfile, obWarning);
+    return true;
+  }
+
   bool OBConversion::SetStartAndEnd()
   {
+    //The record index holds offsets in the file, so can only be used
+    //if the input is not compressed and is still at the start. Input
+    //options can change how a file is divided into objects (e.g. pdb -aT),
+    //so it is not used with them either.
+    OBRecordIndex recindex;
+    bool indexed = pInput && pInput!=&std::cin && !inFormatGzip && !IsOption("zin",GENOPTIONS)
+      && GetOptions(INOPTIONS)->empty() && pInput->tellg()==streampos(0)
+      && GetRecordIndex(recindex, InFilename, pInFormat, IsOption("index",GENOPTIONS)!=nullptr);
+
     unsigned int TempStartNumber=0;
     const char* p = IsOption("f",GENOPTIONS);
     if(p)
@@ -623,8 +711,20 @@ namespace OpenBabel {
         if(StartNumber>1)
           {
             TempStartNumber=StartNumber;
-            //Try to skip objects now
-            int ret = pInFormat->SkipObjects(StartNumber-1,this);
+            //Try to skip objects now, going straight there if the file is indexed
+            int ret;
+            if(indexed)
+              {
+                ret = -1;
+                if(StartNumber-1 <= recindex.NumRecords())
+                  {
+                    pInput->seekg(recindex.Offset(StartNumber-1));
+                    if(*pInput)
+                      ret = 1;
+                  }
+              }
+            else
+              ret = pInFormat->SkipObjects(StartNumber-1,this);
             if(ret==-1) //error
               return false;
             if(ret==1) //success:objects skipped
@@ -834,7 +934,9 @@ namespace OpenBabel {
         inFormatGzip = true;
       }
 #endif
-      SetInStream(pin, false);
+      //the same stream is read on, keeping any data the format has for it
+      if(pin != pInput)
+        SetInStream(pin, false);
     }
 
 
@@ -878,8 +980,18 @@ namespace OpenBabel {
     // If we failed to read, plus the stream is over, then check if this is a stream from ReadFile
     if (!success && !pInput->good() && ownedInStreams.size() > 0) {
       ifstream *inFstream = dynamic_cast<ifstream*>(ownedInStreams[0]);
-      if (inFstream != nullptr)
+      if (inFstream != nullptr) {
+        //A read-ahead stream above the file may still be reading it on
+        //another thread, so free the streams above it first, outermost first
+        ios_base::iostate state = pInput->rdstate();
+        while (ownedInStreams.size() > 1) {
+          delete ownedInStreams.back();
+          ownedInStreams.pop_back();
+        }
+        pInput = inFstream;
         inFstream->close(); // We will free the stream later, but close the file now
+        inFstream->clear(state);
+      }
     }
 
     return success;
@@ -892,7 +1004,7 @@ namespace OpenBabel {
   /// Returns true if successful.
   bool OBConversion::Write(OBBase* pOb, ostream* pos)
   {
-    if(pos) SetOutStream(pos, false);
+    if(pos && pos != pOutput) SetOutStream(pos, false);
 
     if(!pOutFormat || !pOutput) return false;
 
@@ -928,9 +1040,11 @@ namespace OpenBabel {
 
     pStream = conv.pInput;
     std::copy(conv.ownedInStreams.begin(), conv.ownedInStreams.end(), std::back_inserter(ownedStreams));
+    pState = conv.pInState;
 
     conv.pInput = nullptr;
     conv.ownedInStreams.clear();
+    conv.pInState = nullptr;
   }
 
   //restore state, blowing away whatever is in conv
@@ -938,6 +1052,7 @@ namespace OpenBabel {
   {
     conv.SetInStream(nullptr);
     conv.pInput =  dynamic_cast<std::istream*>(pStream);
+    conv.pInState = pState;
 
     assert(conv.ownedInStreams.size() == 0); //should be empty
 
@@ -950,6 +1065,7 @@ namespace OpenBabel {
 
     pStream = nullptr;
     ownedStreams.clear();
+    pState = nullptr;
   }
 
   //save the current output state to this streamstate and clear conv
@@ -959,9 +1075,11 @@ namespace OpenBabel {
 
     pStream = conv.pOutput;
     std::copy(conv.ownedOutStreams.begin(), conv.ownedOutStreams.end(), std::back_inserter(ownedStreams));
+    pState = conv.pOutState;
 
     conv.pOutput = nullptr;
     conv.ownedOutStreams.clear();
+    conv.pOutState = nullptr;
   }
 
   //restore state, blowing away whatever is in conv
@@ -969,6 +1087,7 @@ namespace OpenBabel {
   {
     conv.SetOutStream(nullptr);
     conv.pOutput =  dynamic_cast<std::ostream*>(pStream);
+    conv.pOutState = pState;
 
     assert(conv.ownedOutStreams.size() == 0); //should be empty
 
@@ -981,6 +1100,7 @@ namespace OpenBabel {
 
     pStream = nullptr;
     ownedStreams.clear();
+    pState = nullptr;
   }
 
   //////////////////////////////////////////////////
@@ -1155,9 +1275,10 @@ namespace OpenBabel {
       "Conversion options\n"
       "-f <#> Start import at molecule # specified\n"
       "-l <#> End import at molecule # specified\n"
+      "--index Make a sidecar index of the input file so -f goes straight there\n"
       "-e Continue with next object after error, if possible\n"
       #ifdef HAVE_LIBZ
-      "-z Compress the output with gzip\n"
+      "-z Compress the output with gzip (as BGZF blocks)\n"
       "-zin Decompress the input with gzip\n"
       #endif
       "-k Attempt to translate keywords\n";
@@ -1765,15 +1886,24 @@ Additional options :
     if( (p=IsOption("l", GENOPTIONS)) ) // extra parens to indicate truth value
       nlast=atoi(p);
 
-    ifs.seekg(0); //rewind
-    //Compressed files currently show an error here.***TAKE CHANCE: RESET ifs****
-    ifs.clear();
-
     OBFormat* pFormat = GetInFormat();
     int count=0;
-    //skip each object but stop after nlast objects
-    while(ifs && pFormat->SkipObjects(1, this)>0  && count<nlast)
-      ++count;
+    OBRecordIndex recindex;
+    //as in SetStartAndEnd(), input options may divide the file differently
+    if(&ifs!=&std::cin && !inFormatGzip && !IsOption("zin",GENOPTIONS)
+       && GetOptions(INOPTIONS)->empty()
+       && GetRecordIndex(recindex, InFilename, pFormat, false))
+      count = min<unsigned long>(recindex.NumRecords(), nlast);
+    else
+    {
+      ifs.seekg(0); //rewind
+      //Compressed files currently show an error here.***TAKE CHANCE: RESET ifs****
+      ifs.clear();
+
+      //skip each object but stop after nlast objects
+      while(ifs && pFormat->SkipObjects(1, this)>0  && count<nlast)
+        ++count;
+    }
 
     ifs.clear(); //clear eof
     ifs.seekg(pos); //restore old position
@@ -22,6 +22,7 @@ General Public License for more details.
 #include <iostream>
 #include <string>
 #include <algorithm>
+#include <mutex>
 
 #include <openbabel/oberror.h>
 
@@ -159,11 +160,17 @@ namespace OpenBabel
     delete _filterStreamBuf;
   }
 
+  // Messages may be thrown on several threads at once, e.g. by perception
+  // while fingerprints are made in parallel, so the log is changed under a lock
+  static std::mutex messageMutex;
+
   void OBMessageHandler::ThrowError(OBError err, errorQualifier qualifier)
   {
     if (!_logging)
       return;
 
+    std::lock_guard<std::mutex> lock(messageMutex);
+
     //Output error message if level sufficiently high and, if onceOnly set, it has not been logged before
     if (err.GetLevel() <= _outputLevel &&
       (qualifier!=onceOnly || find(_messageList.begin(), _messageList.end(), err)==_messageList.end()))
@@ -194,6 +201,8 @@ namespace OpenBabel
     deque<OBError>::iterator i;
     OBError error;
 
+    std::lock_guard<std::mutex> lock(messageMutex);
+
     for (i = _messageList.begin(); i != _messageList.end(); ++i)
       {
         error = (*i);
@@ -19,6 +19,7 @@ GNU General Public License for more details.
 #include <openbabel/obmolecformat.h>
 #include <openbabel/mol.h>
 #include <openbabel/reaction.h>
+#include <openbabel/generic.h>
 
 #include <algorithm>
 #include <iterator> // Required for MSVC2015 use of std::back_inserter
@@ -53,7 +54,7 @@ namespace OpenBabel
      {
        while(ret) //do all the molecules in the file
        {
-         ret = pFormat->ReadMolecule(pmol,pConv);
+         ret = pFormat->ReadMolecule(pmol,pConv) && OBDeferredStructure::Expand(pmol);
 
          if(ret && (pmol->NumAtoms() > 0 || (pFormat->Flags()&ZEROATOMSOK)))
          {
@@ -106,7 +107,8 @@ namespace OpenBabel
     //or the format allows zero-atom molecules and it has a title or properties
     if(ret && (pmol->NumAtoms() > 0
       || pmol->IsReaction()
-      || (pFormat->Flags()&ZEROATOMSOK && (*pmol->GetTitle() || pmol->HasData(1)))))
+      || (pFormat->Flags()&ZEROATOMSOK && (*pmol->GetTitle() || pmol->HasData(1)))
+      || pmol->HasData(OBGenericDataType::DeferredStructureData)))
     {
       ptmol = static_cast<OBMol*>(pmol->DoTransformations(pConv->GetOptions(OBConversion::GENOPTIONS),pConv));
       if(ptmol && (pConv->IsOption("j",OBConversion::GENOPTIONS)
@@ -156,7 +158,15 @@ namespace OpenBabel
     bool ret=false;
     if(pmol)
       {
-        if(pmol->NumAtoms()==0)
+        //Only the format which read a deferred structure can write it as it is
+        OBDeferredStructure* pDef = static_cast<OBDeferredStructure*>
+          (pmol->GetData(OBGenericDataType::DeferredStructureData));
+        if(pDef && pDef->GetFormat()!=pFormat)
+          {
+            OBDeferredStructure::Expand(pmol);
+            pDef = nullptr;
+          }
+        if(pmol->NumAtoms()==0 && !pDef)
           {
             std::string auditMsg = "OpenBabel::Molecule ";
             auditMsg += pmol->GetTitle();
@@ -234,7 +244,7 @@ namespace OpenBabel
           IsFirstFile=false;//File has changed
       }
 
-    if (!pF->ReadMolecule(pmol,pConv))
+    if (!pF->ReadMolecule(pmol,pConv) || !OBDeferredStructure::Expand(pmol))
       {
         delete pmol;
         return false;
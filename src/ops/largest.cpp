@@ -21,14 +21,37 @@ GNU General Public License for more details.
 #include <openbabel/descriptor.h>
 #include <openbabel/obconversion.h>
 #include "deferred.h"
+#include <openbabel/obutil.h>
 #include <sstream>
 #include <algorithm>
+#include <limits>
 
 using namespace std;
 
 namespace OpenBabel
 {
 
+//! A molecule in the selection, with its descriptor value and input position
+struct Candidate
+{
+  double val;
+  unsigned long seq;
+  OBBase* pOb;
+};
+
+//! Orders candidates best first: by value, and by input order when equal
+struct CandidateBetter
+{
+  CandidateBetter(bool rev) : _rev(rev){}
+  bool operator()(const Candidate& c1, const Candidate& c2) const
+  {
+    if(c1.val != c2.val)
+      return _rev ? c1.val < c2.val : c1.val > c2.val;
+    return c1.seq < c2.seq;
+  }
+  bool _rev;
+};
+
 class OpLargest : public OBOp
 {
 public:
@@ -62,7 +85,9 @@ public:
 
 private:
   std::string description;
-  std::multimap<double, OBBase*> _selmap;
+  //Heap of the selected molecules with the least wanted at the top
+  std::vector<Candidate> _selheap;
+  unsigned long _seq;
   OBDescriptor* _pDesc;
   std::string _param;
   std::string _prop;
@@ -87,7 +112,8 @@ bool OpLargest::Do(OBBase* pOb, const char* OptionText, OpMap* pOptions, OBConve
   if(pConv->IsFirstInput())
   {
     _pConv = pConv;
-    _selmap.clear();
+    _selheap.clear();
+    _seq = 0;
     _rev = strcmp(GetID(),"largest")!=0; //_rev is initially true for --smallest
     std::vector<string> vec;
     tokenize(vec, OptionText);
@@ -154,57 +180,67 @@ bool OpLargest::Do(OBBase* pOb, const char* OptionText, OpMap* pOptions, OBConve
 
   // All molecules (called from DeferredFormat)
   
-  //Save in map if descriptor val is better
-  // than the current selection or otherwise delete
-  double val;
+  //Save in the heap if descriptor val is better than the least wanted
+  //in the current selection, or otherwise delete. Each molecule takes
+  //O(log N) and only N molecules are held.
+  Candidate cand;
+  cand.val = numeric_limits<double>::quiet_NaN();
+  cand.seq = _seq++;
+  cand.pOb = pOb;
   if(_pDesc)
-    val = _pDesc->Predict(pOb, &_param);
-  else
+    cand.val = _pDesc->Predict(pOb, &_param);
+  else if(OBGenericData* pData = pOb->GetData(_prop))
   {
-    stringstream ss(pOb->GetData(_prop)->GetValue());
-    ss >> val;
+    stringstream ss(pData->GetValue());
+    ss >> cand.val;
   }
- 
-  if(_selmap.size()<_nmols)
-    //populate map of selected mols up to desired number
-    _selmap.insert(make_pair(val, pOb));
-  else
+  if(IsNan(cand.val))
   {
-    //replace mols in selection if new mol is better candidate
-    multimap<double, OBBase*>::iterator leastwanted = 
-      _rev ? --_selmap.end() : _selmap.begin();
-    if((!_rev && val>leastwanted->first) || (_rev && val<leastwanted->first))
-    {
-      //have a better candidate
-      delete leastwanted->second; // delete the worst molecule
-      _selmap.erase(leastwanted); // remove it from the map
-      _selmap.insert(make_pair(val, pOb)); //add new candidate
-    }
-    else
-      delete pOb; // discard  a mol that did not make selection
+    delete pOb; // no value to select by
+    return false;
   }
+
+  CandidateBetter better(_rev);
+  if(_selheap.size()<_nmols)
+  {
+    //populate heap of selected mols up to desired number
+    _selheap.push_back(cand);
+    push_heap(_selheap.begin(), _selheap.end(), better);
+  }
+  else if(better(cand, _selheap.front()))
+  {
+    //have a better candidate, so replace the least wanted molecule.
+    //A later molecule with the same value is not better.
+    delete _selheap.front().pOb;
+    pop_heap(_selheap.begin(), _selheap.end(), better);
+    _selheap.back() = cand;
+    push_heap(_selheap.begin(), _selheap.end(), better);
+  }
+  else
+    delete pOb; // discard  a mol that did not make selection
   return false; //do not save in DeferredFormat 
 }
 
 bool OpLargest::ProcessVec(vector<OBBase*>& vec)
 {
   //Called at the end.
-  //Add the selected mols to the vec for Deferred format to output
+  //Add the selected mols to the vec for Deferred format to output,
+  //best first and those with equal values in input order
+  sort_heap(_selheap.begin(), _selheap.end(), CandidateBetter(_rev));
   vec.clear();
-  vec.reserve(_selmap.size());
-  multimap<double, OBBase*>::reverse_iterator iter;
-  for(iter=_selmap.rbegin(); iter!=_selmap.rend(); ++iter)
+  vec.reserve(_selheap.size());
+  vector<Candidate>::iterator iter;
+  for(iter=_selheap.begin(); iter!=_selheap.end(); ++iter)
   {
     if(_addDescToTitle)
     {
       std::stringstream ss;
-      ss << iter->second->GetTitle() << ' ' << iter->first;
-      iter->second->SetTitle(ss.str().c_str());
+      ss << iter->pOb->GetTitle() << ' ' << iter->val;
+      iter->pOb->SetTitle(ss.str().c_str());
     }
-    vec.push_back(iter->second);
+    vec.push_back(iter->pOb);
   }
-  if(_rev) //it's difficult to find an elegant and efficient way of doing this
-    reverse(vec.begin(),vec.end());
+  _selheap.clear();
   return true;
 }
 
@@ -21,6 +21,7 @@ GNU General Public License for more details.
 #include <openbabel/mol.h>
 #include <fstream>
 #include "deferred.h"
+#include "../asyncstream.h"
 #include <openbabel/descriptor.h>
 
 namespace OpenBabel
@@ -101,11 +102,13 @@ bool OpSplit::Do(OBBase* pOb, const char* OptionText, OpMap* pOptions, OBConvers
     _realOutFormat = pConv->GetOutFormat();
 
     // If there is an output file specified, delete the file,close and invalidate the outstream so OBConversion is not confused.
-    std::ofstream* oldfs = dynamic_cast<std::ofstream*>(pConv->GetOutStream());
+    // The file may be behind a stream which writes it on another thread.
+    std::ofstream* oldfs = dynamic_cast<std::ofstream*>(SinkStream(pConv->GetOutStream()));
     if(oldfs && oldfs->is_open())
     {
       oldfs->close();
       oldfs->setstate(std::ios::failbit);
+      pConv->GetOutStream()->setstate(std::ios::failbit);
       remove(pConv->GetOutFilename().c_str());
     }
 
@@ -18,11 +18,22 @@ GNU General Public License for more details.
 #include <openbabel/babelconfig.h>
 #include <openbabel/op.h>
 #include <openbabel/mol.h>
+#include <openbabel/atom.h>
+#include <openbabel/bond.h>
+#include <openbabel/generic.h>
 #include <openbabel/obconversion.h>
 #include <openbabel/descriptor.h>
 #include <openbabel/obutil.h>
-#include "deferred.h"
-#include <set>
+#include <openbabel/oberror.h>
+#include <openbabel/obiter.h>
+#include <openbabel/residue.h>
+#include <openbabel/stereo/stereo.h>
+#include "tempfile.h"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
 #include <algorithm>
 
 namespace OpenBabel
@@ -32,7 +43,7 @@ template<class T>
 struct Order
 {
   Order(OBDescriptor* pDesc, bool rev) : _pDesc(pDesc), _rev(rev){}
-  bool operator()(std::pair<OBBase*,T> p1, std::pair<OBBase*,T> p2) const
+  bool operator()(const std::pair<std::size_t,T>& p1, const std::pair<std::size_t,T>& p2) const
   {
     return _rev ?
       _pDesc->Order(p2.second, p1.second) :
@@ -41,6 +52,45 @@ struct Order
   OBDescriptor* _pDesc;
   bool _rev;
 };
+
+//! The value of the descriptor for an object, a number or a string
+struct SortKey
+{
+  double num;
+  std::string str;
+  std::size_t seq; //!< position in the input, to keep equal keys in order when merging
+};
+
+//! A sorted run which has been written to a temporary file, being merged,
+//! or (with no filename) the molecules which were kept in memory
+struct SortRun
+{
+  std::string filename;
+  std::ifstream ifs;
+  OBConversion conv;
+  OBMol* pmol;  //!< next molecule of the run
+  SortKey key;
+};
+
+class OpSort;
+//*****************************************************************
+/**
+SortFormat is used like DeferredFormat: OpSort diverts the output objects
+to it and it sends them on to the real output format in order. The objects
+are handed to OpSort to be stored, and are read back from it one at a time.
+**/
+class SortFormat : public OBFormat
+{
+public:
+  SortFormat(OBConversion* pConv, OpSort* pOp);
+  const char* Description() override { return "Sort the output objects"; }
+  bool ReadChemObject(OBConversion* pConv) override;
+  bool WriteChemObject(OBConversion* pConv) override;
+private:
+  OBFormat* _pRealOutFormat;
+  OpSort* _pOp;
+};
+
 //*****************************************************************
 class OpSort : public OBOp
 {
@@ -48,20 +98,56 @@ public:
   OpSort(const char* ID) : OBOp(ID, false)
   {
     OBConversion::RegisterOptionParam(ID, nullptr, 1, OBConversion::GENOPTIONS);
+    OBConversion::RegisterOptionParam("sortmem", nullptr, 1, OBConversion::GENOPTIONS);
   }
+  ~OpSort() override { Clear(); } //removes any temporary files left
 
   const char* Description() override { return "<desc> Sort by descriptor(~desc for reverse)"
     "\n Follow descriptor with + to also add it to the title, e.g. MW+ "
-    "\n Custom ordering is possible; see inchi descriptor"; }
+    "\n Custom ordering is possible; see inchi descriptor"
+    "\n Molecules beyond the memory set by --sortmem <MB> (default 1024)"
+    "\n are sorted in temporary files and merged"; }
 
   bool WorksWith(OBBase* pOb) const override { return dynamic_cast<OBMol*>(pOb) != nullptr; }
   bool Do(OBBase* pOb, const char* OptionText, OpMap* pmap, OBConversion* pConv) override;
-  bool ProcessVec(std::vector<OBBase*>& vec) override;
+
+  void Store(OBBase* pOb);
+  bool Finish();
+  OBBase* Next();
+
+  //! Whether run \p i should be merged before run \p j
+  bool RunBefore(size_t i, size_t j) const
+  {
+    if(Less(_runs[i]->key, _runs[j]->key))
+      return true;
+    return !Less(_runs[j]->key, _runs[i]->key) && _runs[i]->key.seq < _runs[j]->key.seq;
+  }
+
 private:
+  bool Less(const SortKey& k1, const SortKey& k2) const
+  {
+    if(_numeric)
+      return _rev ? _pDesc->Order(k2.num, k1.num) : _pDesc->Order(k1.num, k2.num);
+    return _rev ? _pDesc->Order(k2.str, k1.str) : _pDesc->Order(k1.str, k2.str);
+  }
+  void SortRunInMemory();
+  void SpillRun();
+  bool ReadFromRun(SortRun* run);
+  void Clear();
+
   OBDescriptor* _pDesc;
   std::string _pDescOption;
   bool _rev;
   bool _addDescToTitle;
+  bool _numeric;
+  std::size_t _memLimit;  //!< bytes of molecules to hold before spilling, or 0
+  std::size_t _runBytes;
+  std::size_t _nstored;
+  std::vector<std::pair<OBBase*, SortKey> > _run;
+  std::vector<std::pair<OBBase*, SortKey> > _kept; //!< molecules obc cannot hold, not spilled
+  std::size_t _next;      //!< next object of _run to output
+  std::vector<SortRun*> _runs;
+  std::vector<std::size_t> _heap; //!< runs being merged, as a heap
 };
 
 /////////////////////////////////////////////////////////////////
@@ -96,76 +182,411 @@ bool OpSort::Do(OBBase* pOb, const char* OptionText, OpMap* pmap, OBConversion*
     _pDescOption = spair.second;
     _pDesc->Init();//needed  to clear cache of InChIFilter
 
+    Clear();
+    double mb = 1024;
+    OpMap::const_iterator itr = pmap->find("sortmem");
+    if(itr!=pmap->end())
+      mb = atof(itr->second.c_str());
+    _memLimit = mb > 0 ? static_cast<std::size_t>(mb * 1024 * 1024) : 0;
 
-    //Make a deferred format and divert the output to it
-    new DeferredFormat(pConv, this); //it will delete itself
+    //Make a sorting format and divert the output to it
+    new SortFormat(pConv, this); //it will delete itself
   }
   return true;
 }
 
-//****************************************************************
-bool OpSort::ProcessVec(std::vector<OBBase*>& vec)
-{
-  // Make a vector containing both the OBBase* and the descriptor value and the sort it
-  if(!IsNan(_pDesc->Predict(vec[0], &_pDescOption)))
-  {
-    //a numerical descriptor
-    //Copy into a pair vector
-    std::vector<std::pair<OBBase*,double> > valvec;
-    valvec.reserve(vec.size());
-    std::vector<OBBase*>::iterator iter;
-    for(iter=vec.begin();iter!=vec.end();++iter)
-      valvec.push_back(std::make_pair<OBBase*,double>(&(**iter), _pDesc->Predict(*iter, &_pDescOption)));
-
-    //Sort
-    std::sort(valvec.begin(),valvec.end(), Order<double>(_pDesc, _rev));
-
-    //Copy back
-    std::vector<std::pair<OBBase*,double> >::iterator valiter;
-    iter=vec.begin();
-    for(valiter=valvec.begin();valiter!=valvec.end();++valiter, ++iter)
+/////////////////////////////////////////////////////////////////
+void OpSort::Clear()
+{
+  for(std::size_t i=0; i<_run.size(); ++i)
+    delete _run[i].first;
+  _run.clear();
+  for(std::size_t i=0; i<_kept.size(); ++i)
+    delete _kept[i].first;
+  _kept.clear();
+  for(std::size_t i=0; i<_runs.size(); ++i)
+  {
+    delete _runs[i]->pmol;
+    if(!_runs[i]->filename.empty())
     {
-      *iter = valiter->first;
-      if(_addDescToTitle)
-      {
-        std::stringstream ss;
-        ss << (*iter)->GetTitle() << ' ' << valiter->second;
-        (*iter)->SetTitle(ss.str().c_str());
-      }
+      _runs[i]->ifs.close();
+      remove(_runs[i]->filename.c_str());
     }
+    delete _runs[i];
+  }
+  _runs.clear();
+  _heap.clear();
+  _runBytes = 0;
+  _nstored = 0;
+  _next = 0;
+}
+
+//! Approximate memory used by a molecule
+static std::size_t MolBytes(OBBase* pOb)
+{
+  std::size_t n = sizeof(OBMol) + 64 * pOb->DataSize();
+  OBMol* pmol = dynamic_cast<OBMol*>(pOb);
+  if(pmol)
+    n += pmol->NumAtoms() * (sizeof(OBAtom) + 24 * pmol->NumConformers() + 64)
+      + pmol->NumBonds() * (sizeof(OBBond) + 32);
+  return n;
+}
+
+/////////////////////////////////////////////////////////////////
+void OpSort::Store(OBBase* pOb)
+{
+  //The first object decides whether the descriptor is numerical
+  if(_run.empty() && _runs.empty())
+    _numeric = !IsNan(_pDesc->Predict(pOb, &_pDescOption));
+
+  SortKey key;
+  key.seq = _nstored++;
+  std::stringstream ss;
+  if(_numeric)
+  {
+    key.num = _pDesc->Predict(pOb, &_pDescOption);
+    ss << key.num;
+  }
+  else
+  {
+    key.num = 0.0;
+    _pDesc->GetStringValue(pOb, key.str, &_pDescOption);
+    ss << key.str;
+  }
+  if(_addDescToTitle)
+    pOb->SetTitle((std::string(pOb->GetTitle()) + ' ' + ss.str()).c_str());
+
+  _run.push_back(std::make_pair(pOb, key));
+  _runBytes += MolBytes(pOb) + key.str.size();
+  if(_memLimit && _runBytes > _memLimit)
+    SpillRun();
+}
+
+/////////////////////////////////////////////////////////////////
+/// Sort the molecules in memory, keeping those with equal keys in the
+/// order they are in _run. The values are sorted with the index of their
+/// molecule, and the molecules then put into the same order.
+void OpSort::SortRunInMemory()
+{
+  std::vector<std::size_t> order;
+  order.reserve(_run.size());
+  if(_numeric)
+  {
+    std::vector<std::pair<std::size_t,double> > valvec;
+    valvec.reserve(_run.size());
+    for(std::size_t i=0; i<_run.size(); ++i)
+      valvec.push_back(std::make_pair(i, _run[i].second.num));
+    std::stable_sort(valvec.begin(),valvec.end(), Order<double>(_pDesc, _rev));
+    for(std::size_t i=0; i<_run.size(); ++i)
+      order.push_back(valvec[i].first);
   }
   else
   {
-    //a string descriptor
-    //Copy into a pair vector
-    std::vector<std::pair<OBBase*,std::string> > valvec;
-    valvec.reserve(vec.size());
-    std::vector<OBBase*>::iterator iter;
-    std::string s;
-    for(iter=vec.begin();iter!=vec.end();++iter)
+    std::vector<std::pair<std::size_t,std::string> > valvec;
+    valvec.reserve(_run.size());
+    for(std::size_t i=0; i<_run.size(); ++i)
+    {
+      valvec.push_back(std::make_pair(i, std::string()));
+      valvec.back().second.swap(_run[i].second.str);
+    }
+    std::stable_sort(valvec.begin(),valvec.end(), Order<std::string>(_pDesc, _rev));
+    for(std::size_t i=0; i<_run.size(); ++i)
     {
-      _pDesc->GetStringValue(*iter, s, &_pDescOption);
-      valvec.push_back(std::pair<OBBase*,std::string>(&(**iter), s));
+      order.push_back(valvec[i].first);
+      _run[valvec[i].first].second.str.swap(valvec[i].second);
     }
+  }
+  std::vector<std::pair<OBBase*, SortKey> > sorted(_run.size());
+  for(std::size_t i=0; i<_run.size(); ++i)
+  {
+    sorted[i].first = _run[order[i]].first;
+    sorted[i].second.num = _run[order[i]].second.num;
+    sorted[i].second.str.swap(_run[order[i]].second.str);
+    sorted[i].second.seq = _run[order[i]].second.seq;
+  }
+  _run.swap(sorted);
+}
 
-    //Sort
-    std::sort(valvec.begin(),valvec.end(), Order<std::string>(_pDesc, _rev));
+//! Whether the obc format holds everything in a molecule, so that it is
+//! read back from a run on disk unchanged. Data which has been perceived
+//! is made again when needed, so need not be held.
+static bool Spillable(OBBase* pOb)
+{
+  OBMol* pmol = dynamic_cast<OBMol*>(pOb);
+  if(!pmol)
+    return false;
+  unsigned ncomments = 0;
+  std::vector<OBGenericData*>& vdata = pmol->GetData();
+  for(std::vector<OBGenericData*>::iterator data=vdata.begin(); data!=vdata.end(); ++data)
+  {
+    if((*data)->GetOrigin() == perceived)
+      continue;
+    switch((*data)->GetDataType())
+    {
+    case OBGenericDataType::PairData:
+      if(!dynamic_cast<OBPairData*>(*data))
+        return false; //e.g. OBPairInteger
+      break;
+    case OBGenericDataType::CommentData:
+      if(++ncomments > 1)
+        return false;
+      break;
+    case OBGenericDataType::ConformerData:
+    {
+      OBConformerData* cd = static_cast<OBConformerData*>(*data);
+      if(!cd->GetDimension().empty() || !cd->GetForces().empty() || !cd->GetVelocities().empty()
+         || !cd->GetDisplacements().empty() || !cd->GetData().empty())
+        return false; //only the energies are held
+      break;
+    }
+    case OBGenericDataType::UnitCell:
+    case OBGenericDataType::StereoData:
+      break;
+    default:
+      return false;
+    }
+  }
+  FOR_ATOMS_OF_MOL(a, pmol)
+    if(!a->GetData().empty())
+      return false;
+  FOR_BONDS_OF_MOL(b, pmol)
+    if(!b->GetData().empty())
+      return false;
+  FOR_RESIDUES_OF_MOL(r, pmol)
+    if(!r->GetData().empty())
+      return false;
+  return true;
+}
 
-    //Copy back
-    std::vector<std::pair<OBBase*,std::string> >::iterator valiter;
-    iter=vec.begin();
-    for(valiter=valvec.begin();valiter!=valvec.end();++valiter, ++iter)
+/////////////////////////////////////////////////////////////////
+/// Write the stored molecules, sorted, to a temporary file in the obc
+/// format. Each carries its key and its position in the input as properties,
+/// so that the key need not be calculated again when the runs are merged.
+/// Molecules with data which the obc format does not hold are kept in memory,
+/// and are merged with the runs at the end.
+void OpSort::SpillRun()
+{
+  std::size_t n = 0;
+  for(std::size_t i=0; i<_run.size(); ++i)
+  {
+    if(Spillable(_run[i].first))
+      _run[n++] = _run[i];
+    else
+      _kept.push_back(_run[i]);
+  }
+  _run.resize(n);
+  _runBytes = 0;
+  if(_run.empty())
+    return;
+  SortRunInMemory();
+
+  SortRun* run = new SortRun;
+  run->filename = MakeTempFile("obsort_");
+  run->pmol = nullptr;
+  std::ofstream ofs;
+  if(!run->filename.empty())
+    ofs.open(run->filename.c_str(), std::ios::binary);
+  OBConversion conv;
+  if(!ofs || !conv.SetOutFormat("obc"))
+  {
+    //Carry on sorting in memory
+    obErrorLog.ThrowError(__FUNCTION__, "Cannot write a temporary file in " + TempDirectory()
+      + ", so all the molecules are sorted in memory", obWarning, onceOnly);
+    if(!run->filename.empty())
+      remove(run->filename.c_str());
+    delete run;
+    _memLimit = 0;
+    return;
+  }
+  conv.SetOutStream(&ofs);
+  for(std::size_t i=0; i<_run.size(); ++i)
+  {
+    OBMol* pmol = static_cast<OBMol*>(_run[i].first);
+    OBDeferredStructure::Expand(pmol);
+    OBPairData* dp = new OBPairData;
+    dp->SetAttribute("OpSort key");
+    if(_numeric)
+    {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "%.17g", _run[i].second.num);
+      dp->SetValue(buf);
+    }
+    else
+      dp->SetValue(_run[i].second.str);
+    dp->SetOrigin(local);
+    pmol->SetData(dp);
+    std::stringstream seq;
+    seq << _run[i].second.seq;
+    dp = new OBPairData;
+    dp->SetAttribute("OpSort seq");
+    dp->SetValue(seq.str());
+    dp->SetOrigin(local);
+    pmol->SetData(dp);
+    conv.Write(pmol);
+    delete pmol;
+  }
+  conv.CloseOutFile(); //writes the last chunk
+  ofs.close();
+  _run.clear();
+  _runs.push_back(run);
+}
+
+/////////////////////////////////////////////////////////////////
+/// Read the next molecule of a run and its key
+bool OpSort::ReadFromRun(SortRun* run)
+{
+  if(run->filename.empty())
+  {
+    //the molecules kept in memory, now sorted in _run
+    if(_next >= _run.size())
+      return false;
+    run->pmol = static_cast<OBMol*>(_run[_next].first);
+    run->key = _run[_next].second;
+    _run[_next++].first = nullptr; //now owned by the run
+    return true;
+  }
+
+  run->pmol = new OBMol;
+  if(run->conv.Read(run->pmol))
+  {
+    OBPairData* dp = dynamic_cast<OBPairData*>(run->pmol->GetData("OpSort key"));
+    OBPairData* sp = dynamic_cast<OBPairData*>(run->pmol->GetData("OpSort seq"));
+    if(dp && sp)
+    {
+      if(_numeric)
+        run->key.num = strtod(dp->GetValue().c_str(), nullptr);
+      else
+        run->key.str = dp->GetValue();
+      run->key.seq = strtoul(sp->GetValue().c_str(), nullptr, 10);
+      run->pmol->DeleteData(dp);
+      run->pmol->DeleteData(sp);
+      return true;
+    }
+  }
+  delete run->pmol;
+  run->pmol = nullptr;
+  return false;
+}
+
+static bool InputOrder(const std::pair<OBBase*, SortKey>& p1, const std::pair<OBBase*, SortKey>& p2)
+{
+  return p1.second.seq < p2.second.seq;
+}
+
+struct RunOrder
+{
+  RunOrder(const OpSort* pOp) : _pOp(pOp){}
+  //for a heap with the first run to be merged at the top
+  bool operator()(std::size_t i, std::size_t j) const { return _pOp->RunBefore(j, i); }
+  const OpSort* _pOp;
+};
+
+/////////////////////////////////////////////////////////////////
+/// Called after the last object has been stored.
+/// \return false if there is nothing to output
+bool OpSort::Finish()
+{
+  if(!_runs.empty() && !_run.empty())
+    SpillRun();
+  if(!_kept.empty())
+  {
+    //Back into the input order, so that equal keys stay in it
+    _run.insert(_run.end(), _kept.begin(), _kept.end());
+    _kept.clear();
+    std::sort(_run.begin(), _run.end(), InputOrder);
+  }
+  SortRunInMemory();
+  _next = 0;
+  if(_runs.empty())
+    return !_run.empty();
+
+  //Merge the runs on disk, and those molecules which were kept in memory
+  if(!_run.empty())
+  {
+    SortRun* run = new SortRun;
+    run->pmol = nullptr;
+    _runs.push_back(run);
+  }
+  for(std::size_t i=0; i<_runs.size(); ++i)
+  {
+    SortRun* run = _runs[i];
+    if(!run->filename.empty())
     {
-      *iter = valiter->first;
-      if(_addDescToTitle)
-      {
-        std::stringstream ss;
-        ss << (*iter)->GetTitle() << ' ' << valiter->second;
-        (*iter)->SetTitle(ss.str().c_str());
-      }
+      run->ifs.open(run->filename.c_str(), std::ios::binary);
+      run->conv.SetInFormat("obc");
+      run->conv.SetInStream(&run->ifs);
     }
+    if(ReadFromRun(run))
+      _heap.push_back(i);
+  }
+  std::make_heap(_heap.begin(), _heap.end(), RunOrder(this));
+  return !_heap.empty();
+}
+
+/////////////////////////////////////////////////////////////////
+/// \return the next object in order, or NULL at the end
+OBBase* OpSort::Next()
+{
+  if(_runs.empty())
+  {
+    if(_next < _run.size())
+      return _run[_next++].first;
+    _run.clear();
+    return nullptr;
+  }
+
+  if(_heap.empty())
+  {
+    Clear(); //removes the temporary files
+    return nullptr;
   }
+  std::pop_heap(_heap.begin(), _heap.end(), RunOrder(this));
+  SortRun* run = _runs[_heap.back()];
+  OBBase* pOb = run->pmol;
+  if(ReadFromRun(run))
+    std::push_heap(_heap.begin(), _heap.end(), RunOrder(this));
+  else
+    _heap.pop_back();
+  return pOb;
+}
 
+//****************************************************************
+SortFormat::SortFormat(OBConversion* pConv, OpSort* pOp)
+{
+  _pRealOutFormat = pConv->GetOutFormat();
+  pConv->SetOutFormat(this);
+  _pOp = pOp;
+}
+
+bool SortFormat::ReadChemObject(OBConversion* pConv)
+{
+  OBBase* pOb = _pOp->Next();
+  if(!pOb)
+  {
+    delete this;//self destruction; was made in new in OpSort
+    return false;
+  }
+  pConv->AddChemObject(pOb);
+  return true;
+}
+
+bool SortFormat::WriteChemObject(OBConversion* pConv)
+{
+  _pOp->Store(pConv->GetChemObject());
+
+  if(pConv->IsLast() && _pOp->Finish())
+  {
+    //Output the objects in order. The options have already been applied.
+    pConv->SetOptions("",OBConversion::GENOPTIONS);
+    pConv->SetInAndOutFormats(this, _pRealOutFormat);
+
+    std::ifstream ifs; // get rid of gcc warning
+    pConv->SetInStream(&ifs);//Not used, but Convert checks it is ok
+    pConv->GetInStream()->clear();
+
+    pConv->SetOutputIndex(0);
+    pConv->Convert();
+  }
   return true;
 }
 /*
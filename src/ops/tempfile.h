@@ -0,0 +1,72 @@
+/**********************************************************************
+tempfile.h - Temporary files for ops which move their data to disk
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.org/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+#ifndef OB_OPS_TEMPFILE_H
+#define OB_OPS_TEMPFILE_H
+
+#include <openbabel/babelconfig.h>
+#include <string>
+#include <cstdlib>
+
+#ifdef _WIN32
+  #include <io.h>
+  #include <fcntl.h>
+  #include <sys/stat.h>
+#else
+  #include <unistd.h>
+#endif
+
+namespace OpenBabel
+{
+/// The directory for temporary files, given by TMPDIR or TEMP (or /tmp)
+inline std::string TempDirectory()
+{
+  const char* dir = getenv("TMPDIR");
+  if(!dir)
+    dir = getenv("TEMP");
+  if(!dir)
+#ifdef _WIN32
+    dir = ".";
+#else
+    dir = "/tmp";
+#endif
+  return dir;
+}
+
+/// Make a new, empty file with a unique name, which only this user can
+/// read, in TempDirectory(). Its name is \p prefix followed by random characters.
+/// \return the name of the file, or an empty string if it could not be made
+inline std::string MakeTempFile(const char* prefix)
+{
+  std::string name = TempDirectory() + '/' + prefix + "XXXXXX";
+#ifdef _WIN32
+  if(_mktemp_s(&name[0], name.size() + 1) != 0)
+    return std::string();
+  int fd = _open(name.c_str(), _O_CREAT | _O_EXCL | _O_RDWR | _O_BINARY, _S_IREAD | _S_IWRITE);
+  if(fd < 0)
+    return std::string();
+  _close(fd);
+#else
+  int fd = mkstemp(&name[0]);
+  if(fd < 0)
+    return std::string();
+  close(fd);
+#endif
+  return name;
+}
+
+} //namespace OpenBabel
+
+#endif // OB_OPS_TEMPFILE_H
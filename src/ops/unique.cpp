@@ -21,18 +21,424 @@ GNU General Public License for more details.
 #include <openbabel/obconversion.h>
 #include <openbabel/descriptor.h>
 #include <openbabel/inchiformat.h>
-#include <unordered_map>
+#include "tempfile.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
 
 using namespace std;
 
 namespace OpenBabel
 {
 
+//! 128-bit hash of a key
+struct KeyHash
+{
+  unsigned long long h1, h2;
+  bool operator<(const KeyHash& other) const
+  { return h1 < other.h1 || (h1 == other.h1 && h2 < other.h2); }
+  bool operator==(const KeyHash& other) const
+  { return h1 == other.h1 && h2 == other.h2; }
+};
+
+static inline unsigned long long Rotl64(unsigned long long x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline unsigned long long Fmix64(unsigned long long k)
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+//! MurmurHash3 (x64, 128-bit) of a string
+static KeyHash HashKey(const string& s)
+{
+  const unsigned long long c1 = 0x87c37b91114253d5ULL, c2 = 0x4cf5ad432745937fULL;
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(s.data());
+  size_t len = s.size(), nblocks = len / 16;
+  unsigned long long h1 = 0, h2 = 0;
+  for (size_t i = 0; i < nblocks; ++i) {
+    unsigned long long k1, k2;
+    memcpy(&k1, data + 16 * i, 8);
+    memcpy(&k2, data + 16 * i + 8, 8);
+    k1 *= c1; k1 = Rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    h1 = Rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+    k2 *= c2; k2 = Rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    h2 = Rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+  }
+  const unsigned char* tail = data + 16 * nblocks;
+  unsigned long long k1 = 0, k2 = 0;
+  for (size_t i = len & 15; i > 8; --i)
+    k2 ^= static_cast<unsigned long long>(tail[i - 1]) << (8 * (i - 9));
+  if (len & 15) {
+    for (size_t i = min<size_t>(len & 15, 8); i > 0; --i)
+      k1 ^= static_cast<unsigned long long>(tail[i - 1]) << (8 * (i - 1));
+    if (len & 8 || k2) {
+      k2 *= c2; k2 = Rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    }
+    k1 *= c1; k1 = Rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+  }
+  h1 ^= len; h2 ^= len;
+  h1 += h2; h2 += h1;
+  h1 = Fmix64(h1); h2 = Fmix64(h2);
+  h1 += h2; h2 += h1;
+  KeyHash h = { h1, h2 };
+  return h;
+}
+
+/**
+The set of keys which have been seen, for OpUnique.
+The keys are found by a 128-bit hash of each, and are compared only when
+the hashes match. The keys (and the titles of their molecules) are held
+in memory until they take more than the memory limit, when they are moved
+to a temporary file, leaving only the hashes and their positions in memory.
+When the hashes too take more than the memory limit, they are merged into a
+sorted file on disk, of which only every 256th hash is kept in memory.
+If the temporary files cannot be made, everything is kept in memory.
+**/
+class KeySet
+{
+public:
+  KeySet() : _limit(0), _nused(0), _memkeybytes(0), _keysize(0), _reading(false),
+             _failed(false), _nrun(0) {}
+  ~KeySet() { Clear(); }
+
+  void Clear();
+  void SetMemoryLimit(size_t bytes) { _limit = bytes; }
+
+  //! Add a key, unless it is present already.
+  //! \return true if it was added, or false with the title stored with it
+  bool Insert(const string& key, const string& title, string& firstTitle);
+
+  //! Whether a key could not be read back from the temporary file,
+  //! after which Insert() cannot tell whether a key is present
+  bool Failed() const { return _failed; }
+
+private:
+  struct Entry
+  {
+    KeyHash hash;
+    unsigned long long pos; //!< position of the key in the key file, or in _memkeys
+  };
+  enum { BLOCK = 256 };
+  static const unsigned long long EMPTY = ~0ULL;
+
+  bool Find(const KeyHash& h, unsigned long long& pos);
+  bool FindOnDisk(const KeyHash& h, unsigned long long& pos);
+  void Add(const Entry& e);
+  void Spill();
+  void MoveKeysToFile();
+  void WriteKey(const string& key, const string& title);
+  bool ReadKey(unsigned long long pos, string& key, string& title);
+
+  vector<Entry> _table;       //!< hashes in memory, open addressing
+  size_t _limit;              //!< bytes of keys and hashes to keep in memory, or 0
+  size_t _nused;
+  vector<pair<string, string> > _memkeys; //!< key and title of each distinct key, until moved to _keys
+  size_t _memkeybytes;
+  string _keyname, _runname;
+  fstream _keys;              //!< key and title of each distinct key
+  unsigned long long _keysize;
+  bool _reading;              //!< whether _keys was last read rather than written
+  bool _failed;
+  ifstream _run;              //!< hashes which have been spilled, sorted
+  unsigned long long _nrun;
+  vector<KeyHash> _runindex;  //!< first hash of each block of the run
+};
+
+void KeySet::Clear()
+{
+  vector<Entry>().swap(_table);
+  _nused = 0;
+  vector<pair<string, string> >().swap(_memkeys);
+  _memkeybytes = 0;
+  if(_keys.is_open())
+  {
+    _keys.close();
+    remove(_keyname.c_str());
+  }
+  if(_run.is_open())
+  {
+    _run.close();
+    remove(_runname.c_str());
+  }
+  _runindex.clear();
+  _nrun = 0;
+  _keysize = 0;
+  _reading = false;
+  _failed = false;
+}
+
+bool KeySet::Insert(const string& key, const string& title, string& firstTitle)
+{
+  // A different key with the same hash (very rarely) is stored under
+  // the next hash of a sequence, and so is looked for there
+  KeyHash h = HashKey(key);
+  unsigned long long pos;
+  string prevKey;
+  while(Find(h, pos))
+  {
+    if(!ReadKey(pos, prevKey, firstTitle))
+    {
+      _failed = true;
+      return true;
+    }
+    if(prevKey == key)
+      return false;
+    h.h2 = Fmix64(h.h2 + 1);
+  }
+
+  Entry e;
+  e.hash = h;
+  if(_keys.is_open())
+  {
+    e.pos = _keysize;
+    WriteKey(key, title);
+  }
+  else
+  {
+    e.pos = _memkeys.size();
+    _memkeys.push_back(make_pair(key, title));
+    _memkeybytes += sizeof(_memkeys[0]) + key.size() + title.size();
+  }
+  Add(e);
+  if(_limit && !_keys.is_open() && _table.size() * sizeof(Entry) + _memkeybytes > _limit)
+    MoveKeysToFile();
+  if(_limit && _keys.is_open() && _table.size() * sizeof(Entry) > _limit)
+    Spill();
+  return true;
+}
+
+/// Move the keys held in memory to a new temporary file
+void KeySet::MoveKeysToFile()
+{
+  _keyname = MakeTempFile("obunique_");
+  if(!_keyname.empty())
+    _keys.open(_keyname.c_str(), ios::in | ios::out | ios::trunc | ios::binary);
+  if(!_keys.is_open())
+  {
+    obErrorLog.ThrowError(__FUNCTION__, "Cannot write a temporary file in " + TempDirectory()
+      + ", so all the keys are kept in memory", obWarning, onceOnly);
+    if(!_keyname.empty())
+      remove(_keyname.c_str());
+    _limit = 0;
+    return;
+  }
+
+  vector<unsigned long long> offsets(_memkeys.size());
+  for(size_t i = 0; i < _memkeys.size(); ++i)
+  {
+    offsets[i] = _keysize;
+    WriteKey(_memkeys[i].first, _memkeys[i].second);
+  }
+  for(size_t i = 0; i < _table.size(); ++i)
+    if(_table[i].pos != EMPTY)
+      _table[i].pos = offsets[_table[i].pos];
+  vector<pair<string, string> >().swap(_memkeys);
+  _memkeybytes = 0;
+}
+
+void KeySet::WriteKey(const string& key, const string& title)
+{
+  unsigned int sizes[2] = { static_cast<unsigned int>(key.size()),
+                            static_cast<unsigned int>(title.size()) };
+  if(_reading)
+    _keys.seekp(0, ios::end);
+  _reading = false;
+  _keys.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+  _keys << key << title;
+  _keysize += sizeof(sizes) + key.size() + title.size();
+}
+
+bool KeySet::ReadKey(unsigned long long pos, string& key, string& title)
+{
+  if(!_keys.is_open())
+  {
+    if(pos >= _memkeys.size())
+      return false;
+    key = _memkeys[pos].first;
+    title = _memkeys[pos].second;
+    return true;
+  }
+  unsigned int sizes[2];
+  _reading = true;
+  _keys.seekg(pos);
+  if(!_keys.read(reinterpret_cast<char*>(sizes), sizeof(sizes)))
+  {
+    _keys.clear();
+    return false;
+  }
+  key.resize(sizes[0]);
+  title.resize(sizes[1]);
+  if(sizes[0])
+    _keys.read(&key[0], sizes[0]);
+  if(sizes[1])
+    _keys.read(&title[0], sizes[1]);
+  bool ok = !_keys.fail();
+  _keys.clear();
+  return ok;
+}
+
+bool KeySet::Find(const KeyHash& h, unsigned long long& pos)
+{
+  if(!_table.empty())
+  {
+    size_t mask = _table.size() - 1;
+    for(size_t i = h.h1 & mask; _table[i].pos != EMPTY; i = (i + 1) & mask)
+      if(_table[i].hash == h)
+      {
+        pos = _table[i].pos;
+        return true;
+      }
+  }
+  return FindOnDisk(h, pos);
+}
+
+void KeySet::Add(const Entry& e)
+{
+  // Kept at most 3/4 full
+  if(4 * (_nused + 1) > 3 * _table.size())
+  {
+    vector<Entry> old;
+    old.swap(_table);
+    Entry empty;
+    empty.pos = EMPTY;
+    _table.assign(old.empty() ? 1024 : 2 * old.size(), empty);
+    _nused = 0;
+    for(size_t i = 0; i < old.size(); ++i)
+      if(old[i].pos != EMPTY)
+        Add(old[i]);
+  }
+  size_t mask = _table.size() - 1;
+  size_t i = e.hash.h1 & mask;
+  while(_table[i].pos != EMPTY)
+    i = (i + 1) & mask;
+  _table[i] = e;
+  ++_nused;
+}
+
+static bool EntryLess(const pair<KeyHash, unsigned long long>& a,
+                      const pair<KeyHash, unsigned long long>& b)
+{
+  return a.first < b.first;
+}
+
+/// Merge the hashes in memory into the sorted file on disk
+void KeySet::Spill()
+{
+  vector<pair<KeyHash, unsigned long long> > mem;
+  mem.reserve(_nused);
+  for(size_t i = 0; i < _table.size(); ++i)
+    if(_table[i].pos != EMPTY)
+      mem.push_back(make_pair(_table[i].hash, _table[i].pos));
+  sort(mem.begin(), mem.end(), EntryLess);
+
+  string newname = MakeTempFile("obunique_");
+  ofstream ofs;
+  if(!newname.empty())
+    ofs.open(newname.c_str(), ios::binary);
+  if(!ofs.is_open())
+  {
+    obErrorLog.ThrowError(__FUNCTION__, "Cannot write a temporary file in " + TempDirectory()
+      + ", so all the hashes are kept in memory", obWarning, onceOnly);
+    if(!newname.empty())
+      remove(newname.c_str());
+    _limit = 0;
+    return;
+  }
+
+  // Merge with the previous run
+  vector<KeyHash> index;
+  unsigned long long n = 0, nold = 0;
+  Entry old;
+  bool haveOld = false;
+  if(_run.is_open())
+  {
+    _run.clear();
+    _run.seekg(0);
+    haveOld = nold < _nrun && _run.read(reinterpret_cast<char*>(&old), sizeof(Entry));
+  }
+  size_t m = 0;
+  while(haveOld || m < mem.size())
+  {
+    Entry e;
+    if(haveOld && (m == mem.size() || old.hash < mem[m].first))
+    {
+      e = old;
+      haveOld = ++nold < _nrun && _run.read(reinterpret_cast<char*>(&old), sizeof(Entry));
+    }
+    else
+    {
+      e.hash = mem[m].first;
+      e.pos = mem[m].second;
+      ++m;
+    }
+    if(n % BLOCK == 0)
+      index.push_back(e.hash);
+    ofs.write(reinterpret_cast<const char*>(&e), sizeof(Entry));
+    ++n;
+  }
+  ofs.close();
+
+  if(_run.is_open())
+  {
+    _run.close();
+    remove(_runname.c_str());
+  }
+  _runname = newname;
+  _run.open(_runname.c_str(), ios::binary);
+  _nrun = n;
+  _runindex.swap(index);
+  vector<Entry>().swap(_table);
+  _nused = 0;
+}
+
+bool KeySet::FindOnDisk(const KeyHash& h, unsigned long long& pos)
+{
+  if(_runindex.empty() || h < _runindex[0])
+    return false;
+  // The block which would hold it
+  size_t block = upper_bound(_runindex.begin(), _runindex.end(), h) - _runindex.begin() - 1;
+  unsigned long long first = static_cast<unsigned long long>(block) * BLOCK;
+  size_t n = static_cast<size_t>(min<unsigned long long>(BLOCK, _nrun - first));
+  Entry buf[BLOCK];
+  _run.clear();
+  _run.seekg(first * sizeof(Entry));
+  if(!_run.read(reinterpret_cast<char*>(buf), n * sizeof(Entry)))
+    return false;
+  size_t lo = 0, hi = n;
+  while(lo < hi)
+  {
+    size_t mid = (lo + hi) / 2;
+    if(buf[mid].hash < h)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if(lo < n && buf[lo].hash == h)
+  {
+    pos = buf[lo].pos;
+    return true;
+  }
+  return false;
+}
+
+//*****************************************************************
 class OpUnique : public OBOp
 {
 public:
   OpUnique(const char* ID) : OBOp(ID, false){
     OBConversion::RegisterOptionParam("unique", nullptr, 1, OBConversion::GENOPTIONS);
+    OBConversion::RegisterOptionParam("uniquemem", nullptr, 1, OBConversion::GENOPTIONS);
   }
 
   const char* Description() override { return
@@ -52,6 +458,9 @@ public:
     "/noEZ     ignore E/Z steroeochemistry\n"
     "/nochg    ignore charge and protonation\n"
     "/noiso    ignore isotopes\n\n"
+
+    "The keys are kept in memory up to --uniquemem <MB> (default 1024)\n"
+    "and beyond that in a temporary file, and then their hashes too.\n\n"
 ; }
 
   bool WorksWith(OBBase* pOb) const override { return dynamic_cast<OBMol*>(pOb) != nullptr; }
@@ -65,10 +474,8 @@ private:
   unsigned _ndups;
   bool _inv;
 
-  typedef unordered_map<std::string, std::string> UMap;
-
-  //key is descriptor text(usually inchi) value is molecule title
-  UMap _inchimap;
+  //key is descriptor text(usually inchi), stored with the molecule title
+  KeySet _keys;
 };
 
 /////////////////////////////////////////////////////////////////
@@ -103,7 +510,12 @@ bool OpUnique::Do(OBBase* pOb, const char* OptionText, OpMap* pmap, OBConversion
       return false;
     }
     _pDesc->Init();
-    _inchimap.clear();
+    _keys.Clear();
+    double mb = 1024;
+    OpMap::const_iterator itr = pmap->find("uniquemem");
+    if(itr!=pmap->end())
+      mb = atof(itr->second.c_str());
+    _keys.SetMemoryLimit(mb > 0 ? static_cast<size_t>(mb * 1024 * 1024) : 0);
 
     _reportDup = !_inv; //do not report duplicates when they are the output
   }
@@ -115,18 +527,25 @@ bool OpUnique::Do(OBBase* pOb, const char* OptionText, OpMap* pmap, OBConversion
 
   if(!_trunc.empty())
     InChIFormat::EditInchi(s, _trunc);
-  std::pair<UMap::iterator, bool> result = _inchimap.insert(make_pair(s, pmol->GetTitle()));
   bool ret = true;
-  if(!s.empty() && !result.second)
+  std::string firstTitle;
+  if(!s.empty() && !_keys.Insert(s, pmol->GetTitle(), firstTitle))
   {
     // InChI is already present in set
     ++_ndups;
     if(_reportDup)
-      clog << "Removed " << pmol->GetTitle() << " - a duplicate of " << result.first->second
+      clog << "Removed " << pmol->GetTitle() << " - a duplicate of " << firstTitle
          << " (#" << _ndups << ")" << endl;
     //delete pOb;
     ret = false; //filtered out
   }
+  if(_keys.Failed())
+  {
+    obErrorLog.ThrowError(__FUNCTION__,
+      "Cannot read back the keys from the temporary file", obError, onceOnly);
+    delete pOb;
+    return false; //duplicates can no longer be found
+  }
   if(_inv)
     ret = !ret;
   if(!ret)
@@ -148,8 +567,10 @@ its string value. Descriptors which couldbe useful here are cansmi, cansmiNS
 (ignores stereo) and possibly title.
 
 OpUnique works by attempting to insert the string value of the descriptor for
-each molecule to an internal std::unordered_map. If the string has been seen
-previously, the molecule is deleted and OpUnique::Do() returns false, which
+each molecule to an internal KeySet, which holds 128-bit hashes of the strings
+in memory and the strings themselves in memory or, beyond --uniquemem, in a
+temporary file. If the string has been
+seen previously, the molecule is deleted and OpUnique::Do() returns false, which
 causes the molecule not to be output.
 
 InChI trucation values. param can be a concatination of these e.g. /nochg/noiso
@@ -21,6 +21,8 @@ GNU General Public License for more details.
 #include <cctype>
 #include <iomanip>
 #include <cstring>
+#include <algorithm>
+#include <set>
 
 #include <openbabel/mol.h>
 #include <openbabel/atom.h>
@@ -513,6 +515,7 @@ namespace OpenBabel
 
     result = AllocPattern();
     result->parts = pat->parts;
+    result->smarts = pat->smarts;
     for( i=0; i<pat->acount; i++ )
       {
         aexpr = CopyAtomExpr(pat->atom[i].expr);
@@ -640,6 +643,7 @@ namespace OpenBabel
   AtomExpr *OBSmartsPattern::ParseComplexAtomPrimitive( void )
   {
     Pattern *pat;
+    char *start;
     int index;
 
     switch( *LexPtr++ )
@@ -661,7 +665,7 @@ namespace OpenBabel
       case('$'):
         if( *LexPtr != '(' )
           return nullptr;
-        LexPtr++;
+        start = ++LexPtr;
         pat = ParseSMARTSPattern();
 
         if( !pat )
@@ -671,6 +675,7 @@ namespace OpenBabel
             FreePattern(pat);
             return nullptr;
           }
+        pat->smarts.assign(start, LexPtr);
         LexPtr++;
         return( BuildAtomRecurs(pat) );
 
@@ -1749,6 +1754,27 @@ namespace OpenBabel
     delete [] _buffer;
   }
 
+  //! Remove matches which cover the same atoms as an earlier match,
+  //! keeping the first of each. The sorted atom lists are kept in a set,
+  //! so this takes O(N log N) rather than comparing every pair of matches.
+  static void RemoveDuplicateMatches(std::vector<std::vector<int> > &mlist)
+  {
+    std::set<std::vector<int> > seen;
+    std::vector<std::vector<int> > ulist;
+    std::vector<int> atoms;
+    std::vector<std::vector<int> >::iterator i;
+
+    for (i = mlist.begin();i != mlist.end();++i)
+      {
+        atoms = *i;
+        sort(atoms.begin(), atoms.end());
+        if (seen.insert(atoms).second)
+          ulist.push_back(*i);
+      }
+
+    mlist.swap(ulist);
+  }
+
   bool OBSmartsPattern::Match(OBMol &mol,bool single)
   {
 	OBSmartsMatcher matcher;
@@ -1775,52 +1801,52 @@ namespace OpenBabel
 		  MatchType mtype /*=All*/) const
   {
 	OBSmartsMatcher matcher;
+	return Match(mol, matcher, mlist, mtype);
+  }
+
+  bool OBSmartsPattern::Match(OBMol &mol, OBSmartsMatcher &matcher,
+                              std::vector<std::vector<int> > & mlist,
+                              MatchType mtype /*=All*/) const
+  {
 	mlist.clear();
 	if (_pat == nullptr)
       return false;
     if(_pat->hasExplicitH) //The SMARTS pattern contains [H]
       {
-        //Do matching on a copy of mol with explicit hydrogens
+        //Do matching on a copy of mol with explicit hydrogens.
+        //The copy has its own matcher: cached results are for mol.
+        OBSmartsMatcher tmatcher;
         OBMol tmol = mol;
         tmol.AddHydrogens(false,false);
-        if(!matcher.match(tmol,_pat,mlist,mtype == Single))
+        if(!tmatcher.match(tmol,_pat,mlist,mtype == Single))
         	return false;
       }
     else if(!matcher.match(mol,_pat,mlist,mtype == Single))
     	return false;
 
     if((mtype == AllUnique) && mlist.size() > 1)
-    {
-    	//uniquify
-         bool ok;
-        OBBitVec bv;
-        std::vector<OBBitVec> vbv;
-        std::vector<std::vector<int> > ulist;
-        std::vector<std::vector<int> >::iterator i;
-        std::vector<OBBitVec>::iterator j;
-
-        for (i = mlist.begin();i != mlist.end();++i)
-          {
-            ok = true;
-            bv.Clear();
-            bv.FromVecInt(*i);
-            for (j = vbv.begin();j != vbv.end() && ok;++j)
-              if ((*j) == bv)
-                ok = false;
-
-            if (ok)
-              {
-                ulist.push_back(*i);
-                vbv.push_back(bv);
-              }
-          }
-
-        mlist = ulist;
-    }
+      RemoveDuplicateMatches(mlist);
     return true;
   }
 
 
+  bool OBSmartsPattern::HasMatchAt(OBMol &mol, OBSmartsMatcher &matcher,
+                                   OBAtom *atom) const
+  {
+    if (_pat == nullptr)
+      return false;
+    if (_pat->hasExplicitH)
+      {
+        //As in Match(), use a copy with explicit hydrogens. These are
+        //added after the other atoms, which keep their indices.
+        OBSmartsMatcher tmatcher;
+        OBMol tmol = mol;
+        tmol.AddHydrogens(false,false);
+        return tmatcher.matchAt(tmol,_pat,tmol.GetAtom(atom->GetIdx()));
+      }
+    return matcher.matchAt(mol,_pat,atom);
+  }
+
   bool OBSmartsPattern::RestrictedMatch(OBMol &mol,
                                         std::vector<std::pair<int,int> > &pr,
                                         bool single)
@@ -1904,9 +1930,10 @@ namespace OpenBabel
   }
 
   void OBSmartsMatcher::FastSingleMatch(OBMol &mol, const Pattern *pat,
-                              std::vector<std::vector<int> > &mlist)
+                              std::vector<std::vector<int> > &mlist,
+                              bool eachatom)
   {
-    OBAtom *atom,*a1,*nbr;
+    OBAtom *atom;
     std::vector<OBAtom*>::iterator i;
 
     OBBitVec bv(mol.NumAtoms()+1);
@@ -1921,78 +1948,120 @@ namespace OpenBabel
         vi.resize(pat->bcount);
       }
 
-    int bcount;
     for (atom = mol.BeginAtom(i);atom;atom=mol.NextAtom(i))
-      if (EvalAtomExpr(pat->atom[0].expr,atom))
+      if (EvalAtomExpr(pat->atom[0].expr,atom)
+          && FastMatchFrom(mol,pat,atom,map,bv,vi,vif))
         {
-          map[0] = atom->GetIdx();
-          if (pat->bcount)
-            vif[0] = false;
-          bv.Clear();
-          bv.SetBitOn(atom->GetIdx());
+          mlist.push_back(map);
+          if (!eachatom)
+            return; //found a single match
+        }
+  }
 
-          for (bcount=0;bcount >=0;)
-            {
-              //***entire pattern matched***
-              if (bcount == pat->bcount) //save full match here
-                {
-                  mlist.push_back(map);
+  bool OBSmartsMatcher::FastMatchFrom(OBMol &mol, const Pattern *pat, OBAtom *atom,
+                                      std::vector<int> &map, OBBitVec &bv,
+                                      std::vector<std::vector<OBBond*>::iterator> &vi,
+                                      std::vector<bool> &vif)
+  {
+    OBAtom *a1,*nbr;
+
+    map[0] = atom->GetIdx();
+    if (pat->bcount)
+      vif[0] = false;
+    bv.Clear();
+    bv.SetBitOn(atom->GetIdx());
+
+    for (int bcount=0;bcount >=0;)
+      {
+        //***entire pattern matched***
+        if (bcount == pat->bcount)
+          return true;
+
+        //***match the next bond***
+        if (!pat->bond[bcount].grow) //just check bond here
+          {
+            if ( !vif[bcount] )
+              {
+                OBBond *bond = mol.GetBond(map[pat->bond[bcount].src],
+                                           map[pat->bond[bcount].dst]);
+                if (bond && EvalBondExpr(pat->bond[bcount].expr,bond))
+                  {
+                    vif[bcount++] = true;
+                    if (bcount < pat->bcount)
+                      vif[bcount] = false;
+                  }
+                else
                   bcount--;
-                  return; //found a single match
-                }
+              }
+            else //bond must have already been visited - backtrack
+              bcount--;
+          }
+        else //need to map atom and check bond
+          {
+            a1 = mol.GetAtom(map[pat->bond[bcount].src]);
 
-              //***match the next bond***
-              if (!pat->bond[bcount].grow) //just check bond here
-                {
-                  if ( !vif[bcount] )
-                    {
-                      OBBond *bond = mol.GetBond(map[pat->bond[bcount].src],
-                                                 map[pat->bond[bcount].dst]);
-                      if (bond && EvalBondExpr(pat->bond[bcount].expr,bond))
-                        {
-                          vif[bcount++] = true;
-                          if (bcount < pat->bcount)
-                            vif[bcount] = false;
-                        }
-                      else
-                        bcount--;
-                    }
-                  else //bond must have already been visited - backtrack
-                    bcount--;
-                }
-              else //need to map atom and check bond
-                {
-                  a1 = mol.GetAtom(map[pat->bond[bcount].src]);
-
-                  if (!vif[bcount]) //figure out which nbr atom we are mapping
-                    {
-                      nbr = a1->BeginNbrAtom(vi[bcount]);
-                    }
-                  else
-                    {
-                      bv.SetBitOff(map[pat->bond[bcount].dst]);
-                      nbr = a1->NextNbrAtom(vi[bcount]);
-                    }
-
-                  for (;nbr;nbr=a1->NextNbrAtom(vi[bcount]))
-                    if (!bv[nbr->GetIdx()])
-                      if (EvalAtomExpr(pat->atom[pat->bond[bcount].dst].expr,nbr)
-                          && EvalBondExpr(pat->bond[bcount].expr,(OBBond *)*(vi[bcount])))
-                        {
-                          bv.SetBitOn(nbr->GetIdx());
-                          map[pat->bond[bcount].dst] = nbr->GetIdx();
-                          vif[bcount] = true;
-                          bcount++;
-                          if (bcount < pat->bcount)
-                            vif[bcount] = false;
-                          break;
-                        }
-
-                  if (!nbr)//no match - time to backtrack
-                    bcount--;
-                }
-            }
-        }
+            if (!vif[bcount]) //figure out which nbr atom we are mapping
+              {
+                nbr = a1->BeginNbrAtom(vi[bcount]);
+              }
+            else
+              {
+                bv.SetBitOff(map[pat->bond[bcount].dst]);
+                nbr = a1->NextNbrAtom(vi[bcount]);
+              }
+
+            for (;nbr;nbr=a1->NextNbrAtom(vi[bcount]))
+              if (!bv[nbr->GetIdx()])
+                if (EvalAtomExpr(pat->atom[pat->bond[bcount].dst].expr,nbr)
+                    && EvalBondExpr(pat->bond[bcount].expr,(OBBond *)*(vi[bcount])))
+                  {
+                    bv.SetBitOn(nbr->GetIdx());
+                    map[pat->bond[bcount].dst] = nbr->GetIdx();
+                    vif[bcount] = true;
+                    bcount++;
+                    if (bcount < pat->bcount)
+                      vif[bcount] = false;
+                    break;
+                  }
+
+            if (!nbr)//no match - time to backtrack
+              bcount--;
+          }
+      }
+    return false;
+  }
+
+  //! \return whether FastMatchFrom() can find every first atom of a
+  //! pattern, i.e. it is not chiral and every atom is reached by a bond
+  static bool IsFastMatchable(const Pattern *pat)
+  {
+    int grow = 0;
+    for (int k = 0;k < pat->bcount;++k)
+      if (pat->bond[k].grow)
+        grow++;
+    return !pat->ischiral && grow == pat->acount - 1;
+  }
+
+  bool OBSmartsMatcher::matchAt(OBMol &mol, const Pattern *pat, OBAtom *atom)
+  {
+    if (!pat || pat->acount == 0 || !EvalAtomExpr(pat->atom[0].expr,atom))
+      return false;
+
+    if (IsFastMatchable(pat)) {
+      OBBitVec bv(mol.NumAtoms()+1);
+      std::vector<int> map(pat->acount);
+      std::vector<std::vector<OBBond*>::iterator> vi(pat->bcount);
+      std::vector<bool> vif(pat->bcount);
+      return FastMatchFrom(mol,pat,atom,map,bv,vi,vif);
+    }
+
+    // otherwise look through all the matches
+    std::vector<std::vector<int> > mlist;
+    match(mol,pat,mlist);
+    for (std::vector<std::vector<int> >::iterator j = mlist.begin();j != mlist.end();++j)
+      if ((*j)[0] == static_cast<int>(atom->GetIdx()))
+        return true;
+    return false;
   }
 
 
@@ -2177,25 +2246,33 @@ namespace OpenBabel
         case AE_RECUR:
           {
             //see if pattern has been matched
-            std::vector<std::pair<const Pattern*,std::vector<bool> > >::iterator i;
-            for (i = RSCACHE.begin();i != RSCACHE.end();++i)
-              if (i->first == (Pattern*)expr->recur.recur)
-                return(i->second[atom->GetIdx()]);
-
-            //perceive and match pattern
-            std::vector<std::vector<int> >::iterator j;
-            std::vector<bool> vb(((OBMol*) atom->GetParent())->NumAtoms()+1);
-            std::vector<std::vector<int> > mlist;
-            if (match( *((OBMol *) atom->GetParent()),
-                       (Pattern*)expr->recur.recur,mlist))
-              for (j = mlist.begin();j != mlist.end();++j)
-                vb[(*j)[0]] = true;
+            const Pattern *rpat = (const Pattern*)expr->recur.recur;
+            std::map<const Pattern*,const std::vector<bool>*>::iterator i = RSINDEX.find(rpat);
+            if (i != RSINDEX.end())
+              return((*i->second)[atom->GetIdx()]);
+
+            //the same SMARTS may have been matched as part of another pattern
+            std::map<std::string,std::vector<bool> >::iterator r = RSCACHE.find(rpat->smarts);
+            if (r == RSCACHE.end())
+              {
+                //perceive and match pattern
+                std::vector<std::vector<int> >::iterator j;
+                std::vector<bool> vb(((OBMol*) atom->GetParent())->NumAtoms()+1);
+                std::vector<std::vector<int> > mlist;
+                //only the first atom of each match is needed, so when every
+                //atom is reached by a bond one match per first atom is enough
+                if (IsFastMatchable(rpat))
+                  FastSingleMatch( *((OBMol *) atom->GetParent()),rpat,mlist,true);
+                else
+                  match( *((OBMol *) atom->GetParent()),rpat,mlist);
+                for (j = mlist.begin();j != mlist.end();++j)
+                  vb[(*j)[0]] = true;
 
-            RSCACHE.push_back(std::pair<const Pattern*,
-                              std::vector<bool> > ((const Pattern*)expr->recur.recur,
-                                                   vb));
+                r = RSCACHE.insert(std::make_pair(rpat->smarts, vb)).first;
+              }
+            RSINDEX[rpat] = &r->second;
 
-            return(vb[atom->GetIdx()]);
+            return(r->second[atom->GetIdx()]);
           }
 
         default:
@@ -2258,30 +2335,7 @@ namespace OpenBabel
     if (_mlist.empty() || _mlist.size() == 1)
       return(_mlist);
 
-    bool ok;
-    OBBitVec bv;
-    std::vector<OBBitVec> vbv;
-    std::vector<std::vector<int> > mlist;
-    std::vector<std::vector<int> >::iterator i;
-    std::vector<OBBitVec>::iterator j;
-
-    for (i = _mlist.begin();i != _mlist.end();++i)
-      {
-        ok = true;
-        bv.Clear();
-        bv.FromVecInt(*i);
-        for (j = vbv.begin();j != vbv.end() && ok;++j)
-          if ((*j) == bv)
-            ok = false;
-
-        if (ok)
-          {
-            mlist.push_back(*i);
-            vbv.push_back(bv);
-          }
-      }
-
-    _mlist = mlist;
+    RemoveDuplicateMatches(_mlist);
     return(_mlist);
   }
 
@@ -0,0 +1,310 @@
+/**********************************************************************
+recordindex.cpp - Byte offsets of the records in a multi-record text file
+
+This file is part of the Open Babel project.
+For more information, see <http://openbabel.org/>
+
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation version 2 of the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+***********************************************************************/
+
+#include <openbabel/babelconfig.h>
+#include <openbabel/recordindex.h>
+#include <openbabel/format.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace OpenBabel
+{
+  /** \class OBRecordIndex recordindex.h <openbabel/recordindex.h>
+      \brief Byte offsets of the records in a multi-record text file
+
+      Moving to the n'th object of a file (the -f option) normally means
+      calling OBFormat::SkipObjects(), which reads every record in front
+      of it. For formats whose records can be found line by line (those
+      that return a value from OBFormat::RecordTerminator()), an
+      OBRecordIndex holds the offset of every record, so that the input
+      stream can be positioned with a single seek.
+
+      The index is built by splitting the file into chunks which are
+      scanned in parallel. A chunk which does not start at the beginning of
+      a line leaves that line to the chunk before it, which reads past its
+      own end to finish it, so every line is looked at exactly once.
+
+      The index can be written to a sidecar file (IndexFilename()) which
+      records the size and modification time of the data file, and the
+      format and record terminator it was scanned for, so a stale index,
+      or one made for other records, is never used. OBConversion builds and writes one when the
+      --index option is given, and uses an up to date one whenever -f is.
+
+      The record boundaries are also useful to split a file into parts
+      which can be converted independently:
+\code
+      OBRecordIndex index;
+      if (index.Build(filename, pFormat)) {
+        vector<pair<unsigned long, unsigned long> > parts = index.Split(nthreads);
+        // seek to index.Offset(parts[i].first) and read
+        // parts[i].second - parts[i].first objects
+      }
+\endcode
+  */
+
+  static bool FileStat(const string &filename, unsigned long long &size, long long &mtime)
+  {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+      return false;
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+  }
+
+  // Append to ends the offset just past each line which starts in
+  // [begin, end) and ends a record.
+  static void ScanChunk(const string &filename, const char *term,
+                        unsigned long long begin, unsigned long long end,
+                        vector<unsigned long long> &ends)
+  {
+    ifstream ifs(filename.c_str(), ios::in | ios::binary);
+    if (!ifs)
+      return;
+
+    const size_t termlen = strlen(term);
+    const size_t BUFSIZE = 1 << 20;
+    vector<char> buf(BUFSIZE);
+
+    unsigned long long pos = begin; // file offset of buf[0]
+    bool linestart = true;
+    if (begin > 0) {
+      // Unless the previous character ends a line, the first (partial)
+      // line belongs to the previous chunk
+      ifs.seekg(begin - 1);
+      linestart = ifs.get() == '\n';
+    }
+    size_t matched = 0;   // characters of term matched at the start of this line
+    bool matching = false;
+    bool skipline = !linestart; // line cannot end a record: a comment, or not ours
+
+    while (ifs) {
+      ifs.read(&buf[0], BUFSIZE);
+      size_t n = ifs.gcount();
+      if (n == 0)
+        break;
+      const char *p = &buf[0], *bufend = p + n;
+      while (p != bufend) {
+        if (linestart) {
+          if (pos + (p - &buf[0]) >= end)
+            return;
+          linestart = false;
+          matching = true;
+          matched = 0;
+          skipline = termlen == 0 && *p == '#';
+        }
+        if (matching && *p != '\n') {
+          if (matched < termlen && *p == term[matched]) {
+            ++matched;
+            ++p;
+            continue;
+          }
+          matching = false;
+        }
+        // The rest of the line does not matter
+        const char *nl = static_cast<const char*>(memchr(p, '\n', bufend - p));
+        if (!nl) {
+          p = bufend;
+          break;
+        }
+        if (matched == termlen && !skipline)
+          ends.push_back(pos + (nl - &buf[0]) + 1);
+        linestart = true;
+        p = nl + 1;
+      }
+      pos += n;
+    }
+  }
+
+  bool OBRecordIndex::CanIndex(OBFormat *pFormat)
+  {
+    return pFormat && !(pFormat->Flags() & (READBINARY | READXML))
+      && pFormat->RecordTerminator() != nullptr;
+  }
+
+  bool OBRecordIndex::Build(const string &filename, OBFormat *pFormat, unsigned nthreads)
+  {
+    _offsets.clear();
+    if (!CanIndex(pFormat) || !FileStat(filename, _filesize, _mtime))
+      return false;
+    const char *term = pFormat->RecordTerminator();
+
+    unsigned long long nchunks = nthreads;
+    if (nthreads == 0) {
+      // Not worth a thread for less than a few MB
+      const unsigned long long MINCHUNK = 4 << 20;
+      nchunks = min<unsigned long long>(max(1u, thread::hardware_concurrency()),
+                                        _filesize / MINCHUNK + 1);
+    }
+    nchunks = max(1ULL, min(nchunks, _filesize));
+
+    vector<vector<unsigned long long> > ends(nchunks);
+    vector<thread> threads;
+    for (unsigned long long i = 0; i < nchunks; ++i) {
+      unsigned long long begin = _filesize * i / nchunks;
+      unsigned long long end = _filesize * (i + 1) / nchunks;
+      if (i + 1 == nchunks)
+        ScanChunk(filename, term, begin, end, ends[i]); // on this thread
+      else
+        threads.push_back(thread(ScanChunk, cref(filename), term, begin, end, ref(ends[i])));
+    }
+    for (size_t i = 0; i < threads.size(); ++i)
+      threads[i].join();
+
+    _offsets.push_back(0);
+    for (size_t i = 0; i < ends.size(); ++i)
+      _offsets.insert(_offsets.end(), ends[i].begin(), ends[i].end());
+
+    // A last record without a terminator still counts, unless it is only whitespace
+    ifstream ifs(filename.c_str(), ios::in | ios::binary);
+    unsigned long long last = _offsets.back();
+    if (last < _filesize) {
+      ifs.seekg(last);
+      char ch;
+      while (ifs.get(ch))
+        if (!isspace(static_cast<unsigned char>(ch))) {
+          _offsets.push_back(_filesize);
+          break;
+        }
+    }
+
+    // Nor does a record which is only a terminator line, like the ENDMDL
+    // after an END in a PDB file: readers pass over it to the next record
+    if (*term) {
+      ifs.clear();
+      const unsigned long long SHORT = 256;
+      vector<unsigned long long>::iterator out = _offsets.begin() + 1;
+      for (size_t i = 0; i + 1 < _offsets.size(); ++i) {
+        if (_offsets[i + 1] - _offsets[i] <= SHORT) {
+          string rec(_offsets[i + 1] - _offsets[i], '\0');
+          ifs.seekg(_offsets[i]);
+          ifs.read(&rec[0], rec.size());
+          size_t start = rec.find_first_not_of(" \t\r\n");
+          size_t nl = rec.find('\n', start);
+          if (ifs && start != string::npos && rec.compare(start, strlen(term), term) == 0
+              && (nl == string::npos || nl + 1 == rec.size()))
+            continue; // joined to the next record
+        }
+        *out++ = _offsets[i + 1];
+      }
+      _offsets.erase(out, _offsets.end());
+    }
+
+    _format = pFormat->GetID();
+    _terminator = term;
+    return true;
+  }
+
+  static const char IndexMagic[8] = { 'O', 'B', 'R', 'I', 'D', 'X', '2', '\n' };
+
+  static bool ReadString(istream &is, string &str)
+  {
+    unsigned int len;
+    if (!is.read(reinterpret_cast<char*>(&len), sizeof(len)) || len > 255)
+      return false;
+    str.resize(len);
+    return len == 0 || is.read(&str[0], len);
+  }
+
+  static void WriteString(ostream &os, const string &str)
+  {
+    unsigned int len = str.size();
+    os.write(reinterpret_cast<const char*>(&len), sizeof(len));
+    os.write(str.data(), len);
+  }
+
+  bool OBRecordIndex::Read(const string &indexfile, const string &filename, OBFormat *pFormat)
+  {
+    _offsets.clear();
+    unsigned long long size;
+    long long mtime;
+    if (!CanIndex(pFormat) || !FileStat(filename, size, mtime))
+      return false;
+
+    ifstream ifs(indexfile.c_str(), ios::in | ios::binary);
+    char magic[sizeof(IndexMagic)];
+    unsigned long long count;
+    if (!ifs.read(magic, sizeof(magic)) || memcmp(magic, IndexMagic, sizeof(magic)) != 0
+        || !ifs.read(reinterpret_cast<char*>(&_filesize), sizeof(_filesize))
+        || !ifs.read(reinterpret_cast<char*>(&_mtime), sizeof(_mtime))
+        || !ifs.read(reinterpret_cast<char*>(&count), sizeof(count))
+        || !ReadString(ifs, _format) || !ReadString(ifs, _terminator))
+      return false;
+    if (_filesize != size || _mtime != mtime || count == 0 || count > size + 2)
+      return false; // data file has changed since the index was made
+    if (_format != pFormat->GetID() || _terminator != pFormat->RecordTerminator())
+      return false; // made for other records
+
+    _offsets.resize(count);
+    if (!ifs.read(reinterpret_cast<char*>(&_offsets[0]), count * sizeof(_offsets[0]))) {
+      _offsets.clear();
+      return false;
+    }
+    return true;
+  }
+
+  bool OBRecordIndex::Write(const string &indexfile) const
+  {
+    if (_offsets.empty())
+      return false;
+    ofstream ofs(indexfile.c_str(), ios::out | ios::binary);
+    unsigned long long count = _offsets.size();
+    ofs.write(IndexMagic, sizeof(IndexMagic));
+    ofs.write(reinterpret_cast<const char*>(&_filesize), sizeof(_filesize));
+    ofs.write(reinterpret_cast<const char*>(&_mtime), sizeof(_mtime));
+    ofs.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    WriteString(ofs, _format);
+    WriteString(ofs, _terminator);
+    ofs.write(reinterpret_cast<const char*>(&_offsets[0]), count * sizeof(_offsets[0]));
+    return ofs.good();
+  }
+
+  vector<pair<unsigned long, unsigned long> > OBRecordIndex::Split(unsigned nparts) const
+  {
+    vector<pair<unsigned long, unsigned long> > parts;
+    unsigned long nrecs = NumRecords();
+    if (nrecs == 0 || nparts == 0)
+      return parts;
+    unsigned long long total = _offsets.back();
+    unsigned long first = 0;
+    for (unsigned i = 1; i <= nparts && first < nrecs; ++i) {
+      unsigned long last = nrecs;
+      if (i < nparts) {
+        // first record starting at or after the i'th fraction of the file
+        unsigned long long target = total * i / nparts;
+        last = lower_bound(_offsets.begin(), _offsets.end() - 1, target) - _offsets.begin();
+        if (last <= first)
+          continue;
+      }
+      parts.push_back(make_pair(first, last));
+      first = last;
+    }
+    return parts;
+  }
+
+} // namespace OpenBabel
+
+//! \file recordindex.cpp
+//! \brief Byte offsets of the records in a multi-record text file
@@ -479,6 +479,13 @@ namespace OpenBabel
   {
     vector<double*> tmpclist = CreateConformerList(mol);
 
+    // The molecule's own conformers may be borrowed or part of a block,
+    // so let the molecule free them
+    if (&clist == &mol.GetConformers()) {
+      mol.SetConformers(tmpclist);
+      return;
+    }
+
     //transfer the conf list
     vector<double*>::iterator k;
     for (k = clist.begin();k != clist.end();++k)
@@ -31,6 +31,43 @@ namespace OpenBabel
 {
   class OBConversion; //used only as a pointer
 
+  //! Whether any of the general options needs the atoms of a molecule.
+  //! Title and property options do not, nor do descriptor options which
+  //! name only properties.
+  static bool NeedsStructure(const std::map<std::string, std::string>* pOptions)
+  {
+    map<string,string>::const_iterator itr;
+    for(itr=pOptions->begin(); itr!=pOptions->end(); ++itr)
+      {
+        const string& opt = itr->first;
+        if(opt=="f" || opt=="l" || opt=="e" || opt=="m" || opt=="z" || opt=="zin"
+           || opt=="index" || opt=="firstinput" || opt=="title" || opt=="addtotitle"
+           || opt=="property" || opt=="delete")
+          continue;
+        if(opt!="add" && opt!="append" && opt!="filter" && opt!="sort")
+          return true;
+        //The words which are descriptor IDs
+        const string& text = itr->second;
+        string::size_type pos = 0;
+        while(pos<text.size())
+          {
+            if(!isalnum((unsigned char)text[pos]) && text[pos]!='_')
+              {
+                ++pos;
+                continue;
+              }
+            string::size_type end = pos;
+            while(end<text.size() && (isalnum((unsigned char)text[end]) || text[end]=='_'))
+              ++end;
+            string word = text.substr(pos, end-pos);
+            if(word!="title" && OBDescriptor::FindType(word.c_str()))
+              return true;
+            pos = end;
+          }
+      }
+    return false;
+  }
+
   OBBase* OBMol::DoTransformations(const std::map<std::string, std::string>* pOptions, OBConversion* pConv)
   {
     // Perform any requested transformations
@@ -52,6 +89,11 @@ namespace OpenBabel
     if(pOptions->empty())
       return this;
 
+    //A structure which has not been parsed is parsed now if it is needed
+    if(HasData(OBGenericDataType::DeferredStructureData) && NeedsStructure(pOptions)
+       && !OBDeferredStructure::Expand(this))
+      obErrorLog.ThrowError(__FUNCTION__, "Could not parse the structure of " + string(GetTitle()), obWarning);
+
     // DoOps calls Do() for each of the plugin options in the map
     // It normally returns true, even if there are no options but
     // can return false if one of the options decides that the
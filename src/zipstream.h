@@ -29,6 +29,9 @@ Altered by: Andreas Zieringer 2003 for OpenSG project
 
 Altered by: Geoffrey Hutchison 2005 for Open Babel project
             minor namespace modifications, VC++ compatibility
+
+Altered for Open Babel project
+            parallel BGZF block compression
 */
 
 #ifndef _ZIPSTREAM_H_
@@ -40,6 +43,10 @@ Altered by: Geoffrey Hutchison 2005 for Open Babel project
 #include <sstream>
 #include <iosfwd>
 #include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include <zlib.h>
 
@@ -300,6 +307,110 @@ typedef basic_zip_ostream<char> zip_ostream;
 /// A typedef for basic_zip_istream<char>
 typedef basic_zip_istream<char> zip_istream;
 
+//*****************************************************************************
+//  template class basic_bgzf_streambuf
+//*****************************************************************************
+
+/// Uncompressed size of each block of BGZF output, as used by bgzip
+const size_t bgzf_block_size = 0xff00;
+
+/** \brief A stream decorator that gzips raw input to an ostream in independent blocks.
+
+Each block of up to bgzf_block_size bytes is compressed as a separate gzip
+member carrying the BGZF extra field, so the output is an ordinary gzip file
+which BGZF-aware tools (bgzip, htslib) can also index and seek into.
+Since the blocks do not depend on each other they are compressed in parallel
+on a pool of worker threads, and written to the ostream in order. The output
+does not depend on the number of threads.
+
+Unlike basic_zip_streambuf, sync() does not end a block, so flushing the
+stream (e.g. with std::endl) does not hurt the compression.
+*/
+template <class charT,
+          class traits = std::char_traits<charT> >
+class basic_bgzf_streambuf : public std::basic_streambuf<charT, traits>
+{
+public:
+    typedef std::basic_ostream<charT, traits>& ostream_reference;
+    typedef unsigned char byte_type;
+    typedef char          char_type;
+    typedef std::vector<byte_type> byte_vector_type;
+    typedef std::vector<char_type> char_vector_type;
+    typedef int int_type;
+
+    /** \param nthreads number of compression threads, 0 for one per processor
+     */
+    basic_bgzf_streambuf(ostream_reference ostream,
+                         int level,
+                         unsigned nthreads);
+
+    ~basic_bgzf_streambuf(void);
+
+    int               sync        (void);
+    int_type          overflow    (int_type c);
+    void              finish      (void);
+    inline
+    ostream_reference get_ostream (void) const;
+    inline
+    bool              compression_ok(void) const;
+
+private:
+    struct block
+    {
+        char_vector_type in;
+        byte_vector_type out;
+        bool done;
+    };
+
+    static bool       compress_block(int level, block &b);
+    void              submit_block  (void);
+    void              write_blocks  (bool wait_all);
+    void              work          (void);
+
+    ostream_reference        _ostream;
+    int                      _level;
+    unsigned                 _nthreads;
+    bool                     _good;
+    bool                     _finished;
+    char_vector_type         _buffer;
+
+    // shared with the worker threads
+    std::vector<std::thread> _threads;
+    std::mutex               _mutex;
+    std::condition_variable  _work_cv;
+    std::condition_variable  _done_cv;
+    std::deque<block*>       _queue;   // waiting to be compressed
+    std::deque<block*>       _pending; // not yet written, in output order
+    bool                     _stop;
+};
+
+//*****************************************************************************
+//  template class basic_bgzf_ostream
+//*****************************************************************************
+
+template <class charT,
+          class traits = std::char_traits<charT> >
+class basic_bgzf_ostream :
+    public basic_bgzf_streambuf<charT, traits>,
+    public std::basic_ostream<charT, traits>
+{
+public:
+    typedef std::basic_ostream<charT, traits>& ostream_reference;
+
+    inline
+    explicit basic_bgzf_ostream(ostream_reference ostream,
+                                int level = Z_DEFAULT_COMPRESSION,
+                                unsigned nthreads = 0);
+
+    ~basic_bgzf_ostream(void);
+
+    /// Write the remaining data and the BGZF end-of-file marker
+    void finished(void);
+};
+
+/// A typedef for basic_bgzf_ostream<char>
+typedef basic_bgzf_ostream<char> bgzf_ostream;
+
 /// A typedef for basic_zip_ostream<wchar_t>
 //typedef basic_zip_ostream<wchar_t> zip_wostream;
 /// A typedef for basic_zip_istream<wchart>
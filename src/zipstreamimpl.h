@@ -29,6 +29,9 @@ Altered by: Andreas Zieringer 2003 for OpenSG project
 
 Altered by: Geoffrey Hutchison 2005 for Open Babel project
             minor namespace modifications, VC++ compatibility
+
+Altered for Open Babel project
+            parallel BGZF block compression
 */
 
 #include <cstring>
@@ -580,6 +583,12 @@ basic_unzip_streambuf<charT, traits>::unzip_from_stream(char_type* buffer,
       }
 
       _err = check_header();
+
+      // A member may end without producing any more output, e.g. the
+      // empty block at the end of a BGZF file. That is not the end of
+      // the data if another member follows.
+      if (n_read == 0 && _err == Z_OK)
+        return unzip_from_stream(buffer, buffer_size);
     }
 
     return n_read;
@@ -731,6 +740,301 @@ basic_zip_ostream<charT,traits>& basic_zip_ostream<charT, traits>::add_footer(vo
 
 
 
+//*****************************************************************************
+//  template class basic_bgzf_streambuf
+//*****************************************************************************
+
+//-----------------------------------------------------------------------------
+// PUBLIC
+//-----------------------------------------------------------------------------
+
+/** Construct a BGZF stream. No threads are started until there is
+ *  more than one block to compress.
+ */
+template <class charT, class traits>
+basic_bgzf_streambuf<charT, traits>::basic_bgzf_streambuf(ostream_reference ostream,
+                                                          int level,
+                                                          unsigned nthreads)
+    : _ostream(ostream),
+      _level(level > 9 ? 9 : level),
+      _nthreads(nthreads ? nthreads : std::thread::hardware_concurrency()),
+      _good(true),
+      _finished(false),
+      _buffer(bgzf_block_size),
+      _stop(false)
+{
+    this->setp(&_buffer[0], &_buffer[0] + _buffer.size());
+}
+
+/** Destructor
+ */
+template <class charT, class traits>
+basic_bgzf_streambuf<charT, traits>::~basic_bgzf_streambuf(void)
+{
+    finish();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _work_cv.notify_all();
+    for (size_t i = 0; i < _threads.size(); ++i)
+        _threads[i].join();
+}
+
+/** Data is only compressed a block at a time, so there is nothing to do
+ */
+template <class charT, class traits>
+int basic_bgzf_streambuf<charT, traits>::sync(void)
+{
+    return _good ? 0 : -1;
+}
+
+/** The buffer is full: send it off as a block
+ */
+template <class charT, class traits>
+typename basic_bgzf_streambuf<charT, traits>::int_type
+basic_bgzf_streambuf<charT, traits>::overflow(int_type c)
+{
+    submit_block();
+    if (c != EOF)
+    {
+        *this->pptr() = c;
+        this->pbump(1);
+    }
+    return _good ? traits::not_eof(c) : EOF;
+}
+
+/** Compress and write everything, followed by the BGZF end-of-file marker.
+ *  Nothing more should be written afterwards.
+ */
+template <class charT, class traits>
+void basic_bgzf_streambuf<charT, traits>::finish(void)
+{
+    if (_finished)
+        return;
+    _finished = true;
+
+    if (this->pptr() > this->pbase())
+        submit_block();
+    write_blocks(true);
+
+    // An empty block marks the end of a BGZF file
+    static const char eof_block[28] = {
+        31, -117, 8, 4, 0, 0, 0, 0, 0, -1, 6, 0, 66, 67, 2, 0,
+        27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    _ostream.write(eof_block, sizeof(eof_block));
+    _ostream.flush();
+}
+
+/** returns a reference to the output stream
+ */
+template <class charT, class traits> inline
+typename basic_bgzf_streambuf<charT, traits>::ostream_reference
+basic_bgzf_streambuf<charT, traits>::get_ostream(void) const
+{
+    return _ostream;
+}
+
+/** returns false if compression or writing has failed
+ */
+template <class charT, class traits> inline
+bool basic_bgzf_streambuf<charT, traits>::compression_ok(void) const
+{
+    return _good;
+}
+
+//-----------------------------------------------------------------------------
+// PRIVATE
+//-----------------------------------------------------------------------------
+
+/** Compress b.in into b.out as a complete BGZF block
+ */
+template <class charT, class traits>
+bool basic_bgzf_streambuf<charT, traits>::compress_block(int level, block &b)
+{
+    const size_t header_size = 18, footer_size = 8;
+    z_stream zs;
+    zs.zalloc = (alloc_func) nullptr;
+    zs.zfree = (free_func) nullptr;
+    zs.opaque = nullptr;
+    if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    uLong bound = deflateBound(&zs, static_cast<uLong>(b.in.size()));
+    b.out.resize(header_size + bound + footer_size);
+    zs.next_in = (Bytef*) (b.in.empty() ? nullptr : &b.in[0]);
+    zs.avail_in = static_cast<uInt>(b.in.size());
+    zs.next_out = &b.out[header_size];
+    zs.avail_out = static_cast<uInt>(bound);
+    int err = deflate(&zs, Z_FINISH);
+    size_t csize = bound - zs.avail_out;
+    deflateEnd(&zs);
+    if (err != Z_STREAM_END)
+        return false;
+
+    // gzip header with the BGZF extra field, which holds the block size - 1
+    size_t bsize = header_size + csize + footer_size;
+    const byte_type header[header_size] = {
+        static_cast<byte_type>(detail::gz_magic[0]), static_cast<byte_type>(detail::gz_magic[1]),
+        Z_DEFLATED, detail::gz_extra_field,
+        0, 0, 0, 0, // time
+        0, 0xff,    // xflags, OS unknown
+        6, 0, 'B', 'C', 2, 0,
+        static_cast<byte_type>((bsize - 1) & 0xff),
+        static_cast<byte_type>((bsize - 1) >> 8) };
+    std::copy(header, header + header_size, b.out.begin());
+
+    // crc and length in LSB order
+    unsigned long crc = crc32(0L, nullptr, 0);
+    if (!b.in.empty())
+        crc = crc32(crc, (const Bytef*) &b.in[0], static_cast<uInt>(b.in.size()));
+    unsigned long length = b.in.size();
+    byte_type *footer = &b.out[header_size + csize];
+    for (int n = 0; n < 4; ++n)
+    {
+        footer[n] = static_cast<byte_type>(crc & 0xff);
+        footer[n + 4] = static_cast<byte_type>(length & 0xff);
+        crc >>= 8;
+        length >>= 8;
+    }
+    b.out.resize(bsize);
+    return true;
+}
+
+/** Hand the contents of the buffer to the workers (or compress them
+ *  here if there is only one thread) and start a new buffer.
+ */
+template <class charT, class traits>
+void basic_bgzf_streambuf<charT, traits>::submit_block(void)
+{
+    block *b = new block;
+    b->in.assign(this->pbase(), this->pptr());
+    b->done = false;
+    this->setp(&_buffer[0], &_buffer[0] + _buffer.size());
+
+    if (_nthreads <= 1)
+    {
+        if (!compress_block(_level, *b))
+            _good = false;
+        else
+            _ostream.write((const char_type*) &b->out[0], b->out.size());
+        delete b;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_threads.empty() && !_finished)
+        {
+            // Now there is more than one block, start the workers
+            try
+            {
+                for (unsigned i = 0; i < _nthreads; ++i)
+                    _threads.push_back(std::thread(&basic_bgzf_streambuf::work, this));
+            }
+            catch (...)
+            {
+                // carry on with the threads we have, if any
+            }
+        }
+        _pending.push_back(b);
+        if (!_threads.empty())
+            _queue.push_back(b);
+    }
+    if (_threads.empty())
+    {
+        // The only block: no point starting threads for it
+        b->done = true;
+        if (!compress_block(_level, *b))
+            _good = false;
+    }
+    else
+        _work_cv.notify_one();
+
+    write_blocks(false);
+}
+
+/** Write the finished blocks at the front of the queue to the ostream.
+ *  If wait_all is set, wait for all of them; otherwise only wait if
+ *  there are too many blocks in flight.
+ */
+template <class charT, class traits>
+void basic_bgzf_streambuf<charT, traits>::write_blocks(bool wait_all)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_pending.empty())
+    {
+        block *b = _pending.front();
+        if (!b->done)
+        {
+            if (!wait_all && _pending.size() < 2 * _threads.size())
+                break;
+            _done_cv.wait(lock);
+            continue;
+        }
+        _pending.pop_front();
+        lock.unlock();
+        if (b->out.empty())
+            _good = false;
+        else
+            _ostream.write((const char_type*) &b->out[0], b->out.size());
+        delete b;
+        lock.lock();
+    }
+}
+
+/** Worker thread: compress blocks until told to stop
+ */
+template <class charT, class traits>
+void basic_bgzf_streambuf<charT, traits>::work(void)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;)
+    {
+        while (_queue.empty() && !_stop)
+            _work_cv.wait(lock);
+        if (_queue.empty())
+            return;
+        block *b = _queue.front();
+        _queue.pop_front();
+        lock.unlock();
+        if (!compress_block(_level, *b))
+            b->out.clear();
+        lock.lock();
+        b->done = true;
+        _done_cv.notify_all();
+    }
+}
+
+//*****************************************************************************
+//  template class basic_bgzf_ostream
+//*****************************************************************************
+
+/**
+ */
+template <class charT, class traits> inline
+basic_bgzf_ostream<charT, traits>::basic_bgzf_ostream(ostream_reference ostream,
+                                                      int level,
+                                                      unsigned nthreads) :
+    basic_bgzf_streambuf<charT, traits>(ostream, level, nthreads),
+    std::basic_ostream<charT, traits>(this)
+{
+}
+
+/** Destructor
+ */
+template <class charT, class traits>
+basic_bgzf_ostream<charT, traits>::~basic_bgzf_ostream(void)
+{
+    finished();
+}
+
+template <class charT, class traits>
+void basic_bgzf_ostream<charT, traits>::finished(void)
+{
+    this->finish();
+}
+
 //*****************************************************************************
 //  template class basic_zip_istream
 //*****************************************************************************
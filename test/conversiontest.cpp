@@ -1,13 +1,26 @@
 #include "obtest.h"
 #include <openbabel/mol.h>
+#include <openbabel/atom.h>
+#include <openbabel/obiter.h>
+#include <openbabel/residue.h>
+#include <openbabel/generic.h>
+#include <openbabel/stereo/stereo.h>
+#include <openbabel/stereo/tetrahedral.h>
+#include <openbabel/stereo/cistrans.h>
 #include <openbabel/obconversion.h>
 #include <openbabel/phmodel.h>
 #include <openbabel/elements.h>
+#include <openbabel/recordindex.h>
 
 #include <iostream>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <map>
 
 using namespace std;
 using namespace OpenBabel;
@@ -29,6 +42,519 @@ void testMolToCdxmlConversion()
   OB_COMPARE(cdxmlFromMol, cdxmlTarget);
 }
 
+// Offsets in a record index should match skipping the objects one at a time,
+// however many chunks the file is scanned in, and -f should use them
+void testRecordIndex()
+{
+  const char* files[] = { "implicitH.sdf", "nci.smi", "filterset.sdf" };
+  for (unsigned i = 0; i < 3; ++i) {
+    string filename = OBTestUtil::GetFilename(files[i]);
+    OBConversion conv;
+    OBFormat *pFormat = conv.FormatFromExt(filename.c_str());
+    OB_REQUIRE(OBRecordIndex::CanIndex(pFormat));
+    conv.SetInFormat(pFormat);
+
+    // Expected offsets, from SkipObjects()
+    ifstream ifs(filename.c_str(), ios::in | ios::binary);
+    conv.SetInStream(&ifs, false);
+    vector<unsigned long long> offsets(1, 0);
+    while (pFormat->SkipObjects(1, &conv) == 1 && ifs.peek() != EOF)
+      offsets.push_back(ifs.tellg());
+    conv.SetInStream(nullptr);
+
+    for (unsigned nthreads = 1; nthreads < 8; ++nthreads) {
+      OBRecordIndex index;
+      OB_REQUIRE(index.Build(filename, pFormat, nthreads));
+      OB_COMPARE(index.NumRecords(), offsets.size());
+      for (unsigned long n = 0; n < offsets.size(); ++n)
+        OB_COMPARE(index.Offset(n), offsets[n]);
+
+      vector<pair<unsigned long, unsigned long> > parts = index.Split(nthreads);
+      OB_REQUIRE(!parts.empty());
+      OB_COMPARE(parts.front().first, 0);
+      OB_COMPARE(parts.back().second, index.NumRecords());
+      for (unsigned long p = 1; p < parts.size(); ++p)
+        OB_COMPARE(parts[p].first, parts[p - 1].second);
+    }
+  }
+
+  // PDB records end at END or ENDMDL; the ENDMDL after an END is passed over
+  {
+    string c = "HETATM    1  C1  LIG A   1       0.000   0.000   0.000  1.00  0.00           C\n";
+    string o = "HETATM    2  O1  LIG A   1       1.400   0.000   0.000  1.00  0.00           O\n";
+    string pdb = "MODEL        1\n" + c + "TER\nEND\nENDMDL\nMODEL        2\n" + c + o
+      + "ENDMDL\n" + o + "END\n" + c + c + "END\n";
+    string filename = "recordindex_test.pdb";
+    {
+      ofstream ofs(filename.c_str(), ios::binary);
+      ofs << pdb;
+    }
+    OBConversion conv;
+    OBFormat *pFormat = conv.FindFormat("pdb");
+    OB_REQUIRE(OBRecordIndex::CanIndex(pFormat));
+    conv.SetInFormat(pFormat);
+
+    ifstream ifs(filename.c_str(), ios::in | ios::binary);
+    conv.SetInStream(&ifs, false);
+    vector<unsigned long long> offsets(1, 0);
+    while (pFormat->SkipObjects(1, &conv) == 1 && ifs.peek() != EOF)
+      offsets.push_back(ifs.tellg());
+    ifs.clear();
+    ifs.seekg(0);
+    vector<unsigned> natoms;
+    OBMol mol;
+    while (conv.Read(&mol))
+      natoms.push_back(mol.NumAtoms());
+    conv.SetInStream(nullptr);
+    OB_COMPARE(natoms.size(), 4);
+    OB_COMPARE(offsets.size(), 4);
+
+    OBRecordIndex index;
+    OB_REQUIRE(index.Build(filename, pFormat, 2));
+    OB_COMPARE(index.NumRecords(), 4);
+    for (unsigned long n = 0; n < offsets.size(); ++n)
+      OB_COMPARE(index.Offset(n), offsets[n]);
+
+    OBConversion indexed;
+    indexed.SetInFormat(pFormat);
+    indexed.AddOption("index", OBConversion::GENOPTIONS);
+    indexed.AddOption("f", OBConversion::GENOPTIONS, "4");
+    OB_REQUIRE(indexed.ReadFile(&mol, filename));
+    OB_COMPARE(mol.NumAtoms(), 2);
+    OB_COMPARE(mol.GetAtom(1)->GetAtomicNum(), 6);
+    remove(OBRecordIndex::IndexFilename(filename).c_str());
+    remove(filename.c_str());
+  }
+
+  // Round trip through a sidecar index, used by -f
+  string filename = "recordindex_test.sdf";
+  {
+    ifstream src(OBTestUtil::GetFilename("implicitH.sdf").c_str(), ios::binary);
+    ofstream dst(filename.c_str(), ios::binary);
+    dst << src.rdbuf();
+  }
+  string indexfile = OBRecordIndex::IndexFilename(filename);
+  remove(indexfile.c_str());
+
+  OBConversion sequential;
+  sequential.SetInFormat("sdf");
+  sequential.AddOption("f", OBConversion::GENOPTIONS, "20");
+  OBMol expected;
+  OB_REQUIRE(sequential.ReadFile(&expected, filename));
+
+  OBConversion indexed;
+  indexed.SetInFormat("sdf");
+  indexed.AddOption("index", OBConversion::GENOPTIONS);
+  indexed.AddOption("f", OBConversion::GENOPTIONS, "20");
+  OBMol mol;
+  OB_REQUIRE(indexed.ReadFile(&mol, filename));
+  OB_COMPARE(string(mol.GetTitle()), string(expected.GetTitle()));
+  OB_COMPARE(mol.NumAtoms(), expected.NumAtoms());
+
+  OBRecordIndex index;
+  OB_REQUIRE(index.Read(indexfile, filename, OBConversion::FindFormat("sdf")));
+  OB_REQUIRE(!index.Read(indexfile, filename, OBConversion::FindFormat("smi")));
+  OB_COMPARE(index.NumRecords(), 26);
+  OB_COMPARE(indexed.NumInputObjects(), 7);
+
+  remove(indexfile.c_str());
+  remove(filename.c_str());
+}
+
+// Molecules read back from the obc cache format should be the same as the
+// molecules which were written, across chunk boundaries, in concatenated
+// files and when records are skipped with -f
+static string ConvertString(const string &in, const char *informat,
+                            const char *outformat, const char *first = nullptr)
+{
+  OBConversion conv;
+  conv.SetInAndOutFormats(informat, outformat);
+  if (first)
+    conv.AddOption("f", OBConversion::GENOPTIONS, first);
+  stringstream is(in), os;
+  conv.Convert(&is, &os);
+  return os.str();
+}
+
+void testOBCRoundTrip()
+{
+  const char* files[] = { "nci.smi", "cantest.sdf", "filterset.sdf", "1DRF.pdb", "3o8g_uff.sdf" };
+  for (unsigned i = 0; i < 5; ++i) {
+    string filename = OBTestUtil::GetFilename(files[i]);
+    string informat = filename.substr(filename.rfind('.') + 1);
+    string text = OBTestUtil::ReadFileContent(files[i]);
+    if (i == 0)
+      text += text; // more than one chunk
+    string obc = ConvertString(text, informat.c_str(), "obc");
+    OB_REQUIRE(obc.compare(0, 4, "OBCF") == 0);
+
+    OBConversion orig, cached, can;
+    orig.SetInFormat(informat.c_str());
+    cached.SetInFormat("obc");
+    can.SetOutFormat("can");
+    can.AddOption("i"); // stereo is compared below
+    stringstream origin(text), cachedin(obc);
+    orig.SetInStream(&origin);
+    cached.SetInStream(&cachedin);
+    OBMol mol1, mol2;
+    unsigned count = 0;
+    while (orig.Read(&mol1)) {
+      OB_REQUIRE(cached.Read(&mol2));
+      ++count;
+      // Nothing should need to be perceived again
+      OB_ASSERT(mol2.HasAromaticPerceived());
+      OB_ASSERT(mol2.HasChiralityPerceived());
+
+      OB_COMPARE(mol2.NumAtoms(), mol1.NumAtoms());
+      OB_COMPARE(mol2.NumBonds(), mol1.NumBonds());
+      OB_COMPARE(mol2.NumResidues(), mol1.NumResidues());
+      OB_COMPARE(string(mol2.GetTitle()), string(mol1.GetTitle()));
+      OB_COMPARE(mol2.GetDimension(), mol1.GetDimension());
+      OB_COMPARE(can.WriteString(&mol2), can.WriteString(&mol1));
+      OB_COMPARE(mol2.GetAllData(OBGenericDataType::PairData).size(),
+                 mol1.GetAllData(OBGenericDataType::PairData).size());
+      FOR_ATOMS_OF_MOL(a, mol1) {
+        OBAtom *b = mol2.GetAtom(a->GetIdx());
+        OB_ASSERT(a->GetX() == b->GetX() && a->GetY() == b->GetY() && a->GetZ() == b->GetZ());
+        OB_COMPARE(b->IsAromatic(), a->IsAromatic());
+        if (a->GetResidue()) {
+          OB_REQUIRE(b->GetResidue() != nullptr);
+          OB_COMPARE(b->GetResidue()->GetAtomID(b), a->GetResidue()->GetAtomID(a));
+          OB_COMPARE(b->GetResidue()->GetNum(), a->GetResidue()->GetNum());
+        }
+      }
+
+      OBStereoFacade stereo1(&mol1), stereo2(&mol2);
+      OB_COMPARE(stereo2.NumTetrahedralStereo(), stereo1.NumTetrahedralStereo());
+      OB_COMPARE(stereo2.NumCisTransStereo(), stereo1.NumCisTransStereo());
+      FOR_ATOMS_OF_MOL(a, mol1)
+        if (stereo1.HasTetrahedralStereo(a->GetId())) {
+          OB_REQUIRE(stereo2.HasTetrahedralStereo(a->GetId()));
+          OB_ASSERT(stereo2.GetTetrahedralStereo(a->GetId())->GetConfig() ==
+                    stereo1.GetTetrahedralStereo(a->GetId())->GetConfig());
+        }
+      FOR_BONDS_OF_MOL(b, mol1)
+        if (stereo1.HasCisTransStereo(b->GetId())) {
+          OB_REQUIRE(stereo2.HasCisTransStereo(b->GetId()));
+          OB_ASSERT(stereo2.GetCisTransStereo(b->GetId())->GetConfig() ==
+                    stereo1.GetCisTransStereo(b->GetId())->GetConfig());
+        }
+    }
+    OB_ASSERT(!cached.Read(&mol2));
+    OB_ASSERT(count > 0);
+
+    // Concatenated files, and skipping into the second chunk
+    string smiles = ConvertString(text, informat.c_str(), "smi");
+    OB_COMPARE(ConvertString(obc + obc, "obc", "smi"), smiles + smiles);
+    OB_COMPARE(ConvertString(obc, "obc", "smi", "1030"),
+               ConvertString(text, informat.c_str(), "smi", "1030"));
+
+    // Written one molecule at a time through the API, the file has the
+    // same chunks and one index, written when it is closed
+    OBConversion in, api;
+    in.SetInFormat(informat.c_str());
+    api.SetOutFormat("obc");
+    stringstream apiin(text);
+    in.SetInStream(&apiin);
+    string apifile = "obc_api_test.obc";
+    bool first = true;
+    while (in.Read(&mol1)) {
+      OB_REQUIRE(first ? api.WriteFile(&mol1, apifile) : api.Write(&mol1));
+      first = false;
+    }
+    api.CloseOutFile();
+    ifstream apifs(apifile.c_str(), ios::binary);
+    stringstream written;
+    written << apifs.rdbuf();
+    apifs.close();
+    remove(apifile.c_str());
+    OB_COMPARE(written.str().size(), obc.size());
+    OB_COMPARE(ConvertString(written.str(), "obc", "smi"), smiles);
+
+    // Reading a new stream starts afresh, part way through a chunk
+    OB_REQUIRE(cached.ReadString(&mol2, obc));
+    OB_REQUIRE(cached.ReadString(&mol2, ConvertString("CCO ethanol\n", "smi", "obc")));
+    OB_COMPARE(string(mol2.GetTitle()), string("ethanol"));
+  }
+}
+
+void testXTCFrames()
+{
+  // 5 frames of 12 atoms, written by the GROMACS compression routines
+  string filename = OBTestUtil::GetFilename("traj12.xtc");
+
+  // Without a topology, each frame is a molecule of dummy atoms
+  OBConversion conv;
+  OB_REQUIRE(conv.SetInFormat("xtc"));
+  OBMol frame;
+  OB_REQUIRE(conv.ReadFile(&frame, filename));
+  OB_COMPARE(frame.NumAtoms(), 12);
+  OB_COMPARE(frame.NumConformers(), 1);
+  OB_COMPARE(string(frame.GetTitle()), string("t= 0.00000 step= 0"));
+  unsigned count = 1;
+  for (frame.Clear(); conv.Read(&frame); frame.Clear())
+    ++count;
+  OB_COMPARE(count, 5);
+
+  // -f seeks past frames without decoding them
+  OBConversion skip;
+  skip.SetInFormat("xtc");
+  skip.AddOption("f", OBConversion::GENOPTIONS, "4");
+  OB_REQUIRE(skip.ReadFile(&frame, filename));
+  OB_COMPARE(string(frame.GetTitle()), string("t= 0.60000 step= 300"));
+  OB_ASSERT(fabs(frame.GetAtom(1)->GetX() - 44.05) < 1e-4);
+
+  // With a topology, all the frames are read as conformers...
+  OBMol top;
+  for (int i = 0; i < 12; ++i)
+    top.NewAtom()->SetAtomicNum(6);
+  OBMol traj(top);
+  OB_REQUIRE(conv.ReadFile(&traj, filename));
+  OB_COMPARE(traj.NumConformers(), 5);
+  traj.SetConformer(2);
+  OB_ASSERT(fabs(traj.GetAtom(1)->GetX() - 44.15) < 1e-4);
+
+  // ...or one at a time
+  OBConversion single;
+  single.SetInFormat("xtc");
+  single.AddOption("F", OBConversion::INOPTIONS);
+  OBMol mol(top);
+  OB_REQUIRE(single.ReadFile(&mol, filename));
+  count = 1;
+  while (single.Read(&mol)) {
+    OB_COMPARE(mol.NumConformers(), 1);
+    ++count;
+  }
+  OB_COMPARE(count, 5);
+  OB_ASSERT(fabs(mol.GetAtom(1)->GetX() - 44.09) < 1e-4);
+}
+
+void testDeferredSDStructure()
+{
+  const char *sd =
+    "ethanol\n"
+    "  handmade\n"
+    "\n"
+    "  3  2  0  0  0  0  0  0  0  0999 V2000\n"
+    "    0.0000    0.0000    0.0000 C   0  0  0  0  0  0  0  0  0  0  0  0\n"
+    "    1.5000    0.0000    0.0000 C   0  0  0  0  0  0  0  0  0  0  0  0\n"
+    "    2.0000    1.4000    0.0000 O   0  0  0  0  0  0  0  0  0  0  0  0\n"
+    "  1  2  1  0  0  0  0\n"
+    "  2  3  1  0  0  0  0\n"
+    "M  END\n"
+    ">  <ID>\n"
+    "1\n"
+    "\n"
+    "$$$$\n";
+  const char *sd2 =
+    "methylamine\n"
+    "  handmade\n"
+    "\n"
+    "  2  1  0  0  0  0  0  0  0  0999 V2000\n"
+    "    0.0000    0.0000    0.0000 C   0  0  0  0  0  0  0  0  0  0  0  0\n"
+    "    1.5000    0.0000    0.0000 N   0  0  0  0  0  0  0  0  0  0  0  0\n"
+    "  1  2  1  0  0  0  0\n"
+    "M  END\n"
+    ">  <ID>\n"
+    "2\n"
+    "\n"
+    "$$$$\n";
+  string input = string(sd) + sd2;
+
+  // Passed through unchanged when only the properties are used
+  OBConversion copy;
+  copy.SetInAndOutFormats("sdf", "sdf");
+  copy.AddOption("L", OBConversion::INOPTIONS);
+  stringstream is(input), os;
+  OB_COMPARE(copy.Convert(&is, &os), 2);
+  OB_COMPARE(os.str(), input);
+
+  OBConversion filter;
+  filter.SetInAndOutFormats("sdf", "sdf");
+  filter.AddOption("L", OBConversion::INOPTIONS);
+  filter.AddOption("filter", OBConversion::GENOPTIONS, "ID=2");
+  stringstream is2(input), os2;
+  OB_COMPARE(filter.Convert(&is2, &os2), 1);
+  OB_COMPARE(os2.str(), string(sd2));
+
+  // Parsed when a descriptor or the output format needs the atoms
+  OBConversion desc;
+  desc.SetInAndOutFormats("sdf", "sdf");
+  desc.AddOption("L", OBConversion::INOPTIONS);
+  desc.AddOption("filter", OBConversion::GENOPTIONS, "MW<40");
+  stringstream is3(input), os3;
+  OB_COMPARE(desc.Convert(&is3, &os3), 1);
+  OB_ASSERT(os3.str().find("methylamine\n OpenBabel") == 0);
+  OB_ASSERT(os3.str().find(">  <ID>\n2\n") != string::npos);
+
+  OBConversion smi;
+  smi.SetInAndOutFormats("sdf", "smi");
+  smi.AddOption("L", OBConversion::INOPTIONS);
+  stringstream is4(input), os4;
+  OB_COMPARE(smi.Convert(&is4, &os4), 2);
+  OB_COMPARE(os4.str(), ConvertString(input, "sdf", "smi"));
+  OB_COMPARE(os4.str(), string("CCO\tethanol\nCN\tmethylamine\n"));
+}
+
+// Files passed to Convert() are read ahead and written behind on other
+// threads. The output, and where the input is left, should be as with
+// other streams.
+static int ConvertFive(istream *is, ostream *os)
+{
+  OBConversion conv;
+  conv.SetInAndOutFormats("sdf", "smi");
+  conv.AddOption("l", OBConversion::GENOPTIONS, "5");
+  return conv.Convert(is, os);
+}
+
+void testFileStreams()
+{
+  string filename = OBTestUtil::GetFilename("cantest.sdf");
+  stringstream text;
+  {
+    ifstream src(filename.c_str());
+    text << src.rdbuf();
+  }
+
+  // The first five molecules, and then the next five
+  stringstream expected;
+  OB_COMPARE(ConvertFive(&text, &expected), 5);
+  OB_COMPARE(ConvertFive(&text, &expected), 5);
+
+  string outname = "filestreams_test.smi";
+  ifstream ifs(filename.c_str());
+  {
+    ofstream ofs(outname.c_str());
+    OB_COMPARE(ConvertFive(&ifs, &ofs), 5);
+    OB_ASSERT(ofs.good());
+  }
+  {
+    // The input is left where the conversion stopped
+    ofstream ofs(outname.c_str(), ios::app);
+    OB_COMPARE(ConvertFive(&ifs, &ofs), 5);
+  }
+  OB_COMPARE(ifs.tellg(), text.tellg());
+
+  ifstream out(outname.c_str());
+  stringstream written;
+  written << out.rdbuf();
+  OB_COMPARE(written.str(), expected.str());
+  out.close();
+  remove(outname.c_str());
+
+  // --split finds the named output file behind the writing thread and
+  // removes it, writing a file for each molecule instead
+  string inname = "filestreams_split.smi";
+  {
+    ofstream ofs(inname.c_str());
+    ofs << "C splitA\nCC splitB\n";
+  }
+  OBConversion conv;
+  conv.SetInAndOutFormats("smi", "smi");
+  conv.AddOption("split", OBConversion::GENOPTIONS);
+  vector<string> inlist(1, inname), outlist;
+  conv.FullConvert(inlist, outname, outlist);
+  OB_ASSERT(!ifstream(outname.c_str()).good());
+  OB_ASSERT(ifstream("splitA.smi").good());
+  OB_ASSERT(ifstream("splitB.smi").good());
+  remove(inname.c_str());
+  remove("splitA.smi");
+  remove("splitB.smi");
+}
+
+// SMILES converted from \p in with the general options (ops) in \p options
+static string OpString(const string &in, const char *informat,
+                       const map<string, string> &options)
+{
+  OBConversion conv;
+  conv.SetInAndOutFormats(informat, "smi");
+  map<string, string>::const_iterator itr;
+  for (itr = options.begin(); itr != options.end(); ++itr)
+    conv.AddOption(itr->first.c_str(), OBConversion::GENOPTIONS, itr->second.c_str());
+  stringstream is(in), os;
+  conv.Convert(&is, &os);
+  return os.str();
+}
+
+// Sorting which spills sorted runs to temporary files and merges them
+// should give the same order as sorting in memory, with ties kept in
+// input order
+void testExternalSort()
+{
+  string filename = OBTestUtil::GetFilename("cantest.sdf");
+  stringstream text;
+  {
+    ifstream src(filename.c_str());
+    text << src.rdbuf();
+  }
+
+  string inmemory = OpString(text.str(), "sdf", {{"sort", "MW"}});
+  OB_ASSERT(!inmemory.empty());
+  OB_COMPARE(OpString(text.str(), "sdf", {{"sort", "MW"}, {"sortmem", "0.02"}}), inmemory);
+  OB_COMPARE(OpString(text.str(), "sdf", {{"sort", "~title+"}, {"sortmem", "0.02"}}),
+             OpString(text.str(), "sdf", {{"sort", "~title+"}}));
+  OB_COMPARE(OpString(text.str(), "sdf", {{"sort", "~MW"}, {"sortmem", "0.02"}}),
+             OpString(text.str(), "sdf", {{"sort", "~MW"}}));
+
+  // Atom classes are not held by obc, so those molecules are kept in
+  // memory, and merged in their input order with equal keys on disk
+  string classes = "C[CH2:1]O a\nCCO b\n[CH3:2]C c\nOCC d\nCC e\nC[OH:3] f\nCO g\nCCC h\n";
+  string sorted = "[CH3:2]C\tc\nCC\te\nC[OH:3]\tf\nCO\tg\nCCC\th\nC[CH2:1]O\ta\nCCO\tb\nOCC\td\n";
+  for (int spill = 0; spill < 2; ++spill) {
+    OBConversion conv;
+    conv.SetInAndOutFormats("smi", "smi");
+    conv.AddOption("a", OBConversion::OUTOPTIONS);
+    conv.AddOption("sort", OBConversion::GENOPTIONS, "MW");
+    if (spill)
+      conv.AddOption("sortmem", OBConversion::GENOPTIONS, "0.000001");
+    stringstream is(classes), os;
+    conv.Convert(&is, &os);
+    OB_COMPARE(os.str(), sorted);
+  }
+}
+
+// Duplicates should be found in the same way when the hashes of the keys
+// are moved to disk
+void testUniqueOnDisk()
+{
+  string filename = OBTestUtil::GetFilename("cantest.sdf");
+  stringstream text;
+  {
+    ifstream src(filename.c_str());
+    text << src.rdbuf();
+  }
+  string one = text.str();
+  one.erase(one.rfind("$$$$") + 5); // without the blank line at the end
+  string twice = one + one;
+
+  string once = OpString(one, "sdf", {{"unique", "cansmi"}});
+  OB_ASSERT(!once.empty());
+  OB_COMPARE(OpString(twice, "sdf", {{"unique", "cansmi"}}), once);
+  OB_COMPARE(OpString(twice, "sdf", {{"unique", "cansmi"}, {"uniquemem", "0.001"}}), once);
+  OB_COMPARE(OpString(twice, "sdf", {{"unique", "~cansmi"}, {"uniquemem", "0.001"}}),
+             OpString(twice, "sdf", {{"unique", "~cansmi"}}));
+
+  // When no temporary file can be made, the keys are kept in memory
+  const char *tmpdir = getenv("TMPDIR");
+  static string restore = string("TMPDIR=") + (tmpdir ? tmpdir : "/tmp");
+  static char nodir[] = "TMPDIR=/nonexistent/obtest";
+  putenv(nodir);
+  OB_COMPARE(OpString(twice, "sdf", {{"unique", "cansmi"}, {"uniquemem", "0.001"}}), once);
+  putenv(&restore[0]);
+}
+
+// The selection keeps the best molecules, and the earlier of those with
+// equal values, and outputs them best first
+void testLargestTies()
+{
+  string smiles = "C\ta\nCC\tb\nCC\tc\nCCC\td\nCC\te\nC\tf\n";
+  OB_COMPARE(OpString(smiles, "smi", {{"largest", "3 MW"}}), string("CCC\td\nCC\tb\nCC\tc\n"));
+  OB_COMPARE(OpString(smiles, "smi", {{"smallest", "3 MW"}}), string("C\ta\nC\tf\nCC\tb\n"));
+  OB_COMPARE(OpString(smiles, "smi", {{"largest", "~MW 1"}}), string("C\ta\n"));
+  OB_COMPARE(OpString(smiles, "smi", {{"largest", "10 MW"}}),
+             string("CCC\td\nCC\tb\nCC\tc\nCC\te\nC\ta\nC\tf\n"));
+}
+
 int conversiontest(int argc, char* argv[])
 {
   int defaultchoice = 1;
@@ -52,6 +578,30 @@ int conversiontest(int argc, char* argv[])
   case 1:
     testMolToCdxmlConversion();
     break;
+  case 2:
+    testRecordIndex();
+    break;
+  case 3:
+    testOBCRoundTrip();
+    break;
+  case 4:
+    testXTCFrames();
+    break;
+  case 5:
+    testDeferredSDStructure();
+    break;
+  case 6:
+    testFileStreams();
+    break;
+  case 7:
+    testExternalSort();
+    break;
+  case 8:
+    testUniqueOnDisk();
+    break;
+  case 9:
+    testLargestTies();
+    break;
   //case N:
   //  YOUR_TEST_HERE();
   //  Remember to update CMakeLists.txt with the number of your test
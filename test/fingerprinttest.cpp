@@ -0,0 +1,367 @@
+#include "obtest.h"
+#include <openbabel/mol.h>
+#include <openbabel/obconversion.h>
+#include <openbabel/fingerprint.h>
+#include <openbabel/parsmart.h>
+
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+using namespace OpenBabel;
+
+static const char *smiles[] = {
+  "CCO", "c1ccccc1O", "CC(=O)Nc1ccc(O)cc1", "C1CCC2CCCCC2C1",
+  "OC(=O)C(N)Cc1c[nH]c2ccccc12", "[NH4+].[Cl-]", "C#N", "FC(F)(F)c1ccc(cc1)C=CC(=O)O",
+  "CN1C=NC2=C1C(=O)N(C(=O)N2C)C", "O=C1CCCCC1", "c1ccc2c(c1)ccc1ccccc12", "[2H]C([2H])([2H])Br"
+};
+static const unsigned nsmiles = sizeof(smiles) / sizeof(smiles[0]);
+
+static void ReadAll(vector<OBMol> &mols)
+{
+  OBConversion conv;
+  conv.SetInFormat("smi");
+  mols.resize(nsmiles);
+  for (unsigned i = 0; i < nsmiles; ++i)
+    conv.ReadString(&mols[i], smiles[i]);
+}
+
+static void Calculate(OBFingerprint *fpr, vector<OBMol> *mols,
+                      vector<vector<unsigned int> > *fps, unsigned repeat)
+{
+  fps->resize(mols->size());
+  for (unsigned r = 0; r < repeat; ++r)
+    for (unsigned i = 0; i < mols->size(); ++i)
+      fpr->GetFingerprint(&(*mols)[i], (*fps)[i]);
+}
+
+// Fingerprints calculated on several threads at once, with the same
+// global fingerprint object, should be those calculated on one thread
+static void CheckThreads(const char *id)
+{
+  OBFingerprint *fpr = OBFingerprint::FindFingerprint(id);
+  OB_REQUIRE(fpr != nullptr);
+
+  vector<OBMol> mols;
+  ReadAll(mols);
+  vector<vector<unsigned int> > expected;
+  Calculate(fpr, &mols, &expected, 1);
+  OB_ASSERT(expected[0] != expected[1]);
+
+  const unsigned nthreads = 4;
+  vector<vector<OBMol> > threadmols(nthreads);
+  vector<vector<vector<unsigned int> > > results(nthreads);
+  vector<thread> threads;
+  for (unsigned t = 0; t < nthreads; ++t) {
+    threadmols[t] = mols; // perception is done on each copy
+    threads.push_back(thread(Calculate, fpr, &threadmols[t], &results[t], 20));
+  }
+  for (unsigned t = 0; t < nthreads; ++t) {
+    threads[t].join();
+    OB_COMPARE(results[t] == expected, true);
+  }
+}
+
+void testECFPThreads()
+{
+  const char *ids[] = { "ECFP0", "ECFP2", "ECFP4", "ECFP6", "ECFP8", "ECFP10" };
+  for (unsigned f = 0; f < 6; ++f)
+    CheckThreads(ids[f]);
+}
+
+// FP2 from the path search should set the bits of the hashes of the
+// canonical fragments that it describes, also on several threads
+void testFP2Paths()
+{
+  OBFingerprint *fp2 = OBFingerprint::FindFingerprint("FP2");
+  OB_REQUIRE(fp2 != nullptr);
+  vector<OBMol> mols;
+  ReadAll(mols);
+  for (unsigned i = 0; i < nsmiles; ++i) {
+    vector<unsigned int> fp, described(1024 / OBFingerprint::Getbitsperint());
+    fp2->GetFingerprint(&mols[i], fp);
+    // Lines of "fragment <hash>", each fragment once
+    stringstream ss(fp2->DescribeBits(fp));
+    string line;
+    vector<string> lines;
+    while (getline(ss, line)) {
+      string::size_type pos = line.find('<');
+      OB_REQUIRE(pos != string::npos);
+      fp2->SetBit(described, atoi(line.c_str() + pos + 1));
+      lines.push_back(line);
+    }
+    OB_ASSERT(described == fp);
+    sort(lines.begin(), lines.end());
+    OB_ASSERT(unique(lines.begin(), lines.end()) == lines.end());
+  }
+  // The ring of benzene and phenol
+  vector<unsigned int> fp;
+  fp2->GetFingerprint(&mols[1], fp);
+  OB_ASSERT(fp2->DescribeBits(fp).find("5 6 5 6 5 6 5 6 5 6 5 6 ") != string::npos);
+
+  // The description of the fragments is shared, so is not made on threads
+  unsigned int flags = fp2->Flags();
+  fp2->SetFlags(flags | OBFingerprint::FPT_NOINFO);
+  CheckThreads("FP2");
+  fp2->SetFlags(flags);
+}
+
+// Patterns matched in turn with one matcher, sharing the matches of their
+// recursive SMARTS, should match as they do on their own. The SMARTS pattern
+// fingerprints, which do this, should then describe the expected groups.
+void testPatternFP()
+{
+  const char *smarts[] = { "[$(C=O)]O", "[$(C=O)]N", "[$(C=O);!$(C(=O)O)]",
+                           "[$(C=O)]", "[#7;$([nH])]", "[$(C=O)]1CCCCC1" };
+  const unsigned nsmarts = sizeof(smarts) / sizeof(smarts[0]);
+  vector<OBSmartsPattern> pats(nsmarts);
+  for (unsigned j = 0; j < nsmarts; ++j)
+    OB_REQUIRE(pats[j].Init(smarts[j]));
+
+  vector<OBMol> mols;
+  ReadAll(mols);
+  for (unsigned i = 0; i < nsmiles; ++i) {
+    OBSmartsMatcher matcher;
+    for (unsigned j = 0; j < nsmarts; ++j) {
+      vector<vector<int> > shared, alone;
+      pats[j].Match(mols[i], matcher, shared);
+      pats[j].Match(mols[i], alone);
+      OB_ASSERT(shared == alone);
+    }
+  }
+
+  OBFingerprint *fp4 = OBFingerprint::FindFingerprint("FP4");
+  OB_REQUIRE(fp4 != nullptr);
+  vector<unsigned int> phenol, tryptophan;
+  fp4->GetFingerprint(&mols[1], phenol);
+  OB_ASSERT(fp4->DescribeBits(phenol).find("Phenol") != string::npos);
+  fp4->GetFingerprint(&mols[4], tryptophan);
+  string groups = fp4->DescribeBits(tryptophan);
+  OB_ASSERT(groups.find("Alpha_aminoacid") != string::npos);
+  OB_ASSERT(groups.find("Carboxylic_acid\t") != string::npos);
+  OB_ASSERT(groups.find("Heteroaromatic") != string::npos);
+  OB_ASSERT(groups.find("Phenol") == string::npos);
+
+  CheckThreads("FP3");
+  CheckThreads("FP4");
+  CheckThreads("MACCS");
+}
+
+// Sparse counts, the sparse similarity kernels and a sparse fastsearch index
+void testSparseCounts()
+{
+  OBFingerprint::CountVector a, b;
+  a.push_back(make_pair(1u, 2u));
+  a.push_back(make_pair(3u, 1u));
+  b.push_back(make_pair(1u, 1u));
+  b.push_back(make_pair(2u, 1u));
+  b.push_back(make_pair(3u, 1u));
+  // 2 in common out of 3 in each
+  OB_COMPARE(OBFingerprint::Tanimoto(a, b), 0.5);
+  OB_COMPARE(OBFingerprint::Dice(a, b), 2.0 / 3.0);
+  OB_COMPARE(OBFingerprint::Tversky(a, b, 1.0, 1.0), 0.5);
+  OB_COMPARE(OBFingerprint::Tversky(a, b, 0.5, 0.5), 2.0 / 3.0);
+  OB_COMPARE(OBFingerprint::Tversky(a, b, 1.0, 0.0), 2.0 / 3.0);
+  OB_COMPARE(OBFingerprint::Tanimoto(a, a), 1.0);
+
+  vector<OBMol> mols;
+  ReadAll(mols);
+
+  // The ECFP4 identifiers, which fold to the bits of the dense fingerprint
+  OBFingerprint *ecfp = OBFingerprint::FindFingerprint("ECFP4");
+  OB_REQUIRE(ecfp != nullptr);
+  vector<OBFingerprint::CountVector> counts(nsmiles);
+  for (unsigned i = 0; i < nsmiles; ++i) {
+    OB_REQUIRE(ecfp->GetCounts(&mols[i], counts[i]));
+    vector<unsigned int> fp, folded(4096 / OBFingerprint::Getbitsperint());
+    ecfp->GetFingerprint(&mols[i], fp);
+    unsigned total = 0;
+    for (unsigned k = 0; k < counts[i].size(); ++k) {
+      if (k > 0)
+        OB_ASSERT(counts[i][k - 1].first < counts[i][k].first);
+      total += counts[i][k].second;
+      ecfp->SetBit(folded, (counts[i][k].first % 4096) & 0x7fffffff);
+    }
+    OB_COMPARE(total, 3 * mols[i].NumHvyAtoms());
+    OB_ASSERT(folded == fp);
+  }
+
+  // FP2 has one of each distinct fragment
+  OBFingerprint *fp2 = OBFingerprint::FindFingerprint("FP2");
+  OB_REQUIRE(fp2 != nullptr);
+  OBFingerprint::CountVector paths;
+  OB_REQUIRE(fp2->GetCounts(&mols[2], paths));
+  OB_ASSERT(!paths.empty());
+  for (unsigned k = 0; k < paths.size(); ++k)
+    OB_COMPARE(paths[k].second, 1u);
+
+  // A sparse index, searched for each of the molecules
+  string datafilename("test.smi"), fpid("ECFP4");
+  stringstream index;
+  {
+    FastSearchIndexer fsi(datafilename, &index, fpid, 0, nsmiles, true);
+    for (unsigned i = 0; i < nsmiles; ++i)
+      OB_ASSERT(fsi.Add(&mols[i], 100 * i));
+  }
+  FastSearch fs;
+  OB_COMPARE(fs.ReadIndex(&index), datafilename);
+  OB_COMPARE(fs.GetIndexHeader().words, 0u);
+  OB_ASSERT(fs.GetIndexHeader().flags & FptIndexHeader::SPARSE);
+  OB_COMPARE(fs.GetIndexHeader().nEntries, nsmiles);
+  for (unsigned i = 0; i < nsmiles; ++i) {
+    multimap<double, unsigned long> best;
+    fs.FindSimilar(&mols[i], best, 1);
+    OB_REQUIRE(best.size() == 1);
+    OB_COMPARE(best.begin()->first, 1.0);
+    OB_COMPARE(best.begin()->second, 100 * i);
+
+    vector<unsigned long> matches;
+    fs.FindMatch(&mols[i], matches, 10);
+    OB_REQUIRE(matches.size() == 1);
+    OB_COMPARE(matches[0], 100 * i);
+
+    matches.clear();
+    fs.Find(&mols[i], matches, 100);
+    OB_ASSERT(find(matches.begin(), matches.end(), 100 * i) != matches.end());
+
+    // The molecules above a threshold are those found by the kernel
+    multimap<double, unsigned long> similar;
+    fs.FindSimilar(&mols[i], similar, 0.2);
+    unsigned expected = 0;
+    for (unsigned j = 0; j < nsmiles; ++j)
+      if (OBFingerprint::Tanimoto(counts[i], counts[j]) > 0.2)
+        ++expected;
+    OB_COMPARE(similar.size(), expected);
+    multimap<double, unsigned long>::iterator itr;
+    for (itr = similar.begin(); itr != similar.end(); ++itr)
+      OB_COMPARE(itr->first, OBFingerprint::Tanimoto(counts[i], counts[itr->second / 100]));
+  }
+}
+
+// An index made from submitted molecules, fingerprinted on worker threads,
+// should be the same as one made by adding the molecules one at a time
+static string MakeIndex(const char *id, bool sparse, unsigned nthreads)
+{
+  vector<OBMol> mols;
+  ReadAll(mols);
+  string datafilename("test.smi"), fpid(id);
+  const unsigned n = 1000; // several batches
+  stringstream index;
+  {
+    FastSearchIndexer fsi(datafilename, &index, fpid, 0, n, sparse);
+    if (nthreads == 0) {
+      for (unsigned i = 0; i < n; ++i) {
+        OBMol mol(mols[i % nsmiles]);
+        OB_ASSERT(fsi.Add(&mol, 10 * i));
+      }
+    }
+    else {
+      fsi.SetThreads(nthreads);
+      for (unsigned i = 0; i < n; ++i)
+        fsi.Submit(new OBMol(mols[i % nsmiles]), 10 * i);
+    }
+  }
+  return index.str();
+}
+
+void testIndexThreads()
+{
+  const char *ids[] = { "FP2", "FP3", "FP4", "MACCS", "ECFP4" };
+  for (unsigned f = 0; f < 5; ++f) {
+    string expected = MakeIndex(ids[f], false, 0);
+    OB_ASSERT(expected.size() > 1000 * sizeof(unsigned long));
+    OB_ASSERT(MakeIndex(ids[f], false, 1) == expected);
+    OB_ASSERT(MakeIndex(ids[f], false, 4) == expected);
+  }
+  string expected = MakeIndex("ECFP4", true, 0);
+  OB_ASSERT(MakeIndex("ECFP4", true, 3) == expected);
+}
+
+// The indexer owns the submitted molecules and deletes each one once it
+// has been fingerprinted, whether on the calling thread or a worker
+static atomic<unsigned> ndeleted(0);
+
+class CountedMol : public OBMol
+{
+public:
+  CountedMol(const OBMol &mol) : OBMol(mol) {}
+  ~CountedMol() override { ++ndeleted; }
+};
+
+void testIndexFreesSubmitted()
+{
+  vector<OBMol> mols;
+  ReadAll(mols);
+  string datafilename("test.smi"), fpid("FP2");
+  const unsigned n = 500; // several batches
+  const unsigned nthreads[] = { 1, 3 };
+  for (unsigned t = 0; t < 2; ++t) {
+    ndeleted = 0;
+    stringstream index;
+    {
+      FastSearchIndexer fsi(datafilename, &index, fpid, 0, n);
+      fsi.SetThreads(nthreads[t]);
+      for (unsigned i = 0; i < n; ++i)
+        fsi.Submit(new CountedMol(mols[i % nsmiles]), 10 * i);
+    }
+    OB_COMPARE(ndeleted.load(), n);
+  }
+}
+
+int fingerprinttest(int argc, char* argv[])
+{
+  int defaultchoice = 1;
+
+  int choice = defaultchoice;
+
+  if (argc > 1) {
+    if(sscanf(argv[1], "%d", &choice) != 1) {
+      printf("Couldn't parse that input as a number\n");
+      return -1;
+    }
+  }
+  // Define location of file formats for testing
+  #ifdef FORMATDIR
+    char env[BUFF_SIZE];
+    snprintf(env, BUFF_SIZE, "BABEL_LIBDIR=%s", FORMATDIR);
+    putenv(env);
+  #endif
+
+  switch(choice) {
+  case 1:
+    testECFPThreads();
+    break;
+  case 2:
+    testSparseCounts();
+    break;
+  case 3:
+    testFP2Paths();
+    break;
+  case 4:
+    testPatternFP();
+    break;
+  case 5:
+    testIndexThreads();
+    break;
+  case 6:
+    testIndexFreesSubmitted();
+    break;
+  //case N:
+  //  YOUR_TEST_HERE();
+  //  Remember to update CMakeLists.txt with the number of your test
+  //  break;
+  default:
+    cout << "Test number " << choice << " does not exist!\n";
+    return -1;
+  }
+
+  return 0;
+}
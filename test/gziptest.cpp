@@ -28,6 +28,7 @@ GNU General Public License for more details.
 #include <cstdio>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
 using namespace std;
 using namespace OpenBabel;
@@ -79,6 +80,61 @@ void checkResults(const string& file, const vector<string>& correctResults)
   }
 }
 
+// 2
+// writes enough molecules to a gzipped stream for several BGZF blocks,
+// checks the block headers, and reads them all back
+int bgzftest()
+{
+  OBConversion conv;
+  conv.SetInAndOutFormats("smi", "smi", false, true);
+  OBMol mol;
+  conv.ReadString(&mol, "CC(=O)Nc1ccc(O)cc1 paracetamol");
+
+  const int n = 5000;
+  stringstream gz;
+  conv.SetOutStream(&gz, false);
+  for (int i = 0; i < n; ++i)
+    conv.Write(&mol);
+  conv.SetOutStream(nullptr); // finishes the gzip stream
+
+  string data = gz.str();
+  // gzip magic, FEXTRA flag, and the BC subfield of a BGZF block
+  if (data.size() < 28 || (unsigned char)data[0] != 0x1f || (unsigned char)data[1] != 0x8b
+      || data[3] != 4 || data[12] != 'B' || data[13] != 'C')
+  {
+    cout << "Not a BGZF block header\n";
+    return -1;
+  }
+  // the first block is full, so there is more than one
+  unsigned bsize = (unsigned char)data[16] + ((unsigned char)data[17] << 8) + 1;
+  if (bsize >= data.size() || (unsigned char)data[bsize] != 0x1f)
+  {
+    cout << "Expected a second BGZF block\n";
+    return -1;
+  }
+
+  OBConversion rconv;
+  rconv.SetInAndOutFormats("smi", "smi", true, false);
+  gz.seekg(0);
+  rconv.SetInStream(&gz, false);
+  int count = 0;
+  while (rconv.Read(&mol))
+  {
+    if (string(mol.GetTitle()) != "paracetamol")
+    {
+      cout << "Wrong molecule " << count << " read back\n";
+      return -1;
+    }
+    ++count;
+  }
+  if (count != n)
+  {
+    cout << "Read " << count << " molecules back instead of " << n << "\n";
+    return -1;
+  }
+  return 0;
+}
+
 // 1
 // reads gzip.infiles, which has a file name on each line,
 // converts each molecule into a gzipped string, converts that
@@ -97,7 +153,7 @@ int gziptest(int argc, char* argv[])
     }
   }
 
-  if(choice != 1) //eh, not bothering to split this up
+  if(choice != 1 && choice != 2) //eh, not bothering to split this up
   {
     cout << "Test number " << choice << " does not exist!\n";
     return -1;
@@ -118,6 +174,9 @@ int gziptest(int argc, char* argv[])
     putenv(env);
   #endif
 
+  if(choice == 2)
+    return bgzftest();
+
   ifstream ifs(gzipin.c_str());
   if (!ifs)
     {
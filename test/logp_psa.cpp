@@ -23,13 +23,17 @@ GNU General Public License for more details.
 
 #include <openbabel/babelconfig.h>
 #include <openbabel/mol.h>
+#include <openbabel/atom.h>
 #include <openbabel/obconversion.h>
 #include <openbabel/groupcontrib.h>
+#include <openbabel/generic.h>
 #include <openbabel/obutil.h>
 #include <cstdlib>
 
 #include <cstdio>
 #include <iostream>
+#include <fstream>
+#include <vector>
 
 using namespace std;
 using namespace OpenBabel;
@@ -59,7 +63,7 @@ int logp_psa(int argc, char* argv[])
   cout << "# Unit tests for OBLogP and OBPSA \n";
 
   // the number of tests for "prove"
-  cout << "1..7\n";
+  cout << "1..10\n";
 
   OBConversion obConversion;
   obConversion.SetInAndOutFormats("smi", "mdl");
@@ -122,6 +126,72 @@ int logp_psa(int argc, char* argv[])
     cout << "not ok 7 # " << psa << '\n';
   }
 
+  // The batch calculation on several threads gives the same values
+  // as calculating each descriptor for each molecule in turn
+  ifstream ifs((TESTDATADIR + string("attype.00.smi")).c_str());
+  vector<OBMol> mols;
+  vector<string> expected;
+  const char* ids[] = { "logP", "TPSA", "MR", "MW", "title" };
+  obConversion.SetInStream(&ifs);
+  while (obConversion.Read(&obMol)) {
+    mols.push_back(obMol);
+    for (unsigned i = 0; i < 5; ++i) {
+      string value;
+      OBDescriptor::FindType(ids[i])->GetStringValue(&obMol, value);
+      expected.push_back(value);
+    }
+  }
+
+  vector<OBBase*> batch;
+  for (unsigned i = 0; i < mols.size(); ++i)
+    batch.push_back(&mols[i]);
+  OBDescriptor::AddProperties(batch, "logP TPSA MR MW title", 4);
+
+  unsigned mismatches = 0;
+  for (unsigned i = 0; i < mols.size(); ++i)
+    for (unsigned j = 0; j < 5; ++j) {
+      OBPairData* dp = dynamic_cast<OBPairData*>(mols[i].GetData(ids[j]));
+      if (!dp || dp->GetValue() != expected[5 * i + j])
+        mismatches++;
+    }
+  if (!mols.empty() && mismatches == 0) {
+    cout << "ok 8 # " << mols.size() << " molecules\n";
+  } else {
+    cout << "not ok 8 # " << mismatches << " mismatches\n";
+  }
+
+  // A descriptor which is not flagged as thread-safe is calculated in turn
+  for (unsigned i = 0; i < mols.size(); ++i)
+    mols[i].DeleteData("title");
+  OBDescriptor::AddProperties(batch, "title cansmi", 4);
+  mismatches = 0;
+  for (unsigned i = 0; i < mols.size(); ++i) {
+    if (!mols[i].HasData("title") || !mols[i].HasData("cansmi"))
+      mismatches++;
+  }
+  if (mismatches == 0) {
+    cout << "ok 9\n";
+  } else {
+    cout << "not ok 9 # " << mismatches << " missing\n";
+  }
+
+  // The hydrogenated copy kept for the descriptors is made again
+  // when the molecule is changed
+  obConversion.ReadString(&obMol, "Oc1ccccc1OC");
+  obMol.AddHydrogens();
+  double before = obLogP->Predict(&obMol);
+  obMol.GetAtom(1)->SetAtomicNum(16);
+  double after = obLogP->Predict(&obMol);
+  OBMol thiol;
+  obConversion.ReadString(&thiol, "Sc1ccccc1OC");
+  thiol.AddHydrogens();
+  logP = obLogP->Predict(&thiol);
+  if (!IsNear(before, after) && IsNear(after, logP)) {
+    cout << "ok 10 # " << after << '\n';
+  } else {
+    cout << "not ok 10 # " << before << " " << after << " " << logP << '\n';
+  }
+
   return(0);
 }
 
@@ -27,6 +27,7 @@ GNU General Public License for more details.
 #include <openbabel/atom.h>
 #include <openbabel/bond.h>
 #include <cstdlib>
+#include <cstring>
 
 #include <cstdio>
 #include <iostream>
@@ -235,6 +236,78 @@ int mol(int argc, char* argv[])
       std::cout << "not ok 15 # CalcTorsionAngle " << dihedral << "!= 180.0" << std::endl;
   }
 
-  cout << "1..15\n"; // total number of tests for Perl's "prove" tool
+  // Borrowed conformers are viewed in place and never freed by the molecule
+  {
+    double block[2][6] = { { 0.0, 0.0, 0.0, 1.5, 0.0, 0.0 },
+                           { 0.0, 0.0, 0.0, 0.0, 1.5, 0.0 } };
+    OBMol borrowMol;
+    borrowMol.BeginModify();
+    for (int i = 0; i < 2; ++i) {
+      OBAtom *atom = borrowMol.NewAtom();
+      atom->SetAtomicNum(6);
+      atom->SetImplicitHCount(3);
+    }
+    borrowMol.AddBond(1, 2, 1);
+    borrowMol.EndModify();
+    borrowMol.DeleteConformer(0);
+    borrowMol.BorrowConformer(block[0]);
+    borrowMol.BorrowConformer(block[1]);
+    borrowMol.SetConformer(1);
+    OBConformerView view = borrowMol.GetConformerView();
+    if (view.NumConformers() == 2 && view.Stride() == 6 && view.Data() == block[0]
+        && view(1, 1, 1) == 1.5 && borrowMol.GetAtom(2)->GetY() == 1.5
+        && borrowMol.IsConformerBorrowed(0) && borrowMol.IsConformerBorrowed(1)) {
+      cout << "ok 16" << endl;
+    } else {
+      cout << "not ok 16 # borrowed conformer view" << endl;
+    }
+    view(1, 1, 0) = 2.0; // write through the view
+    borrowMol.AddHydrogens(); // reallocates, so the conformers become owned copies
+    if (borrowMol.NumConformers() == 2 && !borrowMol.IsConformerBorrowed(1)
+        && borrowMol.GetConformer(1) != block[1] && borrowMol.GetConformer(1)[3] == 2.0) {
+      cout << "ok 17" << endl;
+    } else {
+      cout << "not ok 17 # borrowed conformer reallocation" << endl;
+    }
+  }
+
+  // Conformer ensembles stored in one contiguous block
+  {
+    OBMol packMol;
+    packMol.BeginModify();
+    for (int i = 0; i < 3; ++i) {
+      OBAtom *atom = packMol.NewAtom();
+      atom->SetAtomicNum(8);
+      atom->SetVector(i, 0.0, 0.0);
+    }
+    packMol.EndModify();
+    double *extra = new double [9];
+    for (int i = 0; i < 9; ++i)
+      extra[i] = 10.0 + i;
+    packMol.AddConformer(extra);
+    double *block = packMol.AddConformers(2);
+    block[9 + 4] = 42.0; // atom 2, y of the second new conformer
+    packMol.SetConformer(1);
+    packMol.PackConformers();
+    OBConformerView view = packMol.GetConformerView();
+    // A copy has a separate new[] array for each conformer, as before,
+    // so a caller may still replace one through GetConformers()
+    OBMol copyMol(packMol);
+    double *replaced = new double [9];
+    memcpy(replaced, copyMol.GetConformer(3), sizeof(double) * 9);
+    delete [] copyMol.GetConformers()[3];
+    copyMol.GetConformers()[3] = replaced;
+    if (view.NumConformers() == 4 && view.Stride() == 9
+        && view(1, 0, 0) == 10.0 && view(3, 1, 1) == 42.0
+        && packMol.GetAtom(3)->GetX() == 16.0
+        && copyMol.GetConformer(3)[4] == 42.0
+        && copyMol.GetAtom(3)->GetX() == 16.0) {
+      cout << "ok 18" << endl;
+    } else {
+      cout << "not ok 18 # packed conformers" << endl;
+    }
+  }
+
+  cout << "1..18\n"; // total number of tests for Perl's "prove" tool
   return(0);
 }
@@ -29,11 +29,130 @@ GNU General Public License for more details.
 
 #include <cstdio>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <openbabel/elements.h>
+#include <openbabel/recordindex.h>
 
 using namespace std;
 using namespace OpenBabel;
 
+static string ConvertPDB(const string &pdb, const char *first = nullptr,
+                         int *count = nullptr)
+{
+  OBConversion conv;
+  conv.SetInAndOutFormats("pdb", "smi");
+  conv.AddOption("T", OBConversion::INOPTIONS);
+  if (first)
+    conv.AddOption("f", OBConversion::GENOPTIONS, first);
+  stringstream is(pdb), os;
+  int n = conv.Convert(&is, &os);
+  if (count)
+    *count = n;
+  return os.str();
+}
+
+// With -aT each chain, ending at a TER record, is read as a molecule
+static int pdbchains()
+{
+  cout << "# Unit tests for reading PDB chains \n";
+
+  // Two chains, each bonded by a CONECT record, and a second model
+  const string pdb =
+    "MODEL        1\n"
+    "HETATM    1  C1  LIG A   1       0.000   0.000   0.000  1.00  0.00           C\n"
+    "HETATM    2  O1  LIG A   1       1.400   0.000   0.000  1.00  0.00           O\n"
+    "TER       3      LIG A   1\n"
+    "HETATM    4  N1  LIG B   2      10.000   0.000   0.000  1.00  0.00           N\n"
+    "HETATM    5  C2  LIG B   2      11.500   0.000   0.000  1.00  0.00           C\n"
+    "TER       6      LIG B   2\n"
+    "CONECT    1    2\n"
+    "CONECT    4    5\n"
+    "ENDMDL\n"
+    "MODEL        2\n"
+    "HETATM    1  S1  LIG A   1       0.000   0.000   0.000  1.00  0.00           S\n"
+    "HETATM    2  C1  LIG A   1       1.800   0.000   0.000  1.00  0.00           C\n"
+    "TER       3      LIG A   1\n"
+    "CONECT    1    2\n"
+    "ENDMDL\n"
+    "END\n";
+
+  OBConversion models;
+  models.SetInAndOutFormats("pdb", "smi");
+  stringstream is(pdb), os;
+  models.Convert(&is, &os);
+  if (os.str() == "CO.NC\t\nSC\t\n")
+    cout << "ok 1\n";
+  else
+    cout << "not ok 1 # one molecule per model\n";
+
+  // One molecule per chain, reading on correctly after each TER
+  int count;
+  if (ConvertPDB(pdb, nullptr, &count) == "CO\t\nNC\t\nSC\t\n" && count == 3)
+    cout << "ok 2\n";
+  else
+    cout << "not ok 2 # one molecule per chain\n";
+
+  if (ConvertPDB(pdb, "2", &count) == "NC\t\nSC\t\n" && count == 2)
+    cout << "ok 3\n";
+  else
+    cout << "not ok 3 # skipping a chain\n";
+
+  // The record index counts models, so is not used for the count with -aT
+  string filename = "pdbchains_test.pdb";
+  {
+    ofstream ofs(filename.c_str(), ios::binary);
+    ofs << pdb;
+  }
+  string indexfile = OBRecordIndex::IndexFilename(filename);
+  OBRecordIndex index;
+  OBMol mol;
+  OBConversion chains;
+  models.SetInFormat("pdb");
+  chains.SetInFormat("pdb");
+  chains.AddOption("T", OBConversion::INOPTIONS);
+  if (index.Build(filename, OBConversion::FindFormat("pdb")) && index.Write(indexfile)
+      && models.ReadFile(&mol, filename) && models.NumInputObjects() == 2
+      && chains.ReadFile(&mol, filename) && chains.NumInputObjects() == 3)
+    cout << "ok 4\n";
+  else
+    cout << "not ok 4 # counting chains\n";
+  remove(indexfile.c_str());
+  remove(filename.c_str());
+
+  // CONECT records in a chain bond its atoms, even when they are too far
+  // apart to be bonded from the coordinates. The atom of the other chain
+  // which one of them names is not there, and is passed over.
+  const string conect =
+    "HETATM    1  C1  LIG A   1       0.000   0.000   0.000  1.00  0.00           C\n"
+    "HETATM    2  O1  LIG A   1       3.000   0.000   0.000  1.00  0.00           O\n"
+    "CONECT    1    2    4\n"
+    "TER       3      LIG A   1\n"
+    "HETATM    4  N1  LIG B   2      10.000   0.000   0.000  1.00  0.00           N\n"
+    "HETATM    5  C2  LIG B   2      13.000   0.000   0.000  1.00  0.00           C\n"
+    "CONECT    4    5\n"
+    "TER       6      LIG B   2\n"
+    "END\n";
+  OBConversion conv;
+  conv.SetInFormat("pdb");
+  conv.AddOption("T", OBConversion::INOPTIONS);
+  stringstream cs(conect);
+  conv.SetInStream(&cs, false);
+  unsigned nchains = 0, nbonded = 0;
+  while (conv.Read(&mol)) {
+    ++nchains;
+    if (mol.NumAtoms() == 2 && mol.NumBonds() == 1)
+      ++nbonded;
+  }
+  if (nchains == 2 && nbonded == 2)
+    cout << "ok 5\n";
+  else
+    cout << "not ok 5 # CONECT records in chains\n";
+
+  cout << "1..5\n";
+  return 0;
+}
+
 
 int pdbreadfile(int argc, char* argv[])
 {
@@ -63,6 +182,8 @@ int pdbreadfile(int argc, char* argv[])
   case 4:
     pdbfile = "00T_nonstandard_het.pdb";
     break;
+  case 5:
+    break; // chains, from text
   default:
     cout << "Test number " << choice << " does not exist!\n";
     return -1;
@@ -74,6 +195,9 @@ int pdbreadfile(int argc, char* argv[])
     putenv(env);
   #endif
 
+  if (choice == 5)
+    return pdbchains();
+
   cout << "# Unit tests for OBMol \n";
 
   cout << "ok 1\n"; // for loading tests
@@ -227,6 +227,40 @@ void testPeriodicNoncubic() {
 }
 
 
+void testPeriodicConnectTheDots() {
+  // Two carbons bonded only across the cell boundary, a third bonded
+  // directly, and an isolated oxygen in the middle of the cell
+  OBMol mol;
+  double coords[4][3] = { {0.5, 5.0, 5.0}, {9.0, 5.0, 5.0},
+                          {9.0, 5.0, 3.5}, {5.0, 5.0, 5.0} };
+  mol.BeginModify();
+  for (int i = 0; i < 4; ++i) {
+    OBAtom *a = mol.NewAtom();
+    a->SetAtomicNum(i == 3 ? 8 : 6);
+    a->SetVector(coords[i][0], coords[i][1], coords[i][2]);
+  }
+  mol.EndModify();
+
+  OBMol copy = mol;
+  copy.ConnectTheDots();
+  OB_COMPARE( copy.NumBonds(), 1 );
+
+  // A cell of a single grid cell, and a triclinic one of several
+  double cells[2][6] = { {10, 10, 10, 90, 90, 90}, {10, 30, 30, 90, 90, 70} };
+  for (int i = 0; i < 2; ++i) {
+    OBMol pmol = mol;
+    OBUnitCell *uc = new OBUnitCell;
+    uc->SetData(cells[i][0], cells[i][1], cells[i][2], cells[i][3], cells[i][4], cells[i][5]);
+    pmol.SetData(uc);
+    pmol.SetPeriodicMol();
+    pmol.ConnectTheDots();
+    OB_COMPARE( pmol.NumBonds(), 2 );
+    OB_ASSERT( pmol.GetBond(1, 2) != nullptr );
+    OB_ASSERT( pmol.GetBond(2, 3) != nullptr );
+    OB_COMPARE( pmol.GetAtom(4)->GetExplicitDegree(), 0 );
+  }
+}
+
 
 int periodictest(int argc, char* argv[])
 {
@@ -261,6 +295,9 @@ int periodictest(int argc, char* argv[])
   case 4:
     testPeriodicNoncubic();
     break;
+  case 5:
+    testPeriodicConnectTheDots();
+    break;
   default:
     cout << "Test number " << choice << " does not exist!\n";
     return -1;
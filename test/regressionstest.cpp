@@ -695,6 +695,44 @@ void test_SegCopySubstructure()
   OB_COMPARE(4, copy.NumBonds());
 }
 
+void test_Molfile_FixedWidthFields()
+{
+  // The molfile writer formats its fields itself; check them against printf
+  // for coordinates that round half-way, to negative zero, or overflow the
+  // field width
+  const double coords[][3] = {
+    {0.00005, -0.00005, 0.00015},
+    {-0.00001, -0.0, 1.23455},
+    {12345.67895, -98765.43215, 2.5e-5},
+    {1234567.0, -0.99995, 999.99995}
+  };
+  const int charges[] = {0, -3, 2, 1};
+  OBMol mol;
+  mol.SetDimension(3);
+  for (int i = 0; i < 4; ++i) {
+    OBAtom *atom = mol.NewAtom();
+    atom->SetAtomicNum(OBElements::Carbon);
+    atom->SetVector(coords[i][0], coords[i][1], coords[i][2]);
+    atom->SetFormalCharge(charges[i]);
+  }
+  mol.GetAtom(3)->SetIsotope(13);
+  OB_ASSERT(mol.AddBond(1, 2, 1));
+
+  OBConversion conv;
+  OB_REQUIRE(conv.SetOutFormat("mol"));
+  std::string molfile = conv.WriteString(&mol);
+  const char *mdlcharge[] = {"  0", "  7", "  2", "  3"};
+  for (int i = 0; i < 4; ++i) {
+    char line[BUFF_SIZE];
+    snprintf(line, BUFF_SIZE, "%10.4f%10.4f%10.4f C   0%s  0  0  0",
+             coords[i][0], coords[i][1], coords[i][2], mdlcharge[i]);
+    OB_ASSERT(molfile.find(line) != std::string::npos);
+  }
+  OB_ASSERT(molfile.find("  1  2  1  0  0  0  0\n") != std::string::npos);
+  OB_ASSERT(molfile.find("M  ISO  1   3  13\n") != std::string::npos);
+  OB_ASSERT(molfile.find("M  CHG  3   2  -3   3   2   4   1\n") != std::string::npos);
+}
+
 int regressionstest(int argc, char *argv[])
 {
   int defaultchoice = 1;
@@ -724,6 +762,9 @@ int regressionstest(int argc, char *argv[])
   case 2:
     test_SegCopySubstructure();
     break;
+  case 3:
+    test_Molfile_FixedWidthFields();
+    break;
   case 221:
     test_Issue134_InChI_addH();
     break;
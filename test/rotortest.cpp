@@ -2,6 +2,8 @@
 #include <openbabel/mol.h>
 #include <openbabel/obconversion.h>
 #include <openbabel/rotor.h>
+#include <openbabel/rotamer.h>
+#include <openbabel/forcefield.h>
 #include <openbabel/bond.h>
 #include <openbabel/obutil.h>
 
@@ -178,6 +180,74 @@ void testOBRotorListFixedBonds()
 
 }
 
+void testRotorSearchConformerBlocks()
+{
+  // Rotor searches replace the conformers of a molecule whose ensemble
+  // is stored in a block, e.g. the copy made by OBForceField::Setup()
+  OBMolPtr mol = OBTestUtil::ReadFile("octane.cml");
+  unsigned int size = 3 * mol->NumAtoms();
+  double *extra = new double [size];
+  memcpy(extra, mol->GetCoordinates(), sizeof(double) * size);
+  mol->AddConformer(extra);
+  double *block = mol->AddConformers(1);
+  memcpy(block, mol->GetCoordinates(), sizeof(double) * size);
+  OB_REQUIRE(mol->NumConformers() == 3);
+
+  OBForceField *pFF = OBForceField::FindForceField("UFF");
+  OB_REQUIRE(pFF);
+  OB_REQUIRE(pFF->Setup(*mol));
+  pFF->SystematicRotorSearch(1);
+  OB_ASSERT(pFF->GetConformers(*mol));
+  OB_ASSERT(mol->NumConformers() > 3);
+
+  OBRotorList rl;
+  rl.Setup(*mol);
+  OBRotamerList rotamers;
+  rotamers.SetBaseCoordinateSets(*mol);
+  rotamers.Setup(*mol, rl);
+  std::vector<int> rotorKey(rl.Size() + 1, 0);
+  rotamers.AddRotamer(rotorKey);
+  rotorKey[1] = 1;
+  rotamers.AddRotamer(rotorKey);
+  rotamers.ExpandConformerList(*mol, mol->GetConformers());
+  OB_COMPARE(mol->NumConformers(), 2);
+  OB_ASSERT(mol->GetCoordinates() == mol->GetConformer(0));
+}
+
+void testRotorSearchBorrowedConformers()
+{
+  // A borrowed conformer is dropped, not freed, when the conformers are
+  // replaced by a rotor search or by expanding rotamers
+  OBMolPtr mol = OBTestUtil::ReadFile("octane.cml");
+  unsigned int size = 3 * mol->NumAtoms();
+  std::vector<double> buffer(mol->GetCoordinates(), mol->GetCoordinates() + size);
+  std::vector<double> saved(buffer);
+  mol->BorrowConformer(&buffer[0]);
+  OB_REQUIRE(mol->IsConformerBorrowed(1));
+
+  OBForceField *pFF = OBForceField::FindForceField("UFF");
+  OB_REQUIRE(pFF);
+  OB_REQUIRE(pFF->Setup(*mol));
+  pFF->SystematicRotorSearch(1);
+  OB_ASSERT(pFF->GetConformers(*mol));
+  OB_ASSERT(mol->NumConformers() > 2);
+  for (int k = 0; k < mol->NumConformers(); ++k)
+    OB_ASSERT(!mol->IsConformerBorrowed(k));
+
+  OBMolPtr other = OBTestUtil::ReadFile("octane.cml");
+  other->BorrowConformer(&buffer[0]);
+  OBRotorList rl;
+  rl.Setup(*other);
+  OBRotamerList rotamers;
+  rotamers.SetBaseCoordinateSets(*other);
+  rotamers.Setup(*other, rl);
+  std::vector<int> rotorKey(rl.Size() + 1, 0);
+  rotamers.AddRotamer(rotorKey);
+  rotamers.ExpandConformerList(*other, other->GetConformers());
+  OB_COMPARE(other->NumConformers(), 1);
+  OB_ASSERT(!other->IsConformerBorrowed(0));
+  OB_ASSERT(buffer == saved);
+}
 
 int rotortest(int argc, char* argv[])
 {
@@ -213,6 +283,12 @@ int rotortest(int argc, char* argv[])
   case 4:
     testOBRotorListFixedBonds();
     break;
+  case 5:
+    testRotorSearchConformerBlocks();
+    break;
+  case 6:
+    testRotorSearchBorrowedConformers();
+    break;
   default:
     cout << "Test number " << choice << " does not exist!\n";
     return -1;
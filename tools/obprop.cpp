@@ -27,6 +27,7 @@ GNU General Public License for more details.
 
 #include <openbabel/mol.h>
 #include <openbabel/descriptor.h>
+#include <openbabel/generic.h>
 #include <openbabel/obconversion.h>
 #include <openbabel/obiter.h>
 #include <openbabel/residue.h>
@@ -103,10 +104,19 @@ int main(int argc,char **argv)
       exit (-1);
     }
   
-  OBMol mol;
   OBFormat *canSMIFormat = conv.FindFormat("can");
   OBFormat *inchiFormat = conv.FindFormat("inchi");
 
+  // The descriptors which are calculated together, with their labels
+  const char *descriptors[][2] = {
+    { "logP", "logP             " },
+    { "TPSA", "PSA              " },
+    { "MR",   "MR               " }
+  };
+  string descriptorList;
+  for (unsigned i = 0; i < sizeof(descriptors) / sizeof(descriptors[0]); ++i)
+    if (OBDescriptor::FindType(descriptors[i][0]))
+      descriptorList = descriptorList + descriptors[i][0] + ' ';
 
   ////////////////////////////////////////////////////////////////////////////
   // List of properties
@@ -116,76 +126,88 @@ int main(int argc,char **argv)
   
   //.....ADD YOURS HERE.....
   
-  for (c = 1;; ++c)
+  // Molecules are read in batches, so that their descriptors can be
+  // calculated on several threads
+  vector<OBMol> mols(256);
+  bool done = false;
+  for (c = 1; !done;)
     {
-      mol.Clear();
-      conv.Read(&mol, &ifs);
-      if (mol.Empty())
-        break;
-      
-      if (!mol.HasHydrogensAdded())
-        mol.AddHydrogens();
-      // Print the properties
-      if (strlen(mol.GetTitle()) != 0)
-        cout << "name             " << mol.GetTitle() << endl;
-      else 
-        cout << "name             " << FileIn << " " << c << endl;
-
-      cout << "formula          " << mol.GetFormula() << endl;
-      cout << "mol_weight       " << mol.GetMolWt() << endl;
-      cout << "exact_mass       " << mol.GetExactMass() << endl;
-
-      string smilesString = "-";
-      if (canSMIFormat) {
-        conv.SetOutFormat(canSMIFormat);
-        smilesString = conv.WriteString(&mol);
-        if ( smilesString.length() == 0 )
+      vector<OBBase*> batch;
+      for (unsigned i = 0; i < mols.size(); ++i)
         {
-          smilesString = "-";
+          OBMol &mol = mols[i];
+          mol.Clear();
+          conv.Read(&mol, &ifs);
+          if (mol.Empty())
+            {
+              done = true;
+              break;
+            }
+          if (!mol.HasHydrogensAdded())
+            mol.AddHydrogens();
+          batch.push_back(&mol);
         }
-      }
-      cout << "canonical_SMILES " << smilesString << endl;
+      OBDescriptor::AddProperties(batch, descriptorList);
 
-      string inchiString = "-";
-      if (inchiFormat) {
-        conv.SetOutFormat(inchiFormat);
-        inchiString = conv.WriteString(&mol);
-        if ( inchiString.length() == 0 )
+      for (unsigned i = 0; i < batch.size(); ++i, ++c)
         {
-          inchiString = "-";
-        }
-      }
-      cout << "InChI            " << inchiString << endl;
+          OBMol &mol = mols[i];
+          // Print the properties
+          if (strlen(mol.GetTitle()) != 0)
+            cout << "name             " << mol.GetTitle() << endl;
+          else 
+            cout << "name             " << FileIn << " " << c << endl;
 
-      cout << "num_atoms        " << mol.NumAtoms() << endl;
-      cout << "num_bonds        " << mol.NumBonds() << endl;
-      cout << "num_residues     " << mol.NumResidues() << endl;
-      cout << "num_rotors       " << mol.NumRotors() << endl;
-      if (mol.NumResidues() > 0)
-        cout << "sequence         " << sequence(mol) << endl;
-      else
-        cout << "sequence         " << "-" << endl;
+          cout << "formula          " << mol.GetFormula() << endl;
+          cout << "mol_weight       " << mol.GetMolWt() << endl;
+          cout << "exact_mass       " << mol.GetExactMass() << endl;
 
-      cout << "num_rings        " << nrings(mol) << endl;
+          string smilesString = "-";
+          if (canSMIFormat) {
+            conv.SetOutFormat(canSMIFormat);
+            smilesString = conv.WriteString(&mol);
+            if ( smilesString.length() == 0 )
+            {
+              smilesString = "-";
+            }
+          }
+          cout << "canonical_SMILES " << smilesString << endl;
 
-      OBDescriptor* pDesc;
-      pDesc= OBDescriptor::FindType("logP");
-      if(pDesc)
-        cout << "logP             " << pDesc->Predict(&mol) << endl;
+          string inchiString = "-";
+          if (inchiFormat) {
+            conv.SetOutFormat(inchiFormat);
+            inchiString = conv.WriteString(&mol);
+            if ( inchiString.length() == 0 )
+            {
+              inchiString = "-";
+            }
+          }
+          cout << "InChI            " << inchiString << endl;
 
-      pDesc = OBDescriptor::FindType("TPSA");
-      if(pDesc)
-        cout << "PSA              " << pDesc->Predict(&mol) << endl;
+          cout << "num_atoms        " << mol.NumAtoms() << endl;
+          cout << "num_bonds        " << mol.NumBonds() << endl;
+          cout << "num_residues     " << mol.NumResidues() << endl;
+          cout << "num_rotors       " << mol.NumRotors() << endl;
+          if (mol.NumResidues() > 0)
+            cout << "sequence         " << sequence(mol) << endl;
+          else
+            cout << "sequence         " << "-" << endl;
 
-      pDesc = OBDescriptor::FindType("MR");
-      if(pDesc)
-        cout << "MR               " << pDesc->Predict(&mol) << endl;
+          cout << "num_rings        " << nrings(mol) << endl;
 
-      cout << "$$$$" << endl; // SDF like end of compound descriptor list
-      
-      //Other OBDescriptors could be output here, even ones that were rarely
-      // used. Since these are plugin classes, they may not be loaded, but
-      // then with code like the above they are just ignored.
+          for (unsigned j = 0; j < sizeof(descriptors) / sizeof(descriptors[0]); ++j)
+            {
+              OBPairData *dp = dynamic_cast<OBPairData*>(mol.GetData(descriptors[j][0]));
+              if (dp)
+                cout << descriptors[j][1] << dp->GetValue() << endl;
+            }
+
+          cout << "$$$$" << endl; // SDF like end of compound descriptor list
+
+          //Other OBDescriptors could be added to the list above, even ones
+          // that were rarely used. Since these are plugin classes, they may
+          // not be loaded, but then they are just ignored.
+        }
     } // end for loop
   
   return(0);